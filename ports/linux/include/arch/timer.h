@@ -0,0 +1,85 @@
+/**
+ * AES67 Framework
+ * Copyright (C) 2021  Philip Tschiemer, https://github.com/tschiemer/aes67
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * All timers are multiplexed onto a single timerfd by means of a hierarchical timer wheel (with a resolution of 1ms).
+ *
+ * The timerfd (see aes67_timer_getfd()) becomes readable whenever a timer expires, upon which aes67_timer_process() is
+ * to be called from the event loop: it marks expired timers and calls their expiry callbacks (if any) in the calling
+ * thread. Timer states are also valid without calling aes67_timer_process(), ie polling aes67_timer_getstate() works
+ * just as with other ports.
+ *
+ * Setting, unsetting and polling timers is thread-safe, aes67_timer_process() is meant to be called by one thread only.
+ */
+
+#ifndef AES67_ARCH_TIMER_H
+#define AES67_ARCH_TIMER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Marks availability of aes67_timer_getfd(), aes67_timer_process() and aes67_timer_setcallback()
+ */
+#define AES67_TIMER_FD 1
+
+struct aes67_timer;
+
+typedef void (*aes67_timer_callback)(struct aes67_timer * timer, void * user_data);
+
+struct aes67_timer {
+    volatile enum aes67_timer_state state;
+
+    uint64_t expires;                   // msec (wheel time)
+    struct aes67_timer * next;          // wheel slot list
+    struct aes67_timer ** pprev;        // NULL if not in wheel
+
+    aes67_timer_callback callback;
+    void * user_data;
+};
+
+/**
+ * State of timer, ie also expired if the expiry was not yet processed by aes67_timer_process().
+ */
+enum aes67_timer_state aes67_timer_poll(struct aes67_timer * timer);
+
+#define AES67_TIMER_GETSTATE(ptimer) aes67_timer_poll(ptimer)
+
+/**
+ * Optional callback called upon expiry (from within aes67_timer_process()), to be set after aes67_timer_init().
+ */
+void aes67_timer_setcallback(struct aes67_timer * timer, aes67_timer_callback callback, void * user_data);
+
+/**
+ * Timerfd to be watched for readability (valid after aes67_timer_init_system()).
+ */
+int aes67_timer_getfd(void);
+
+/**
+ * Processes expired timers, ie to be called when the timerfd is readable.
+ */
+void aes67_timer_process(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //AES67_ARCH_TIMER_H
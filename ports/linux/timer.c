@@ -0,0 +1,387 @@
+/**
+ * AES67 Framework
+ * Copyright (C) 2021  Philip Tschiemer, https://github.com/tschiemer/aes67
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "aes67/host/timer.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
+
+#define WHEEL_BITS      6
+#define WHEEL_SIZE      (1 << WHEEL_BITS)
+#define WHEEL_MASK      (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS    4
+
+// (about 4.6h) longer timers are parked in the last level until they come into range
+#define WHEEL_RANGE     ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS))
+
+#define LEVEL_SPAN(l)   ((uint64_t)1 << (WHEEL_BITS * (l)))
+
+#define NEVER           UINT64_MAX
+
+static struct {
+    int timerfd;
+    pthread_mutex_t mutex;
+
+    uint64_t base;                                          // monotonic msec at wheel time 0
+    uint64_t now;                                           // wheel time, ie next msec to be processed
+    uint64_t armed;                                         // wheel time timerfd is armed for
+
+    struct aes67_timer * slots[WHEEL_LEVELS][WHEEL_SIZE];
+    struct aes67_timer * pending;                           // expired, callbacks to be called
+} wheel = {
+    .timerfd = -1,
+    .mutex = PTHREAD_MUTEX_INITIALIZER
+};
+
+static uint64_t monotonic_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t now_ms(void)
+{
+    return monotonic_ms() - wheel.base;
+}
+
+static void timer_link(struct aes67_timer ** head, struct aes67_timer * timer)
+{
+    timer->next = *head;
+    if (timer->next != NULL){
+        timer->next->pprev = &timer->next;
+    }
+    *head = timer;
+    timer->pprev = head;
+}
+
+static void timer_unlink(struct aes67_timer * timer)
+{
+    if (timer->pprev == NULL){
+        return;
+    }
+    *timer->pprev = timer->next;
+    if (timer->next != NULL){
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+/**
+ * Puts timer into slot according to its distance from the current wheel time.
+ */
+static void wheel_add(struct aes67_timer * timer)
+{
+    uint64_t expires = timer->expires < wheel.now ? wheel.now : timer->expires;
+
+    if (expires - wheel.now >= WHEEL_RANGE){
+        expires = wheel.now + WHEEL_RANGE - 1;
+    }
+
+    uint64_t delta = expires - wheel.now;
+
+    u8_t level = 0;
+    while(level < WHEEL_LEVELS - 1 && delta >= LEVEL_SPAN(level + 1)){
+        level++;
+    }
+
+    timer_link(&wheel.slots[level][(expires >> (WHEEL_BITS * level)) & WHEEL_MASK], timer);
+}
+
+/**
+ * Redistributes the current slot of given level (and, when wrapping, of the next higher levels) to lower levels.
+ */
+static void wheel_cascade(u8_t level)
+{
+    for(; level < WHEEL_LEVELS; level++){
+        u32_t index = (wheel.now >> (WHEEL_BITS * level)) & WHEEL_MASK;
+
+        struct aes67_timer * timer = wheel.slots[level][index];
+        wheel.slots[level][index] = NULL;
+
+        while(timer != NULL){
+            struct aes67_timer * next = timer->next;
+            timer->pprev = NULL;
+            wheel_add(timer);
+            timer = next;
+        }
+
+        if (index != 0){
+            break;
+        }
+    }
+}
+
+static bool level_empty(u8_t level)
+{
+    for(u32_t i = 0; i < WHEEL_SIZE; i++){
+        if (wheel.slots[level][i] != NULL){
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Advances wheel time up to (and including) target, expired timers are moved to the pending list.
+ */
+static void wheel_advance(uint64_t target)
+{
+    while(wheel.now <= target){
+
+        u32_t index = wheel.now & WHEEL_MASK;
+
+        if (index == 0){
+            wheel_cascade(1);
+        } else if (level_empty(0)){
+            // skip ahead to the next cascade of the lowest level holding timers
+            u8_t level = 1;
+            while(level < WHEEL_LEVELS && level_empty(level)){
+                level++;
+            }
+            if (level == WHEEL_LEVELS){
+                wheel.now = target + 1;
+                break;
+            }
+            uint64_t boundary = ((wheel.now >> (WHEEL_BITS * level)) + 1) << (WHEEL_BITS * level);
+            wheel.now = boundary <= target ? boundary : target + 1;
+            continue;
+        }
+
+        struct aes67_timer * timer = wheel.slots[0][index];
+        wheel.slots[0][index] = NULL;
+
+        while(timer != NULL){
+            struct aes67_timer * next = timer->next;
+            timer->pprev = NULL;
+            timer_link(&wheel.pending, timer);
+            timer = next;
+        }
+
+        wheel.now++;
+    }
+}
+
+/**
+ * Wheel time of next expiry or cascade.
+ */
+static uint64_t wheel_next(void)
+{
+    if (wheel.pending != NULL){
+        return wheel.now;
+    }
+
+    uint64_t next = NEVER;
+
+    for(u32_t i = 0; i < WHEEL_SIZE; i++){
+        if (wheel.slots[0][(wheel.now + i) & WHEEL_MASK] != NULL){
+            next = wheel.now + i;
+            break;
+        }
+    }
+
+    // a cascade might well come before
+    for(u8_t level = 1; level < WHEEL_LEVELS; level++){
+        uint64_t span = LEVEL_SPAN(level);
+        uint64_t boundary = (wheel.now + span - 1) & ~(span - 1);
+
+        for(u32_t i = 0; i < WHEEL_SIZE && boundary < next; i++, boundary += span){
+            if (wheel.slots[level][(boundary >> (WHEEL_BITS * level)) & WHEEL_MASK] != NULL){
+                next = boundary;
+                break;
+            }
+        }
+    }
+
+    return next;
+}
+
+static void wheel_arm(void)
+{
+    uint64_t next = wheel_next();
+
+    if (next == wheel.armed){
+        return;
+    }
+    wheel.armed = next;
+
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+
+    if (next != NEVER){
+        uint64_t abs = wheel.base + next;
+        its.it_value.tv_sec = abs / 1000;
+        its.it_value.tv_nsec = (abs % 1000) * 1000000;
+        // (a zero value would disarm)
+        if (abs == 0){
+            its.it_value.tv_nsec = 1;
+        }
+    }
+
+    if (timerfd_settime(wheel.timerfd, TFD_TIMER_ABSTIME, &its, NULL)){
+        perror("timer: timerfd_settime()");
+    }
+}
+
+void aes67_timer_init_system(void)
+{
+    wheel.timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (wheel.timerfd == -1){
+        perror("timer_init_system: timerfd_create()");
+        exit(1);
+    }
+
+    wheel.base = monotonic_ms();
+    wheel.now = 0;
+    wheel.armed = NEVER;
+}
+
+void aes67_timer_deinit_system(void)
+{
+    if (wheel.timerfd != -1){
+        close(wheel.timerfd);
+        wheel.timerfd = -1;
+    }
+}
+
+int aes67_timer_getfd(void)
+{
+    return wheel.timerfd;
+}
+
+void aes67_timer_init(struct aes67_timer *timer)
+{
+    assert(timer != NULL);
+
+    timer->state = aes67_timer_state_unset;
+    timer->expires = 0;
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->callback = NULL;
+    timer->user_data = NULL;
+}
+
+void aes67_timer_deinit(struct aes67_timer *timer)
+{
+    assert(timer != NULL);
+
+    pthread_mutex_lock(&wheel.mutex);
+
+    timer_unlink(timer);
+    timer->state = aes67_timer_state_undefined;
+
+    pthread_mutex_unlock(&wheel.mutex);
+}
+
+void aes67_timer_setcallback(struct aes67_timer * timer, aes67_timer_callback callback, void * user_data)
+{
+    assert(timer != NULL);
+
+    timer->callback = callback;
+    timer->user_data = user_data;
+}
+
+void aes67_timer_set(struct aes67_timer *timer, u32_t millisec)
+{
+    assert(timer != NULL);
+
+    pthread_mutex_lock(&wheel.mutex);
+
+    timer_unlink(timer);
+
+    timer->expires = now_ms() + millisec;
+    timer->state = aes67_timer_state_set;
+
+    wheel_add(timer);
+    wheel_arm();
+
+    pthread_mutex_unlock(&wheel.mutex);
+}
+
+void aes67_timer_unset(struct aes67_timer *timer)
+{
+    assert(timer != NULL);
+
+    pthread_mutex_lock(&wheel.mutex);
+
+    timer_unlink(timer);
+    timer->state = aes67_timer_state_unset;
+
+    // (not rearming, a spurious wakeup is cheaper)
+
+    pthread_mutex_unlock(&wheel.mutex);
+}
+
+enum aes67_timer_state aes67_timer_poll(struct aes67_timer * timer)
+{
+    assert(timer != NULL);
+
+    pthread_mutex_lock(&wheel.mutex);
+
+    // (the timer remains in the wheel until processed, such that any callback is still called)
+    if (timer->state == aes67_timer_state_set && timer->expires <= now_ms()){
+        timer->state = aes67_timer_state_expired;
+    }
+
+    enum aes67_timer_state state = timer->state;
+
+    pthread_mutex_unlock(&wheel.mutex);
+
+    return state;
+}
+
+void aes67_timer_process(void)
+{
+    uint64_t expirations;
+    if (read(wheel.timerfd, &expirations, sizeof(expirations))){}
+
+    pthread_mutex_lock(&wheel.mutex);
+
+    wheel_advance(now_ms());
+
+    // one at a time, callbacks may well (un)set any timers
+    while(wheel.pending != NULL){
+        struct aes67_timer * timer = wheel.pending;
+
+        timer_unlink(timer);
+        timer->state = aes67_timer_state_expired;
+
+        aes67_timer_callback callback = timer->callback;
+        void * user_data = timer->user_data;
+
+        if (callback != NULL){
+            pthread_mutex_unlock(&wheel.mutex);
+            callback(timer, user_data);
+            pthread_mutex_lock(&wheel.mutex);
+        }
+    }
+
+    // (force rearming, the timerfd was consumed)
+    wheel.armed = NEVER - 1;
+    wheel_arm();
+
+    pthread_mutex_unlock(&wheel.mutex);
+}
@@ -317,4 +317,43 @@ u32_t aes67_crc32(u8_t * buf, size_t count)
 }
 #endif
 
+#ifndef aes67_fnv1a64
+// http://www.isthe.com/chongo/tech/comp/fnv/index.html#FNV-1a
+u64_t aes67_fnv1a64(u8_t * buf, size_t count)
+{
+    u64_t result;
+
+#if AES67_HAVE_INT64 == 1
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    while (count--) {
+        h ^= *buf++;
+        h *= 0x100000001b3ULL;
+    }
+
+    result.msb = (u32_t)(h >> 32);
+    result.lsb = (u32_t)h;
+#else
+    // FNV prime 2^40 + 0x1b3, multiplication done on 16-bit halves of the lower word
+    u32_t hi = 0xcbf29ce4;
+    u32_t lo = 0x84222325;
+
+    while (count--) {
+        lo ^= *buf++;
+
+        u32_t p0 = (lo & 0xffff) * 0x1b3;
+        u32_t p1 = (lo >> 16) * 0x1b3 + (p0 >> 16);
+
+        hi = hi * 0x1b3 + (p1 >> 16) + (lo << 8);
+        lo = (p1 << 16) | (p0 & 0xffff);
+    }
+
+    result.msb = hi;
+    result.lsb = lo;
+#endif
+
+    return result;
+}
+#endif
+
 #endif /* BYTE_ORDER == LITTLE_ENDIAN */
\ No newline at end of file
@@ -41,8 +41,102 @@ aes67_sap_service_register(struct aes67_sap_service *sap, u16_t hash, enum aes67
 
 #if AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC || 0 < AES67_SAP_MEMORY_MAX_SESSIONS
 static u32_t get_timeout_sec(struct aes67_sap_service *sap, u16_t stat, u32_t timeout_after_sec);
+static void set_announced(struct aes67_sap_service *sap, struct aes67_sap_session *session);
+#else
+#define set_announced(sap, session)
+#endif
+
+#if 0 < AES67_SAP_MEMORY_HASHTABLE_SIZE && (AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC || 0 < AES67_SAP_MEMORY_MAX_SESSIONS)
+#define AES67_SAP_HASHTABLE 1
+
+/**
+ * Bucket of session identified by msg hash and originating source.
+ */
+static inline u32_t hashtable_index(u16_t hash, enum aes67_net_ipver ipver, u8_t *ip)
+{
+    u32_t h = hash;
+
+    for(u16_t i = 0; i < AES67_NET_IPVER_SIZE(ipver); i++){
+        h = 31 * h + ip[i];
+    }
+
+    h ^= h >> 16;
+
+    return h & (AES67_SAP_MEMORY_HASHTABLE_SIZE - 1);
+}
+#else
+#define AES67_SAP_HASHTABLE 0
 #endif
 
+#if AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC
+
+static inline u8_t session_is_self(struct aes67_sap_session * session)
+{
+    return (session->stat & AES67_SAP_SESSION_STAT_SRC) == AES67_SAP_SESSION_STAT_SRC_IS_SELF;
+}
+
+static void session_unlink(struct aes67_sap_service * sap, struct aes67_sap_session * session)
+{
+    if (session->prev != NULL){
+        session->prev->next = session->next;
+    } else if (session_is_self(session)){
+        sap->first_self_session = session->next;
+    } else {
+        sap->first_session = session->next;
+    }
+
+    if (session->next != NULL){
+        session->next->prev = session->prev;
+    } else if (!session_is_self(session)){
+        sap->last_session = session->prev;
+    }
+
+    session->prev = NULL;
+    session->next = NULL;
+}
+
+/**
+ * Own sessions are put at the beginning of their list, other sessions at the end (ie as most recently announced).
+ */
+static void session_link(struct aes67_sap_service * sap, struct aes67_sap_session * session)
+{
+    if (session_is_self(session)){
+        session->prev = NULL;
+        session->next = sap->first_self_session;
+        if (session->next != NULL){
+            session->next->prev = session;
+        }
+        sap->first_self_session = session;
+    } else {
+        session->prev = sap->last_session;
+        session->next = NULL;
+        if (session->prev != NULL){
+            session->prev->next = session;
+        } else {
+            sap->first_session = session;
+        }
+        sap->last_session = session;
+    }
+}
+
+#endif //AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC
+
+/**
+ * Marks session as just announced.
+ */
+static void session_touch(struct aes67_sap_service * sap, struct aes67_sap_session * session)
+{
+    aes67_time_now(&session->last_announcement);
+
+#if AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC
+    // keep others ordered by last announcement
+    if (!session_is_self(session) && sap->last_session != session){
+        session_unlink(sap, session);
+        session_link(sap, session);
+    }
+#endif
+}
+
 
 
 void aes67_sap_service_init(struct aes67_sap_service *sap)
@@ -60,11 +154,18 @@ void aes67_sap_service_init(struct aes67_sap_service *sap)
     aes67_timer_init(&sap->timeout_timer);
 
     sap->no_of_ads_other = 0;
+    sap->no_of_ads_self = 0;
 
 #if AES67_SAP_MEMORY == AES67_MEMORY_POOL && 0 < AES67_SAP_MEMORY_MAX_SESSIONS
     aes67_memset(sap->sessions, 0, sizeof(sap->sessions));
 #elif AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC
     sap->first_session = NULL;
+    sap->last_session = NULL;
+    sap->first_self_session = NULL;
+#endif
+
+#if AES67_SAP_HASHTABLE == 1
+    aes67_memset(sap->hashtable, 0, sizeof(sap->hashtable));
 #endif
 }
 
@@ -76,18 +177,27 @@ void aes67_sap_service_deinit(struct aes67_sap_service * sap)
     aes67_timer_deinit(&sap->timeout_timer);
 
 #if AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC
-    struct aes67_sap_session * current = sap->first_session;
+    struct aes67_sap_session * lists[] = {sap->first_session, sap->first_self_session};
 
     sap->first_session = NULL;
+    sap->last_session = NULL;
+    sap->first_self_session = NULL;
+
+    for(u8_t l = 0; l < 2; l++){
+        struct aes67_sap_session * current = lists[l];
 
-    while(current != NULL){
-        struct aes67_sap_session * previous = current;
-        current = current->next;
-        previous->next = NULL; // not needed really
+        while(current != NULL){
+            struct aes67_sap_session * previous = current;
+            current = current->next;
 
-        AES67_SAP_FREE(previous);
+            AES67_SAP_FREE(previous);
+        }
     }
 #endif
+
+#if AES67_SAP_HASHTABLE == 1
+    aes67_memset(sap->hashtable, 0, sizeof(sap->hashtable));
+#endif
 }
 
 #if AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC || 0 < AES67_SAP_MEMORY_MAX_SESSIONS
@@ -98,20 +208,29 @@ struct aes67_sap_session * aes67_sap_service_find(struct aes67_sap_service * sap
     AES67_ASSERT("AES67_NET_IPVER_ISVALID(ipver)", AES67_NET_IPVER_ISVALID(ipver));
     AES67_ASSERT("ip != NULL", ip != NULL);
 
-#if AES67_SAP_MEMORY == AES67_MEMORY_POOL
-    for(u16_t i = 0; i < AES67_SAP_MEMORY_MAX_SESSIONS; i++){
+#if AES67_SAP_HASHTABLE == 1
+    struct aes67_sap_session * current = sap->hashtable[hashtable_index(hash, ipver, ip)];
+
+    for(; current != NULL; current = current->hnext){
+        if (current->hash == hash && current->src.ipver == ipver && 0 == aes67_memcmp(current->src.ip, ip, AES67_NET_IPVER_SIZE(ipver))){
+            return current;
+        }
+    }
+#elif AES67_SAP_MEMORY == AES67_MEMORY_POOL
+    for(u32_t i = 0; i < AES67_SAP_MEMORY_MAX_SESSIONS; i++){
         if ((sap->sessions[i].stat & AES67_SAP_SESSION_STAT_SET) && sap->sessions[i].hash == hash && sap->sessions[i].src.ipver == ipver && 0 == aes67_memcmp(sap->sessions[i].src.ip, ip, AES67_NET_IPVER_SIZE(ipver))){
             return &sap->sessions[i];
         }
     }
 #else //AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC
-    struct aes67_sap_session * current = sap->first_session;
+    struct aes67_sap_session * lists[] = {sap->first_session, sap->first_self_session};
 
-    while(current != NULL){
-        if ((current->stat & AES67_SAP_SESSION_STAT_SET) && current->hash == hash && current->src.ipver == ipver && 0 == aes67_memcmp(current->src.ip, ip, AES67_NET_IPVER_SIZE(ipver))){
-            return current;
+    for(u8_t l = 0; l < 2; l++){
+        for(struct aes67_sap_session * current = lists[l]; current != NULL; current = current->next){
+            if ((current->stat & AES67_SAP_SESSION_STAT_SET) && current->hash == hash && current->src.ipver == ipver && 0 == aes67_memcmp(current->src.ip, ip, AES67_NET_IPVER_SIZE(ipver))){
+                return current;
+            }
         }
-        current = current->next;
     }
 #endif
 
@@ -139,10 +258,11 @@ struct aes67_sap_session * aes67_sap_service_register(struct aes67_sap_service *
 
     struct aes67_sap_session * session = NULL;
 
-    for(u16_t i = 0; i < AES67_SAP_MEMORY_MAX_SESSIONS; i++){
+    for(u32_t i = 0; i < AES67_SAP_MEMORY_MAX_SESSIONS; i++){
         if (sap->sessions[i].stat == AES67_SAP_SESSION_STAT_CLEAR){
 
             session = &sap->sessions[i];
+            break;
 //            sap->sessions[i].stat = AES67_SAP_SESSION_STAT_SET;
 //            sap->sessions[i].hash = hash;
 //            sap->sessions[i].src.ipver = ipver;
@@ -177,21 +297,28 @@ struct aes67_sap_session * aes67_sap_service_register(struct aes67_sap_service *
 
     // never let overflow
     if ((src & AES67_SAP_SESSION_STAT_SRC) == AES67_SAP_SESSION_STAT_SRC_IS_SELF) {
-        if (sap->no_of_ads_self < UINT16_MAX){
+        if (sap->no_of_ads_self < UINT32_MAX){
             sap->no_of_ads_self++;
         }
     } else {
-        if (sap->no_of_ads_other < UINT16_MAX){
+        if (sap->no_of_ads_other < UINT32_MAX){
             sap->no_of_ads_other++;
         }
     }
 
+    // (as if just announced, such that the (ordered) list of others stays consistent)
+    aes67_time_now(&session->last_announcement);
+    session->announcement_delay_ms = 0;
+
 #if AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC
-    session->next = NULL;
+    session_link(sap, session);
+#endif
 
-    // insert at beginning of linked list
-    session->next = sap->first_session;
-    sap->first_session = session;
+#if AES67_SAP_HASHTABLE == 1
+    u32_t index = hashtable_index(hash, ipver, ip);
+
+    session->hnext = sap->hashtable[index];
+    sap->hashtable[index] = session;
 #endif
 
     return session;
@@ -202,33 +329,36 @@ void aes67_sap_service_unregister(struct aes67_sap_service * sap, struct aes67_s
 {
     AES67_ASSERT("session != NULL", session!=NULL);
 
-    session->stat = AES67_SAP_SESSION_STAT_CLEAR;
-
     if ((session->stat & AES67_SAP_SESSION_STAT_SRC) == AES67_SAP_SESSION_STAT_SRC_IS_SELF){
         sap->no_of_ads_self--;
     } else {
         sap->no_of_ads_other--;
     }
 
-#if AES67_SAP_MEMORY == AES67_MEMORY_POOL
+#if AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC
+    // (while the stat still tells which list)
+    session_unlink(sap, session);
+#endif
 
+    session->stat = AES67_SAP_SESSION_STAT_CLEAR;
 
-#else //AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC
+#if AES67_SAP_HASHTABLE == 1
+    struct aes67_sap_session ** link = &sap->hashtable[hashtable_index(session->hash, session->src.ipver, session->src.ip)];
 
-    if (sap->first_session == session) {
-        sap->first_session = session->next;
-    } else {
-        struct aes67_sap_session * before = sap->first_session;
+    while(*link != session){
 
-        while(before->next != session) {
+        AES67_ASSERT("*link != NULL", *link != NULL);
 
-            AES67_ASSERT("next != NULL", before->next != NULL);
+        link = &(*link)->hnext;
+    }
 
-            before = before->next;
-        }
+    *link = session->hnext;
+#endif
+
+#if AES67_SAP_MEMORY == AES67_MEMORY_POOL
 
-        before->next = session->next;
-    }
+
+#else //AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC
 
     AES67_SAP_FREE(session);
 
@@ -237,7 +367,37 @@ void aes67_sap_service_unregister(struct aes67_sap_service * sap, struct aes67_s
 #endif //AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC || 0 < AES67_SAP_MEMORY_MAX_SESSIONS
 
 
-void aes67_sap_compute_times_sec(s32_t no_of_ads, s32_t announcement_size, u32_t *announce_sec, u32_t *timeout_sec)
+/**
+ * Announcement interval (in sec) according to RFC 2974, ie max(min interval, 8 * ad size * no of ads / bandwidth).
+ *
+ * With many (or large) announcements the product exceeds 32 bits, the interval saturates at AES67_SAP_MAX_INTERVAL_SEC.
+ */
+static u32_t compute_interval_sec(u32_t no_of_ads, u32_t announcement_size)
+{
+#if AES67_HAVE_INT64 == 1
+    uint64_t i = ((uint64_t)8 * announcement_size * no_of_ads) / AES67_SAP_BANDWITH;
+#else
+    u32_t bits = 8 * announcement_size;
+    // (product exceeding 32 bits is way beyond the maximum interval anyway)
+    u32_t i = (bits != 0 && no_of_ads > UINT32_MAX / bits) ? AES67_SAP_MAX_INTERVAL_SEC : (bits * no_of_ads) / AES67_SAP_BANDWITH;
+#endif
+
+    if (i > AES67_SAP_MAX_INTERVAL_SEC){
+        return AES67_SAP_MAX_INTERVAL_SEC;
+    }
+
+    return i > AES67_SAP_MIN_INTERVAL_SEC ? (u32_t)i : AES67_SAP_MIN_INTERVAL_SEC;
+}
+
+/**
+ * Seconds to msec (as used by timers and time diffs), saturating.
+ */
+static u32_t sec_to_msec(u32_t sec)
+{
+    return sec > UINT32_MAX / 1000 ? UINT32_MAX : 1000 * sec;
+}
+
+void aes67_sap_compute_times_sec(u32_t no_of_ads, u32_t announcement_size, u32_t *announce_sec, u32_t *timeout_sec)
 {
     // announcement size likely is 0 if no announcement has been sent yet.
     if (announcement_size == 0 || no_of_ads == 0) {
@@ -254,13 +414,10 @@ void aes67_sap_compute_times_sec(s32_t no_of_ads, s32_t announcement_size, u32_t
         return;
     }
 
-    s32_t i = (8 * announcement_size * no_of_ads) / AES67_SAP_BANDWITH;
+    u32_t interval_sec = compute_interval_sec(no_of_ads, announcement_size);
 
-    s32_t interval_sec = i > AES67_SAP_MIN_INTERVAL_SEC ? i : AES67_SAP_MIN_INTERVAL_SEC;
-
-    s32_t offset_sec = (AES67_RAND() % ((2*interval_sec)/3) ) - interval_sec/3;
-
-    u32_t next_tx = interval_sec + offset_sec;
+    // interval - 1/3 interval + [0, 2/3 interval)
+    u32_t next_tx = interval_sec - interval_sec/3 + ((u32_t)AES67_RAND() % ((2*interval_sec)/3));
 
     if (announce_sec != NULL) {
         *announce_sec = next_tx;
@@ -268,8 +425,9 @@ void aes67_sap_compute_times_sec(s32_t no_of_ads, s32_t announcement_size, u32_t
 
     if (timeout_sec != NULL) {
         // max(3600, 10 * ad_interval)
+        // (AES67_SAP_MAX_INTERVAL_SEC keeps this within 32 bits)
         interval_sec *= 10;
-        *timeout_sec = (u32_t)(interval_sec > AES67_SAP_MIN_TIMEOUT_SEC ? interval_sec : AES67_SAP_MIN_TIMEOUT_SEC);
+        *timeout_sec = interval_sec > AES67_SAP_MIN_TIMEOUT_SEC ? interval_sec : AES67_SAP_MIN_TIMEOUT_SEC;
     }
 }
 
@@ -278,7 +436,7 @@ void aes67_sap_compute_times_sec(s32_t no_of_ads, s32_t announcement_size, u32_t
 u32_t get_timeout_sec(struct aes67_sap_service *sap, u16_t stat, u32_t timeout_after_sec)
 {
     // we are comparing msec
-    timeout_after_sec *= 1000;
+    u32_t timeout_after_ms = sec_to_msec(timeout_after_sec);
 
     aes67_time_t now;
 
@@ -289,19 +447,19 @@ u32_t get_timeout_sec(struct aes67_sap_service *sap, u16_t stat, u32_t timeout_a
 
 #if AES67_SAP_MEMORY == AES67_MEMORY_POOL
 
-    for(u16_t i = 0; i < AES67_SAP_MEMORY_MAX_SESSIONS; i++){
+    for(u32_t i = 0; i < AES67_SAP_MEMORY_MAX_SESSIONS; i++){
 
         // only check session not coming from this service
         if ( (sap->sessions[i].stat & AES67_SAP_SESSION_STAT_SET) && (sap->sessions[i].stat & AES67_SAP_SESSION_STAT_SRC_IS_SELF) == stat){
 
-            u32_t age = aes67_time_diffmsec(&now, &sap->sessions[i].last_announcement);
+            u32_t age = aes67_time_diffmsec(&sap->sessions[i].last_announcement, &now);
 
             if (age > oldest){
                 oldest = age;
 
                 // in case there is at least one that has timed out already,
                 // set timer and stop further processing
-                if (oldest > timeout_after_sec){
+                if (oldest > timeout_after_ms){
 //                    aes67_timer_set(&sap->timeout_timer, AES67_TIMER_NOW);
 
                     return AES67_TIMER_NOW;
@@ -312,33 +470,58 @@ u32_t get_timeout_sec(struct aes67_sap_service *sap, u16_t stat, u32_t timeout_a
 
 #else // AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC
 
-    struct aes67_sap_session * current = sap->first_session;
+    u8_t self = (stat & AES67_SAP_SESSION_STAT_SRC) == AES67_SAP_SESSION_STAT_SRC_IS_SELF;
 
-    for(;current != NULL; current = current->next){
+    // others are ordered, ie the first is the oldest
+    struct aes67_sap_session * current = self ? sap->first_self_session : sap->first_session;
 
-        // only check session not coming from this service
-        if ((current->stat & AES67_SAP_SESSION_STAT_SET) && (current->stat & AES67_SAP_SESSION_STAT_SRC) == (stat & AES67_SAP_SESSION_STAT_SRC)){
+    for(;current != NULL; current = self ? current->next : NULL){
 
-            u32_t age = aes67_time_diffmsec(&now, &current->last_announcement);
+        u32_t age = aes67_time_diffmsec(&current->last_announcement, &now);
 
-            if (age > oldest){
-                oldest = age;
+        if (age > oldest){
+            oldest = age;
 
-                // in case there is at least one that has timed out already,
-                // set timer and stop further processing
-                if (oldest > timeout_after_sec){
-                    return AES67_TIMER_NOW;
-                }
+            // in case there is at least one that has timed out already,
+            // set timer and stop further processing
+            if (oldest > timeout_after_ms){
+                return AES67_TIMER_NOW;
             }
         }
     }
 
 #endif
 
-    return (timeout_after_sec - oldest)/1000;
+    // (rounded up, such that the oldest has actually timed out by then)
+    return (timeout_after_ms - oldest)/1000 + 1;
 }
 
 
+/**
+ * Minimal spacing (in msec) between any two announcements as to not exceed the SAP bandwidth.
+ */
+static u32_t get_announcement_spacing_msec(struct aes67_sap_service *sap)
+{
+    return (8 * 1000 * (u32_t)sap->announcement_size) / AES67_SAP_BANDWITH;
+}
+
+/**
+ * Randomized delay (in msec) until next announcement of a session (RFC 2974, ie interval +- 1/3 interval).
+ */
+static u32_t get_announcement_delay_msec(struct aes67_sap_service *sap)
+{
+    u32_t interval_ms = sec_to_msec(compute_interval_sec(aes67_sap_no_of_ads(sap), sap->announcement_size));
+
+    return interval_ms - interval_ms / 3 + ((u32_t)AES67_RAND() % (2 * interval_ms / 3 + 1));
+}
+
+static void set_announced(struct aes67_sap_service *sap, struct aes67_sap_session *session)
+{
+    aes67_time_now(&session->last_announcement);
+
+    session->announcement_delay_ms = get_announcement_delay_msec(sap);
+}
+
 void aes67_sap_service_set_announcement_timer(struct aes67_sap_service * sap)
 {
     AES67_ASSERT("sap != NULL", sap != NULL);
@@ -353,16 +536,55 @@ void aes67_sap_service_set_announcement_timer(struct aes67_sap_service * sap)
         return;
     }
 
+    // (without jitter, each session has its own randomized deadline)
+    sap->announcement_sec = compute_interval_sec(aes67_sap_no_of_ads(sap), sap->announcement_size);
+
+    aes67_time_t now;
+
+    aes67_time_now(&now);
+
+    // find earliest deadline of own sessions
+    u32_t next_ms = UINT32_MAX;
+
+#if AES67_SAP_MEMORY == AES67_MEMORY_POOL
+
+    for(u32_t i = 0; i < AES67_SAP_MEMORY_MAX_SESSIONS; i++){
+
+        if ( (sap->sessions[i].stat & AES67_SAP_SESSION_STAT_SET) && (sap->sessions[i].stat & AES67_SAP_SESSION_STAT_SRC) == AES67_SAP_SESSION_STAT_SRC_IS_SELF){
+
+            s32_t age = aes67_time_diffmsec(&sap->sessions[i].last_announcement, &now);
+            u32_t remaining = (age < 0) ? sap->sessions[i].announcement_delay_ms : (((u32_t)age >= sap->sessions[i].announcement_delay_ms) ? 0 : sap->sessions[i].announcement_delay_ms - age);
+
+            if (remaining < next_ms){
+                next_ms = remaining;
+            }
+        }
+    }
+
+#else // AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC
+
+    struct aes67_sap_session * current = sap->first_self_session;
+
+    for(;current != NULL; current = current->next){
+
+        s32_t age = aes67_time_diffmsec(&current->last_announcement, &now);
+        u32_t remaining = (age < 0) ? current->announcement_delay_ms : (((u32_t)age >= current->announcement_delay_ms) ? 0 : current->announcement_delay_ms - age);
+
+        if (remaining < next_ms){
+            next_ms = remaining;
+        }
+    }
 
-    aes67_sap_compute_times_sec(sap->no_of_ads_other+sap->no_of_ads_self, sap->announcement_size, &sap->announcement_sec, NULL);
+#endif
 
-    u32_t timeout_after_sec = sap->announcement_sec;
+    // never announce faster than the bandwidth allows, ie spread sessions that are due at the same time
+    u32_t spacing_ms = get_announcement_spacing_msec(sap);
 
-    timeout_after_sec = get_timeout_sec(sap, AES67_SAP_SESSION_STAT_SRC_IS_SELF, timeout_after_sec);
+    if (next_ms < spacing_ms){
+        next_ms = spacing_ms;
+    }
 
-    // actually set timer
-//    printf("atimer = %d\n", timeout_after_sec);
-    aes67_timer_set(&sap->announcement_timer, 1000 * timeout_after_sec);
+    aes67_timer_set(&sap->announcement_timer, next_ms);
 }
 
 
@@ -379,49 +601,48 @@ void aes67_sap_service_announcement_check(struct aes67_sap_service *sap, void *u
 
     aes67_time_now(&now);
 
-    // max(3600, 10 * ad_interval)
-    u32_t timeout_after = sap->announcement_sec;
+    // only the most overdue session is announced per check, any other due session will follow after the minimal spacing
+    struct aes67_sap_session * due = NULL;
+    s32_t overdue = 0;
 
 #if AES67_SAP_MEMORY == AES67_MEMORY_POOL
 
-    for(u16_t i = 0; i < AES67_SAP_MEMORY_MAX_SESSIONS; i++){
-
-        // only check session not coming from this service
-        if ( (sap->sessions[i].stat & AES67_SAP_SESSION_STAT_SET) && (sap->sessions[i].stat & AES67_SAP_SESSION_STAT_SRC_IS_SELF) == AES67_SAP_SESSION_STAT_SRC_IS_SELF){
+    for(u32_t i = 0; i < AES67_SAP_MEMORY_MAX_SESSIONS; i++){
 
-            u32_t age = aes67_time_diffmsec(&sap->sessions[i].last_announcement, &now);
+        // only check sessions coming from this service
+        if ( (sap->sessions[i].stat & AES67_SAP_SESSION_STAT_SET) && (sap->sessions[i].stat & AES67_SAP_SESSION_STAT_SRC) == AES67_SAP_SESSION_STAT_SRC_IS_SELF){
 
-            if (timeout_after < age){
+            s32_t o = aes67_time_diffmsec(&sap->sessions[i].last_announcement, &now) - (s32_t)sap->sessions[i].announcement_delay_ms;
 
-                aes67_sap_service_event(sap, aes67_sap_event_announcement_request, sap->sessions[i].hash,
-                                        sap->sessions[i].src.ipver, sap->sessions[i].src.ip, NULL, 0, NULL, 0,
-                                        user_data);
+            if (o >= 0 && (due == NULL || o > overdue)){
+                due = &sap->sessions[i];
+                overdue = o;
             }
         }
     }
 
 #else // AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC
 
-    struct aes67_sap_session * current = sap->first_session;
+    // (own sessions only)
+    struct aes67_sap_session * current = sap->first_self_session;
 
     for(;current != NULL; current = current->next) {
 
-        // only check session not coming from this service
-        if ((current->stat & AES67_SAP_SESSION_STAT_SET) && (current->stat & AES67_SAP_SESSION_STAT_SRC_IS_SELF) == AES67_SAP_SESSION_STAT_SRC_IS_SELF){
-
-            u32_t age = aes67_time_diffmsec(&current->last_announcement, &now);
+        s32_t o = aes67_time_diffmsec(&current->last_announcement, &now) - (s32_t)current->announcement_delay_ms;
 
-            if (timeout_after < age){
-
-                aes67_sap_service_event(sap, aes67_sap_event_announcement_request, current->hash, current->src.ipver, current->src.ip, NULL, 0, NULL, 0, user_data);
-
-            }
+        if (o >= 0 && (due == NULL || o > overdue)){
+            due = current;
+            overdue = o;
         }
     }
 
 #endif
 
     aes67_timer_unset(&sap->announcement_timer);
+
+    if (due != NULL){
+        aes67_sap_service_event(sap, aes67_sap_event_announcement_request, due->hash, due->src.ipver, due->src.ip, NULL, 0, NULL, 0, user_data);
+    }
 }
 
 
@@ -443,12 +664,10 @@ void aes67_sap_service_set_timeout_timer(struct aes67_sap_service * sap)
     aes67_sap_compute_times_sec(sap->no_of_ads_other+sap->no_of_ads_self, sap->announcement_size, NULL, &sap->timeout_sec);
 
     // max(3600, 10 * ad_interval)
-    u32_t timeout_after_sec = 1000 * sap->timeout_sec;
-
-    timeout_after_sec = get_timeout_sec(sap, AES67_SAP_SESSION_STAT_SRC_IS_OTHER, timeout_after_sec);
+    u32_t timeout_after_sec = get_timeout_sec(sap, AES67_SAP_SESSION_STAT_SRC_IS_OTHER, sap->timeout_sec);
 
 //    printf("ttimer = %d\n", timeout_after_sec);
-    aes67_timer_set(&sap->timeout_timer, 1000*timeout_after_sec);
+    aes67_timer_set(&sap->timeout_timer, sec_to_msec(timeout_after_sec));
 }
 
 void aes67_sap_service_timeouts_cleanup(struct aes67_sap_service *sap, void *user_data)
@@ -465,11 +684,11 @@ void aes67_sap_service_timeouts_cleanup(struct aes67_sap_service *sap, void *use
     aes67_time_now(&now);
 
     // max(3600, 10 * ad_interval)
-    u32_t timeout_after = 1000 * sap->timeout_sec;
+    u32_t timeout_after = sec_to_msec(sap->timeout_sec);
 
 #if AES67_SAP_MEMORY == AES67_MEMORY_POOL
 
-    for(u16_t i = 0; i < AES67_SAP_MEMORY_MAX_SESSIONS; i++){
+    for(u32_t i = 0; i < AES67_SAP_MEMORY_MAX_SESSIONS; i++){
 
         // only check session not coming from this service
         if ( (sap->sessions[i].stat & AES67_SAP_SESSION_STAT_SET) && (sap->sessions[i].stat & AES67_SAP_SESSION_STAT_SRC_IS_SELF) != AES67_SAP_SESSION_STAT_SRC_IS_SELF){
@@ -489,21 +708,17 @@ void aes67_sap_service_timeouts_cleanup(struct aes67_sap_service *sap, void *use
 
 #else // AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC
 
-    struct aes67_sap_session * current = sap->first_session;
-
-    for(;current != NULL; current = current->next) {
-
-        // only check session not coming from this service
-        if ((current->stat & AES67_SAP_SESSION_STAT_SET) && (current->stat & AES67_SAP_SESSION_STAT_SRC_IS_SELF) != AES67_SAP_SESSION_STAT_SRC_IS_SELF){
-
-            u32_t age = aes67_time_diffmsec(&current->last_announcement, &now);
+    // others are ordered by last announcement, ie stop at the first one not timed out
+    // (note: the event handler might well unregister further sessions)
+    while(sap->first_session != NULL && timeout_after < (u32_t)aes67_time_diffmsec(&sap->first_session->last_announcement, &now)) {
 
-            if (timeout_after < age){
+        struct aes67_sap_session * current = sap->first_session;
 
-                aes67_sap_service_event(sap, aes67_sap_event_timeout, current->hash, current->src.ipver, current->src.ip, NULL, 0, NULL, 0, user_data);
+        aes67_sap_service_event(sap, aes67_sap_event_timeout, current->hash, current->src.ipver, current->src.ip, NULL, 0, NULL, 0, user_data);
 
-                aes67_sap_service_unregister(sap, current);
-            }
+        // (unless already done so by the event handler)
+        if (sap->first_session == current){
+            aes67_sap_service_unregister(sap, current);
         }
     }
 
@@ -668,6 +883,10 @@ void aes67_sap_service_handle(struct aes67_sap_service *sap, u8_t *msg, u16_t ms
     u8_t * payload = &data[pos];
     u16_t payloadlen = datalen - pos;
 
+#if AES67_SAP_FILTER_FINGERPRINT == 1
+    u64_t fingerprint = aes67_fnv1a64(data, datalen);
+#endif
+
     enum aes67_sap_event event = aes67_sap_event_undefined;
 
     // update internal session table according to
@@ -701,7 +920,7 @@ void aes67_sap_service_handle(struct aes67_sap_service *sap, u8_t *msg, u16_t ms
             session->authenticated = msg[AES67_SAP_AUTH_LEN] > 0 ? aes67_sap_auth_result_ok : aes67_sap_auth_result_not_ok;
 #endif
 
-            aes67_time_now(&session->last_announcement);
+            session_touch(sap, session);
 
 #if AES67_SAP_FILTER_XOR8 == 1
             u8_t xor8 = aes67_xor8(msg, msglen);
@@ -711,10 +930,21 @@ void aes67_sap_service_handle(struct aes67_sap_service *sap, u8_t *msg, u16_t ms
             } else { // updated
                 // if nothing has changed, abort
                 if ( (session->stat & AES67_SAP_SESSION_STAT_XOR8_HASH) == xor8){
-                    return;
+                    goto done;
                 }
             }
 #endif
+
+#if AES67_SAP_FILTER_FINGERPRINT == 1
+            if (event == aes67_sap_event_updated && u64_eq(session->fingerprint, fingerprint)){
+                // unchanged re-announcement, spare the consumer from looking at the payload again
+                event = aes67_sap_event_refreshed;
+                payload = NULL;
+                payloadlen = 0;
+            } else {
+                session->fingerprint = fingerprint;
+            }
+#endif
         }
 
     } else {
@@ -742,6 +972,10 @@ void aes67_sap_service_handle(struct aes67_sap_service *sap, u8_t *msg, u16_t ms
         }
     }
 
+#if AES67_SAP_FILTER_XOR8 == 1
+done:
+#endif
+
 #if AES67_SAP_DECOMPRESS_AVAILABLE == 1
 
     // don' forget to free payload memory if was decompressed (well, however the function may be implemented)
@@ -825,10 +1059,6 @@ u16_t aes67_sap_service_msg(struct aes67_sap_service *sap, u8_t *msg, u16_t maxl
         session = NULL;
     }
 
-    // so, if this service's session exists and it is being announced, update the timestamp
-    if ( (opt & AES67_SAP_STATUS_MSGTYPE_MASK) == AES67_SAP_STATUS_MSGTYPE_ANNOUNCE && session != NULL){
-        aes67_time_now(&session->last_announcement);
-    }
 
 #if AES67_SAP_COMPRESS_ENABLED == 1
 
@@ -872,9 +1102,34 @@ u16_t aes67_sap_service_msg(struct aes67_sap_service *sap, u8_t *msg, u16_t maxl
         sap->announcement_size = len;
     }
 
+    // so, if this service's session exists and it is being announced, update the timestamp and next deadline
+    if ( (opt & AES67_SAP_STATUS_MSGTYPE_MASK) == AES67_SAP_STATUS_MSGTYPE_ANNOUNCE && session != NULL){
+        set_announced(sap, session);
+    }
+
     return len;
 }
 
+void aes67_sap_service_announced(struct aes67_sap_service *sap, u16_t hash, enum aes67_net_ipver ipver, u8_t *ip, u16_t msglen)
+{
+    AES67_ASSERT("sap != NULL", sap != NULL);
+    AES67_ASSERT("hash != 0", hash != 0);
+    AES67_ASSERT("AES67_NET_IPVER_ISVALID(ipver)", AES67_NET_IPVER_ISVALID(ipver));
+    AES67_ASSERT("ip != NULL", ip != NULL);
+
+    struct aes67_sap_session * session = aes67_sap_service_find(sap, hash, ipver, ip);
+
+    if (session == NULL){
+        session = aes67_sap_service_register(sap, hash, ipver, ip, AES67_SAP_SESSION_STAT_SRC_IS_SELF);
+    }
+
+    sap->announcement_size = msglen;
+
+    if (session != NULL){
+        set_announced(sap, session);
+    }
+}
+
 
 u16_t aes67_sap_service_msg_sdp(struct aes67_sap_service *sap, u8_t *msg, u16_t maxlen, u8_t opt, u16_t hash,
                                 struct aes67_net_addr *ip, struct aes67_sdp *sdp, void *user_data)
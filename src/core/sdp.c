@@ -158,6 +158,44 @@ struct aes67_sdp_attr_encoding * aes67_sdp_get_stream_encoding(struct aes67_sdp
     return NULL;
 }
 
+u8_t aes67_sdp_stream_match(struct aes67_sdp * sdp, u8_t si, enum aes67_audio_encoding encoding, u32_t samplerate, u8_t nchannels)
+{
+    AES67_ASSERT("sdp != NULL", sdp != NULL);
+    AES67_ASSERT("si < sdp->streams.count", si < sdp->streams.count);
+
+    // skip stream if no valid connection given (shouldn't be the case in a valid SDP packet)
+    if (NULL == aes67_sdp_get_connection(sdp, si)){
+        return 0;
+    }
+
+    // skip if stream has no valid refclock
+    if (0 == aes67_sdp_get_refclk_count(sdp, si)){
+        return 0;
+    }
+
+    // skip if stream has no encoding
+    if (0 == aes67_sdp_get_stream_encoding_count(sdp, si)){
+        return 0;
+    }
+
+    struct aes67_sdp_attr_encoding * enc = aes67_sdp_get_stream_encoding(sdp, si, 0);
+
+    if (enc == NULL){
+        return 0;
+    }
+    if (nchannels > 0 && nchannels != enc->nchannels){
+        return 0;
+    }
+    if (encoding != aes67_audio_encoding_undefined && encoding != enc->encoding){
+        return 0;
+    }
+    if (samplerate != 0 && samplerate != enc->samplerate){
+        return 0;
+    }
+
+    return 1;
+}
+
 struct aes67_sdp_attr_refclk * aes67_sdp_get_refclk(struct aes67_sdp * sdp, aes67_sdp_flags flags, u8_t pi)
 {
     AES67_ASSERT("sdp != NULL", sdp != NULL);
@@ -167,6 +167,13 @@ u16_t aes67_16bit_ones_complement_sum(u8_t * bytes, size_t u16_count, u16_t init
 u32_t aes67_crc32(u8_t * buf, size_t count);
 #endif
 
+#ifndef aes67_fnv1a64
+/**
+ * 64-bit FNV-1a hash (non-cryptographic), intended as cheap fingerprint of message contents.
+ */
+u64_t aes67_fnv1a64(u8_t * buf, size_t count);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -56,6 +56,14 @@
 #define AES67_SAP_MEMORY_HARD_LIMIT 0
 #endif
 
+#ifndef AES67_SAP_MEMORY_HASHTABLE_SIZE
+/**
+ * Number of buckets (power of two) of the session lookup table, 0 to just search the session table linearly.
+ * Costs one pointer per bucket and one per session, worth it starting from a few hundred sessions.
+ */
+#define AES67_SAP_MEMORY_HASHTABLE_SIZE 0
+#endif
+
 #ifndef AES67_SAP_AUTH_ENABLED
 #define AES67_SAP_AUTH_ENABLED 0
 #endif
@@ -98,7 +106,16 @@
  * If enabled, complete message will be xor8'ed and (upon renewal) compared -> identical messages will not be passed on.
  * A simple mechanism to reduce event callbacks, but for SDP files, in principle the originator ("o=..") should be checked.
  */
-#define AES67_SAP_HASH_CHECK 0
+#define AES67_SAP_FILTER_XOR8 0
+#endif
+
+#ifndef AES67_SAP_FILTER_FINGERPRINT
+/**
+ * If enabled, a 64-bit fingerprint of the (uncompressed) payload is kept per session and identical re-announcements
+ * are only passed on as aes67_sap_event_refreshed (without payload), ie only actual changes have to be parsed.
+ * Much less prone to collisions than AES67_SAP_FILTER_XOR8 (which is superseded by this option).
+ */
+#define AES67_SAP_FILTER_FINGERPRINT 1
 #endif
 
 
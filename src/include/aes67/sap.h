@@ -39,8 +39,8 @@
 #if AES67_SAP_MEMORY != AES67_MEMORY_POOL && AES67_SAP_MEMORY != AES67_MEMORY_DYNAMIC
 #error Please specify valid memory strategy for SAP (AES67_SAP_MEMORY)
 #endif
-#if AES67_SAP_MEMORY_MAX_SESSIONS > UINT16_MAX
-#error AES67_SAP_MEMORY_MAX_SESSIONS too big!
+#if AES67_SAP_MEMORY_HASHTABLE_SIZE & (AES67_SAP_MEMORY_HASHTABLE_SIZE - 1)
+#error AES67_SAP_MEMORY_HASHTABLE_SIZE must be a power of two!
 #endif
 
 
@@ -89,6 +89,13 @@ extern "C" {
 #define AES67_SAP_MIN_INTERVAL_SEC 300
 #endif
 
+/**
+ * Upper bound of the announcement interval, such that the derived timeout (10 * interval) still fits into 32-bit msec.
+ */
+#ifndef AES67_SAP_MAX_INTERVAL_SEC
+#define AES67_SAP_MAX_INTERVAL_SEC (UINT32_MAX / 10000)
+#endif
+
 #ifndef AES67_SAP_MIN_TIMEOUT_SEC
 #define AES67_SAP_MIN_TIMEOUT_SEC 3600
 #endif
@@ -153,7 +160,8 @@ enum aes67_sap_event {
     aes67_sap_event_updated,
     aes67_sap_event_deleted,
     aes67_sap_event_timeout,
-    aes67_sap_event_announcement_request
+    aes67_sap_event_announcement_request,
+    aes67_sap_event_refreshed
 };
 
 #define AES67_SAP_EVENT_IS_VALID(__e__) ( \
@@ -161,7 +169,8 @@ enum aes67_sap_event {
     (__e__) == aes67_sap_event_updated || \
     (__e__) == aes67_sap_event_deleted || \
     (__e__) == aes67_sap_event_timeout  || \
-    (__e__) == aes67_sap_event_announcement_request \
+    (__e__) == aes67_sap_event_announcement_request || \
+    (__e__) == aes67_sap_event_refreshed \
 )
 
 // internal status bits
@@ -188,20 +197,26 @@ struct aes67_sap_session {
     u16_t hash;
     struct aes67_net_addr src;
     aes67_time_t last_announcement;
+    u32_t announcement_delay_ms; // randomized delay of next announcement after last (own sessions only)
 
 #if AES67_SAP_AUTH_ENABLED == 1
     // these are not quite thought through yet, but show an the idea
     enum aes67_sap_auth_result authenticated;
 #endif
 
-#if AES67_SAP_FILTER_XOR8 == 1
-
+#if AES67_SAP_FILTER_FINGERPRINT == 1
+    u64_t fingerprint; // of uncompressed payload (including payload type)
 #endif
 
 #if AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC
+    struct aes67_sap_session * prev;
     struct aes67_sap_session * next;
 #endif
 
+#if 0 < AES67_SAP_MEMORY_HASHTABLE_SIZE
+    struct aes67_sap_session * hnext; // next session in same bucket
+#endif
+
 //    void * data; // optional user data
 };
 
@@ -216,6 +231,9 @@ struct aes67_sap_service {
      */
     u16_t announcement_size;
 
+    /**
+     * Last computed announcement interval (without jitter)
+     */
     u32_t announcement_sec;
 
     /**
@@ -238,13 +256,20 @@ struct aes67_sap_service {
      * Counter of active packets
      * used for interval computation but also interesting otherwise
      */
-    u16_t no_of_ads_other;
-    u16_t no_of_ads_self;
+    u32_t no_of_ads_other;
+    u32_t no_of_ads_self;
 
 #if AES67_SAP_MEMORY == AES67_MEMORY_POOL && 0 < AES67_SAP_MEMORY_MAX_SESSIONS
     struct aes67_sap_session sessions[AES67_SAP_MEMORY_MAX_SESSIONS];
 #elif AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC
-    struct aes67_sap_session * first_session; // first session of linked list
+    // sessions of others are kept in order of their last announcement, ie timeouts are found at the beginning
+    struct aes67_sap_session * first_session; // least recently announced
+    struct aes67_sap_session * last_session; // most recently announced
+    struct aes67_sap_session * first_self_session; // own sessions (unordered)
+#endif
+
+#if 0 < AES67_SAP_MEMORY_HASHTABLE_SIZE && (AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC || 0 < AES67_SAP_MEMORY_MAX_SESSIONS)
+    struct aes67_sap_session * hashtable[AES67_SAP_MEMORY_HASHTABLE_SIZE]; // buckets by msg hash and originating source
 #endif
 };
 
@@ -282,7 +307,7 @@ void aes67_sap_service_unregister(struct aes67_sap_service * sap, struct aes67_s
 #define aes67_sap_service_unregister(session, sap)
 #endif
 
-INLINE_FUN u16_t aes67_sap_no_of_ads(struct aes67_sap_service * sap)
+INLINE_FUN u32_t aes67_sap_no_of_ads(struct aes67_sap_service * sap)
 {
     return sap->no_of_ads_other + sap->no_of_ads_self;
 }
@@ -296,7 +321,7 @@ INLINE_FUN u16_t aes67_sap_no_of_ads(struct aes67_sap_service * sap)
  * @param timeout_sec           (nullable)
  * @return
  */
-void aes67_sap_compute_times_sec(s32_t no_of_ads, s32_t announcement_size, u32_t *announce_sec, u32_t *timeout_sec);
+void aes67_sap_compute_times_sec(u32_t no_of_ads, u32_t announcement_size, u32_t *announce_sec, u32_t *timeout_sec);
 
 
 /**
@@ -317,6 +342,9 @@ INLINE_FUN enum aes67_timer_state aes67_sap_service_announcement_timer_state(str
 /**
  * Sets and enables announcement timer to trigger when next announcement can/should be sent.
  *
+ * Each own session has its own randomized deadline (interval +- 1/3 interval as per RFC 2974) and subsequent
+ * announcements are at least as far apart as AES67_SAP_BANDWITH allows, ie sessions do not go out in bursts.
+ *
  * @param sap
  */
 void aes67_sap_service_set_announcement_timer(struct aes67_sap_service * sap);
@@ -335,6 +363,12 @@ INLINE_FUN enum aes67_timer_state aes67_sap_service_timeout_timer_state(struct a
     return aes67_timer_getstate(&sap->timeout_timer);
 }
 
+/**
+ * Requests the announcement of the most overdue own session (if any) through aes67_sap_service_event(..)
+ *
+ * @param sap
+ * @param user_data
+ */
 void aes67_sap_service_announcement_check(struct aes67_sap_service *sap, void *user_data);
 
 /**
@@ -413,6 +447,18 @@ u16_t aes67_sap_service_msg(struct aes67_sap_service *sap, u8_t *msg, u16_t maxl
 u16_t aes67_sap_service_msg_sdp(struct aes67_sap_service *sap, u8_t *msg, u16_t maxlen, u8_t opt, u16_t hash,
                                 struct aes67_net_addr *ip, struct aes67_sdp *sdp, void *user_data);
 
+/**
+ * To be called when (re-)sending an announcement previously generated with aes67_sap_service_msg(..), ie updates the
+ * internal session state just like generating the message again would (but without the need to do so).
+ *
+ * @param sap
+ * @param hash      session identifier as used for generating the message
+ * @param ipver
+ * @param ip        originating source as used for generating the message
+ * @param msglen    length of sent message
+ */
+void aes67_sap_service_announced(struct aes67_sap_service *sap, u16_t hash, enum aes67_net_ipver ipver, u8_t *ip, u16_t msglen);
+
 
 /**
  *
@@ -423,6 +469,9 @@ u16_t aes67_sap_service_msg_sdp(struct aes67_sap_service *sap, u8_t *msg, u16_t
  * @param payload
  * @param payloadlen
  * @param user_data         As set in aes67_sap_service_init(..)
+ *
+ * Note: aes67_sap_event_refreshed (iff AES67_SAP_FILTER_FINGERPRINT == 1) signals an unchanged re-announcement of a
+ * known session, payload will be NULL.
  */
 extern void
 aes67_sap_service_event(struct aes67_sap_service *sap, enum aes67_sap_event event, u16_t hash,
@@ -504,6 +504,18 @@ INLINE_FUN u8_t aes67_sdp_get_stream_encoding_count(struct aes67_sdp * sdp, u8_t
  */
 struct aes67_sdp_attr_encoding * aes67_sdp_get_stream_encoding(struct aes67_sdp * sdp, u8_t si, u8_t ei);
 
+/**
+ * Tests if stream is usable (ie has a connection, refclock and encoding) and its (primary) encoding matches.
+ *
+ * @param sdp
+ * @param si            stream index
+ * @param encoding      required encoding (aes67_audio_encoding_undefined for any)
+ * @param samplerate    required sampling rate (0 for any)
+ * @param nchannels     required number of channels (0 for any)
+ * @return 1 if matching, 0 otherwise
+ */
+u8_t aes67_sdp_stream_match(struct aes67_sdp * sdp, u8_t si, enum aes67_audio_encoding encoding, u32_t samplerate, u8_t nchannels);
+
 /**
  * Comfort function to add a new stream encoding.
  *
@@ -0,0 +1,69 @@
+/**
+ * @file mdns-avahi-poll.h
+ * AvahiPoll adapter of the avahi mDNS backend (see AES67_MDNS_AVAHI_THREAD == 0).
+ *
+ * Watches are added to an epoll instance and timeouts are mapped onto a timerfd (also part of the epoll set), thus
+ * avahi is driven from any event loop polling the epoll fd and all callbacks happen from within
+ * aes67_mdns_avahi_poll_dispatch() in the caller's thread.
+ */
+
+/**
+ * AES67 Framework
+ * Copyright (C) 2021  Philip Tschiemer, https://github.com/tschiemer/aes67
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AES67_UTILS_MDNS_AVAHI_POLL_H
+#define AES67_UTILS_MDNS_AVAHI_POLL_H
+
+#include <avahi-common/watch.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Max number of events handled per dispatch.
+ */
+#ifndef AES67_MDNS_AVAHI_POLL_MAXEVENTS
+#define AES67_MDNS_AVAHI_POLL_MAXEVENTS 16
+#endif
+
+struct aes67_mdns_avahi_poll {
+    AvahiPoll api;                      // as to be given to avahi_client_new()
+    int epfd;
+    int timerfd;
+    struct AvahiWatch * watches;
+    struct AvahiTimeout * timeouts;
+};
+
+int aes67_mdns_avahi_poll_init(struct aes67_mdns_avahi_poll * adapter);
+
+/**
+ * Releases all watches and timeouts (ie to be called once avahi does not use them anymore).
+ */
+void aes67_mdns_avahi_poll_deinit(struct aes67_mdns_avahi_poll * adapter);
+
+/**
+ * Waits up to timeout_msec (-1 := forever) for events of watches and calls their callbacks, then calls callbacks of
+ * due timeouts. Watches and timeouts may be freed (or created) from within any callback.
+ */
+void aes67_mdns_avahi_poll_dispatch(struct aes67_mdns_avahi_poll * adapter, int timeout_msec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //AES67_UTILS_MDNS_AVAHI_POLL_H
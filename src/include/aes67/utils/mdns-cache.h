@@ -0,0 +1,164 @@
+/**
+ * @file mdns-cache.h
+ * Resolve result cache shared by the mDNS backends that do not keep records themselves (dnssd, avahi).
+ *
+ * Entries are keyed by service instance (main type, name, domain) and hold the last resolved host target, port,
+ * TXT record and addresses, each address expiring according to the ttl reported by the backend.
+ * Backends answer resolve2 instance resolutions from the cache and are asked to re-resolve instances once
+ * AES67_MDNS_CACHE_REFRESH percent of the TTL have passed (see aes67_mdns_cache_process()).
+ */
+
+/**
+ * AES67 Framework
+ * Copyright (C) 2021  Philip Tschiemer, https://github.com/tschiemer/aes67
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AES67_UTILS_MDNS_CACHE_H
+#define AES67_UTILS_MDNS_CACHE_H
+
+#include "aes67/arch.h"
+#include "aes67/net.h"
+#include "aes67/utils/mdns.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Max number of cached service instances, the instance expiring first is dropped when exceeded.
+ */
+#ifndef AES67_MDNS_CACHE_SIZE
+#define AES67_MDNS_CACHE_SIZE       512
+#endif
+
+/**
+ * Number of buckets of the index of instances (power of 2).
+ */
+#ifndef AES67_MDNS_CACHE_HASHSIZE
+#define AES67_MDNS_CACHE_HASHSIZE   256
+#endif
+
+/**
+ * Max number of addresses per service instance.
+ */
+#ifndef AES67_MDNS_CACHE_ADDRS
+#define AES67_MDNS_CACHE_ADDRS      4
+#endif
+
+/**
+ * TTL (sec) assumed if the backend does not report any (avahi), which is the TTL of address records (RFC 6762 10).
+ */
+#ifndef AES67_MDNS_CACHE_TTL
+#define AES67_MDNS_CACHE_TTL        120
+#endif
+
+/**
+ * Percentage of TTL after which instances are re-resolved.
+ */
+#ifndef AES67_MDNS_CACHE_REFRESH
+#define AES67_MDNS_CACHE_REFRESH    80
+#endif
+
+#define AES67_MDNS_CACHE_NEVER      INT64_MAX
+
+struct aes67_mdns_cache_addr {
+    enum aes67_net_ipver ipver;
+    u8_t ip[AES67_NET_ADDR_SIZE];
+    u32_t ttl;
+    int64_t received;                       // msec, monotonic
+    int64_t expires;
+};
+
+struct aes67_mdns_cache_entry {
+    struct aes67_mdns_cache_entry * next;
+    struct aes67_mdns_cache_entry * prev;
+    struct aes67_mdns_cache_entry * hnext;  // next in bucket of index
+
+    u32_t hash;                             // of (normalized) type, name and domain
+
+    char * type;                            // normalized main type, ie "_rtsp._tcp"
+    char * name;
+    char * domain;                          // normalized, ie "local"
+
+    char * hosttarget;
+    u16_t port;
+    u16_t txtlen;
+    u8_t * txt;
+
+    u8_t naddrs;
+    struct aes67_mdns_cache_addr addrs[AES67_MDNS_CACHE_ADDRS];
+
+    int64_t refresh;                        // time of next refresh (or AES67_MDNS_CACHE_NEVER if requested already)
+};
+
+struct aes67_mdns_cache {
+    struct aes67_mdns_cache_entry * first;
+    size_t count;
+    struct aes67_mdns_cache_entry * index[AES67_MDNS_CACHE_HASHSIZE];
+};
+
+/**
+ * Backend specific (re-)resolution of given cached instance.
+ */
+typedef void (*aes67_mdns_cache_refresh_callback)(struct aes67_mdns_cache_entry * entry, void * user_data);
+
+void aes67_mdns_cache_init(struct aes67_mdns_cache * cache);
+void aes67_mdns_cache_clear(struct aes67_mdns_cache * cache);
+
+/**
+ * Entry of instance with at least one valid address, NULL if none.
+ * Types may be given in any of the forms used by the backends, ie "_ravenna._sub._rtsp._tcp", "_rtsp._tcp,_ravenna"
+ * or "_rtsp._tcp." all refer to the same instances; a NULL domain is "local".
+ */
+struct aes67_mdns_cache_entry * aes67_mdns_cache_lookup(struct aes67_mdns_cache * cache, const char * type, const char * name, const char * domain);
+
+/**
+ * Adds (or refreshes) resolved address of instance, hosttarget, port and TXT replace any cached values.
+ * A ttl of 0 is taken as AES67_MDNS_CACHE_TTL.
+ * If out of memory the instance is not cached (anymore).
+ */
+void aes67_mdns_cache_update(struct aes67_mdns_cache * cache, const char * type, const char * name, const char * domain,
+                             const char * hosttarget, u16_t port, u16_t txtlen, const u8_t * txt,
+                             enum aes67_net_ipver ipver, const u8_t * ip, u32_t ttl);
+
+void aes67_mdns_cache_remove(struct aes67_mdns_cache * cache, struct aes67_mdns_cache_entry * entry);
+
+/**
+ * Reports (valid) addresses of cached instance to resolve callback (on behalf of given resource), ttl being the
+ * remaining time to live. Returns number of reported addresses (0 if out of memory).
+ */
+u8_t aes67_mdns_cache_report(struct aes67_mdns_cache_entry * entry, aes67_mdns_resource_t res, enum aes67_mdns_result result,
+                             const char * type, aes67_mdns_resolve_callback callback, void * user_data);
+
+/**
+ * Expires addresses (and instances without addresses) and calls refresh callback for instances due to be refreshed
+ * (once per update). Returns time of next expiry or refresh (msec, see aes67_mdns_cache_now()).
+ */
+int64_t aes67_mdns_cache_process(struct aes67_mdns_cache * cache, aes67_mdns_cache_refresh_callback refresh, void * user_data);
+
+/**
+ * Monotonic time in msec as used for cache timestamps.
+ */
+int64_t aes67_mdns_cache_now(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //AES67_UTILS_MDNS_CACHE_H
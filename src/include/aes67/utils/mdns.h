@@ -31,6 +31,46 @@
 extern "C" {
 #endif
 
+/**
+ * (native backend) Max number of cached records, the record expiring first is dropped when exceeded.
+ */
+#ifndef AES67_MDNS_NATIVE_CACHE_SIZE
+#define AES67_MDNS_NATIVE_CACHE_SIZE 512
+#endif
+
+/**
+ * (native backend) Port to use, only to be changed for testing purposes.
+ */
+#ifndef AES67_MDNS_NATIVE_PORT
+#define AES67_MDNS_NATIVE_PORT 5353
+#endif
+
+/**
+ * (native backend) Expose a timerfd through aes67_mdns_getsockfds() that becomes readable whenever aes67_mdns_process()
+ * has to send queries, probes or announcements or expire cached records.
+ * Without it aes67_mdns_process() must be called periodically.
+ */
+#ifndef AES67_MDNS_NATIVE_TIMERFD
+#ifdef __linux__
+#define AES67_MDNS_NATIVE_TIMERFD 1
+#else
+#define AES67_MDNS_NATIVE_TIMERFD 0
+#endif
+#endif
+
+/**
+ * (avahi backend) Run avahi's event loop in a helper thread handing over to the caller's thread (through a socket pair)
+ * instead of driving avahi through an AvahiPoll adapter on epoll/timerfd (linux only) where everything happens within
+ * aes67_mdns_process() in the caller's thread.
+ */
+#ifndef AES67_MDNS_AVAHI_THREAD
+#ifdef __linux__
+#define AES67_MDNS_AVAHI_THREAD 0
+#else
+#define AES67_MDNS_AVAHI_THREAD 1
+#endif
+#endif
+
 typedef void * aes67_mdns_context_t;
 typedef void * aes67_mdns_resource_t;
 
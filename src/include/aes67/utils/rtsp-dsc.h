@@ -30,8 +30,11 @@
 #include "aes67/arch.h"
 #include "aes67/net.h"
 #include "aes67/rtsp.h"
+#include "aes67/sdp.h"
 
 #include <stdbool.h>
+#include <poll.h>
+#include <time.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -41,9 +44,49 @@ extern "C" {
 #define AES67_RTSP_DSC_BUFSIZE          1500
 #endif
 
+/**
+ * Time given to (non-blocking) connect and response
+ */
+#ifndef AES67_RTSP_DSC_TIMEOUT_SEC
+#define AES67_RTSP_DSC_TIMEOUT_SEC      5
+#endif
+
+/**
+ * Time an idle connection is kept alive for further requests to the same device
+ */
+#ifndef AES67_RTSP_DSC_KEEPALIVE_SEC
+#define AES67_RTSP_DSC_KEEPALIVE_SEC    10
+#endif
+
+/**
+ * Max number of concurrent requests of a multiplexer
+ */
+#ifndef AES67_RTSP_DSC_MUX_SIZE
+#define AES67_RTSP_DSC_MUX_SIZE         8
+#endif
+
+/**
+ * Max number of responses kept by a cache (least recently used are dropped)
+ */
+#ifndef AES67_RTSP_DSC_CACHE_SIZE
+#define AES67_RTSP_DSC_CACHE_SIZE       256
+#endif
+
+/**
+ * Slots of the cache's index (by key hash), at least twice the cache size keeps probe sequences short
+ */
+#ifndef AES67_RTSP_DSC_CACHE_INDEX_SIZE
+#define AES67_RTSP_DSC_CACHE_INDEX_SIZE (2 * AES67_RTSP_DSC_CACHE_SIZE)
+#endif
+
+#define AES67_RTSP_DSC_URILEN           256
+#define AES67_RTSP_DSC_ETAGLEN          64
+#define AES67_RTSP_DSC_LASTMODLEN       40
+
 enum aes67_rtsp_dsc_state {
     aes67_rtsp_dsc_state_bored,
     aes67_rtsp_dsc_state_querying,
+    aes67_rtsp_dsc_state_connecting,
     aes67_rtsp_dsc_state_awaiting_response,
     aes67_rtsp_dsc_state_done
 };
@@ -54,8 +97,15 @@ struct aes67_rtsp_dsc_res_st {
     bool blocking;
     int sockfd;
 
-    u8_t buf[AES67_RTSP_DSC_BUFSIZE];
+    struct aes67_net_addr addr;     // peer of connection
+    bool keepalive;                 // connection may be reused after response
+    bool reused;                    // request sent on a kept alive connection (repeated once if the device closed it)
+    u16_t cseq;
+    time_t deadline;                // of pending request resp. of idle connection
+
+    u8_t buf[AES67_RTSP_DSC_BUFSIZE + 1]; // (content is null-terminated when handed out by multiplexer)
     u16_t buflen;
+    u16_t reqlen;                   // of request (still in buf until the response is read)
 
     u8_t * line;
     u16_t llen;
@@ -63,6 +113,9 @@ struct aes67_rtsp_dsc_res_st {
     u16_t statuscode;
     u16_t hdrlen;
     u16_t contentlen;
+
+    char etag[AES67_RTSP_DSC_ETAGLEN];          // of response (if any)
+    char lastmod[AES67_RTSP_DSC_LASTMODLEN];    // Last-Modified of response (if any)
 };
 
 void aes67_rtsp_dsc_init(struct aes67_rtsp_dsc_res_st * res, bool blocking);
@@ -77,6 +130,11 @@ int aes67_rtsp_dsc_start(
 void aes67_rtsp_dsc_stop(struct aes67_rtsp_dsc_res_st * res);
 void aes67_rtsp_dsc_process(struct aes67_rtsp_dsc_res_st * res);
 
+/**
+ * Socket and events to wait for (if any), ie to be passed to the caller's poller before calling aes67_rtsp_dsc_process().
+ */
+bool aes67_rtsp_dsc_getpollfd(struct aes67_rtsp_dsc_res_st * res, struct pollfd * pfd);
+
 inline const u8_t * aes67_rtsp_dsc_content(struct aes67_rtsp_dsc_res_st * res)
 {
     return res->contentlen ? &res->buf[res->hdrlen] : NULL;
@@ -93,8 +151,122 @@ ssize_t aes67_rtsp_dsc_easy(
 
 ssize_t aes67_rtsp_dsc_easy_url(const char *url, u8_t *sdp, size_t maxlen);
 
+
+/**
+ * Cache of DESCRIBE responses by device and URI.
+ *
+ * Responses are revalidated by conditional requests (If-None-Match resp. If-Modified-Since) where the device
+ * provides an ETag resp. Last-Modified, a response with unchanged content (by fingerprint) is recognized as such
+ * otherwise. The originator is parsed only when the content changes.
+ */
+struct aes67_rtsp_dsc_cache_entry {
+    u32_t key_hash;
+    struct aes67_net_addr addr;
+    char uri[AES67_RTSP_DSC_URILEN];
+
+    u32_t fingerprint;                          // FNV-1a of content
+    u8_t * content;
+    u16_t contentlen;
+    struct aes67_sdp_originator origin;         // as found in content (if any)
+    bool has_origin;
+
+    char etag[AES67_RTSP_DSC_ETAGLEN];
+    char lastmod[AES67_RTSP_DSC_LASTMODLEN];
+
+    time_t last_used;
+    u32_t lru_prev, lru_next;                   // (entry indices, see aes67_rtsp_dsc_cache)
+};
+
+struct aes67_rtsp_dsc_cache {
+    struct aes67_rtsp_dsc_cache_entry entries[AES67_RTSP_DSC_CACHE_SIZE];
+    size_t count;
+
+    u32_t index[AES67_RTSP_DSC_CACHE_INDEX_SIZE];   // open addressed by key hash, entry index + 1 (0 if free)
+    u32_t lru_first, lru_last;                      // least resp. most recently used entry
+};
+
+void aes67_rtsp_dsc_cache_init(struct aes67_rtsp_dsc_cache * cache);
+void aes67_rtsp_dsc_cache_deinit(struct aes67_rtsp_dsc_cache * cache);
+
+struct aes67_rtsp_dsc_cache_entry * aes67_rtsp_dsc_cache_lookup(struct aes67_rtsp_dsc_cache * cache, const enum aes67_net_ipver ipver, const u8_t *ip, const u16_t port, const char * encoded_uri);
+void aes67_rtsp_dsc_cache_remove(struct aes67_rtsp_dsc_cache * cache, const enum aes67_net_ipver ipver, const u8_t *ip, const u16_t port, const char * encoded_uri);
+
+/**
+ * Updates cache with (completed) response, sets unchanged if the content is the one already cached (including a
+ * Not Modified response). Returns entry or NULL if response is not cacheable.
+ */
+struct aes67_rtsp_dsc_cache_entry * aes67_rtsp_dsc_cache_update(struct aes67_rtsp_dsc_cache * cache, struct aes67_rtsp_dsc_res_st * res, const char * encoded_uri, bool * unchanged);
+
+
+/**
+ * Multiplexer of concurrent non-blocking requests.
+ *
+ * Connections are kept alive after a response (unless closed by the device) and are reused for subsequent requests to
+ * the same device, ie several sessions of a device (/by-name/..) are retrieved through one connection. An unreachable
+ * device occupies only the slots of its own requests (until timed out).
+ */
+struct aes67_rtsp_dsc_mux;
+
+/**
+ * Called for every completed request, statuscode is 0 if the request failed (or timed out).
+ * Content (if any) is null-terminated and valid during callback only.
+ * If a cache is used, unchanged is set if the content did not change since the last request (a Not Modified
+ * response is passed on as OK with the cached content).
+ */
+typedef void (*aes67_rtsp_dsc_mux_callback)(struct aes67_rtsp_dsc_mux * mux, void * req_data, u16_t statuscode, u8_t * content, u16_t contentlen, bool unchanged, void * user_data);
+
+struct aes67_rtsp_dsc_mux {
+    struct aes67_rtsp_dsc_res_st res[AES67_RTSP_DSC_MUX_SIZE];
+    void * req_data[AES67_RTSP_DSC_MUX_SIZE];
+    char uri[AES67_RTSP_DSC_MUX_SIZE][AES67_RTSP_DSC_URILEN];
+
+    struct aes67_rtsp_dsc_cache * cache;        // optional
+
+    aes67_rtsp_dsc_mux_callback callback;
+    void * user_data;
+};
+
+void aes67_rtsp_dsc_mux_init(struct aes67_rtsp_dsc_mux * mux, aes67_rtsp_dsc_mux_callback callback, void * user_data);
+void aes67_rtsp_dsc_mux_deinit(struct aes67_rtsp_dsc_mux * mux);
+
+/**
+ * Use given cache for (conditional) requests, NULL to disable.
+ */
+void aes67_rtsp_dsc_mux_setcache(struct aes67_rtsp_dsc_mux * mux, struct aes67_rtsp_dsc_cache * cache);
+
+/**
+ * Starts request, fails if no slot is available or the request could not be sent.
+ */
+int aes67_rtsp_dsc_mux_start(struct aes67_rtsp_dsc_mux * mux, const enum aes67_net_ipver ipver, const u8_t *ip, const u16_t port, const char * encoded_uri, void * req_data);
+
+/**
+ * Aborts pending request (without callback).
+ */
+void aes67_rtsp_dsc_mux_cancel(struct aes67_rtsp_dsc_mux * mux, void * req_data);
+
+/**
+ * Processes all pending requests and idle connections, completed requests are passed to callback.
+ */
+void aes67_rtsp_dsc_mux_process(struct aes67_rtsp_dsc_mux * mux);
+
+/**
+ * Number of slots available for further requests resp. number of pending requests to given device.
+ */
+size_t aes67_rtsp_dsc_mux_available(struct aes67_rtsp_dsc_mux * mux);
+size_t aes67_rtsp_dsc_mux_count(struct aes67_rtsp_dsc_mux * mux, const enum aes67_net_ipver ipver, const u8_t *ip);
+
+/**
+ * Sockets and events to wait for, returns number of pollfds set.
+ */
+size_t aes67_rtsp_dsc_mux_getpollfds(struct aes67_rtsp_dsc_mux * mux, struct pollfd * fds, size_t max);
+
+/**
+ * Earliest time processing is due even without socket events (timeouts), 0 if none.
+ */
+time_t aes67_rtsp_dsc_mux_deadline(struct aes67_rtsp_dsc_mux * mux);
+
 #ifdef __cplusplus
-extern "C" {
+}
 #endif
 
 #endif //AES67_UTILS_RTSP_H
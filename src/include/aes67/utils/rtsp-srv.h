@@ -24,6 +24,8 @@
 #include "aes67/rtsp.h"
 
 #include <stdbool.h>
+#include <time.h>
+#include <poll.h>
 #include <netinet/in.h>
 
 #ifndef AES67_RTSP_SRV_MAXURILEN
@@ -42,6 +44,42 @@
 #define AES67_RTSP_SRV_TXBUFSIZE AES67_RTSP_SRV_RXBUFSIZE
 #endif
 
+/**
+ * Max number of concurrently served client connections (each with its own rx/tx buffers).
+ * If all are in use, the longest idle keep-alive connection is dropped in favor of a new one.
+ */
+#ifndef AES67_RTSP_SRV_MAXCONN
+#define AES67_RTSP_SRV_MAXCONN 16
+#endif
+
+// listening socket, wakeup pipe and connections (see aes67_rtsp_srv_getpollfds())
+#define AES67_RTSP_SRV_MAXPOLLFDS (AES67_RTSP_SRV_MAXCONN + 2)
+
+/**
+ * Connections without any progress (idle keep-alive, incomplete request, client not reading) are closed after this many seconds.
+ */
+#ifndef AES67_RTSP_SRV_TIMEOUT_SEC
+#define AES67_RTSP_SRV_TIMEOUT_SEC 30
+#endif
+
+/**
+ * Number of buckets of URI (and sdpref) index of resources (power of 2)
+ */
+#ifndef AES67_RTSP_SRV_URI_HASHSIZE
+#define AES67_RTSP_SRV_URI_HASHSIZE 64
+#endif
+
+/**
+ * Connections are multiplexed using an (internal) epoll instance instead of poll() (linux only)
+ */
+#ifndef AES67_RTSP_SRV_EPOLL
+#ifdef __linux__
+#define AES67_RTSP_SRV_EPOLL 1
+#else
+#define AES67_RTSP_SRV_EPOLL 0
+#endif
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -78,43 +116,50 @@ struct aes67_rtsp_srv_http_response {
 };
 
 
+/**
+ * Rendered DESCRIBE response (header fields following CSeq and the SDP itself), shared by resource and any
+ * connection still sending it.
+ */
+struct aes67_rtsp_srv_rendered {
+    u32_t refs;
+    u16_t len;
+    u8_t data[];
+};
+
 struct aes67_rtsp_srv_resource {
     struct aes67_rtsp_srv_resource * next;
+    struct aes67_rtsp_srv_resource * prev;
+    struct aes67_rtsp_srv_resource * hnext; // next in bucket of URI index
+    struct aes67_rtsp_srv_resource * snext; // next in bucket of sdpref index
 
+    u32_t hash; // of uri
     u8_t urilen;
     char uri[AES67_RTSP_SRV_MAXURILEN];
 
     void * sdpref;
-};
-
-struct aes67_rtsp_srv {
-
-    enum aes67_rtsp_srv_state state;
 
-    bool http_enabled;
-    void * user_data;
+    // cached response, NULL until first DESCRIBE (resp. after aes67_rtsp_srv_sdp_changed())
+    struct aes67_rtsp_srv_rendered * rendered;
+};
 
-    struct sockaddr_in listen_addr;
-    int listen_sockfd;
+struct aes67_rtsp_srv_conn {
 
-    struct sockaddr_in client_addr;
-    int client_sockfd;
+    enum aes67_rtsp_srv_state state; // init := unused
 
-    bool blocking;
+    int sockfd;
+    struct sockaddr_in addr;
 
-    struct aes67_rtsp_srv_resource * first_res;
+    time_t last_activity;
+    short events; // currently watched events
 
+    bool keepalive;
+    u32_t served; // number of responses
 
     struct {
 
         u8_t data[AES67_RTSP_SRV_RXBUFSIZE];
         u16_t data_len;
 
-        // helper
-        u8_t * line;
-        u16_t llen;
-        int CR;
-
         enum aes67_rtsp_srv_proto proto;
         struct {
             u16_t major;
@@ -131,31 +176,97 @@ struct aes67_rtsp_srv {
     } req; // request
 
     struct {
-//        u16_t status_code;
         u16_t sent;
         u16_t len;
         u8_t data[AES67_RTSP_SRV_TXBUFSIZE];
+        struct aes67_rtsp_srv_rendered * body; // sent following data (if set)
         void * response_state;
         bool more;
+        bool parked; // waiting for more data (see aes67_rtsp_srv_http_wake())
     } res; // response
 };
 
+struct aes67_rtsp_srv {
+
+    enum aes67_rtsp_srv_state state;
+
+    bool http_enabled;
+    void * user_data;
+
+    struct sockaddr_in listen_addr;
+    int listen_sockfd;
+    short listen_events;
+
+    int epfd;
+    int wakefd[2];
+
+    bool blocking;
+
+    struct aes67_rtsp_srv_resource * first_res;
+    struct aes67_rtsp_srv_resource * uri_index[AES67_RTSP_SRV_URI_HASHSIZE];
+    struct aes67_rtsp_srv_resource * sdpref_index[AES67_RTSP_SRV_URI_HASHSIZE];
+
+    u16_t nconn;
+    struct aes67_rtsp_srv_conn conn[AES67_RTSP_SRV_MAXCONN];
+
+    struct aes67_rtsp_srv_conn * current; // while calling http handler
+};
+
 void aes67_rtsp_srv_init(struct aes67_rtsp_srv * srv, bool http_enabled, void * user_data);
 void aes67_rtsp_srv_deinit(struct aes67_rtsp_srv * srv);
 
 int aes67_rtsp_srv_start(struct aes67_rtsp_srv * srv, const enum aes67_net_ipver ipver, const u8_t *ip, u16_t port);
 void aes67_rtsp_srv_stop(struct aes67_rtsp_srv * srv);
 
+/**
+ * Sockets are always non-blocking, in blocking mode aes67_rtsp_srv_process() waits for activity.
+ */
 void aes67_rtsp_srv_blocking(struct aes67_rtsp_srv * srv, bool blocking);
 
+/**
+ * For hosts with their own event loop: fds to wait for before calling aes67_rtsp_srv_process().
+ * With epoll this is just the epoll instance, otherwise the listening socket, wakeup pipe and client connections
+ * (ie at most AES67_RTSP_SRV_MAXPOLLFDS).
+ * Returns number of fds set.
+ */
+size_t aes67_rtsp_srv_getpollfds(struct aes67_rtsp_srv * srv, struct pollfd * fds, size_t max);
+
+/**
+ * Accepts connections and advances any ready connection by as much as possible (ie a pipelined request is
+ * served as soon as the previous response is sent).
+ */
 void aes67_rtsp_srv_process(struct aes67_rtsp_srv * srv);
 
 u16_t aes67_rtsp_srv_sdp_getter(struct aes67_rtsp_srv * srv, void * sdpref, u8_t * buf, u16_t maxlen);
+
+/**
+ * Generates (the next part of) the http response into buf, setting more if there is more to come (the handler is
+ * then called again once the data is sent). Returning no data but setting more parks the response (eg for streams)
+ * until aes67_rtsp_srv_http_wake() is called, at the latest after AES67_RTSP_SRV_TIMEOUT_SEC / 2 (a stream should
+ * then send some keep-alive data, otherwise the connection is timed out).
+ * Called with a NULL buf when the connection terminated prematurely (to clean up response_state).
+ */
 void aes67_rtsp_srv_http_handler(struct aes67_rtsp_srv * srv, const enum aes67_rtsp_srv_method method, char * uri, u8_t urilen, u8_t * buf, u16_t * len, u16_t maxlen, bool * more, void ** response_state);
 
+/**
+ * Resumes parked http responses, can be called from any thread.
+ */
+void aes67_rtsp_srv_http_wake(struct aes67_rtsp_srv * srv);
+
+/**
+ * Value (not null-terminated) of header field of request, NULL if not given.
+ * Only valid within aes67_rtsp_srv_http_handler().
+ */
+const u8_t * aes67_rtsp_srv_http_header(struct aes67_rtsp_srv * srv, const char * name, u16_t * len);
+
 struct aes67_rtsp_srv_resource * aes67_rtsp_srv_sdp_add(struct aes67_rtsp_srv * srv, const char * uri, const u8_t urilen, void * sdpref);
 void aes67_rtsp_srv_sdp_remove(struct aes67_rtsp_srv * srv, void * sdpref);
 
+/**
+ * Discards cached response of resource, ie to be called whenever the SDP (as returned by aes67_rtsp_srv_sdp_getter()) changes.
+ */
+void aes67_rtsp_srv_sdp_changed(struct aes67_rtsp_srv * srv, void * sdpref);
+
 
 #ifdef __cplusplus
 }
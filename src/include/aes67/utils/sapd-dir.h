@@ -0,0 +1,146 @@
+/**
+ * @file sapd-dir.h
+ * Shared memory session directory as published by sapd (see sapd --shm).
+ *
+ * Layout: header, fixed number of records and the payload heap. The directory is written by sapd only and
+ * versioned by a seqlock (header seq is odd while being written), ie readers never block the writer but retry
+ * reading should the sequence number have changed meanwhile (the reader functions below take care of this).
+ */
+
+/**
+ * AES67 Framework
+ * Copyright (C) 2021  Philip Tschiemer, https://github.com/tschiemer/aes67
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AES67_UTILS_SAPD_DIR_H
+#define AES67_UTILS_SAPD_DIR_H
+
+#include "aes67/arch.h"
+#include "aes67/sdp.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AES67_SAPD_DIR_SHM          "/sapd-dir"
+
+#define AES67_SAPD_DIR_MAGIC        0x53444952 // "SDIR"
+#define AES67_SAPD_DIR_VERSION      2
+
+#ifndef AES67_SAPD_DIR_CAPACITY
+#define AES67_SAPD_DIR_CAPACITY     1024
+#endif
+
+#ifndef AES67_SAPD_DIR_HEAPSIZE
+#define AES67_SAPD_DIR_HEAPSIZE     (1024*1024)
+#endif
+
+#define AES67_SAPD_DIR_KEYLEN       160
+#define AES67_SAPD_DIR_VERSIONLEN   32
+
+/**
+ * Not all sessions did fit into directory (or had an origin too long for a record)
+ */
+#define AES67_SAPD_DIR_FLAG_TRUNCATED   1
+
+struct aes67_sapd_dir_header {
+    u32_t magic;
+    u32_t version;
+    u32_t seq;                              // seqlock, odd while being written
+    u32_t capacity;                         // number of records
+    u32_t heapsize;
+    u32_t count;                            // number of valid records
+    u32_t flags;
+    u32_t reserved;
+    int64_t updated;                        // time of last update
+};
+
+struct aes67_sapd_dir_record {
+    u32_t key_hash;                         // FNV-1a of key
+    char key[AES67_SAPD_DIR_KEYLEN];        // origin identity, ie "<username> <sess-id> <nettype> <addrtype> <address>"
+    char version[AES67_SAPD_DIR_VERSIONLEN];// origin session version
+    u8_t managed_by;                        // see AES67_SAPSRV_MANAGEDBY_LOCAL/REMOTE
+    u8_t reserved[3];
+    u32_t ifaces;                           // interface mask (see aes67_sapsrv_session_get_ifaces())
+    int64_t last_activity;
+    u32_t payload_offset;                   // into heap
+    u32_t payloadlen;
+};
+
+struct aes67_sapd_dir {
+    bool writable;
+    size_t size;
+    u8_t * map;
+    struct aes67_sapd_dir_header * header;
+    struct aes67_sapd_dir_record * records;
+    u32_t * index;                          // open addressing hash table of record index + 1 (0 = empty) by key_hash
+    u32_t indexmask;
+    u8_t * heap;
+    u32_t heapused;                         // writer only
+};
+
+/**
+ * Renders identity of origin (ie origin without session version) as used for lookups.
+ * Returns length of key or 0 if it does not fit.
+ */
+u16_t aes67_sapd_dir_key(char * key, size_t maxlen, const struct aes67_sdp_originator * origin);
+
+/**
+ * Reader: map (read-only) directory published by sapd, NULL if not available.
+ */
+struct aes67_sapd_dir * aes67_sapd_dir_open(void);
+void aes67_sapd_dir_close(struct aes67_sapd_dir * dir);
+
+/**
+ * Current (even) sequence number, changes with every update, ie can be used to cheaply check for changes.
+ * Odd if the writer did not complete an update in due time (readers give up rather than wait forever).
+ */
+u32_t aes67_sapd_dir_seq(struct aes67_sapd_dir * dir);
+
+/**
+ * Copies (consistent) record and payload of session with given origin resp. of the index-th session.
+ * Returns payload length, -1 if not found (or payload does not fit into buffer, or no consistent state could be read).
+ */
+ssize_t aes67_sapd_dir_lookup(struct aes67_sapd_dir * dir, const struct aes67_sdp_originator * origin,
+                              struct aes67_sapd_dir_record * record, u8_t * payload, size_t maxlen);
+ssize_t aes67_sapd_dir_get(struct aes67_sapd_dir * dir, u32_t index,
+                           struct aes67_sapd_dir_record * record, u8_t * payload, size_t maxlen);
+
+/**
+ * Writer: (re-)create directory in shared memory.
+ */
+struct aes67_sapd_dir * aes67_sapd_dir_create(u32_t capacity, u32_t heapsize);
+void aes67_sapd_dir_destroy(struct aes67_sapd_dir * dir);
+
+/**
+ * Writer: replaces directory content, ie begin() clears directory, add() any number of sessions, commit() publishes.
+ * aes67_sapd_dir_add() returns EXIT_FAILURE if the session does not fit (directory is marked truncated).
+ * The writer should prepare its sessions beforehand, readers give up on updates taking longer than some milliseconds.
+ */
+void aes67_sapd_dir_begin(struct aes67_sapd_dir * dir);
+int aes67_sapd_dir_add(struct aes67_sapd_dir * dir, const struct aes67_sdp_originator * origin, u8_t managed_by,
+                       u32_t ifaces, int64_t last_activity, const u8_t * payload, u32_t payloadlen);
+void aes67_sapd_dir_commit(struct aes67_sapd_dir * dir);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //AES67_UTILS_SAPD_DIR_H
@@ -25,6 +25,7 @@
 #define AES67_UTILS_SAPD_H
 
 #include <syslog.h>
+#include <inttypes.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -48,8 +49,50 @@ extern "C" {
 
 #define AES67_SAPD_LOCAL_SOCK     "/var/run/sapd.sock"
 //#define AES67_SAPD_LOCAL_SOCK      "sapd.sock"
-#define AES67_SAPD_LOCAL_LISTEN_BACKLOG    3
-#define AES67_SAPD_LOCAL_MAX_CONNECTIONS   10
+#define AES67_SAPD_LOCAL_LISTEN_BACKLOG    64
+
+/**
+ * Main loop waits using epoll (edge-triggered for local clients) instead of select() (linux only)
+ */
+#ifndef AES67_SAPD_EPOLL
+#ifdef __linux__
+#define AES67_SAPD_EPOLL    1
+#else
+#define AES67_SAPD_EPOLL    0
+#endif
+#endif
+
+/**
+ * Default max number of local clients (see --max-clients), select() is limited to FD_SETSIZE fds
+ */
+#ifndef AES67_SAPD_LOCAL_MAX_CONNECTIONS
+#if AES67_SAPD_EPOLL == 1
+#define AES67_SAPD_LOCAL_MAX_CONNECTIONS   1024
+#else
+#define AES67_SAPD_LOCAL_MAX_CONNECTIONS   256
+#endif
+#endif
+
+/**
+ * Number of recent notifications kept for event stream clients resuming by Last-Event-ID (see --rav-sse), clients
+ * further behind are sent a reset and a full listing again.
+ */
+#ifndef AES67_SAPD_SSE_JOURNAL
+#define AES67_SAPD_SSE_JOURNAL  256
+#endif
+
+/**
+ * Max number of concurrent event stream clients, further clients are turned away (503) to leave connections of the
+ * RTSP/HTTP server (AES67_RTSP_SRV_MAXCONN) for DESCRIBE requests.
+ */
+#ifndef AES67_SAPD_SSE_MAXCLIENTS
+#define AES67_SAPD_SSE_MAXCLIENTS   8
+#endif
+
+/**
+ * Path of the (http) event stream on the RTSP server (see --rav-sse)
+ */
+#define AES67_SAPD_SSE_PATH     "/events"
 
 #define AES67_SAPD_ERR              0
 #define AES67_SAPD_ERR_UNRECOGNIZED 1
@@ -123,6 +166,31 @@ extern "C" {
 #define AES67_SAPD_RESULT_LIST      "LS"
 #define AES67_SAPD_RESULT_LIST_FMT  "LS %d %d %d o=%s %s %s IN IP%d %s"
 
+/**
+ * LIST changes since given change sequence number (delta synchronization)
+ *
+ * Command: ls since <seq> [SPACE <return-sdp>] NL
+ *  <seq>           sequence number as returned by a previous LSSEQ, 0 for a full list
+ *  <return-sdp>    see above
+ *
+ * On success returns
+ *  [LSRESET NL]                if changes since <seq> are not known (anymore), ie the client must discard any sessions
+ *                              it knows, the following LS items then are a full list
+ *  LSDEL <seq> <origin> NL     (0-N) sessions deleted since <seq> (oldest first)
+ *  LS .. NL [<sdp>]            (0-N) sessions added or changed since <seq> (oldest change first), see above
+ *  LSSEQ <seq> NL              current sequence number (to use for the next delta)
+ *  OK NL
+ *
+ * Sequence numbers also increase across restarts of the daemon (any older number leads to an LSRESET).
+ */
+#define AES67_SAPD_CMD_LIST_SINCE           "ls since"
+#define AES67_SAPD_CMD_LIST_SINCE_FMT       "ls since %" PRIu64 " %d"
+#define AES67_SAPD_RESULT_LIST_RESET        "LSRESET"
+#define AES67_SAPD_RESULT_LIST_DELETED      "LSDEL"
+#define AES67_SAPD_RESULT_LIST_DELETED_FMT  "LSDEL %" PRIu64 " o=%s %s %s IN IP%d %s"
+#define AES67_SAPD_RESULT_LIST_SEQ          "LSSEQ"
+#define AES67_SAPD_RESULT_LIST_SEQ_FMT      "LSSEQ %" PRIu64
+
 /**
  * Add or update a locally administered SDP
  *
@@ -169,6 +237,27 @@ extern "C" {
 #define AES67_SAPD_CMD_TAKEOVER     "takeover"
 #define AES67_SAPD_CMD_TAKEOVER_FMT "takeover o=%s %s %s IN IP%d %s"
 
+/**
+ * Filter unsolicited messages of this connection
+ *
+ * Command: filter [SPACE <key>=<value>]* NL
+ *  enc=<8|16|24|32|AM824>  stream encoding (L8, L16, L24, L32, AM824 respectively)
+ *  rate=<samplerate>       stream sampling rate; ex. 48000
+ *  ch=<nchannels>          stream number of channels
+ *  mcast=<ip>[/<prefix>]   stream connection address in given range; ex. 239.69.0.0/16
+ *  origin=<ip>             originator address
+ *  name=<pattern>          session name (or ravenna session name) matching shell pattern (no spaces); ex. Stage*
+ *
+ * Replaces any previous filter, without criteria the filter is removed (ie all messages are delivered again).
+ * Messages concerning a session are only delivered if all criteria match, where stream criteria (enc, rate, ch, mcast)
+ * must be met by the same stream (see sdp-parse -t -b -r -c). Information not (yet) known does not match, eg a RAVDSCV
+ * message is only delivered if there is no criterion but name. Messages not concerning a particular session (INFO) are
+ * always delivered.
+ *
+ * On success returns OK (NL)
+ */
+#define AES67_SAPD_CMD_FILTER       "filter"
+
 /**
  * RAVLIST known ravenna sessions
  *
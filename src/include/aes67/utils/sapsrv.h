@@ -31,6 +31,7 @@
 //#include "aes67/debug.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #if AES67_SAP_MEMORY != AES67_MEMORY_DYNAMIC
 #error sap-server requires dynamic memory allocation (at this point in time)
@@ -61,6 +62,55 @@ extern "C" {
 #define AES67_SAPSRV_SDP_MAXLEN                  1024
 #endif
 
+#ifndef AES67_SAPSRV_HASHTABLE_SIZE
+#define AES67_SAPSRV_HASHTABLE_SIZE              256
+#endif
+
+/**
+ * Max number of messages read per recvmmsg() call (linux only)
+ */
+#ifndef AES67_SAPSRV_RX_BATCH
+#define AES67_SAPSRV_RX_BATCH                    16
+#endif
+
+/**
+ * Max number of network interfaces a server can listen/send on (at most 32)
+ */
+#ifndef AES67_SAPSRV_IFACES_MAX
+#define AES67_SAPSRV_IFACES_MAX                  4
+#endif
+
+#if AES67_SAPSRV_IFACES_MAX < 1 || 32 < AES67_SAPSRV_IFACES_MAX
+#error AES67_SAPSRV_IFACES_MAX must be in range 1 - 32
+#endif
+
+/**
+ * Threaded mode: SAP traffic is received and handled by a separate io thread (requires pthreads), events are passed
+ * to the host (in order) through a lock-free queue and delivered when the host calls aes67_sapsrv_process() resp.
+ * aes67_sapsrv_process_sockfd() on the (notification) fd returned by aes67_sapsrv_getsockfds().
+ * Session functions modifying sessions are thread-safe, anything else (ie lookups, iterating sessions and getters)
+ * must be guarded by aes67_sapsrv_lock()/aes67_sapsrv_unlock(), session handles being valid only while holding the
+ * lock; the event handler is called without the lock held and its origin and payload arguments stay valid for the call.
+ * The io thread sleeps until network traffic arrives or it is woken by the host upon timer expiry, ie the host has to
+ * call aes67_sapsrv_process_timers() (or aes67_sapsrv_process()) whenever timers might have expired (with a timerfd
+ * port, see AES67_TIMER_FD, aes67_timer_process() wakes it instead).
+ */
+#ifndef AES67_SAPSRV_THREADED
+#define AES67_SAPSRV_THREADED                    0
+#endif
+
+/**
+ * Number of deleted sessions remembered for change tracking (see aes67_sapsrv_changes_horizon())
+ */
+#ifndef AES67_SAPSRV_TOMBSTONES
+#define AES67_SAPSRV_TOMBSTONES                  1024
+#endif
+
+/**
+ * Session interface mask, bit i refers to the i-th interface passed to aes67_sapsrv_start_ifaces()
+ */
+#define AES67_SAPSRV_IFACES_ALL          UINT32_MAX
+
 #ifndef aes67_sapsrv_time_t
 #define u32_t aes67_sapsrv_time_t;
 #endif
@@ -98,11 +148,36 @@ typedef void (*aes67_sapsrv_event_handler)(aes67_sapsrv_t server, aes67_sapsrv_s
 aes67_sapsrv_t
 aes67_sapsrv_start(u32_t send_scopes, u16_t port, u32_t listen_scopes, unsigned int ipv6_if,
                    aes67_sapsrv_event_handler event_handler, void *user_data);
+
+/**
+ * Like aes67_sapsrv_start() but joins the multicast groups on (and sends through) each of the given interfaces
+ * (interface indices, see if_nametoindex()); ifcount = 0 uses the default interface.
+ * The interface a message was received on is recorded per session (see aes67_sapsrv_session_get_ifaces()).
+ */
+aes67_sapsrv_t
+aes67_sapsrv_start_ifaces(u32_t send_scopes, u16_t port, u32_t listen_scopes, const unsigned int * ifaces, size_t ifcount,
+                          aes67_sapsrv_event_handler event_handler, void *user_data);
 void aes67_sapsrv_stop(aes67_sapsrv_t sapserver);
 
 
 void aes67_sapsrv_process(aes67_sapsrv_t sapserver);
 
+/**
+ * For hosts with their own event loop (select/poll/epoll on aes67_sapsrv_getsockfds()):
+ * aes67_sapsrv_process_sockfd() drains the given ready socket (ie until EAGAIN),
+ * aes67_sapsrv_process_timers() handles pending announcements and timeouts and should be called after every wakeup.
+ * With a timerfd port (AES67_TIMER_FD) announcements and timeouts are handled upon expiry from within
+ * aes67_timer_process() instead, which the host then has to call whenever aes67_timer_getfd() is readable.
+ */
+void aes67_sapsrv_process_sockfd(aes67_sapsrv_t sapserver, int sockfd);
+void aes67_sapsrv_process_timers(aes67_sapsrv_t sapserver);
+
+/**
+ * Guards session access in threaded mode (recursive), no-ops otherwise.
+ */
+void aes67_sapsrv_lock(aes67_sapsrv_t sapserver);
+void aes67_sapsrv_unlock(aes67_sapsrv_t sapserver);
+
 void aes67_sapsrv_getsockfds(aes67_sapsrv_t sapserver, int * fds[], size_t * count);
 
 int aes67_sapsrv_setblocking(aes67_sapsrv_t sapserver, bool state);
@@ -119,6 +194,15 @@ aes67_sapsrv_session_t aes67_sapsrv_session_by_origin(aes67_sapsrv_t sapserver,
 aes67_sapsrv_session_t aes67_sapsrv_session_first(aes67_sapsrv_t sapserver);
 aes67_sapsrv_session_t aes67_sapsrv_session_next(aes67_sapsrv_session_t current);
 
+/**
+ * Payloads (as passed to the event handler, except for remote duplicates, and returned by the getters) are immutable
+ * and shared, ie a session update replaces the session's payload rather than changing it.
+ * They are valid until the session is updated or deleted unless the host keeps a reference using
+ * aes67_sapsrv_payload_ref(), which must be released with aes67_sapsrv_payload_unref().
+ */
+u8_t * aes67_sapsrv_payload_ref(u8_t * payload);
+void aes67_sapsrv_payload_unref(u8_t * payload);
+
 void aes67_sapsrv_session_get_payload(aes67_sapsrv_session_t session, u8_t ** payload, u16_t * len);
 struct aes67_sdp_originator * aes67_sapsrv_session_get_origin(aes67_sapsrv_session_t session);
 u8_t * aes67_sapsrv_session_get_sdp(aes67_sapsrv_session_t session, u16_t * sdplen);
@@ -126,6 +210,47 @@ time_t aes67_sapsrv_session_get_lastactivity(aes67_sapsrv_session_t session);
 u8_t aes67_sapsrv_session_get_managedby(aes67_sapsrv_session_t session);
 void aes67_sapsrv_session_set_managedby(aes67_sapsrv_t sapserver, aes67_sapsrv_session_t sapsession, u8_t managed_by);
 
+/**
+ * Interface mask of session, ie interfaces a remote session was seen on, resp. a local session is announced on.
+ */
+u32_t aes67_sapsrv_session_get_ifaces(aes67_sapsrv_session_t session);
+void aes67_sapsrv_session_set_ifaces(aes67_sapsrv_t sapserver, aes67_sapsrv_session_t sapsession, u32_t ifaces);
+
+/**
+ * Session snapshot for warm starts: aes67_sapsrv_snapshot_save() writes all remotely managed sessions (payload, SAP
+ * msg hash and source, last activity) to the given (memory mapped) file, aes67_sapsrv_snapshot_load() restores them
+ * (announcing them as discovered). Restored sessions are provisional until announced again and time out as usual
+ * if not (ie AES67_SAP_MIN_TIMEOUT_SEC after their last activity).
+ * Both return EXIT_SUCCESS or EXIT_FAILURE.
+ */
+int aes67_sapsrv_snapshot_save(aes67_sapsrv_t sapserver, const char * path);
+int aes67_sapsrv_snapshot_load(aes67_sapsrv_t sapserver, const char * path);
+bool aes67_sapsrv_session_is_provisional(aes67_sapsrv_session_t session);
+
+/**
+ * Change tracking (eg for delta synchronization): any change of a session (added, updated, managed-by) assigns the
+ * session the next change sequence number, a deleted session leaves a tombstone with the sequence number of its
+ * deletion. Only the last AES67_SAPSRV_TOMBSTONES tombstones are kept, ie changes since a sequence number older than
+ * aes67_sapsrv_changes_horizon() can not be told anymore (and require a full resync).
+ * Sequence numbers start off the time of server start, ie also increase across restarts.
+ * Like iterating sessions, to be guarded by aes67_sapsrv_lock() in threaded mode.
+ */
+uint64_t aes67_sapsrv_changes_seq(aes67_sapsrv_t sapserver);
+uint64_t aes67_sapsrv_changes_horizon(aes67_sapsrv_t sapserver);
+uint64_t aes67_sapsrv_session_get_changeseq(aes67_sapsrv_session_t session);
+
+/**
+ * Sessions changed after seq in order of their changes, ie first session returned is the oldest change.
+ */
+aes67_sapsrv_session_t aes67_sapsrv_session_changed_since(aes67_sapsrv_t sapserver, uint64_t seq);
+aes67_sapsrv_session_t aes67_sapsrv_session_next_changed(aes67_sapsrv_session_t session);
+
+/**
+ * Tombstones oldest first, index in range 0 .. aes67_sapsrv_tombstone_count() - 1.
+ */
+u32_t aes67_sapsrv_tombstone_count(aes67_sapsrv_t sapserver);
+const struct aes67_sdp_originator * aes67_sapsrv_tombstone_get(aes67_sapsrv_t sapserver, u32_t index, uint64_t * seq);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,344 @@
+/**
+ * AES67 Framework
+ * Copyright (C) 2021  Philip Tschiemer, https://github.com/tschiemer/aes67
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "aes67/utils/mdns-avahi-poll.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/time.h>
+
+struct AvahiWatch {
+    struct aes67_mdns_avahi_poll * adapter;
+    struct AvahiWatch * next;
+    int fd;
+    AvahiWatchEvent events;
+    AvahiWatchEvent revents;    // events being dispatched
+    AvahiWatchCallback callback;
+    void * userdata;
+    bool dead;                  // freed by avahi, to be released after dispatching
+};
+
+struct AvahiTimeout {
+    struct aes67_mdns_avahi_poll * adapter;
+    struct AvahiTimeout * next;
+    bool enabled;
+    struct timeval tv;          // absolute, as given by avahi (ie gettimeofday() based)
+    AvahiTimeoutCallback callback;
+    void * userdata;
+    bool dead;
+};
+
+static uint32_t watch_to_epoll(AvahiWatchEvent event)
+{
+    return (event & AVAHI_WATCH_IN ? EPOLLIN : 0) |
+           (event & AVAHI_WATCH_OUT ? EPOLLOUT : 0) |
+           (event & AVAHI_WATCH_ERR ? EPOLLERR : 0) |
+           (event & AVAHI_WATCH_HUP ? EPOLLHUP : 0);
+}
+
+static AvahiWatchEvent watch_from_epoll(uint32_t events)
+{
+    return (events & EPOLLIN ? AVAHI_WATCH_IN : 0) |
+           (events & EPOLLOUT ? AVAHI_WATCH_OUT : 0) |
+           (events & EPOLLERR ? AVAHI_WATCH_ERR : 0) |
+           (events & EPOLLHUP ? AVAHI_WATCH_HUP : 0);
+}
+
+/**
+ * Arms timerfd to expire with the first enabled timeout (or disarms it).
+ */
+static void timeouts_arm(struct aes67_mdns_avahi_poll * adapter)
+{
+    struct AvahiTimeout * first = NULL;
+
+    for(struct AvahiTimeout * t = adapter->timeouts; t != NULL; t = t->next){
+        if (t->enabled && !t->dead && (first == NULL || timercmp(&t->tv, &first->tv, <))){
+            first = t;
+        }
+    }
+
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+
+    if (first != NULL){
+        struct timeval now, rem;
+        gettimeofday(&now, NULL);
+
+        if (timercmp(&first->tv, &now, >)){
+            timersub(&first->tv, &now, &rem);
+            its.it_value.tv_sec = rem.tv_sec;
+            its.it_value.tv_nsec = rem.tv_usec * 1000;
+        }
+        // (already due, a zero it_value would disarm)
+        if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0){
+            its.it_value.tv_nsec = 1;
+        }
+    }
+
+    timerfd_settime(adapter->timerfd, 0, &its, NULL);
+}
+
+static AvahiWatch* watch_new(const AvahiPoll *api, int fd, AvahiWatchEvent event, AvahiWatchCallback callback, void *userdata)
+{
+    struct aes67_mdns_avahi_poll * adapter = api->userdata;
+
+    struct AvahiWatch * w = calloc(1, sizeof(struct AvahiWatch));
+    if (w == NULL){
+        return NULL;
+    }
+
+    w->adapter = adapter;
+    w->fd = fd;
+    w->events = event;
+    w->callback = callback;
+    w->userdata = userdata;
+
+    struct epoll_event ev = {
+        .events = watch_to_epoll(event),
+        .data.ptr = w
+    };
+    if (epoll_ctl(adapter->epfd, EPOLL_CTL_ADD, fd, &ev) == -1){
+        fprintf(stderr, __FILE__": epoll_ctl(ADD) failed: %s\n", strerror(errno));
+        free(w);
+        return NULL;
+    }
+
+    w->next = adapter->watches;
+    adapter->watches = w;
+
+    return w;
+}
+
+static void watch_update(AvahiWatch *w, AvahiWatchEvent event)
+{
+    assert(w != NULL);
+    assert(!w->dead);
+
+    w->events = event;
+
+    struct epoll_event ev = {
+        .events = watch_to_epoll(event),
+        .data.ptr = w
+    };
+    epoll_ctl(w->adapter->epfd, EPOLL_CTL_MOD, w->fd, &ev);
+}
+
+static AvahiWatchEvent watch_get_events(AvahiWatch *w)
+{
+    assert(w != NULL);
+
+    return w->revents;
+}
+
+static void watch_free(AvahiWatch *w)
+{
+    assert(w != NULL);
+
+    // (fd might be closed already, in which case the kernel removed it anyway)
+    epoll_ctl(w->adapter->epfd, EPOLL_CTL_DEL, w->fd, NULL);
+
+    w->dead = true;
+}
+
+static AvahiTimeout* timeout_new(const AvahiPoll *api, const struct timeval *tv, AvahiTimeoutCallback callback, void *userdata)
+{
+    struct aes67_mdns_avahi_poll * adapter = api->userdata;
+
+    struct AvahiTimeout * t = calloc(1, sizeof(struct AvahiTimeout));
+    if (t == NULL){
+        return NULL;
+    }
+
+    t->adapter = adapter;
+    t->callback = callback;
+    t->userdata = userdata;
+
+    if (tv != NULL){
+        t->enabled = true;
+        t->tv = *tv;
+    }
+
+    t->next = adapter->timeouts;
+    adapter->timeouts = t;
+
+    timeouts_arm(adapter);
+
+    return t;
+}
+
+static void timeout_update(AvahiTimeout *t, const struct timeval *tv)
+{
+    assert(t != NULL);
+    assert(!t->dead);
+
+    t->enabled = tv != NULL;
+    if (tv != NULL){
+        t->tv = *tv;
+    }
+
+    timeouts_arm(t->adapter);
+}
+
+static void timeout_free(AvahiTimeout *t)
+{
+    assert(t != NULL);
+
+    t->dead = true;
+    t->enabled = false;
+
+    timeouts_arm(t->adapter);
+}
+
+/**
+ * Releases watches and timeouts freed by avahi.
+ */
+static void poll_cleanup(struct aes67_mdns_avahi_poll * adapter, bool all)
+{
+    struct AvahiWatch ** pw = &adapter->watches;
+    while(*pw != NULL){
+        struct AvahiWatch * w = *pw;
+        if (w->dead || all){
+            *pw = w->next;
+            free(w);
+        } else {
+            pw = &w->next;
+        }
+    }
+
+    struct AvahiTimeout ** pt = &adapter->timeouts;
+    while(*pt != NULL){
+        struct AvahiTimeout * t = *pt;
+        if (t->dead || all){
+            *pt = t->next;
+            free(t);
+        } else {
+            pt = &t->next;
+        }
+    }
+}
+
+int aes67_mdns_avahi_poll_init(struct aes67_mdns_avahi_poll * adapter)
+{
+    assert(adapter != NULL);
+
+    adapter->watches = NULL;
+    adapter->timeouts = NULL;
+
+    adapter->timerfd = -1;
+    adapter->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (adapter->epfd == -1){
+        fprintf(stderr, __FILE__": epoll_create1() failed: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    adapter->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (adapter->timerfd == -1){
+        fprintf(stderr, __FILE__": timerfd_create() failed: %s\n", strerror(errno));
+        aes67_mdns_avahi_poll_deinit(adapter);
+        return EXIT_FAILURE;
+    }
+
+    // (the timerfd is told apart from watches by a NULL pointer)
+    struct epoll_event ev = {
+        .events = EPOLLIN,
+        .data.ptr = NULL
+    };
+    if (epoll_ctl(adapter->epfd, EPOLL_CTL_ADD, adapter->timerfd, &ev) == -1){
+        fprintf(stderr, __FILE__": epoll_ctl(ADD) failed: %s\n", strerror(errno));
+        aes67_mdns_avahi_poll_deinit(adapter);
+        return EXIT_FAILURE;
+    }
+
+    adapter->api.userdata = adapter;
+    adapter->api.watch_new = watch_new;
+    adapter->api.watch_update = watch_update;
+    adapter->api.watch_get_events = watch_get_events;
+    adapter->api.watch_free = watch_free;
+    adapter->api.timeout_new = timeout_new;
+    adapter->api.timeout_update = timeout_update;
+    adapter->api.timeout_free = timeout_free;
+
+    return EXIT_SUCCESS;
+}
+
+void aes67_mdns_avahi_poll_deinit(struct aes67_mdns_avahi_poll * adapter)
+{
+    assert(adapter != NULL);
+
+    poll_cleanup(adapter, true);
+
+    if (adapter->timerfd != -1){
+        close(adapter->timerfd);
+        adapter->timerfd = -1;
+    }
+    if (adapter->epfd != -1){
+        close(adapter->epfd);
+        adapter->epfd = -1;
+    }
+}
+
+void aes67_mdns_avahi_poll_dispatch(struct aes67_mdns_avahi_poll * adapter, int timeout_msec)
+{
+    assert(adapter != NULL);
+
+    struct epoll_event events[AES67_MDNS_AVAHI_POLL_MAXEVENTS];
+
+    int n = epoll_wait(adapter->epfd, events, AES67_MDNS_AVAHI_POLL_MAXEVENTS, timeout_msec);
+
+    for(int i = 0; i < n; i++){
+        struct AvahiWatch * w = events[i].data.ptr;
+
+        if (w == NULL){
+            uint64_t expirations;
+            if (read(adapter->timerfd, &expirations, sizeof(expirations))){}
+            continue;
+        }
+
+        // (might have been freed by a previous callback)
+        if (w->dead){
+            continue;
+        }
+
+        w->revents = watch_from_epoll(events[i].events);
+        w->callback(w, w->fd, w->revents, w->userdata);
+        w->revents = 0;
+    }
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    for(struct AvahiTimeout * t = adapter->timeouts; t != NULL; t = t->next){
+        if (t->enabled && !t->dead && !timercmp(&t->tv, &now, >)){
+            // like avahi's own implementations, timeouts are one-shot until updated
+            t->enabled = false;
+            t->callback(t, t->userdata);
+        }
+    }
+
+    poll_cleanup(adapter, false);
+
+    timeouts_arm(adapter);
+}
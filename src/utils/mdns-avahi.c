@@ -17,7 +17,11 @@
  */
 
 /**
- * Source code to allow for FD based polling adapted from avahi dnssd-compat source
+ * By default (AES67_MDNS_AVAHI_THREAD == 0) avahi is driven through an AvahiPoll adapter (see mdns-avahi-poll.h), the
+ * epoll fd of which is what aes67_mdns_getsockfds() returns. Thus all callbacks happen from within aes67_mdns_process()
+ * in the caller's thread.
+ *
+ * Otherwise, source code to allow for FD based polling adapted from avahi dnssd-compat source
  * https://github.com/lathiat/avahi/blob/master/avahi-compat-libdns_sd/compat.c
  */
 
@@ -32,6 +36,13 @@
 #include <signal.h>
 #include <netinet/in.h>
 #include <fcntl.h>
+#include <stdbool.h>
+
+#if AES67_MDNS_AVAHI_THREAD == 0
+#include "aes67/utils/mdns-avahi-poll.h"
+#endif
+
+#include "aes67/utils/mdns-cache.h"
 
 #include <avahi-client/client.h>
 #include <avahi-client/lookup.h>
@@ -76,20 +87,30 @@ typedef struct resource_st {
 
 
 typedef struct context_st {
+#if AES67_MDNS_AVAHI_THREAD == 1
     AvahiSimplePoll *simple_poll;
+#else
+    struct aes67_mdns_avahi_poll adapter;
+#endif
     AvahiClient *client;
 
     resource_t * first_resource;
 
+    struct aes67_mdns_cache cache;
+    resource_t * refresh;   // (unlinked) owner of cache refresh resolutions
 
+#if AES67_MDNS_AVAHI_THREAD == 1
     int thread_fd, main_fd;
 
     pthread_t thread;
     int thread_running;
 
     pthread_mutex_t mutex;
+#endif
 } context_t;
 
+#if AES67_MDNS_AVAHI_THREAD == 1
+
 
 enum {
     COMMAND_POLL = 'p',
@@ -200,6 +221,8 @@ static void * thread_func(void *data) {
     return NULL;
 }
 
+#endif //AES67_MDNS_AVAHI_THREAD == 1
+
 static resource_t * resource_new(context_t * context, enum restype restype, void *callback, void * user_data)
 {
 
@@ -358,10 +381,22 @@ static void resolve_callback(
         }
     }
 
+    // avahi does not tell the ttl, thus the cache assumes AES67_MDNS_CACHE_TTL
     uint16_t ttl = 0;
 
-    ((aes67_mdns_resolve_callback) res->callback)(res, result, type, name, host_name,
-                                                  port, txtlen, (uint8_t*)txtstr, ipver, ip, ttl, res->user_data);
+    if (result == aes67_mdns_result_discovered){
+        aes67_mdns_cache_update(&res->context->cache, type, name, domain, host_name, port, txtlen, (uint8_t*)txtstr, ipver, ip, ttl);
+    } else if (result == aes67_mdns_result_terminated){
+        struct aes67_mdns_cache_entry * entry = aes67_mdns_cache_lookup(&res->context->cache, type, name, domain);
+        if (entry != NULL){
+            aes67_mdns_cache_remove(&res->context->cache, entry);
+        }
+    }
+
+    if (res->callback != NULL){
+        ((aes67_mdns_resolve_callback) res->callback)(res, result, type, name, host_name,
+                                                      port, txtlen, (uint8_t*)txtstr, ipver, ip, ttl, res->user_data);
+    }
     if (txtstr)
         free(txtstr);
 
@@ -421,6 +456,17 @@ static void browse_callback(
             return;
         }
 
+        // previously resolved instances are answered from cache (if it can be copied)
+        context_t * context = res->context;
+        struct aes67_mdns_cache_entry * entry = aes67_mdns_cache_lookup(&context->cache, type, name, domain);
+        if (entry != NULL && aes67_mdns_cache_report(entry, res, result, type, res->callback, res->user_data) > 0){
+            // (callback may have changed cache)
+            if (result == aes67_mdns_result_terminated && (entry = aes67_mdns_cache_lookup(&context->cache, type, name, domain)) != NULL){
+                aes67_mdns_cache_remove(&context->cache, entry);
+            }
+            return;
+        }
+
         res->result = result;
 
         if (!(avahi_service_resolver_new(res->context->client, interface, protocol, name, type, domain, AVAHI_PROTO_UNSPEC, 0, resolve_callback, res))) {
@@ -433,7 +479,9 @@ static void browse_callback(
 static void client_callback(AvahiClient *c, AvahiClientState state, AVAHI_GCC_UNUSED void * userdata) {
     assert(c);
 
+#if AES67_MDNS_AVAHI_THREAD == 1
     context_t * context = userdata;
+#endif
 
     /* Called whenever the client or server state changes */
 
@@ -445,7 +493,9 @@ static void client_callback(AvahiClient *c, AvahiClientState state, AVAHI_GCC_UN
             break;
         case AVAHI_CLIENT_FAILURE:
             fprintf(stderr, "Client failure: %s\n", avahi_strerror(avahi_client_errno(c)));
+#if AES67_MDNS_AVAHI_THREAD == 1
             avahi_simple_poll_quit(context->simple_poll);
+#endif
             break;
         case AVAHI_CLIENT_S_COLLISION:
             /* Let's drop our registered services. When the server is back
@@ -472,6 +522,34 @@ aes67_mdns_context_t  aes67_mdns_new(void)
 
     context_t * context = calloc(1, sizeof(context_t));
 
+    aes67_mdns_cache_init(&context->cache);
+
+    context->refresh = resource_new(context, restype_resolve2, NULL, NULL);
+    context->refresh->result = aes67_mdns_result_discovered;
+
+#if AES67_MDNS_AVAHI_THREAD == 0
+
+    if (aes67_mdns_avahi_poll_init(&context->adapter)){
+        goto fail;
+    }
+
+    /* Allocate a new client */
+    context->client = avahi_client_new(&context->adapter.api, 0, client_callback, context, &error);
+
+    if (!context->client) {
+        fprintf(stderr, "Failed to create client: %s\n", avahi_strerror(error));
+        goto fail;
+    }
+
+    return context;
+
+fail:
+    aes67_mdns_delete(context);
+
+    return NULL;
+
+#else //AES67_MDNS_AVAHI_THREAD == 1
+
     int fd[2] = { -1, -1 };
     pthread_mutexattr_t mutex_attr;
 
@@ -536,6 +614,8 @@ fail:
     assert(pthread_mutex_unlock(&context->mutex));
 
     return NULL;
+
+#endif //AES67_MDNS_AVAHI_THREAD == 1
 }
 
 void aes67_mdns_delete(aes67_mdns_context_t ctx)
@@ -552,9 +632,19 @@ void aes67_mdns_delete(aes67_mdns_context_t ctx)
         avahi_client_free(context->client);
     }
 
+#if AES67_MDNS_AVAHI_THREAD == 1
     if (context->simple_poll){
         avahi_simple_poll_free(context->simple_poll);
     }
+#else
+    aes67_mdns_avahi_poll_deinit(&context->adapter);
+#endif
+
+    aes67_mdns_cache_clear(&context->cache);
+
+    if (context->refresh){
+        resource_delete(context, context->refresh);
+    }
 
     free(context);
 }
@@ -906,12 +996,37 @@ void aes67_mdns_stop(aes67_mdns_resource_t res)
 }
 
 
+/**
+ * Re-resolves cached instance, ie the result only updates the cache.
+ */
+static void cache_refresh(struct aes67_mdns_cache_entry * entry, void * user_data)
+{
+    context_t * context = user_data;
+
+    if (!avahi_service_resolver_new(context->client, AVAHI_IF_UNSPEC, AVAHI_PROTO_UNSPEC, entry->name, entry->type, entry->domain,
+                                    AVAHI_PROTO_UNSPEC, 0, resolve_callback, context->refresh)){
+        fprintf(stderr, "Failed to refresh service '%s': %s\n", entry->name, avahi_strerror(avahi_client_errno(context->client)));
+    }
+}
+
 void aes67_mdns_process(aes67_mdns_context_t ctx, int timeout_msec)
 {
     assert(ctx != NULL);
 
     context_t * context = ctx;
 
+#if AES67_MDNS_AVAHI_THREAD == 0
+
+    aes67_mdns_cache_process(&context->cache, cache_refresh, context);
+
+    aes67_mdns_avahi_poll_dispatch(&context->adapter, timeout_msec);
+
+#else //AES67_MDNS_AVAHI_THREAD == 1
+
+    pthread_mutex_lock(&context->mutex);
+    aes67_mdns_cache_process(&context->cache, cache_refresh, context);
+    pthread_mutex_unlock(&context->mutex);
+
     int nfds = context->main_fd + 1;
     fd_set rfds;
     fd_set xfds;
@@ -964,6 +1079,8 @@ finish:
 //    sdref_unref(sdref);
 
 //    return ret;
+
+#endif //AES67_MDNS_AVAHI_THREAD == 1
 }
 
 void aes67_mdns_getsockfds(aes67_mdns_context_t ctx, int * fds[], size_t *count)
@@ -974,7 +1091,11 @@ void aes67_mdns_getsockfds(aes67_mdns_context_t ctx, int * fds[], size_t *count)
 
     context_t * context = ctx;
 
+#if AES67_MDNS_AVAHI_THREAD == 0
+    *fds = &context->adapter.epfd;
+#else
     *fds = &context->main_fd;
+#endif
     *count = 1;
 }
 
@@ -0,0 +1,437 @@
+/**
+ * AES67 Framework
+ * Copyright (C) 2021  Philip Tschiemer, https://github.com/tschiemer/aes67
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "aes67/utils/mdns-cache.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <syslog.h>
+#include <time.h>
+
+int64_t aes67_mdns_cache_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Main type without subtype and trailing dot, ie "_rtsp._tcp" for "_ravenna._sub._rtsp._tcp", "_rtsp._tcp,_ravenna"
+ * and "_rtsp._tcp."
+ */
+static size_t normalize_type(char * out, size_t maxlen, const char * type)
+{
+    const char * sub = strstr(type, "._sub.");
+    if (sub != NULL){
+        type = sub + sizeof("._sub.") - 1;
+    }
+
+    size_t l = strcspn(type, ",");
+    if (l > 0 && type[l-1] == '.'){
+        l--;
+    }
+    if (l >= maxlen){
+        l = maxlen - 1;
+    }
+
+    memcpy(out, type, l);
+    out[l] = '\0';
+
+    return l;
+}
+
+static size_t normalize_domain(char * out, size_t maxlen, const char * domain)
+{
+    if (domain == NULL || *domain == '\0'){
+        domain = "local";
+    }
+
+    size_t l = strlen(domain);
+    if (l > 0 && domain[l-1] == '.'){
+        l--;
+    }
+    if (l >= maxlen){
+        l = maxlen - 1;
+    }
+
+    memcpy(out, domain, l);
+    out[l] = '\0';
+
+    return l;
+}
+
+/**
+ * Case-insensitive hash (FNV-1a) of normalized type, name and normalized domain.
+ */
+static u32_t hash(const char * type, const char * name, const char * domain)
+{
+    const char * parts[3] = {type, name, domain};
+    u32_t h = 2166136261U;
+
+    for(u8_t i = 0; i < 3; i++){
+        for(const char * c = parts[i]; *c != '\0'; c++){
+            h ^= (u8_t)tolower((u8_t)*c);
+            h *= 16777619U;
+        }
+        // (separator)
+        h *= 16777619U;
+    }
+
+    return h;
+}
+
+static struct aes67_mdns_cache_entry * find(struct aes67_mdns_cache * cache, const char * type, const char * name, const char * domain)
+{
+    char t[256], d[256];
+
+    normalize_type(t, sizeof(t), type);
+    normalize_domain(d, sizeof(d), domain);
+
+    u32_t h = hash(t, name, d);
+
+    for(struct aes67_mdns_cache_entry * entry = cache->index[h & (AES67_MDNS_CACHE_HASHSIZE - 1)]; entry != NULL; entry = entry->hnext){
+        if (entry->hash == h && strcasecmp(entry->name, name) == 0 && strcasecmp(entry->type, t) == 0 && strcasecmp(entry->domain, d) == 0){
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static int64_t expires(struct aes67_mdns_cache_entry * entry)
+{
+    int64_t first = AES67_MDNS_CACHE_NEVER;
+
+    for(u8_t i = 0; i < entry->naddrs; i++){
+        if (entry->addrs[i].expires < first){
+            first = entry->addrs[i].expires;
+        }
+    }
+
+    return first;
+}
+
+static void entry_free(struct aes67_mdns_cache_entry * entry)
+{
+    free(entry->type);
+    free(entry->name);
+    free(entry->domain);
+    free(entry->hosttarget);
+    free(entry->txt);
+    free(entry);
+}
+
+void aes67_mdns_cache_init(struct aes67_mdns_cache * cache)
+{
+    assert(cache != NULL);
+
+    cache->first = NULL;
+    cache->count = 0;
+
+    for(u32_t i = 0; i < AES67_MDNS_CACHE_HASHSIZE; i++){
+        cache->index[i] = NULL;
+    }
+}
+
+void aes67_mdns_cache_clear(struct aes67_mdns_cache * cache)
+{
+    assert(cache != NULL);
+
+    while(cache->first != NULL){
+        aes67_mdns_cache_remove(cache, cache->first);
+    }
+}
+
+struct aes67_mdns_cache_entry * aes67_mdns_cache_lookup(struct aes67_mdns_cache * cache, const char * type, const char * name, const char * domain)
+{
+    assert(cache != NULL);
+
+    if (type == NULL || name == NULL){
+        return NULL;
+    }
+
+    struct aes67_mdns_cache_entry * entry = find(cache, type, name, domain);
+
+    if (entry == NULL || expires(entry) <= aes67_mdns_cache_now()){
+        return NULL;
+    }
+
+    return entry;
+}
+
+void aes67_mdns_cache_update(struct aes67_mdns_cache * cache, const char * type, const char * name, const char * domain,
+                             const char * hosttarget, u16_t port, u16_t txtlen, const u8_t * txt,
+                             enum aes67_net_ipver ipver, const u8_t * ip, u32_t ttl)
+{
+    assert(cache != NULL);
+
+    if (type == NULL || name == NULL || ip == NULL || (ipver != aes67_net_ipver_4 && ipver != aes67_net_ipver_6) ||
+        ipver > AES67_NET_ADDR_SIZE){
+        return;
+    }
+
+    int64_t now = aes67_mdns_cache_now();
+
+    if (ttl == 0){
+        ttl = AES67_MDNS_CACHE_TTL;
+    }
+
+    struct aes67_mdns_cache_entry * entry = find(cache, type, name, domain);
+
+    if (entry == NULL){
+
+        // make room by dropping the instance expiring first
+        if (cache->count >= AES67_MDNS_CACHE_SIZE){
+            struct aes67_mdns_cache_entry * first = cache->first;
+            for(struct aes67_mdns_cache_entry * e = cache->first; e != NULL; e = e->next){
+                if (expires(e) < expires(first)){
+                    first = e;
+                }
+            }
+            aes67_mdns_cache_remove(cache, first);
+        }
+
+        char t[256], d[256];
+        normalize_type(t, sizeof(t), type);
+        normalize_domain(d, sizeof(d), domain);
+
+        entry = calloc(1, sizeof(struct aes67_mdns_cache_entry));
+        if (entry == NULL){
+            syslog(LOG_ERR, "mdns cache: out of memory");
+            return;
+        }
+        entry->type = strdup(t);
+        entry->name = strdup(name);
+        entry->domain = strdup(d);
+
+        if (entry->type == NULL || entry->name == NULL || entry->domain == NULL){
+            entry_free(entry);
+            syslog(LOG_ERR, "mdns cache: out of memory");
+            return;
+        }
+
+        entry->prev = NULL;
+        entry->next = cache->first;
+        if (entry->next != NULL){
+            entry->next->prev = entry;
+        }
+        cache->first = entry;
+        cache->count++;
+
+        entry->hash = hash(t, entry->name, d);
+        struct aes67_mdns_cache_entry ** bucket = &cache->index[entry->hash & (AES67_MDNS_CACHE_HASHSIZE - 1)];
+        entry->hnext = *bucket;
+        *bucket = entry;
+    }
+
+    // service data is replaced as a whole (a changed host target invalidates any addresses)
+    if (hosttarget != NULL && (entry->hosttarget == NULL || strcasecmp(entry->hosttarget, hosttarget) != 0)){
+        free(entry->hosttarget);
+        entry->hosttarget = strdup(hosttarget);
+        entry->naddrs = 0;
+        if (entry->hosttarget == NULL){
+            // (rather forget instance than keep stale data)
+            aes67_mdns_cache_remove(cache, entry);
+            syslog(LOG_ERR, "mdns cache: out of memory");
+            return;
+        }
+    }
+    entry->port = port;
+
+    if (entry->txtlen != txtlen || (txtlen > 0 && memcmp(entry->txt, txt, txtlen) != 0)){
+        free(entry->txt);
+        entry->txt = NULL;
+        entry->txtlen = 0;
+        if (txtlen > 0 && txt != NULL){
+            entry->txt = malloc(txtlen);
+            if (entry->txt == NULL){
+                aes67_mdns_cache_remove(cache, entry);
+                syslog(LOG_ERR, "mdns cache: out of memory");
+                return;
+            }
+            memcpy(entry->txt, txt, txtlen);
+            entry->txtlen = txtlen;
+        }
+    }
+
+    struct aes67_mdns_cache_addr * addr = NULL;
+
+    for(u8_t i = 0; i < entry->naddrs; i++){
+        if (entry->addrs[i].ipver == ipver && memcmp(entry->addrs[i].ip, ip, ipver) == 0){
+            addr = &entry->addrs[i];
+            break;
+        }
+    }
+
+    if (addr == NULL){
+        if (entry->naddrs < AES67_MDNS_CACHE_ADDRS){
+            addr = &entry->addrs[entry->naddrs++];
+        } else {
+            // replace address expiring first
+            addr = &entry->addrs[0];
+            for(u8_t i = 1; i < entry->naddrs; i++){
+                if (entry->addrs[i].expires < addr->expires){
+                    addr = &entry->addrs[i];
+                }
+            }
+        }
+        addr->ipver = ipver;
+        memcpy(addr->ip, ip, ipver);
+    }
+
+    addr->ttl = ttl;
+    addr->received = now;
+    addr->expires = now + 1000 * (int64_t)ttl;
+
+    // refresh is due when the first address reaches the given percentage of its ttl
+    entry->refresh = AES67_MDNS_CACHE_NEVER;
+    for(u8_t i = 0; i < entry->naddrs; i++){
+        int64_t refresh = entry->addrs[i].received + (int64_t)entry->addrs[i].ttl * 10 * AES67_MDNS_CACHE_REFRESH;
+        if (refresh < entry->refresh){
+            entry->refresh = refresh;
+        }
+    }
+}
+
+void aes67_mdns_cache_remove(struct aes67_mdns_cache * cache, struct aes67_mdns_cache_entry * entry)
+{
+    assert(cache != NULL);
+    assert(entry != NULL);
+
+    struct aes67_mdns_cache_entry ** pp = &cache->index[entry->hash & (AES67_MDNS_CACHE_HASHSIZE - 1)];
+    while(*pp != NULL && *pp != entry){
+        pp = &(*pp)->hnext;
+    }
+    if (*pp == NULL){
+        return;
+    }
+
+    *pp = entry->hnext;
+
+    if (entry->prev != NULL){
+        entry->prev->next = entry->next;
+    } else {
+        cache->first = entry->next;
+    }
+    if (entry->next != NULL){
+        entry->next->prev = entry->prev;
+    }
+    cache->count--;
+
+    entry_free(entry);
+}
+
+u8_t aes67_mdns_cache_report(struct aes67_mdns_cache_entry * entry, aes67_mdns_resource_t res, enum aes67_mdns_result result,
+                             const char * type, aes67_mdns_resolve_callback callback, void * user_data)
+{
+    assert(entry != NULL);
+    assert(callback != NULL);
+
+    int64_t now = aes67_mdns_cache_now();
+    u8_t count = 0;
+
+    // (copy, the callback might well cause the entry to be removed)
+    u8_t naddrs = entry->naddrs;
+    struct aes67_mdns_cache_addr addrs[AES67_MDNS_CACHE_ADDRS];
+    memcpy(addrs, entry->addrs, sizeof(addrs));
+
+    char * name = strdup(entry->name);
+    char * hosttarget = entry->hosttarget ? strdup(entry->hosttarget) : NULL;
+    u16_t port = entry->port;
+    u16_t txtlen = entry->txtlen;
+    u8_t * txt = txtlen > 0 ? malloc(txtlen) : NULL;
+
+    if (name == NULL || (entry->hosttarget != NULL && hosttarget == NULL) || (txtlen > 0 && txt == NULL)){
+        free(txt);
+        free(hosttarget);
+        free(name);
+        syslog(LOG_ERR, "mdns cache: out of memory");
+        return 0;
+    }
+    if (txtlen > 0){
+        memcpy(txt, entry->txt, txtlen);
+    }
+
+    for(u8_t i = 0; i < naddrs; i++){
+        if (addrs[i].expires <= now){
+            continue;
+        }
+        u32_t ttl = (addrs[i].expires - now) / 1000;
+
+        callback(res, result, type, name, hosttarget, port, txtlen, txt, addrs[i].ipver, addrs[i].ip, ttl, user_data);
+
+        count++;
+    }
+
+    free(txt);
+    free(hosttarget);
+    free(name);
+
+    return count;
+}
+
+int64_t aes67_mdns_cache_process(struct aes67_mdns_cache * cache, aes67_mdns_cache_refresh_callback refresh, void * user_data)
+{
+    assert(cache != NULL);
+
+    int64_t now = aes67_mdns_cache_now();
+    int64_t next = AES67_MDNS_CACHE_NEVER;
+
+    struct aes67_mdns_cache_entry * entry = cache->first;
+
+    while(entry != NULL){
+        struct aes67_mdns_cache_entry * nextentry = entry->next;
+
+        for(u8_t i = 0; i < entry->naddrs; ){
+            if (entry->addrs[i].expires <= now){
+                entry->addrs[i] = entry->addrs[--entry->naddrs];
+            } else {
+                i++;
+            }
+        }
+
+        if (entry->naddrs == 0){
+            aes67_mdns_cache_remove(cache, entry);
+            entry = nextentry;
+            continue;
+        }
+
+        if (entry->refresh <= now){
+            // only once, an update (ie the result of the refresh) sets the next refresh time
+            entry->refresh = AES67_MDNS_CACHE_NEVER;
+            if (refresh != NULL){
+                refresh(entry, user_data);
+            }
+        }
+
+        int64_t e = expires(entry);
+        if (e < next){
+            next = e;
+        }
+        if (entry->refresh < next){
+            next = entry->refresh;
+        }
+
+        entry = nextentry;
+    }
+
+    return next;
+}
@@ -23,6 +23,7 @@
  */
 
 #include "aes67/utils/mdns.h"
+#include "aes67/utils/mdns-cache.h"
 
 #include <dns_sd.h>
 #include <assert.h>
@@ -65,6 +66,7 @@ typedef struct context_st {
     DNSServiceRef sharedRef;
     dnssd_sock_t sockfd;
     struct resource_st * first_resource;
+    struct aes67_mdns_cache cache;
 } context_t;
 
 typedef struct resource_st {
@@ -89,6 +91,8 @@ typedef struct resource_st {
     u16_t txtlen;
     u8_t * txt;
 
+    int64_t timeout;    // cache refresh resources (without callback) are given up after this
+
 } resource_t;
 
 
@@ -107,6 +111,8 @@ static aes67_mdns_resource_t resolve_start(resource_t * res, const char * name,
 static void getaddr_callback(DNSServiceRef sdRef, DNSServiceFlags flags, uint32_t interfaceIndex, DNSServiceErrorType errorCode, const char *hostname, const struct sockaddr *address, uint32_t ttl, void *context);
 static aes67_mdns_resource_t getaddr_start(resource_t * res, const char * hostname);
 
+static void cache_refresh(struct aes67_mdns_cache_entry * entry, void * user_data);
+
 static resource_t * resource_new(context_t * ctx, enum restype restype, void *callback, void *user_data, resource_t *parent)
 {
     assert(ctx != NULL);
@@ -129,6 +135,8 @@ static resource_t * resource_new(context_t * ctx, enum restype restype, void *ca
     res->txtlen = 0;
     res->txt = NULL;
 
+    res->timeout = AES67_MDNS_CACHE_NEVER;
+
     return res;
 }
 
@@ -242,6 +250,8 @@ aes67_mdns_context_t aes67_mdns_new(void)
 
     ctx->sockfd = DNSServiceRefSockFD(ctx->sharedRef);
 
+    aes67_mdns_cache_init(&ctx->cache);
+
     return ctx;
 }
 
@@ -252,6 +262,8 @@ void aes67_mdns_delete(aes67_mdns_context_t ctx)
     while(__ctx->first_resource != NULL){
         aes67_mdns_stop(__ctx->first_resource);
     }
+
+    aes67_mdns_cache_clear(&__ctx->cache);
 }
 
 
@@ -286,6 +298,17 @@ static void browse_callback(DNSServiceRef ref, DNSServiceFlags flags, u32_t inte
             return;
         }
 
+        // previously resolved instances are answered from cache (if it can be copied)
+        context_t * ctx = res->ctx;
+        struct aes67_mdns_cache_entry * entry = aes67_mdns_cache_lookup(&ctx->cache, regtype, serviceName, replyDomain);
+        if (entry != NULL && aes67_mdns_cache_report(entry, res, result, regtype, (aes67_mdns_resolve_callback)res->callback, res->user_data) > 0){
+            // (callback may have changed cache)
+            if (result == aes67_mdns_result_terminated && (entry = aes67_mdns_cache_lookup(&ctx->cache, regtype, serviceName, replyDomain)) != NULL){
+                aes67_mdns_cache_remove(&ctx->cache, entry);
+            }
+            return;
+        }
+
         resource_t * res2 = resource_new(res->ctx, restype_resolve2_resolve, res->callback, res->user_data, res);
 
         res2->result = result;
@@ -377,7 +400,9 @@ static void resolve_callback(DNSServiceRef ref, DNSServiceFlags flags, u32_t int
             res2 = res->parent;
         }
 
-        ((aes67_mdns_resolve_callback)res->callback)(res2, result, res->regType, res->serviceName, NULL, 0, 0, NULL, aes67_net_ipver_undefined, NULL, 0, res->user_data);
+        if (res->callback != NULL){
+            ((aes67_mdns_resolve_callback)res->callback)(res2, result, res->regType, res->serviceName, NULL, 0, 0, NULL, aes67_net_ipver_undefined, NULL, 0, res->user_data);
+        }
     } else {
 
         resource_t * res2;
@@ -386,8 +411,10 @@ static void resolve_callback(DNSServiceRef ref, DNSServiceFlags flags, u32_t int
             res2 = resource_new(res->ctx, restype_resolve_getaddr, res->callback, res->user_data, res);
             res2->result = result;
         } else {
-            res2 = resource_new(res->ctx, restype_resolve2_getaddr, res->callback, res->user_data, res);
+            // (the resolve resource is deleted right away, thus the address lookup belongs to the resolve2 resource)
+            res2 = resource_new(res->ctx, restype_resolve2_getaddr, res->callback, res->user_data, res->parent);
             res2->result = res->result;
+            res2->timeout = res->timeout;
         }
 
         if (res->serviceName != NULL){
@@ -500,8 +527,22 @@ static void getaddr_callback(DNSServiceRef sdRef, DNSServiceFlags flags, uint32_
         }
     }
 
-    ((aes67_mdns_resolve_callback) res->callback)(res, result, res->regType, res->serviceName, res->hostTarget,
-                                                  res->port, res->txtlen, res->txt, ipver, ip, ttl, res->user_data);
+    if (ip != NULL){
+        if (result == aes67_mdns_result_discovered && (flags & kDNSServiceFlagsAdd)){
+            aes67_mdns_cache_update(&res->ctx->cache, res->regType, res->serviceName, NULL, res->hostTarget,
+                                    res->port, res->txtlen, res->txt, ipver, ip, ttl);
+        } else if (result == aes67_mdns_result_terminated){
+            struct aes67_mdns_cache_entry * entry = aes67_mdns_cache_lookup(&res->ctx->cache, res->regType, res->serviceName, NULL);
+            if (entry != NULL){
+                aes67_mdns_cache_remove(&res->ctx->cache, entry);
+            }
+        }
+    }
+
+    if (res->callback != NULL){
+        ((aes67_mdns_resolve_callback) res->callback)(res, result, res->regType, res->serviceName, res->hostTarget,
+                                                      res->port, res->txtlen, res->txt, ipver, ip, ttl, res->user_data);
+    }
 
     if (res->type == restype_resolve2_getaddr && ((flags & kDNSServiceFlagsMoreComing) == 0 || errorCode != kDNSServiceErr_NoError)) {
         resource_delete(res);
@@ -679,6 +720,30 @@ aes67_mdns_register_start(aes67_mdns_context_t ctx, const char *fullname, u16_t
 
 
 
+/**
+ * Re-resolves cached instance, ie the result only updates the cache.
+ */
+static void cache_refresh(struct aes67_mdns_cache_entry * entry, void * user_data)
+{
+    context_t * ctx = user_data;
+
+    resource_t * res = resource_new(ctx, restype_resolve2_resolve, NULL, NULL, NULL);
+
+    res->result = aes67_mdns_result_discovered;
+    res->regType = strdup(entry->type);
+    res->serviceName = strdup(entry->name);
+
+    // give up once cached addresses have expired
+    res->timeout = 0;
+    for(u8_t i = 0; i < entry->naddrs; i++){
+        if (entry->addrs[i].expires > res->timeout){
+            res->timeout = entry->addrs[i].expires;
+        }
+    }
+
+    resolve_start(res, entry->name, entry->type, entry->domain);
+}
+
 void aes67_mdns_stop(aes67_mdns_resource_t res)
 {
     assert(res != NULL);
@@ -711,6 +776,19 @@ void aes67_mdns_process(aes67_mdns_context_t ctx, int timeout_msec)
     if (retval > 0){
         DNSServiceProcessResult(__ctx->sharedRef);
     }
+
+    // give up unanswered cache refreshes
+    int64_t now = aes67_mdns_cache_now();
+    for(resource_t * res = __ctx->first_resource; res != NULL; ){
+        if (res->callback == NULL && res->timeout <= now){
+            resource_delete(res);
+            res = __ctx->first_resource;
+        } else {
+            res = res->next;
+        }
+    }
+
+    aes67_mdns_cache_process(&__ctx->cache, cache_refresh, __ctx);
 }
 
 void aes67_mdns_getsockfds(aes67_mdns_context_t ctx, int * fds[], size_t *count)
@@ -0,0 +1,1907 @@
+/**
+ * AES67 Framework
+ * Copyright (C) 2021  Philip Tschiemer, https://github.com/tschiemer/aes67
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Built-in mDNS querier and responder (RFC 6762, RFC 6763), IPv4 only.
+ *
+ * Everything runs in the caller's thread from within aes67_mdns_process(), which is to be called whenever one of the
+ * fds of aes67_mdns_getsockfds() is readable (the multicast socket and, on linux, a timerfd signalling the next due
+ * query, probe, announcement or cache expiry).
+ *
+ * Simplifications: no simultaneous probe tiebreaking, no conflict handling after registration, host name (A records)
+ * is not probed, responses are not delayed/aggregated.
+ */
+
+#include "aes67/utils/mdns.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <poll.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#if AES67_MDNS_NATIVE_TIMERFD == 1
+#include <sys/timerfd.h>
+#endif
+
+#define MDNS_PORT           5353
+#define MDNS_GROUP          "224.0.0.251"
+
+#define MDNS_NAME_MAX       256     // wire format, including terminating zero length label
+#define MDNS_RDATA_MAX      1024    // larger records are ignored
+#define MDNS_PKT_MAX        1460    // size of sent packets
+#define MDNS_RXBUF_SIZE     9000
+
+#define MDNS_TYPE_A         1
+#define MDNS_TYPE_PTR       12
+#define MDNS_TYPE_TXT       16
+#define MDNS_TYPE_AAAA      28
+#define MDNS_TYPE_SRV       33
+#define MDNS_TYPE_ANY       255
+
+#define MDNS_CLASS_IN       1
+#define MDNS_CLASS_FLUSH    0x8000  // (response) unique record, flush other cached records
+#define MDNS_CLASS_QU       0x8000  // (question) unicast response requested
+
+#define MDNS_FLAGS_RESPONSE 0x8400  // QR + AA
+
+#define MDNS_TTL_HOST       120     // records referring to host names (A, AAAA, SRV)
+#define MDNS_TTL_OTHER      4500
+
+#define QUERY_INTERVAL_MIN  1000    // msec, doubled up to
+#define QUERY_INTERVAL_MAX  3600000
+#define PROBE_INTERVAL      250
+#define PROBE_COUNT         3
+#define ANNOUNCE_INTERVAL   1000
+#define ANNOUNCE_COUNT      2
+#define TXT_WAIT            1000    // resolve without TXT record if not received after this
+#define GOODBYE_DELAY       1000    // (RFC 6762 10.1)
+#define REFRESH_COUNT       4       // refresh queries at 80, 85, 90, 95 % of TTL
+
+#define MAX_QUESTIONS       32
+#define MAX_IFACES          16
+
+#define NEVER               INT64_MAX
+
+enum restype {
+    restype_browse,
+    restype_resolve,
+    restype_resolve2,
+    restype_service,
+    restype_register
+};
+
+enum resstate {
+    resstate_querying,
+    resstate_resolved,
+    resstate_pending,       // service not yet committed
+    resstate_probing,
+    resstate_announcing,
+    resstate_registered,
+    resstate_failed
+};
+
+/**
+ * Resource record, names (also those in rdata) are kept in uncompressed wire format.
+ */
+struct record_st {
+    struct record_st * next;
+    u8_t name[MDNS_NAME_MAX];
+    u16_t type;
+    u16_t rrclass;
+    bool unique;
+    u32_t ttl;
+    u16_t rdlen;
+    u8_t rdata[];
+};
+
+struct cache_st {
+    struct cache_st * next;
+    int64_t received;
+    int64_t expires;
+    u8_t refreshed;     // number of refresh points passed
+    struct record_st rr; // must be last
+};
+
+struct question_st {
+    u8_t name[MDNS_NAME_MAX];
+    u16_t type;
+};
+
+struct context_st;
+
+struct instance_st {
+    struct instance_st * next;
+    u8_t name[MDNS_NAME_MAX];
+    struct resource_st * resolve;   // (resolve2) instance resolution
+    bool seen;
+};
+
+typedef struct resource_st {
+    struct context_st * context;
+    struct resource_st * next;
+    struct resource_st * parent;    // resolve2 resource of instance resolution
+
+    enum restype type;
+    enum resstate state;
+    bool stopped;   // stopped from within callback, to be deleted (see reap())
+    int error_code;
+
+    void * callback;
+    void * user_data;
+
+    char * type_str;
+    char * name_str;
+
+    u8_t qname[MDNS_NAME_MAX];      // browse: service type, resolve: service instance
+
+    int64_t started;
+    int64_t next_tx;
+    u32_t interval;
+    u8_t count;
+
+    struct instance_st * instances; // browse, resolve2
+
+    u8_t host[MDNS_NAME_MAX];       // service: target of SRV record, resolve: last resolved target
+    u16_t port;
+
+    struct record_st * records;     // service, register
+} resource_t;
+
+typedef struct context_st {
+    int sockfd;
+    int timerfd;
+    int fds[2];
+    size_t nfds;
+
+    struct in_addr ifaces[MAX_IFACES];
+    size_t nifaces;
+
+    u8_t hostname[MDNS_NAME_MAX];
+    struct record_st * host_records;
+
+    struct cache_st * cache;
+    size_t ncache;
+
+    resource_t * first_resource;
+    bool processing;
+
+    struct question_st questions[MAX_QUESTIONS];
+    size_t nquestions;
+} context_t;
+
+struct pkt_st {
+    u8_t data[MDNS_PKT_MAX];
+    u16_t len;
+    u16_t counts[4]; // questions, answers, authority, additional
+};
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+////// names
+
+static u16_t name_len(const u8_t * name)
+{
+    u16_t l = 0;
+    while(name[l] != 0){
+        l += name[l] + 1;
+    }
+    return l + 1;
+}
+
+static u8_t lower(u8_t c)
+{
+    return ('A' <= c && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static bool name_eq(const u8_t * a, const u8_t * b)
+{
+    for(u16_t i = 0; ; ){
+        if (a[i] != b[i]){
+            return false;
+        }
+        if (a[i] == 0){
+            return true;
+        }
+        for(u8_t l = a[i++]; l > 0; l--, i++){
+            if (lower(a[i]) != lower(b[i])){
+                return false;
+            }
+        }
+    }
+}
+
+/**
+ * Appends dotted labels of str, returns new length or 0 on error.
+ */
+static u16_t name_append(u8_t * name, u16_t len, const char * str)
+{
+    while(str != NULL && *str != '\0'){
+        const char * dot = strchr(str, '.');
+        size_t l = dot ? (size_t)(dot - str) : strlen(str);
+
+        if (l > 63 || len + 1 + l + 1 > MDNS_NAME_MAX){
+            return 0;
+        }
+        if (l > 0){
+            name[len++] = l;
+            memcpy(&name[len], str, l);
+            len += l;
+        }
+
+        str = dot ? dot + 1 : NULL;
+    }
+    return len;
+}
+
+/**
+ * Builds name from (raw, optional) instance label followed by (dotted) type and domain, returns length or 0 on error.
+ */
+static u16_t name_build(u8_t * name, const char * instance, const char * type, const char * domain)
+{
+    u16_t len = 0;
+
+    if (instance != NULL){
+        size_t l = strlen(instance);
+        if (l == 0 || l > 63){
+            return 0;
+        }
+        name[len++] = l;
+        memcpy(&name[len], instance, l);
+        len += l;
+    }
+
+    u16_t l = name_append(name, len, type);
+    if (l == 0 && type != NULL && *type != '\0'){
+        return 0;
+    }
+    len = l ? l : len;
+
+    l = name_append(name, len, domain == NULL ? "local" : domain);
+    if (l == 0){
+        return 0;
+    }
+    len = l;
+
+    name[len++] = 0;
+
+    return len;
+}
+
+/**
+ * Decodes (possibly compressed) name at pos of message, advances pos and returns length of (uncompressed) name.
+ */
+static u16_t name_decode(const u8_t * msg, u16_t msglen, u16_t * pos, u8_t * name)
+{
+    u16_t p = *pos;
+    u16_t len = 0;
+    bool jumped = false;
+    u8_t jumps = 0;
+
+    while(p < msglen){
+        u8_t l = msg[p];
+
+        if ((l & 0xC0) == 0xC0){
+            if (p + 1 >= msglen || ++jumps > 32){
+                return 0;
+            }
+            if (!jumped){
+                *pos = p + 2;
+                jumped = true;
+            }
+            p = ((l & 0x3F) << 8) | msg[p+1];
+            continue;
+        }
+        if ((l & 0xC0) != 0){
+            return 0;
+        }
+        if (l == 0){
+            name[len++] = 0;
+            if (!jumped){
+                *pos = p + 1;
+            }
+            return len;
+        }
+        if (p + 1 + l > msglen || len + 1 + l + 1 > MDNS_NAME_MAX){
+            return 0;
+        }
+        memcpy(&name[len], &msg[p], 1 + l);
+        len += 1 + l;
+        p += 1 + l;
+    }
+
+    return 0;
+}
+
+/**
+ * Dotted (unescaped) representation of name.
+ */
+static void name_tostr(const u8_t * name, char * str, size_t maxlen)
+{
+    size_t len = 0;
+
+    for(u16_t i = 0; name[i] != 0 && len + name[i] + 2 < maxlen; i += name[i] + 1){
+        if (len > 0){
+            str[len++] = '.';
+        }
+        memcpy(&str[len], &name[i+1], name[i]);
+        len += name[i];
+    }
+
+    str[len] = '\0';
+}
+
+/**
+ * First label (ie service instance name).
+ */
+static void name_label(const u8_t * name, char * str)
+{
+    memcpy(str, &name[1], name[0]);
+    str[name[0]] = '\0';
+}
+
+////// records
+
+static struct record_st * record_new(const u8_t * name, u16_t type, bool unique, u32_t ttl, u16_t rdlen, const u8_t * rdata)
+{
+    struct record_st * rec = calloc(1, sizeof(struct record_st) + rdlen);
+
+    memcpy(rec->name, name, name_len(name));
+    rec->type = type;
+    rec->rrclass = MDNS_CLASS_IN;
+    rec->unique = unique;
+    rec->ttl = ttl;
+    rec->rdlen = rdlen;
+    memcpy(rec->rdata, rdata, rdlen);
+
+    return rec;
+}
+
+static void record_push(struct record_st ** list, struct record_st * rec)
+{
+    rec->next = *list;
+    *list = rec;
+}
+
+static void record_free_all(struct record_st ** list)
+{
+    while(*list != NULL){
+        struct record_st * next = (*list)->next;
+        free(*list);
+        *list = next;
+    }
+}
+
+/**
+ * Name contained in rdata (PTR target, SRV target), NULL if not applicable.
+ */
+static const u8_t * record_rdata_name(const struct record_st * rec)
+{
+    if (rec->type == MDNS_TYPE_PTR && rec->rdlen > 0){
+        return rec->rdata;
+    }
+    if (rec->type == MDNS_TYPE_SRV && rec->rdlen > 6){
+        return &rec->rdata[6];
+    }
+    return NULL;
+}
+
+static bool record_eq(const struct record_st * a, const struct record_st * b)
+{
+    if (a->type != b->type || a->rrclass != b->rrclass || a->rdlen != b->rdlen || !name_eq(a->name, b->name)){
+        return false;
+    }
+
+    // names in rdata are case-insensitive as well
+    const u8_t * name = record_rdata_name(a);
+    if (name != NULL){
+        u16_t offset = name - a->rdata;
+        return memcmp(a->rdata, b->rdata, offset) == 0 && name_eq(name, &b->rdata[offset]);
+    }
+
+    return memcmp(a->rdata, b->rdata, a->rdlen) == 0;
+}
+
+/**
+ * Parses record at pos of message into rec (with names in rdata decompressed).
+ * Returns 1 if ok, 0 if record is to be ignored, -1 on error.
+ */
+static int record_parse(const u8_t * msg, u16_t msglen, u16_t * pos, struct record_st * rec)
+{
+    if (name_decode(msg, msglen, pos, rec->name) == 0 || *pos + 10 > msglen){
+        return -1;
+    }
+
+    const u8_t * p = &msg[*pos];
+    rec->type = (p[0] << 8) | p[1];
+    rec->rrclass = ((p[2] << 8) | p[3]) & ~MDNS_CLASS_FLUSH;
+    rec->unique = (p[2] & 0x80) != 0;
+    rec->ttl = ((u32_t)p[4] << 24) | ((u32_t)p[5] << 16) | ((u32_t)p[6] << 8) | p[7];
+    u16_t rdlen = (p[8] << 8) | p[9];
+
+    *pos += 10;
+
+    if (*pos + rdlen > msglen){
+        return -1;
+    }
+
+    u16_t rdpos = *pos;
+    *pos += rdlen;
+
+    if (rdlen > MDNS_RDATA_MAX){
+        return 0;
+    }
+
+    if (rec->type == MDNS_TYPE_PTR){
+        rec->rdlen = name_decode(msg, rdpos + rdlen, &rdpos, rec->rdata);
+        return rec->rdlen ? 1 : 0;
+    }
+    if (rec->type == MDNS_TYPE_SRV){
+        if (rdlen < 7){
+            return 0;
+        }
+        memcpy(rec->rdata, &msg[rdpos], 6);
+        rdpos += 6;
+        u16_t l = name_decode(msg, rdpos + rdlen - 6, &rdpos, &rec->rdata[6]);
+        if (l == 0 || l + 6 > MDNS_RDATA_MAX){
+            return 0;
+        }
+        rec->rdlen = 6 + l;
+        return 1;
+    }
+
+    memcpy(rec->rdata, &msg[rdpos], rdlen);
+    rec->rdlen = rdlen;
+
+    return 1;
+}
+
+////// packets
+
+static void pkt_init(struct pkt_st * pkt, u16_t id, u16_t flags)
+{
+    memset(pkt->counts, 0, sizeof(pkt->counts));
+    pkt->data[0] = id >> 8;
+    pkt->data[1] = id;
+    pkt->data[2] = flags >> 8;
+    pkt->data[3] = flags;
+    memset(&pkt->data[4], 0, 8);
+    pkt->len = 12;
+}
+
+static void pkt_finalize(struct pkt_st * pkt)
+{
+    for(int i = 0; i < 4; i++){
+        pkt->data[4 + 2*i] = pkt->counts[i] >> 8;
+        pkt->data[5 + 2*i] = pkt->counts[i];
+    }
+}
+
+static bool pkt_question(struct pkt_st * pkt, const u8_t * name, u16_t type, u16_t rrclass)
+{
+    u16_t nlen = name_len(name);
+
+    if (pkt->len + nlen + 4 > MDNS_PKT_MAX){
+        return false;
+    }
+
+    memcpy(&pkt->data[pkt->len], name, nlen);
+    pkt->len += nlen;
+    pkt->data[pkt->len++] = type >> 8;
+    pkt->data[pkt->len++] = type;
+    pkt->data[pkt->len++] = rrclass >> 8;
+    pkt->data[pkt->len++] = rrclass;
+
+    pkt->counts[0]++;
+
+    return true;
+}
+
+/**
+ * Adds record to given section (which must be added in order), names are written uncompressed.
+ */
+static bool pkt_record(struct pkt_st * pkt, int section, const struct record_st * rec, u32_t ttl, bool flush)
+{
+    u16_t nlen = name_len(rec->name);
+
+    if (pkt->len + nlen + 10 + rec->rdlen > MDNS_PKT_MAX){
+        return false;
+    }
+
+    u16_t rrclass = rec->rrclass | (flush ? MDNS_CLASS_FLUSH : 0);
+
+    u8_t * p = &pkt->data[pkt->len];
+    memcpy(p, rec->name, nlen);
+    p += nlen;
+    *p++ = rec->type >> 8;
+    *p++ = rec->type;
+    *p++ = rrclass >> 8;
+    *p++ = rrclass;
+    *p++ = ttl >> 24;
+    *p++ = ttl >> 16;
+    *p++ = ttl >> 8;
+    *p++ = ttl;
+    *p++ = rec->rdlen >> 8;
+    *p++ = rec->rdlen;
+    memcpy(p, rec->rdata, rec->rdlen);
+
+    pkt->len += nlen + 10 + rec->rdlen;
+    pkt->counts[section]++;
+
+    return true;
+}
+
+/**
+ * Sends packet to given address or, if NULL, to mDNS group on all interfaces.
+ */
+static void pkt_send(context_t * context, struct pkt_st * pkt, const struct sockaddr_in * to)
+{
+    pkt_finalize(pkt);
+
+    if (to != NULL){
+        sendto(context->sockfd, pkt->data, pkt->len, 0, (const struct sockaddr *)to, sizeof(struct sockaddr_in));
+        return;
+    }
+
+    struct sockaddr_in group = {
+        .sin_family = AF_INET,
+        .sin_port = htons(AES67_MDNS_NATIVE_PORT)
+    };
+    inet_pton(AF_INET, MDNS_GROUP, &group.sin_addr);
+
+    if (context->nifaces == 0){
+        sendto(context->sockfd, pkt->data, pkt->len, 0, (struct sockaddr *)&group, sizeof(group));
+        return;
+    }
+
+    for(size_t i = 0; i < context->nifaces; i++){
+        setsockopt(context->sockfd, IPPROTO_IP, IP_MULTICAST_IF, &context->ifaces[i], sizeof(struct in_addr));
+        sendto(context->sockfd, pkt->data, pkt->len, 0, (struct sockaddr *)&group, sizeof(group));
+    }
+}
+
+////// cache
+
+static u32_t cache_remaining(struct cache_st * entry, int64_t now)
+{
+    return entry->expires > now ? (entry->expires - now) / 1000 : 0;
+}
+
+static struct cache_st * cache_find(context_t * context, const u8_t * name, u16_t type, struct cache_st * after)
+{
+    struct cache_st * entry = after ? after->next : context->cache;
+
+    for(; entry != NULL; entry = entry->next){
+        if (entry->rr.type == type && name_eq(entry->rr.name, name)){
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static void cache_remove(context_t * context, struct cache_st * entry)
+{
+    struct cache_st ** pp = &context->cache;
+    while(*pp != entry){
+        pp = &(*pp)->next;
+    }
+    *pp = entry->next;
+    context->ncache--;
+    free(entry);
+}
+
+/**
+ * Adds or updates record, returns true if the record was not yet known.
+ */
+static bool cache_add(context_t * context, struct record_st * rec, int64_t now)
+{
+    // unique records replace any other data (received more than a second ago), RFC 6762 10.2
+    if (rec->unique && rec->ttl > 0){
+        for(struct cache_st * entry = context->cache; entry != NULL; entry = entry->next){
+            if (entry->rr.type == rec->type && entry->rr.rrclass == rec->rrclass && now - entry->received > 1000 &&
+                entry->expires > now + GOODBYE_DELAY && name_eq(entry->rr.name, rec->name) && !record_eq(&entry->rr, rec)){
+                entry->expires = now + GOODBYE_DELAY;
+            }
+        }
+    }
+
+    for(struct cache_st * entry = context->cache; entry != NULL; entry = entry->next){
+        if (record_eq(&entry->rr, rec)){
+            entry->received = now;
+            entry->refreshed = 0;
+            entry->rr.ttl = rec->ttl;
+            entry->expires = now + (rec->ttl ? 1000 * (int64_t)rec->ttl : GOODBYE_DELAY);
+            return false;
+        }
+    }
+
+    if (rec->ttl == 0){
+        return false;
+    }
+
+    // make room by dropping the record expiring first
+    if (context->ncache >= AES67_MDNS_NATIVE_CACHE_SIZE){
+        struct cache_st * first = context->cache;
+        for(struct cache_st * entry = context->cache; entry != NULL; entry = entry->next){
+            if (entry->expires < first->expires){
+                first = entry;
+            }
+        }
+        cache_remove(context, first);
+    }
+
+    struct cache_st * entry = calloc(1, sizeof(struct cache_st) + rec->rdlen);
+
+    memcpy(&entry->rr, rec, sizeof(struct record_st));
+    memcpy(entry->rr.rdata, rec->rdata, rec->rdlen);
+    entry->rr.next = NULL;
+    entry->received = now;
+    entry->expires = now + 1000 * (int64_t)rec->ttl;
+
+    entry->next = context->cache;
+    context->cache = entry;
+    context->ncache++;
+
+    return true;
+}
+
+static int64_t cache_refresh_due(struct cache_st * entry)
+{
+    if (entry->refreshed >= REFRESH_COUNT || entry->rr.ttl == 0){
+        return NEVER;
+    }
+    return entry->received + (int64_t)entry->rr.ttl * 10 * (80 + 5 * entry->refreshed);
+}
+
+////// resources
+
+static resource_t * resource_new(context_t * context, enum restype type, void * callback, void * user_data)
+{
+    resource_t * res = calloc(1, sizeof(resource_t));
+
+    res->context = context;
+    res->type = type;
+    res->callback = callback;
+    res->user_data = user_data;
+    res->started = now_ms();
+    res->next_tx = NEVER;
+
+    return res;
+}
+
+static void resource_link(context_t * context, resource_t * res)
+{
+    res->next = context->first_resource;
+    context->first_resource = res;
+}
+
+static void send_records(context_t * context, resource_t * res, bool goodbye);
+static void resource_delete(resource_t * res);
+
+static void instance_delete(struct instance_st * instance)
+{
+    if (instance->resolve != NULL){
+        resource_delete(instance->resolve);
+    }
+    free(instance);
+}
+
+static void resource_delete(resource_t * res)
+{
+    context_t * context = res->context;
+
+    resource_t ** pp = &context->first_resource;
+    while(*pp != NULL && *pp != res){
+        pp = &(*pp)->next;
+    }
+    if (*pp == res){
+        *pp = res->next;
+    }
+
+    if (res->state == resstate_announcing || res->state == resstate_registered){
+        send_records(context, res, true);
+    }
+
+    while(res->instances != NULL){
+        struct instance_st * next = res->instances->next;
+        instance_delete(res->instances);
+        res->instances = next;
+    }
+
+    record_free_all(&res->records);
+
+    free(res->type_str);
+    free(res->name_str);
+    free(res);
+}
+
+/**
+ * Deletes resources stopped from within callbacks.
+ */
+static void reap(context_t * context)
+{
+    resource_t * res = context->first_resource;
+    while(res != NULL){
+        resource_t * next = res->next;
+        if (res->stopped){
+            resource_delete(res);
+            // children might have been deleted aswell
+            next = context->first_resource;
+        }
+        res = next;
+    }
+}
+
+/**
+ * Service type without subtype, ie "_rtsp._tcp" for "_ravenna_session._sub._rtsp._tcp"
+ */
+static const char * main_type(const char * type)
+{
+    const char * sub = strstr(type, "._sub.");
+    return sub ? sub + sizeof("._sub.") - 1 : type;
+}
+
+////// querier
+
+static void question_add(context_t * context, const u8_t * name, u16_t type)
+{
+    for(size_t i = 0; i < context->nquestions; i++){
+        if (context->questions[i].type == type && name_eq(context->questions[i].name, name)){
+            return;
+        }
+    }
+    if (context->nquestions >= MAX_QUESTIONS){
+        return;
+    }
+    memcpy(context->questions[context->nquestions].name, name, name_len(name));
+    context->questions[context->nquestions].type = type;
+    context->nquestions++;
+}
+
+/**
+ * Sends pending questions including known answers (RFC 6762 7.1).
+ */
+static void questions_send(context_t * context, int64_t now)
+{
+    if (context->nquestions == 0){
+        return;
+    }
+
+    struct pkt_st pkt;
+    pkt_init(&pkt, 0, 0);
+
+    for(size_t i = 0; i < context->nquestions; i++){
+        pkt_question(&pkt, context->questions[i].name, context->questions[i].type, MDNS_CLASS_IN);
+    }
+
+    for(size_t i = 0; i < context->nquestions; i++){
+        struct cache_st * entry = NULL;
+        while((entry = cache_find(context, context->questions[i].name, context->questions[i].type, entry)) != NULL){
+            u32_t remaining = cache_remaining(entry, now);
+            if (remaining > entry->rr.ttl / 2){
+                if (!pkt_record(&pkt, 1, &entry->rr, remaining, false)){
+                    break;
+                }
+            }
+        }
+    }
+
+    pkt_send(context, &pkt, NULL);
+
+    context->nquestions = 0;
+}
+
+static const struct cache_st * resolve_srv(resource_t * res)
+{
+    return cache_find(res->context, res->qname, MDNS_TYPE_SRV, NULL);
+}
+
+/**
+ * Wether any (active) query is interested in given record (to be refreshed).
+ */
+static bool interested(context_t * context, const struct record_st * rec)
+{
+    for(resource_t * res = context->first_resource; res != NULL; res = res->next){
+        if (res->stopped){
+            continue;
+        }
+        if (res->type == restype_browse || res->type == restype_resolve2){
+            if (rec->type == MDNS_TYPE_PTR && name_eq(rec->name, res->qname)){
+                return true;
+            }
+        } else if (res->type == restype_resolve){
+            if ((rec->type == MDNS_TYPE_SRV || rec->type == MDNS_TYPE_TXT) && name_eq(rec->name, res->qname)){
+                return true;
+            }
+            const struct cache_st * srv = resolve_srv(res);
+            if ((rec->type == MDNS_TYPE_A || rec->type == MDNS_TYPE_AAAA) && srv != NULL && name_eq(rec->name, &srv->rr.rdata[6])){
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void resolve_report(resource_t * res, int64_t now)
+{
+    context_t * context = res->context;
+
+    const struct cache_st * srv = resolve_srv(res);
+    if (srv == NULL){
+        return;
+    }
+
+    const struct cache_st * txt = cache_find(context, res->qname, MDNS_TYPE_TXT, NULL);
+    if (txt == NULL && now - res->started < TXT_WAIT){
+        return;
+    }
+
+    const u8_t * target = &srv->rr.rdata[6];
+    u16_t port = (srv->rr.rdata[4] << 8) | srv->rr.rdata[5];
+
+    char hosttarget[MDNS_NAME_MAX];
+    name_tostr(target, hosttarget, sizeof(hosttarget));
+
+    char name[64];
+    name_label(res->qname, name);
+
+    resource_t * cbres = res->parent ? res->parent : res;
+
+    struct cache_st * addr = NULL;
+    bool found = false;
+
+    for(addr = context->cache; addr != NULL && !cbres->stopped; addr = addr->next){
+        if ((addr->rr.type != MDNS_TYPE_A || addr->rr.rdlen != 4) && (addr->rr.type != MDNS_TYPE_AAAA || addr->rr.rdlen != 16)){
+            continue;
+        }
+        if (!name_eq(addr->rr.name, target)){
+            continue;
+        }
+
+        if (!found){
+            res->state = resstate_resolved;
+            memcpy(res->host, target, name_len(target));
+            res->port = port;
+            found = true;
+        }
+
+        u32_t ttl = cache_remaining((struct cache_st *)srv, now);
+        if (cache_remaining(addr, now) < ttl){
+            ttl = cache_remaining(addr, now);
+        }
+
+        ((aes67_mdns_resolve_callback)res->callback)(cbres, aes67_mdns_result_discovered, cbres->type_str, name,
+                hosttarget, port, txt ? txt->rr.rdlen : 0, txt ? txt->rr.rdata : NULL,
+                addr->rr.type == MDNS_TYPE_A ? aes67_net_ipver_4 : aes67_net_ipver_6, addr->rr.rdata, ttl, res->user_data);
+    }
+}
+
+static resource_t * resolve_new(context_t * context, const u8_t * instance, resource_t * parent, void * callback, void * user_data)
+{
+    resource_t * res = resource_new(context, restype_resolve, callback, user_data);
+
+    res->parent = parent;
+    res->state = resstate_querying;
+    memcpy(res->qname, instance, name_len(instance));
+    res->interval = QUERY_INTERVAL_MIN;
+    res->next_tx = res->started + 20 + rand() % 100;
+
+    resource_link(context, res);
+
+    return res;
+}
+
+/**
+ * Matches known instances of browse (or resolve2) against cached PTR records.
+ */
+static void browse_update(resource_t * res)
+{
+    context_t * context = res->context;
+
+    for(struct instance_st * instance = res->instances; instance != NULL; instance = instance->next){
+        instance->seen = false;
+    }
+
+    struct cache_st * ptr = NULL;
+    while((ptr = cache_find(context, res->qname, MDNS_TYPE_PTR, ptr)) != NULL && !res->stopped){
+
+        struct instance_st * instance = res->instances;
+        while(instance != NULL && !name_eq(instance->name, ptr->rr.rdata)){
+            instance = instance->next;
+        }
+
+        if (instance != NULL){
+            instance->seen = true;
+            continue;
+        }
+
+        instance = calloc(1, sizeof(struct instance_st));
+        memcpy(instance->name, ptr->rr.rdata, ptr->rr.rdlen);
+        instance->seen = true;
+        instance->next = res->instances;
+        res->instances = instance;
+
+        if (res->type == restype_resolve2){
+            instance->resolve = resolve_new(context, instance->name, res, res->callback, res->user_data);
+        } else {
+            char name[64];
+            name_label(instance->name, name);
+            ((aes67_mdns_browse_callback)res->callback)(res, aes67_mdns_result_discovered, res->type_str, name, "local", res->user_data);
+        }
+    }
+
+    struct instance_st ** pp = &res->instances;
+    while(*pp != NULL && !res->stopped){
+        struct instance_st * instance = *pp;
+
+        if (instance->seen){
+            pp = &instance->next;
+            continue;
+        }
+
+        *pp = instance->next;
+
+        char name[64];
+        name_label(instance->name, name);
+
+        if (res->type == restype_resolve2){
+            // only report sessions that were reported as discovered
+            if (instance->resolve->state == resstate_resolved){
+                char hosttarget[MDNS_NAME_MAX];
+                name_tostr(instance->resolve->host, hosttarget, sizeof(hosttarget));
+                ((aes67_mdns_resolve_callback)res->callback)(res, aes67_mdns_result_terminated, res->type_str, name,
+                        hosttarget, instance->resolve->port, 0, NULL, aes67_net_ipver_undefined, NULL, 0, res->user_data);
+            }
+        } else {
+            ((aes67_mdns_browse_callback)res->callback)(res, aes67_mdns_result_terminated, res->type_str, name, "local", res->user_data);
+        }
+
+        instance_delete(instance);
+    }
+}
+
+/**
+ * Lets queries react to cache changes.
+ */
+static void queries_update(context_t * context, int64_t now)
+{
+    for(resource_t * res = context->first_resource; res != NULL; res = res->next){
+        if (res->stopped || (res->parent != NULL && res->parent->stopped)){
+            continue;
+        }
+        if (res->type == restype_browse || res->type == restype_resolve2){
+            browse_update(res);
+        } else if (res->type == restype_resolve && res->state == resstate_querying){
+            resolve_report(res, now);
+        }
+    }
+}
+
+////// responder
+
+/**
+ * Announcement (or goodbye) of all records of resource.
+ */
+static void send_records(context_t * context, resource_t * res, bool goodbye)
+{
+    struct pkt_st pkt;
+    pkt_init(&pkt, 0, MDNS_FLAGS_RESPONSE);
+
+    for(struct record_st * rec = res->records; rec != NULL; rec = rec->next){
+        if (!pkt_record(&pkt, 1, rec, goodbye ? 0 : rec->ttl, rec->unique && !goodbye)){
+            pkt_send(context, &pkt, NULL);
+            pkt_init(&pkt, 0, MDNS_FLAGS_RESPONSE);
+            pkt_record(&pkt, 1, rec, goodbye ? 0 : rec->ttl, rec->unique && !goodbye);
+        }
+    }
+
+    // host records of service (if not the local host)
+    if (!goodbye && res->type == restype_service && !name_eq(res->host, context->hostname)){
+        // (added through aes67_mdns_service_addrecord())
+    } else if (!goodbye && res->type == restype_service){
+        for(struct record_st * rec = context->host_records; rec != NULL; rec = rec->next){
+            if (!pkt_record(&pkt, 3, rec, rec->ttl, true)){
+                break;
+            }
+        }
+    }
+
+    pkt_send(context, &pkt, NULL);
+}
+
+static void send_probe(context_t * context, resource_t * res)
+{
+    struct pkt_st pkt;
+    pkt_init(&pkt, 0, 0);
+
+    for(struct record_st * rec = res->records; rec != NULL; rec = rec->next){
+        if (!rec->unique){
+            continue;
+        }
+        bool asked = false;
+        for(struct record_st * prev = res->records; prev != rec; prev = prev->next){
+            asked |= prev->unique && name_eq(prev->name, rec->name);
+        }
+        if (!asked){
+            pkt_question(&pkt, rec->name, MDNS_TYPE_ANY, MDNS_CLASS_IN | (res->count == 0 ? MDNS_CLASS_QU : 0));
+        }
+    }
+
+    for(struct record_st * rec = res->records; rec != NULL; rec = rec->next){
+        if (rec->unique){
+            pkt_record(&pkt, 2, rec, rec->ttl, false);
+        }
+    }
+
+    pkt_send(context, &pkt, NULL);
+}
+
+static void responder_result(resource_t * res, enum aes67_mdns_result result)
+{
+    if (res->type == restype_service){
+        ((aes67_mdns_service_callback)res->callback)(res, result, res->type_str, res->name_str, "local", res->user_data);
+    } else {
+        ((aes67_mdns_register_callback)res->callback)(res, result, res->user_data);
+    }
+}
+
+/**
+ * Checks received records against unique records being probed.
+ */
+static void check_conflict(context_t * context, const struct record_st * rec)
+{
+    for(resource_t * res = context->first_resource; res != NULL; res = res->next){
+        if (res->stopped || res->state != resstate_probing){
+            continue;
+        }
+        for(struct record_st * own = res->records; own != NULL; own = own->next){
+            if (own->unique && own->type == rec->type && name_eq(own->name, rec->name) && !record_eq(own, rec)){
+                res->state = resstate_failed;
+                res->next_tx = NEVER;
+                responder_result(res, aes67_mdns_result_collision);
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Collects own records that may be given as answers.
+ */
+static size_t own_records(context_t * context, const struct record_st ** recs, size_t max)
+{
+    size_t count = 0;
+
+    for(struct record_st * rec = context->host_records; rec != NULL && count < max; rec = rec->next){
+        recs[count++] = rec;
+    }
+    for(resource_t * res = context->first_resource; res != NULL; res = res->next){
+        if (res->stopped || (res->state != resstate_announcing && res->state != resstate_registered)){
+            continue;
+        }
+        for(struct record_st * rec = res->records; rec != NULL && count < max; rec = rec->next){
+            recs[count++] = rec;
+        }
+    }
+
+    return count;
+}
+
+static bool known_answer(const struct record_st * rec, struct record_st ** known, size_t nknown)
+{
+    for(size_t i = 0; i < nknown; i++){
+        if (known[i]->ttl >= rec->ttl / 2 && record_eq(known[i], rec)){
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Marks records of given name and type (any if 0) as additional record (unless already an answer).
+ */
+static void mark_additional(const struct record_st ** recs, u8_t * marks, size_t count, const u8_t * name, u16_t type)
+{
+    for(size_t i = 0; i < count; i++){
+        if (marks[i] == 0 && (type == 0 || recs[i]->type == type) && name_eq(recs[i]->name, name)){
+            marks[i] = 2;
+        }
+    }
+}
+
+static void respond(context_t * context, const u8_t * msg, u16_t msglen, const struct sockaddr_in * from)
+{
+    u16_t id = (msg[0] << 8) | msg[1];
+    u16_t qdcount = (msg[4] << 8) | msg[5];
+    u16_t ancount = (msg[6] << 8) | msg[7];
+
+    // legacy unicast (RFC 6762 6.7)
+    bool legacy = ntohs(from->sin_port) != AES67_MDNS_NATIVE_PORT;
+
+    struct question_st * questions = malloc(qdcount * sizeof(struct question_st) + 1);
+    u16_t * qclasses = malloc(qdcount * sizeof(u16_t) + 1);
+    bool unicast = qdcount > 0;
+
+    u16_t pos = 12;
+    u16_t nq = 0;
+
+    for(; nq < qdcount; nq++){
+        if (name_decode(msg, msglen, &pos, questions[nq].name) == 0 || pos + 4 > msglen){
+            break;
+        }
+        questions[nq].type = (msg[pos] << 8) | msg[pos+1];
+        qclasses[nq] = (msg[pos+2] << 8) | msg[pos+3];
+        unicast &= (qclasses[nq] & MDNS_CLASS_QU) != 0;
+        pos += 4;
+    }
+
+    // known answers
+    struct record_st ** known = calloc(ancount + 1, sizeof(struct record_st *));
+    size_t nknown = 0;
+
+    for(u16_t i = 0; i < ancount && nq == qdcount; i++){
+        struct record_st * rec = malloc(sizeof(struct record_st) + MDNS_RDATA_MAX);
+        int r = record_parse(msg, msglen, &pos, rec);
+        if (r == 1){
+            known[nknown++] = rec;
+        } else {
+            free(rec);
+            if (r < 0){
+                break;
+            }
+        }
+    }
+
+    size_t max = 64;
+    for(resource_t * res = context->first_resource; res != NULL; res = res->next){
+        for(struct record_st * rec = res->records; rec != NULL; rec = rec->next){
+            max++;
+        }
+    }
+    const struct record_st ** recs = malloc(max * sizeof(struct record_st *));
+    u8_t * marks = calloc(max, 1); // 1 = answer, 2 = additional
+    size_t count = own_records(context, recs, max);
+
+    bool any = false;
+
+    for(u16_t q = 0; q < nq; q++){
+        if ((qclasses[q] & ~MDNS_CLASS_QU) != MDNS_CLASS_IN && (qclasses[q] & ~MDNS_CLASS_QU) != MDNS_TYPE_ANY){
+            continue;
+        }
+        for(size_t i = 0; i < count; i++){
+            if ((questions[q].type == recs[i]->type || questions[q].type == MDNS_TYPE_ANY) &&
+                name_eq(questions[q].name, recs[i]->name) && !known_answer(recs[i], known, nknown)){
+                marks[i] = 1;
+                any = true;
+            }
+        }
+    }
+
+    if (any){
+        // additional records, RFC 6763 12
+        for(size_t i = 0; i < count; i++){
+            if (marks[i] != 1){
+                continue;
+            }
+            const u8_t * target = record_rdata_name(recs[i]);
+            if (recs[i]->type == MDNS_TYPE_PTR){
+                mark_additional(recs, marks, count, target, MDNS_TYPE_SRV);
+                mark_additional(recs, marks, count, target, MDNS_TYPE_TXT);
+            }
+        }
+        for(size_t i = 0; i < count; i++){
+            if (marks[i] != 0 && recs[i]->type == MDNS_TYPE_SRV){
+                mark_additional(recs, marks, count, record_rdata_name(recs[i]), MDNS_TYPE_A);
+                mark_additional(recs, marks, count, record_rdata_name(recs[i]), MDNS_TYPE_AAAA);
+            }
+        }
+
+        struct pkt_st pkt;
+        const struct sockaddr_in * to = (legacy || unicast) ? from : NULL;
+
+        pkt_init(&pkt, legacy ? id : 0, MDNS_FLAGS_RESPONSE);
+        if (legacy){
+            for(u16_t q = 0; q < nq; q++){
+                pkt_question(&pkt, questions[q].name, questions[q].type, MDNS_CLASS_IN);
+            }
+        }
+
+        for(int section = 1; section <= 3; section += 2){
+            for(size_t i = 0; i < count; i++){
+                if ((section == 1 && marks[i] != 1) || (section == 3 && marks[i] != 2)){
+                    continue;
+                }
+                u32_t ttl = legacy && recs[i]->ttl > 10 ? 10 : recs[i]->ttl;
+                bool flush = recs[i]->unique && !legacy;
+                if (!pkt_record(&pkt, section, recs[i], ttl, flush)){
+                    if (section == 3){
+                        break;
+                    }
+                    pkt_send(context, &pkt, to);
+                    pkt_init(&pkt, legacy ? id : 0, MDNS_FLAGS_RESPONSE);
+                    pkt_record(&pkt, section, recs[i], ttl, flush);
+                }
+            }
+        }
+
+        pkt_send(context, &pkt, to);
+    }
+
+    free(marks);
+    free(recs);
+    for(size_t i = 0; i < nknown; i++){
+        free(known[i]);
+    }
+    free(known);
+    free(qclasses);
+    free(questions);
+}
+
+static void receive(context_t * context, const u8_t * msg, u16_t msglen, const struct sockaddr_in * from, int64_t now)
+{
+    if (msglen < 12){
+        return;
+    }
+
+    u16_t flags = (msg[2] << 8) | msg[3];
+
+    // ignore other opcodes and responses with rcode set
+    if ((flags & 0x7800) != 0 || (flags & 0x000F) != 0){
+        return;
+    }
+
+    if ((flags & 0x8000) == 0){
+        respond(context, msg, msglen, from);
+        return;
+    }
+
+    // responses must be sent from the mdns port
+    if (ntohs(from->sin_port) != AES67_MDNS_NATIVE_PORT){
+        return;
+    }
+
+    u16_t qdcount = (msg[4] << 8) | msg[5];
+    u16_t rrcount = ((msg[6] << 8) | msg[7]) + ((msg[8] << 8) | msg[9]) + ((msg[10] << 8) | msg[11]);
+
+    u16_t pos = 12;
+
+    for(u16_t i = 0; i < qdcount; i++){
+        u8_t name[MDNS_NAME_MAX];
+        if (name_decode(msg, msglen, &pos, name) == 0 || pos + 4 > msglen){
+            return;
+        }
+        pos += 4;
+    }
+
+    struct record_st * rec = malloc(sizeof(struct record_st) + MDNS_RDATA_MAX);
+
+    bool changed = false;
+
+    for(u16_t i = 0; i < rrcount; i++){
+        int r = record_parse(msg, msglen, &pos, rec);
+        if (r < 0){
+            break;
+        }
+        if (r == 0 || rec->rrclass != MDNS_CLASS_IN){
+            continue;
+        }
+
+        check_conflict(context, rec);
+
+        changed |= cache_add(context, rec, now);
+        changed |= rec->ttl == 0;
+    }
+
+    free(rec);
+
+    if (changed){
+        queries_update(context, now);
+    }
+}
+
+////// timing
+
+static int64_t next_due(context_t * context, int64_t now)
+{
+    int64_t due = NEVER;
+
+    for(resource_t * res = context->first_resource; res != NULL; res = res->next){
+        if (res->next_tx < due){
+            due = res->next_tx;
+        }
+        // resolve without TXT
+        if (res->type == restype_resolve && res->state == resstate_querying && res->started + TXT_WAIT > now &&
+            res->started + TXT_WAIT < due && resolve_srv(res) != NULL){
+            due = res->started + TXT_WAIT;
+        }
+    }
+
+    for(struct cache_st * entry = context->cache; entry != NULL; entry = entry->next){
+        if (entry->expires < due){
+            due = entry->expires;
+        }
+        int64_t refresh = cache_refresh_due(entry);
+        if (refresh < due){
+            due = refresh;
+        }
+    }
+
+    return due;
+}
+
+static void timers_process(context_t * context, int64_t now)
+{
+    bool expired = false;
+
+    // expire and refresh cache entries
+    struct cache_st * entry = context->cache;
+    while(entry != NULL){
+        struct cache_st * next = entry->next;
+
+        if (entry->expires <= now){
+            cache_remove(context, entry);
+            expired = true;
+        } else {
+            while(cache_refresh_due(entry) <= now){
+                if (entry->refreshed++ == 0 && interested(context, &entry->rr)){
+                    question_add(context, entry->rr.name, entry->rr.type);
+                }
+            }
+        }
+
+        entry = next;
+    }
+
+    if (expired){
+        queries_update(context, now);
+    }
+
+    for(resource_t * res = context->first_resource; res != NULL; res = res->next){
+
+        if (res->stopped){
+            continue;
+        }
+
+        if (res->type == restype_resolve && res->state == resstate_querying){
+            resolve_report(res, now);
+        }
+
+        if (res->next_tx > now){
+            continue;
+        }
+
+        switch(res->state){
+            case resstate_querying:
+                if (res->type == restype_resolve){
+                    question_add(context, res->qname, MDNS_TYPE_SRV);
+                    question_add(context, res->qname, MDNS_TYPE_TXT);
+                    const struct cache_st * srv = resolve_srv(res);
+                    if (srv != NULL){
+                        question_add(context, &srv->rr.rdata[6], MDNS_TYPE_A);
+                        question_add(context, &srv->rr.rdata[6], MDNS_TYPE_AAAA);
+                    }
+                } else {
+                    question_add(context, res->qname, MDNS_TYPE_PTR);
+                }
+                res->next_tx = now + res->interval;
+                res->interval = res->interval * 2 > QUERY_INTERVAL_MAX ? QUERY_INTERVAL_MAX : res->interval * 2;
+                break;
+
+            case resstate_probing:
+                if (res->count < PROBE_COUNT){
+                    send_probe(context, res);
+                    res->count++;
+                    res->next_tx = now + PROBE_INTERVAL;
+                } else {
+                    res->state = resstate_announcing;
+                    res->count = 0;
+                    res->next_tx = now;
+                }
+                if (res->state != resstate_announcing){
+                    break;
+                }
+                // fall through
+
+            case resstate_announcing:
+                send_records(context, res, false);
+                if (++res->count >= ANNOUNCE_COUNT){
+                    res->state = resstate_registered;
+                    res->next_tx = NEVER;
+                } else {
+                    res->next_tx = now + ANNOUNCE_INTERVAL;
+                }
+                if (res->count == 1){
+                    responder_result(res, aes67_mdns_result_registered);
+                }
+                break;
+
+            default:
+                res->next_tx = NEVER;
+                break;
+        }
+    }
+
+    questions_send(context, now);
+}
+
+static void timer_arm(context_t * context, int64_t now)
+{
+#if AES67_MDNS_NATIVE_TIMERFD == 1
+    int64_t due = next_due(context, now);
+
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+
+    if (due != NEVER){
+        int64_t msec = due > now ? due - now : 1;
+        its.it_value.tv_sec = msec / 1000;
+        its.it_value.tv_nsec = (msec % 1000) * 1000000;
+    }
+
+    timerfd_settime(context->timerfd, 0, &its, NULL);
+#endif
+}
+
+////// setup
+
+static void host_setup(context_t * context)
+{
+    char hostname[64];
+
+    if (gethostname(hostname, sizeof(hostname)) != 0){
+        strcpy(hostname, "aes67");
+    }
+    hostname[sizeof(hostname)-1] = '\0';
+
+    char * dot = strchr(hostname, '.');
+    if (dot != NULL){
+        *dot = '\0';
+    }
+
+    name_build(context->hostname, hostname, NULL, NULL);
+
+    struct ifaddrs * ifaddrs = NULL;
+    if (getifaddrs(&ifaddrs) == 0){
+        for(struct ifaddrs * ifa = ifaddrs; ifa != NULL && context->nifaces < MAX_IFACES; ifa = ifa->ifa_next){
+            if (ifa->ifa_addr == NULL || ifa->ifa_addr->sa_family != AF_INET || (ifa->ifa_flags & IFF_UP) == 0 ||
+                (ifa->ifa_flags & IFF_MULTICAST) == 0){
+                continue;
+            }
+            context->ifaces[context->nifaces++] = ((struct sockaddr_in *)ifa->ifa_addr)->sin_addr;
+        }
+        freeifaddrs(ifaddrs);
+    }
+
+    for(size_t i = 0; i < context->nifaces; i++){
+        // loopback addresses are of no use to others (unless there is nothing else)
+        if ((ntohl(context->ifaces[i].s_addr) >> 24) == 127 && context->nifaces > 1){
+            continue;
+        }
+        record_push(&context->host_records, record_new(context->hostname, MDNS_TYPE_A, true, MDNS_TTL_HOST, 4, (u8_t*)&context->ifaces[i]));
+    }
+}
+
+static int socket_setup(context_t * context)
+{
+    context->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (context->sockfd == -1){
+        perror("mdns socket()");
+        return EXIT_FAILURE;
+    }
+
+    int yes = 1;
+    setsockopt(context->sockfd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+#ifdef SO_REUSEPORT
+    setsockopt(context->sockfd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes));
+#endif
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(AES67_MDNS_NATIVE_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY)
+    };
+
+    if (bind(context->sockfd, (struct sockaddr *)&addr, sizeof(addr)) == -1){
+        perror("mdns bind()");
+        return EXIT_FAILURE;
+    }
+
+    u8_t ttl = 255;
+    setsockopt(context->sockfd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    u8_t loop = 1;
+    setsockopt(context->sockfd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+    int uttl = 255;
+    setsockopt(context->sockfd, IPPROTO_IP, IP_TTL, &uttl, sizeof(uttl));
+
+    struct ip_mreq mreq;
+    inet_pton(AF_INET, MDNS_GROUP, &mreq.imr_multiaddr);
+
+    if (context->nifaces == 0){
+        mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+        if (setsockopt(context->sockfd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == -1){
+            perror("mdns IP_ADD_MEMBERSHIP");
+            return EXIT_FAILURE;
+        }
+    }
+    for(size_t i = 0; i < context->nifaces; i++){
+        mreq.imr_interface = context->ifaces[i];
+        setsockopt(context->sockfd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+    }
+
+    int flags = fcntl(context->sockfd, F_GETFL, 0);
+    fcntl(context->sockfd, F_SETFL, flags | O_NONBLOCK);
+
+    context->fds[context->nfds++] = context->sockfd;
+
+#if AES67_MDNS_NATIVE_TIMERFD == 1
+    context->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (context->timerfd == -1){
+        perror("mdns timerfd_create()");
+        return EXIT_FAILURE;
+    }
+    context->fds[context->nfds++] = context->timerfd;
+#endif
+
+    return EXIT_SUCCESS;
+}
+
+aes67_mdns_context_t aes67_mdns_new(void)
+{
+    context_t * context = calloc(1, sizeof(context_t));
+
+    context->sockfd = -1;
+    context->timerfd = -1;
+
+    host_setup(context);
+
+    if (socket_setup(context)){
+        aes67_mdns_delete(context);
+        return NULL;
+    }
+
+    return context;
+}
+
+void aes67_mdns_delete(aes67_mdns_context_t ctx)
+{
+    assert(ctx != NULL);
+
+    context_t * context = ctx;
+
+    while(context->first_resource != NULL){
+        resource_delete(context->first_resource);
+    }
+
+    while(context->cache != NULL){
+        cache_remove(context, context->cache);
+    }
+
+    record_free_all(&context->host_records);
+
+    if (context->sockfd != -1){
+        close(context->sockfd);
+    }
+    if (context->timerfd != -1){
+        close(context->timerfd);
+    }
+
+    free(context);
+}
+
+////// API
+
+static aes67_mdns_resource_t browse_start(context_t * context, enum restype type, const char * regtype, const char * domain, void * callback, void * user_data)
+{
+    assert(context != NULL);
+    assert(regtype != NULL);
+
+    resource_t * res = resource_new(context, type, callback, user_data);
+
+    if (name_build(res->qname, NULL, regtype, domain) == 0){
+        free(res);
+        return NULL;
+    }
+
+    res->type_str = strdup(regtype);
+    res->state = resstate_querying;
+    res->interval = QUERY_INTERVAL_MIN;
+    res->next_tx = res->started + 20 + rand() % 100;
+
+    resource_link(context, res);
+
+    // known instances
+    browse_update(res);
+
+    timer_arm(context, now_ms());
+
+    return res;
+}
+
+aes67_mdns_resource_t
+aes67_mdns_browse_start(aes67_mdns_context_t ctx, const char *type, const char *domain,
+                        aes67_mdns_browse_callback callback, void *user_data)
+{
+    return browse_start(ctx, restype_browse, type, domain, callback, user_data);
+}
+
+aes67_mdns_resource_t
+aes67_mdns_resolve_start(aes67_mdns_context_t ctx, const char *type, const char *name, const char *domain,
+                         aes67_mdns_resolve_callback callback, void *user_data)
+{
+    assert(ctx != NULL);
+    assert(type != NULL);
+    assert(name != NULL);
+
+    context_t * context = ctx;
+
+    u8_t instance[MDNS_NAME_MAX];
+    if (name_build(instance, name, main_type(type), domain) == 0){
+        return NULL;
+    }
+
+    resource_t * res = resolve_new(context, instance, NULL, callback, user_data);
+    res->type_str = strdup(type);
+
+    timer_arm(context, now_ms());
+
+    return res;
+}
+
+aes67_mdns_resource_t
+aes67_mdns_resolve2_start(aes67_mdns_context_t ctx, const char *type, const char *domain,
+                          aes67_mdns_resolve_callback callback, void *user_data)
+{
+    return browse_start(ctx, restype_resolve2, type, domain, callback, user_data);
+}
+
+aes67_mdns_resource_t
+aes67_mdns_service_start(aes67_mdns_context_t ctx, const char *type, const char *name, const char *domain,
+                         const char * host, u16_t port, u16_t txtlen, const u8_t * txt, aes67_mdns_service_callback callback, void *user_data)
+{
+    assert(ctx != NULL);
+    assert(type != NULL);
+    assert(name != NULL);
+
+    context_t * context = ctx;
+
+    u8_t instance[MDNS_NAME_MAX];
+    u8_t service[MDNS_NAME_MAX];
+    u8_t services[MDNS_NAME_MAX];
+
+    if (name_build(instance, name, main_type(type), domain) == 0 || name_build(service, NULL, main_type(type), domain) == 0){
+        return NULL;
+    }
+    name_build(services, NULL, "_services._dns-sd._udp", domain);
+
+    resource_t * res = resource_new(context, restype_service, callback, user_data);
+
+    res->type_str = strdup(type);
+    res->name_str = strdup(name);
+    res->state = resstate_pending;
+    res->port = port;
+
+    if (host == NULL){
+        memcpy(res->host, context->hostname, name_len(context->hostname));
+    } else if (name_build(res->host, NULL, host, strchr(host, '.') ? "" : "local") == 0){
+        resource_delete(res);
+        return NULL;
+    }
+
+    // SRV
+    u8_t rdata[6 + MDNS_NAME_MAX];
+    memset(rdata, 0, 4);
+    rdata[4] = port >> 8;
+    rdata[5] = port;
+    u16_t hlen = name_len(res->host);
+    memcpy(&rdata[6], res->host, hlen);
+
+    record_push(&res->records, record_new(services, MDNS_TYPE_PTR, false, MDNS_TTL_OTHER, name_len(service), service));
+    record_push(&res->records, record_new(service, MDNS_TYPE_PTR, false, MDNS_TTL_OTHER, name_len(instance), instance));
+
+    if (main_type(type) != type){
+        u8_t subtype[MDNS_NAME_MAX];
+        if (name_build(subtype, NULL, type, domain) == 0){
+            resource_delete(res);
+            return NULL;
+        }
+        record_push(&res->records, record_new(subtype, MDNS_TYPE_PTR, false, MDNS_TTL_OTHER, name_len(instance), instance));
+    }
+
+    // (empty TXT records consist of a single empty string)
+    u8_t empty = 0;
+    record_push(&res->records, record_new(instance, MDNS_TYPE_TXT, true, MDNS_TTL_OTHER, txtlen ? txtlen : 1, txtlen ? txt : &empty));
+    record_push(&res->records, record_new(instance, MDNS_TYPE_SRV, true, MDNS_TTL_HOST, 6 + hlen, rdata));
+
+    resource_link(context, res);
+
+    return res;
+}
+
+aes67_mdns_resource_t
+aes67_mdns_service_addrecord(aes67_mdns_context_t ctx, aes67_mdns_resource_t service, u16_t rrtype, u16_t rdlen, const u8_t * rdata, u32_t ttl)
+{
+    assert(ctx != NULL);
+    assert(service != NULL);
+
+    resource_t * res = service;
+
+    if (res->type != restype_service || res->state != resstate_pending){
+        fprintf(stderr, "invalid resource type\n");
+        return NULL;
+    }
+
+    // like avahi, records are added for the host (ie A/AAAA records of a host given to aes67_mdns_service_start())
+    record_push(&res->records, record_new(res->host, rrtype, true, ttl, rdlen, rdata));
+
+    return res;
+}
+
+aes67_mdns_resource_t
+aes67_mdns_service_commit(aes67_mdns_context_t ctx, aes67_mdns_resource_t service)
+{
+    assert(ctx != NULL);
+    assert(service != NULL);
+
+    context_t * context = ctx;
+    resource_t * res = service;
+
+    if (res->state != resstate_pending){
+        return NULL;
+    }
+
+    res->state = resstate_probing;
+    res->count = 0;
+    res->next_tx = now_ms() + rand() % PROBE_INTERVAL;
+
+    timer_arm(context, now_ms());
+
+    return res;
+}
+
+aes67_mdns_resource_t
+aes67_mdns_register_start(aes67_mdns_context_t ctx, const char *fullname, u16_t rrtype, u16_t rrclass, u16_t rdlen, const u8_t * rdata, u32_t ttl, aes67_mdns_register_callback callback, void *user_data)
+{
+    assert(ctx != NULL);
+    assert(fullname != NULL);
+
+    context_t * context = ctx;
+
+    u8_t name[MDNS_NAME_MAX];
+    if (name_build(name, NULL, fullname, "") == 0){
+        return NULL;
+    }
+
+    resource_t * res = resource_new(context, restype_register, callback, user_data);
+
+    struct record_st * rec = record_new(name, rrtype, true, ttl, rdlen, rdata);
+    rec->rrclass = rrclass;
+    record_push(&res->records, rec);
+
+    res->state = resstate_probing;
+    res->next_tx = now_ms() + rand() % PROBE_INTERVAL;
+
+    resource_link(context, res);
+
+    timer_arm(context, now_ms());
+
+    return res;
+}
+
+void aes67_mdns_stop(aes67_mdns_resource_t res)
+{
+    assert(res != NULL);
+
+    resource_t * r = res;
+
+    // resources must not disappear while (possibly) iterated
+    if (r->context->processing){
+        r->stopped = true;
+        return;
+    }
+
+    resource_delete(r);
+}
+
+void aes67_mdns_process(aes67_mdns_context_t ctx, int timeout_msec)
+{
+    assert(ctx != NULL);
+
+    context_t * context = ctx;
+
+    int64_t now = now_ms();
+
+    if (timeout_msec != 0){
+        int64_t due = next_due(context, now);
+        int64_t wait = due == NEVER ? -1 : (due > now ? due - now : 0);
+
+        if (timeout_msec > 0 && (wait < 0 || wait > timeout_msec)){
+            wait = timeout_msec;
+        }
+
+        struct pollfd pfd = {
+            .fd = context->sockfd,
+            .events = POLLIN
+        };
+        poll(&pfd, 1, (int)wait);
+
+        now = now_ms();
+    }
+
+#if AES67_MDNS_NATIVE_TIMERFD == 1
+    uint64_t expirations;
+    if (read(context->timerfd, &expirations, sizeof(expirations))){}
+#endif
+
+    context->processing = true;
+
+    u8_t buf[MDNS_RXBUF_SIZE];
+    struct sockaddr_in from;
+    socklen_t fromlen = sizeof(from);
+    ssize_t len;
+
+    while((len = recvfrom(context->sockfd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &fromlen)) > 0){
+        receive(context, buf, len, &from, now);
+        fromlen = sizeof(from);
+    }
+
+    timers_process(context, now);
+
+    context->processing = false;
+
+    reap(context);
+
+    timer_arm(context, now);
+}
+
+void aes67_mdns_getsockfds(aes67_mdns_context_t ctx, int * fds[], size_t *count)
+{
+    assert(ctx != NULL);
+    assert(fds != NULL);
+    assert(count != NULL);
+
+    context_t * context = ctx;
+
+    *fds = context->fds;
+    *count = context->nfds;
+}
+
+int aes67_mdns_geterrcode(aes67_mdns_resource_t res)
+{
+    assert(res != NULL);
+
+    resource_t * r = res;
+
+    return r->error_code;
+}
@@ -32,6 +32,7 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <ctype.h>
+#include <syslog.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -133,21 +134,26 @@ static void publish_callback(aes67_mdns_resource_t res, enum aes67_mdns_result r
 static void block_until_event(){
 
     int nfds = 0;
-    fd_set rfds, xfds;
+    fd_set rfds, wfds, xfds;
 //    sigset_t sigmask;
 
     FD_ZERO(&rfds);
+    FD_ZERO(&wfds);
     FD_ZERO(&xfds);
 
     if (opts.rtsp){
-        nfds = rtsp_srv.listen_sockfd;
-        FD_SET(rtsp_srv.listen_sockfd, &rfds);
-        FD_SET(rtsp_srv.listen_sockfd, &xfds);
-        if (rtsp_srv.client_sockfd != -1){
-            FD_SET(rtsp_srv.client_sockfd, &rfds);
-            FD_SET(rtsp_srv.client_sockfd, &xfds);
-            if (rtsp_srv.client_sockfd > rtsp_srv.listen_sockfd){
-                nfds = rtsp_srv.client_sockfd;
+        struct pollfd fds[AES67_RTSP_SRV_MAXPOLLFDS];
+        size_t nrtsp = aes67_rtsp_srv_getpollfds(&rtsp_srv, fds, AES67_RTSP_SRV_MAXPOLLFDS);
+        for (size_t i = 0; i < nrtsp; i++) {
+            if (fds[i].events & POLLIN){
+                FD_SET(fds[i].fd, &rfds);
+            }
+            if (fds[i].events & POLLOUT){
+                FD_SET(fds[i].fd, &wfds);
+            }
+            FD_SET(fds[i].fd, &xfds);
+            if (fds[i].fd > nfds) {
+                nfds = fds[i].fd;
             }
         }
     }
@@ -165,8 +171,14 @@ static void block_until_event(){
 
     nfds++;
 
+    // wake up regularly to let rtsp server time out stale connections
+    struct timeval timeout = {
+        .tv_sec = 1,
+        .tv_usec = 0
+    };
+
     // just wait until something interesting happens
-    select(nfds, &rfds, NULL, &xfds, NULL);
+    select(nfds, &rfds, &wfds, &xfds, opts.rtsp ? &timeout : NULL);
 }
 
 static int mdns_setup()
@@ -310,38 +322,40 @@ u16_t aes67_rtsp_srv_sdp_getter(struct aes67_rtsp_srv * srv, void * sdpref, u8_t
 
 void aes67_rtsp_srv_http_handler(struct aes67_rtsp_srv * srv, const enum aes67_rtsp_srv_method method, char * uri, u8_t urilen, u8_t * buf, u16_t * len, u16_t maxlen, bool * more, void ** response_state)
 {
-    static struct {
+    // (per connection) state of a file transmission that did not fit the internal buffer at once
+    struct http_state {
         int fd;
         off_t filesize;
         off_t read;
-    } state = {
-        .fd = -1
-    };
+    } * state = *response_state;
 
-    // if data is set, this is from a previous call but the file to be transmitted was to big for the internal buffer to send at once.
-    // possibly the
-    if (*response_state){
+    // if state is set, this is from a previous call but the file to be transmitted was to big for the internal buffer to send at once.
+    if (state){
 
         // premature termination
-        if (state.fd != -1){
-            close(state.fd);
+        if (buf == NULL){
+            close(state->fd);
+            free(state);
+            *response_state = NULL;
+            *more = false;
             return;
         }
 
         // continue passing file contents to server
 
-        ssize_t r = read(state.fd, buf + *len, maxlen);
+        ssize_t r = read(state->fd, buf, maxlen);
 
         if (r > 0){
             *len = r;
-            state.read += r;
+            state->read += r;
         }
 
-        *more = state.read < state.filesize;
+        *more = r > 0 && state->read < state->filesize;
 
         if (!*more){
-            close(state.fd);
-            state.fd = -1;
+            close(state->fd);
+            free(state);
+            *response_state = NULL;
         }
 
         return;
@@ -431,8 +445,8 @@ void aes67_rtsp_srv_http_handler(struct aes67_rtsp_srv * srv, const enum aes67_r
         }
     }
 
-    state.fd = open(path, O_RDONLY);
-    if (state.fd == -1){
+    int fd = open(path, O_RDONLY);
+    if (fd == -1){
         fprintf(stderr, "ERROR 500 2 \n");
         *len = snprintf((char*)buf, maxlen,
                         "HTTP/1.1 500 Internal Server Error\r\n"
@@ -442,8 +456,6 @@ void aes67_rtsp_srv_http_handler(struct aes67_rtsp_srv * srv, const enum aes67_r
         return;
     }
 
-    state.filesize = st.st_size;
-
     *len = snprintf((char*)buf, maxlen,
                     "HTTP/1.1 200 OK\r\n"
                     "Connection: close\r\n"
@@ -452,24 +464,28 @@ void aes67_rtsp_srv_http_handler(struct aes67_rtsp_srv * srv, const enum aes67_r
                     , st.st_size
     );
 
-    state.read = 0;
-
     ssize_t remaining = maxlen - *len;
-    ssize_t r = read(state.fd, buf + *len, remaining);
+    ssize_t r = read(fd, buf + *len, remaining);
 
     if (r > 0){
         *len += r;
-        state.read += r;
+    } else {
+        r = 0;
     }
 
-    *more = state.read < state.filesize;
+    *more = r < st.st_size;
 
     if (!*more){
-        close(state.fd);
-        state.fd = -1;
+        close(fd);
+        return;
     }
 
-    *response_state = &state;
+    state = malloc(sizeof(struct http_state));
+    state->fd = fd;
+    state->filesize = st.st_size;
+    state->read = r;
+
+    *response_state = state;
 }
 
 static int load_sdpres(char * fname, size_t maxlen)
@@ -680,6 +696,10 @@ int main(int argc, char * argv[])
         return EXIT_FAILURE;
     }
 
+    // (debug) messages of rtsp server go to stderr only if verbose
+    openlog(argv0, opts.verbose ? LOG_PERROR : 0, LOG_USER);
+    setlogmask(LOG_UPTO(opts.verbose ? LOG_DEBUG : LOG_NOTICE));
+
     for (int i = optind; i < argc; i++) {
         if (load_sdpres(argv[i], 1024)) {
             fprintf(stderr, "sdp load error\n");
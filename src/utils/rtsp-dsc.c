@@ -21,6 +21,8 @@
 //#include "aes67/debug.h"
 
 #include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/socket.h>
@@ -39,6 +41,10 @@ void aes67_rtsp_dsc_init(struct aes67_rtsp_dsc_res_st * res, bool blocking)
     res->state = aes67_rtsp_dsc_state_bored;
     res->sockfd = -1;
     res->blocking = blocking;
+    res->keepalive = false;
+    res->reused = false;
+    res->cseq = 0;
+    res->deadline = 0;
 }
 
 void aes67_rtsp_dsc_deinit(struct aes67_rtsp_dsc_res_st * res)
@@ -46,44 +52,118 @@ void aes67_rtsp_dsc_deinit(struct aes67_rtsp_dsc_res_st * res)
     aes67_rtsp_dsc_stop(res);
 }
 
-int aes67_rtsp_dsc_start(
-        struct aes67_rtsp_dsc_res_st * res,
-        const enum aes67_net_ipver ipver,
-        const u8_t *ip,
-        const u16_t port,
-        const char * encoded_uri
-)
+static bool header_name_eq(const u8_t * name, size_t len, const char * expected)
 {
-    assert(res != NULL);
-    assert(AES67_NET_IPVER_ISVALID(ipver));
-    assert(ip != NULL);
-    assert(encoded_uri != NULL);
+    if (len != strlen(expected)){
+        return false;
+    }
+    for(size_t i = 0; i < len; i++){
+        u8_t a = name[i], b = expected[i];
+        if ('A' <= a && a <= 'Z') a += 'a' - 'A';
+        if ('A' <= b && b <= 'Z') b += 'a' - 'A';
+        if (a != b){
+            return false;
+        }
+    }
+    return true;
+}
 
-    // can not start when an operation is pending
-    if (res->state == aes67_rtsp_dsc_state_querying || res->state == aes67_rtsp_dsc_state_awaiting_response){
-//        fprintf(stderr, "operation pending\n");
+/**
+ * Copies (trimmed) header value, empty if it does not fit.
+ */
+static void header_value(const u8_t * delim, const u8_t * eol, char * value, size_t maxlen)
+{
+    const u8_t * start = delim + 1;
+    while(start < eol && *start == ' '){
+        start++;
+    }
+    while(eol > start && (eol[-1] == '\r' || eol[-1] == '\n' || eol[-1] == ' ')){
+        eol--;
+    }
+
+    size_t len = eol - start;
+    if (len >= maxlen){
+        len = 0;
+    }
+
+    memcpy(value, start, len);
+    value[len] = '\0';
+}
+
+static void rtsp_dsc_fail(struct aes67_rtsp_dsc_res_st * res)
+{
+    if (res->sockfd != -1){
+        close(res->sockfd);
+        res->sockfd = -1;
+    }
+    // (failed requests are reported with statuscode 0, even if a status line was received)
+    res->statuscode = 0;
+    res->contentlen = 0;
+    res->state = aes67_rtsp_dsc_state_done;
+}
+
+static int rtsp_dsc_reconnect(struct aes67_rtsp_dsc_res_st * res);
+
+static int rtsp_dsc_send(struct aes67_rtsp_dsc_res_st * res)
+{
+    // (request is small enough to fit into the socket buffer)
+    if (send(res->sockfd, res->buf, res->buflen, MSG_NOSIGNAL) != res->buflen) {
+        if (res->reused && (errno == EPIPE || errno == ECONNRESET)){
+            return rtsp_dsc_reconnect(res);
+        }
+        res->statuscode = errno;
+        close(res->sockfd);
+        res->sockfd = -1;
+        res->state = aes67_rtsp_dsc_state_bored;
+        syslog(LOG_ERR,"rtsp write(): %s", strerror(errno));
         return EXIT_FAILURE;
     }
-    // mark as busy
-    res->state = aes67_rtsp_dsc_state_querying;
 
+    res->reqlen = res->buflen;
+    res->buflen = 0;
+    res->statuscode = 0;
+    res->hdrlen = 0;
+    res->contentlen = 0;
+    res->etag[0] = '\0';
+    res->lastmod[0] = '\0';
+
+    res->state = aes67_rtsp_dsc_state_awaiting_response;
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Nothing (more) to read, either still within time or an actual failure.
+ */
+static void rtsp_dsc_read_failed(struct aes67_rtsp_dsc_res_st * res)
+{
+    if ((errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) && (res->blocking || time(NULL) < res->deadline)){
+        return;
+    }
+    rtsp_dsc_fail(res);
+}
+
+/**
+ * Connects to res->addr and sends the request prepared in res->buf (once connected, if non-blocking).
+ */
+static int rtsp_dsc_connect(struct aes67_rtsp_dsc_res_st * res)
+{
     struct sockaddr_storage server;
 
     uint8_t in_len = 0;
-    if (ipver == aes67_net_ipver_4){
+    if (res->addr.ipver == aes67_net_ipver_4){
         in_len = sizeof(struct sockaddr_in);
         ((struct sockaddr_in *)&server)->sin_family = AF_INET;
-        ((struct sockaddr_in *)&server)->sin_port = htons(port);
-        ((struct sockaddr_in *)&server)->sin_addr.s_addr = *(u32_t *) ip;
-//        server.s
-    } else if (ipver == aes67_net_ipver_6){
+        ((struct sockaddr_in *)&server)->sin_port = htons(res->addr.port);
+        ((struct sockaddr_in *)&server)->sin_addr.s_addr = *(u32_t *) res->addr.ip;
+    } else if (res->addr.ipver == aes67_net_ipver_6){
         in_len = sizeof(struct sockaddr_in6);
         ((struct sockaddr_in6 *)&server)->sin6_family = AF_INET6;
-        ((struct sockaddr_in6 *)&server)->sin6_port = htons(port);
-        memcpy(&((struct sockaddr_in6 *)&server)->sin6_addr, ip, AES67_NET_IPVER_SIZE(ipver));
+        ((struct sockaddr_in6 *)&server)->sin6_port = htons(res->addr.port);
+        memcpy(&((struct sockaddr_in6 *)&server)->sin6_addr, res->addr.ip, AES67_NET_IPVER_SIZE(res->addr.ipver));
     }
 
-    res->sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    res->sockfd = socket(server.ss_family, SOCK_STREAM, 0);
 
     if (res->sockfd == -1) {
         res->statuscode = errno;
@@ -92,55 +172,141 @@ int aes67_rtsp_dsc_start(
         return EXIT_FAILURE;
     }
 
-    if (connect(res->sockfd, (struct sockaddr *) &server, in_len) < 0) {
-        res->statuscode = errno;
-        res->state = aes67_rtsp_dsc_state_bored;
-        syslog(LOG_ERR, "rtsp connect(): %s", strerror(errno));
-        return EXIT_FAILURE;
-    }
-
     if (!res->blocking){
-        // set non-blocking
+        // set non-blocking (before connecting, so an unreachable device does not block)
         int flags = fcntl(res->sockfd, F_GETFL, 0);
         if (fcntl(res->sockfd, F_SETFL, flags | O_NONBLOCK) == -1){
-//            fprintf(stderr, "couldn't non-block\n");
             syslog(LOG_ERR, "rtsp fcntl(): %s", strerror(errno));
+            close(res->sockfd);
+            res->sockfd = -1;
             res->state = aes67_rtsp_dsc_state_bored;
             return EXIT_FAILURE;
         }
     }
 
+    if (connect(res->sockfd, (struct sockaddr *) &server, in_len) < 0) {
+
+        // completes asynchronously, request is sent once connected (see aes67_rtsp_dsc_process())
+        if (errno == EINPROGRESS && !res->blocking){
+            res->state = aes67_rtsp_dsc_state_connecting;
+            return EXIT_SUCCESS;
+        }
+
+        res->statuscode = errno;
+        close(res->sockfd);
+        res->sockfd = -1;
+        res->state = aes67_rtsp_dsc_state_bored;
+        syslog(LOG_ERR, "rtsp connect(): %s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    return rtsp_dsc_send(res);
+}
+
+/**
+ * A kept alive connection may have been closed by the device in the meantime (before it got the request),
+ * which is not a failure of the device: the request is repeated once on a new connection.
+ */
+static int rtsp_dsc_reconnect(struct aes67_rtsp_dsc_res_st * res)
+{
+    syslog(LOG_DEBUG, "rtsp: kept alive connection closed by device, reconnecting");
+
+    close(res->sockfd);
+    res->sockfd = -1;
+
+    res->reused = false;
+    res->buflen = res->reqlen;
+    res->deadline = time(NULL) + AES67_RTSP_DSC_TIMEOUT_SEC;
+
+    return rtsp_dsc_connect(res);
+}
+
+/**
+ * Starts request, conditional if etag resp. lastmod of a previous response are given.
+ */
+static int rtsp_dsc_start(
+        struct aes67_rtsp_dsc_res_st * res,
+        const enum aes67_net_ipver ipver,
+        const u8_t *ip,
+        const u16_t port,
+        const char * encoded_uri,
+        const char * etag,
+        const char * lastmod
+)
+{
+    assert(res != NULL);
+    assert(AES67_NET_IPVER_ISVALID(ipver));
+    assert(ip != NULL);
+    assert(encoded_uri != NULL);
+
+    // can not start when an operation is pending
+    if (res->state == aes67_rtsp_dsc_state_querying || res->state == aes67_rtsp_dsc_state_connecting || res->state == aes67_rtsp_dsc_state_awaiting_response){
+//        fprintf(stderr, "operation pending\n");
+        return EXIT_FAILURE;
+    }
+    // mark as busy
+    res->state = aes67_rtsp_dsc_state_querying;
+
+    // reuse kept alive connection to same device
+    bool reuse = res->sockfd != -1 && res->keepalive &&
+                 res->addr.ipver == ipver && res->addr.port == port && memcmp(res->addr.ip, ip, AES67_NET_IPVER_SIZE(ipver)) == 0;
+
+    if (!reuse && res->sockfd != -1){
+        close(res->sockfd);
+        res->sockfd = -1;
+    }
+
+    if (!reuse){
+        res->addr.ipver = ipver;
+        memcpy(res->addr.ip, ip, AES67_NET_IPVER_SIZE(ipver));
+        res->addr.port = port;
+
+        res->cseq = 0;
+    }
+
+    res->reused = reuse;
+    res->keepalive = true;
+    res->cseq++;
+
     size_t len = aes67_strncpy((char*)res->buf, "DESCRIBE rtsp://", AES67_RTSP_DSC_BUFSIZE);
 
     len += aes67_net_ip2str(&res->buf[len], (enum aes67_net_ipver)ipver, (u8_t*)ip, (u16_t)port);
 
     len += aes67_strncpy((char*)&res->buf[len], encoded_uri, AES67_RTSP_DSC_BUFSIZE - len);
 
-    len += aes67_strncpy((char*)&res->buf[len], " RTSP/1.0\r\n"
-                                         "CSeq: 1\r\n"
-                                         "Accept: application/sdp\r\n"
-                                         "\r\n", AES67_RTSP_DSC_BUFSIZE - len);
+    len += snprintf((char*)&res->buf[len], AES67_RTSP_DSC_BUFSIZE - len, " RTSP/1.0\r\n"
+                                         "CSeq: %hu\r\n"
+                                         "Accept: application/sdp\r\n", res->cseq);
+
+    if (etag != NULL && etag[0] != '\0'){
+        len += snprintf((char*)&res->buf[len], AES67_RTSP_DSC_BUFSIZE - len, "If-None-Match: %s\r\n", etag);
+    }
+    if (lastmod != NULL && lastmod[0] != '\0'){
+        len += snprintf((char*)&res->buf[len], AES67_RTSP_DSC_BUFSIZE - len, "If-Modified-Since: %s\r\n", lastmod);
+    }
+
+    len += aes67_strncpy((char*)&res->buf[len], "\r\n", AES67_RTSP_DSC_BUFSIZE - len);
 
     res->buflen = len;
 
+    res->deadline = time(NULL) + AES67_RTSP_DSC_TIMEOUT_SEC;
 
-    // writing to the socket could also be done in the process function (this here is, in principle, a blocking call..)
-    if (write(res->sockfd, res->buf, res->buflen) == -1) {
-        close(res->sockfd);
-        res->statuscode = errno;
-        res->state = aes67_rtsp_dsc_state_bored;
-        syslog(LOG_ERR,"rtsp write(): %s", strerror(errno));
-        return EXIT_FAILURE;
+    if (!reuse){
+        return rtsp_dsc_connect(res);
     }
 
-    res->buflen = 0;
-    res->statuscode = 0;
-    res->hdrlen = 0;
-    res->contentlen = 0;
-
-    res->state = aes67_rtsp_dsc_state_awaiting_response;
+    return rtsp_dsc_send(res);
+}
 
-    return EXIT_SUCCESS;
+int aes67_rtsp_dsc_start(
+        struct aes67_rtsp_dsc_res_st * res,
+        const enum aes67_net_ipver ipver,
+        const u8_t *ip,
+        const u16_t port,
+        const char * encoded_uri
+)
+{
+    return rtsp_dsc_start(res, ipver, ip, port, encoded_uri, NULL, NULL);
 }
 
 void aes67_rtsp_dsc_stop(struct aes67_rtsp_dsc_res_st * res)
@@ -172,6 +338,33 @@ void aes67_rtsp_dsc_process(struct aes67_rtsp_dsc_res_st * res)
         // should only reach here on here or if multithreading
         return;
     }
+    if (res->state == aes67_rtsp_dsc_state_connecting){
+        struct pollfd pfd = {
+            .fd = res->sockfd,
+            .events = POLLOUT
+        };
+        if (poll(&pfd, 1, 0) == 0){
+            if (time(NULL) >= res->deadline){
+                syslog(LOG_ERR, "rtsp connect(): timeout");
+                rtsp_dsc_fail(res);
+            }
+            return;
+        }
+
+        int err = 0;
+        socklen_t errlen = sizeof(err);
+        if (getsockopt(res->sockfd, SOL_SOCKET, SO_ERROR, &err, &errlen) == -1 || err != 0){
+            syslog(LOG_ERR, "rtsp connect(): %s", strerror(err));
+            rtsp_dsc_fail(res);
+            return;
+        }
+
+        if (rtsp_dsc_send(res)){
+            res->statuscode = 0;
+            res->state = aes67_rtsp_dsc_state_done;
+        }
+        return;
+    }
     if (res->state == aes67_rtsp_dsc_state_awaiting_response){
         ssize_t r; // read result
         u8_t c; // read buf
@@ -184,7 +377,16 @@ void aes67_rtsp_dsc_process(struct aes67_rtsp_dsc_res_st * res)
 
                 r = read(res->sockfd, &c, 1);
 
+                // kept alive connection closed by device before responding
+                if (res->reused && res->buflen == 0 && (r == 0 || (r == -1 && errno == ECONNRESET))){
+                    if (rtsp_dsc_reconnect(res)){
+                        rtsp_dsc_fail(res);
+                    }
+                    return;
+                }
+
                 if (r == -1){ // timeout
+                    rtsp_dsc_read_failed(res);
                     return;
                 } else if (r == 0) { // closed
                     close(res->sockfd);
@@ -247,12 +449,10 @@ void aes67_rtsp_dsc_process(struct aes67_rtsp_dsc_res_st * res)
                 r = read(res->sockfd, &c, 1);
 
                 if (r == -1){ // timeout
+                    rtsp_dsc_read_failed(res);
                     return;
                 } else if (r == 0) { // closed
-                    close(res->sockfd);
-                    res->sockfd = -1;
-                    res->state = aes67_rtsp_dsc_state_done;
-                    printf("closed!\n");
+                    rtsp_dsc_fail(res);
                     return;
                 } else if (r == 1) {
                     res->buf[res->buflen++] = c;
@@ -270,7 +470,7 @@ void aes67_rtsp_dsc_process(struct aes67_rtsp_dsc_res_st * res)
 
 
                         // expect a header line: "<attr>: <value>\r\n"
-                        u8_t * delim = aes67_memchr(res->line, ':', res->line - &res->buf[res->buflen]);
+                        u8_t * delim = aes67_memchr(res->line, ':', res->llen);
                         if (delim != NULL){
 
 //                            res->buf[res->buflen] = '\0';
@@ -309,6 +509,25 @@ void aes67_rtsp_dsc_process(struct aes67_rtsp_dsc_res_st * res)
                                 res->contentlen = aes67_atoi(delim+2, res->llen - sizeof("content-length: \r"), 10, &rl);
                             }
 
+                            // device wants to close connection after response?
+                            if (header_name_eq(res->line, delim - res->line, "Connection")){
+                                u8_t * value = delim + 1;
+                                while(*value == ' '){
+                                    value++;
+                                }
+                                if (header_name_eq(value, &res->line[res->llen] - value - 2, "close")){
+                                    res->keepalive = false;
+                                }
+                            }
+
+                            // validators for conditional requests (see aes67_rtsp_dsc_cache)
+                            if (header_name_eq(res->line, delim - res->line, "ETag")){
+                                header_value(delim, &res->line[res->llen], res->etag, sizeof(res->etag));
+                            }
+                            if (header_name_eq(res->line, delim - res->line, "Last-Modified")){
+                                header_value(delim, &res->line[res->llen], res->lastmod, sizeof(res->lastmod));
+                            }
+
                         }
 
                         // reset line start
@@ -327,54 +546,68 @@ void aes67_rtsp_dsc_process(struct aes67_rtsp_dsc_res_st * res)
                 }
             } // header
 
-            // require content length to be set
+            // no content length, no content (ie Not Modified or errors)
             if (res->contentlen == 0) {
-                close(res->sockfd);
-                res->sockfd = -1;
+                if (!res->keepalive){
+                    close(res->sockfd);
+                    res->sockfd = -1;
+                }
+                res->deadline = time(NULL) + AES67_RTSP_DSC_KEEPALIVE_SEC;
                 res->state = aes67_rtsp_dsc_state_done;
-                printf("no content length\n");
                 return;
             }
 
             // sanity check
             if (res->hdrlen + res->contentlen > AES67_RTSP_DSC_BUFSIZE){
                 printf("too small buffer to receive complete content!\n");
-                close(res->sockfd);
                 // mark as no content;
-                res->contentlen = 0;
-
-                res->state = aes67_rtsp_dsc_state_done;
-
-                printf("too little content\n");
+                rtsp_dsc_fail(res);
                 return;
             }
+        } // header
 
-            u16_t missing = res->contentlen - (res->buflen - res->hdrlen);
+        // read (remaining) content
+        u16_t missing = res->contentlen - (res->buflen - res->hdrlen);
 
-            r = read(res->sockfd, &res->buf[res->buflen], missing);
+        r = read(res->sockfd, &res->buf[res->buflen], missing);
 
-            if (r == -1){ // timeout
-                return;
-            } else if (r == 0) { // closed prematurely
-                close(res->sockfd);
-                res->sockfd = -1;
-                // invalidate content
-                res->contentlen = 0;
-                res->state = aes67_rtsp_dsc_state_done;
-                return;
-            } else if (r > 0) {
-                res->buflen += r;
+        if (r == -1){ // timeout
+            rtsp_dsc_read_failed(res);
+            return;
+        } else if (r == 0) { // closed prematurely
+            // invalidate content
+            rtsp_dsc_fail(res);
+            return;
+        } else if (r > 0) {
+            res->buflen += r;
 
-                if (r == missing){
+            if (r == missing){
+                // keep connection for further requests (unless told otherwise)
+                if (!res->keepalive){
                     close(res->sockfd);
                     res->sockfd = -1;
-                    res->state = aes67_rtsp_dsc_state_done;
                 }
+                res->deadline = time(NULL) + AES67_RTSP_DSC_KEEPALIVE_SEC;
+                res->state = aes67_rtsp_dsc_state_done;
             }
+        }
+    } // state == awaiting_response
+}
 
-            return;
-        } // state == awaiting_response
+bool aes67_rtsp_dsc_getpollfd(struct aes67_rtsp_dsc_res_st * res, struct pollfd * pfd)
+{
+    assert(res != NULL);
+    assert(pfd != NULL);
+
+    if (res->sockfd == -1){
+        return false;
     }
+
+    pfd->fd = res->sockfd;
+    pfd->events = res->state == aes67_rtsp_dsc_state_connecting ? POLLOUT : POLLIN;
+    pfd->revents = 0;
+
+    return true;
 }
 
 
@@ -395,16 +628,26 @@ ssize_t aes67_rtsp_dsc_easy(
 
     struct aes67_rtsp_dsc_res_st res;
 
-    aes67_rtsp_dsc_init(&res, true);
+    aes67_rtsp_dsc_init(&res, false);
 
     if (aes67_rtsp_dsc_start(&res, addr.ipver, addr.ip, addr.port, uri)){
         return EXIT_FAILURE;
     }
 
+    // wait for socket events (instead of spinning) until done or timed out
     while(res.state != aes67_rtsp_dsc_state_done){
+        struct pollfd pfd;
+        if (aes67_rtsp_dsc_getpollfd(&res, &pfd)){
+            time_t wait = res.deadline - time(NULL);
+            poll(&pfd, 1, wait > 0 ? 1000 * wait : 0);
+        }
         aes67_rtsp_dsc_process(&res);
     }
 
+    if (res.contentlen > maxlen){
+        res.contentlen = 0;
+    }
+
     if (res.contentlen > 0){
         memcpy(sdp, aes67_rtsp_dsc_content(&res), res.contentlen);
     }
@@ -491,3 +734,513 @@ ssize_t aes67_rtsp_dsc_easy_url(const char *url, u8_t *sdp, size_t maxlen)
 //    return 0;
     return aes67_rtsp_dsc_easy(ip.ip, ip.ipver, ip.port, uri, sdp, maxlen);
 }
+
+
+#define FNV_OFFSET  2166136261u
+#define FNV_PRIME   16777619u
+
+static u32_t fnv1a(u32_t hash, const u8_t * data, size_t len)
+{
+    for(size_t i = 0; i < len; i++){
+        hash = (hash ^ data[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+static u32_t cache_key_hash(const enum aes67_net_ipver ipver, const u8_t *ip, const u16_t port, const char * encoded_uri)
+{
+    u32_t hash = FNV_OFFSET;
+    u8_t v = ipver;
+    hash = fnv1a(hash, &v, 1);
+    hash = fnv1a(hash, ip, AES67_NET_IPVER_SIZE(ipver));
+    hash = fnv1a(hash, (const u8_t*)&port, sizeof(port));
+    return fnv1a(hash, (const u8_t*)encoded_uri, strlen(encoded_uri));
+}
+
+static void cache_entry_clear(struct aes67_rtsp_dsc_cache_entry * entry)
+{
+    if (entry->content != NULL){
+        free(entry->content);
+    }
+    memset(entry, 0, sizeof(struct aes67_rtsp_dsc_cache_entry));
+}
+
+#define CACHE_NONE  UINT32_MAX
+
+static u32_t cache_index_slot(struct aes67_rtsp_dsc_cache * cache, u32_t e)
+{
+    u32_t slot = cache->entries[e].key_hash % AES67_RTSP_DSC_CACHE_INDEX_SIZE;
+    while(cache->index[slot] != e + 1){
+        assert(cache->index[slot] != 0);
+        slot = (slot + 1) % AES67_RTSP_DSC_CACHE_INDEX_SIZE;
+    }
+    return slot;
+}
+
+static void cache_index_add(struct aes67_rtsp_dsc_cache * cache, u32_t e)
+{
+    u32_t slot = cache->entries[e].key_hash % AES67_RTSP_DSC_CACHE_INDEX_SIZE;
+    while(cache->index[slot] != 0){
+        slot = (slot + 1) % AES67_RTSP_DSC_CACHE_INDEX_SIZE;
+    }
+    cache->index[slot] = e + 1;
+}
+
+/**
+ * Removes entry from index, following entries of the probe sequence move up (ie no tombstones needed).
+ */
+static void cache_index_remove(struct aes67_rtsp_dsc_cache * cache, u32_t e)
+{
+    u32_t hole = cache_index_slot(cache, e);
+    u32_t slot = hole;
+
+    for(;;){
+        slot = (slot + 1) % AES67_RTSP_DSC_CACHE_INDEX_SIZE;
+        if (cache->index[slot] == 0){
+            break;
+        }
+
+        // entries whose home slot is (cyclically) after the hole stay where they are
+        u32_t home = cache->entries[cache->index[slot] - 1].key_hash % AES67_RTSP_DSC_CACHE_INDEX_SIZE;
+        if (hole <= slot ? (hole < home && home <= slot) : (hole < home || home <= slot)){
+            continue;
+        }
+
+        cache->index[hole] = cache->index[slot];
+        hole = slot;
+    }
+
+    cache->index[hole] = 0;
+}
+
+static void cache_lru_unlink(struct aes67_rtsp_dsc_cache * cache, u32_t e)
+{
+    struct aes67_rtsp_dsc_cache_entry * entry = &cache->entries[e];
+
+    if (entry->lru_prev == CACHE_NONE){
+        cache->lru_first = entry->lru_next;
+    } else {
+        cache->entries[entry->lru_prev].lru_next = entry->lru_next;
+    }
+    if (entry->lru_next == CACHE_NONE){
+        cache->lru_last = entry->lru_prev;
+    } else {
+        cache->entries[entry->lru_next].lru_prev = entry->lru_prev;
+    }
+}
+
+static void cache_lru_append(struct aes67_rtsp_dsc_cache * cache, u32_t e)
+{
+    struct aes67_rtsp_dsc_cache_entry * entry = &cache->entries[e];
+
+    entry->lru_prev = cache->lru_last;
+    entry->lru_next = CACHE_NONE;
+    if (cache->lru_last == CACHE_NONE){
+        cache->lru_first = e;
+    } else {
+        cache->entries[cache->lru_last].lru_next = e;
+    }
+    cache->lru_last = e;
+}
+
+/**
+ * Marks entry as most recently used.
+ */
+static void cache_touch(struct aes67_rtsp_dsc_cache * cache, struct aes67_rtsp_dsc_cache_entry * entry)
+{
+    u32_t e = entry - cache->entries;
+
+    if (cache->lru_last != e){
+        cache_lru_unlink(cache, e);
+        cache_lru_append(cache, e);
+    }
+
+    entry->last_used = time(NULL);
+}
+
+void aes67_rtsp_dsc_cache_init(struct aes67_rtsp_dsc_cache * cache)
+{
+    assert(cache != NULL);
+
+    memset(cache, 0, sizeof(struct aes67_rtsp_dsc_cache));
+
+    cache->lru_first = CACHE_NONE;
+    cache->lru_last = CACHE_NONE;
+}
+
+void aes67_rtsp_dsc_cache_deinit(struct aes67_rtsp_dsc_cache * cache)
+{
+    assert(cache != NULL);
+
+    for(size_t i = 0; i < cache->count; i++){
+        cache_entry_clear(&cache->entries[i]);
+    }
+    cache->count = 0;
+
+    memset(cache->index, 0, sizeof(cache->index));
+    cache->lru_first = CACHE_NONE;
+    cache->lru_last = CACHE_NONE;
+}
+
+struct aes67_rtsp_dsc_cache_entry * aes67_rtsp_dsc_cache_lookup(struct aes67_rtsp_dsc_cache * cache, const enum aes67_net_ipver ipver, const u8_t *ip, const u16_t port, const char * encoded_uri)
+{
+    assert(cache != NULL);
+    assert(AES67_NET_IPVER_ISVALID(ipver));
+    assert(ip != NULL);
+    assert(encoded_uri != NULL);
+
+    u32_t hash = cache_key_hash(ipver, ip, port, encoded_uri);
+
+    for(u32_t slot = hash % AES67_RTSP_DSC_CACHE_INDEX_SIZE; cache->index[slot] != 0; slot = (slot + 1) % AES67_RTSP_DSC_CACHE_INDEX_SIZE){
+        struct aes67_rtsp_dsc_cache_entry * entry = &cache->entries[cache->index[slot] - 1];
+        if (entry->key_hash == hash &&
+            entry->addr.ipver == ipver && entry->addr.port == port &&
+            memcmp(entry->addr.ip, ip, AES67_NET_IPVER_SIZE(ipver)) == 0 &&
+            strcmp(entry->uri, encoded_uri) == 0){
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+void aes67_rtsp_dsc_cache_remove(struct aes67_rtsp_dsc_cache * cache, const enum aes67_net_ipver ipver, const u8_t *ip, const u16_t port, const char * encoded_uri)
+{
+    struct aes67_rtsp_dsc_cache_entry * entry = aes67_rtsp_dsc_cache_lookup(cache, ipver, ip, port, encoded_uri);
+
+    if (entry == NULL){
+        return;
+    }
+
+    u32_t e = entry - cache->entries;
+
+    cache_index_remove(cache, e);
+    cache_lru_unlink(cache, e);
+    cache_entry_clear(entry);
+
+    // keep entries packed, ie move last entry into its place
+    u32_t last = --cache->count;
+    if (e != last){
+        cache->index[cache_index_slot(cache, last)] = e + 1;
+
+        memcpy(entry, &cache->entries[last], sizeof(struct aes67_rtsp_dsc_cache_entry));
+        memset(&cache->entries[last], 0, sizeof(struct aes67_rtsp_dsc_cache_entry));
+
+        if (entry->lru_prev == CACHE_NONE){
+            cache->lru_first = e;
+        } else {
+            cache->entries[entry->lru_prev].lru_next = e;
+        }
+        if (entry->lru_next == CACHE_NONE){
+            cache->lru_last = e;
+        } else {
+            cache->entries[entry->lru_next].lru_prev = e;
+        }
+    }
+}
+
+struct aes67_rtsp_dsc_cache_entry * aes67_rtsp_dsc_cache_update(struct aes67_rtsp_dsc_cache * cache, struct aes67_rtsp_dsc_res_st * res, const char * encoded_uri, bool * unchanged)
+{
+    assert(cache != NULL);
+    assert(res != NULL);
+    assert(encoded_uri != NULL);
+    assert(unchanged != NULL);
+
+    *unchanged = false;
+
+    if (strlen(encoded_uri) >= AES67_RTSP_DSC_URILEN){
+        return NULL;
+    }
+
+    struct aes67_rtsp_dsc_cache_entry * entry = aes67_rtsp_dsc_cache_lookup(cache, res->addr.ipver, res->addr.ip, res->addr.port, encoded_uri);
+
+    if (res->statuscode == AES67_RTSP_STATUS_NOT_MODIFIED){
+        if (entry == NULL || entry->content == NULL){
+            return NULL;
+        }
+        cache_touch(cache, entry);
+        *unchanged = true;
+        return entry;
+    }
+
+    if (res->statuscode != AES67_RTSP_STATUS_OK || res->contentlen == 0){
+        return NULL;
+    }
+
+    const u8_t * content = &res->buf[res->hdrlen];
+    u32_t fingerprint = fnv1a(FNV_OFFSET, content, res->contentlen);
+
+    if (entry == NULL){
+        // take free or least recently used entry
+        u32_t e;
+        if (cache->count < AES67_RTSP_DSC_CACHE_SIZE){
+            e = cache->count++;
+        } else {
+            e = cache->lru_first;
+            cache_index_remove(cache, e);
+            cache_lru_unlink(cache, e);
+            cache_entry_clear(&cache->entries[e]);
+        }
+        entry = &cache->entries[e];
+
+        entry->key_hash = cache_key_hash(res->addr.ipver, res->addr.ip, res->addr.port, encoded_uri);
+        memcpy(&entry->addr, &res->addr, sizeof(struct aes67_net_addr));
+        strcpy(entry->uri, encoded_uri);
+
+        cache_index_add(cache, e);
+        cache_lru_append(cache, e);
+    }
+    else if (entry->fingerprint == fingerprint && entry->contentlen == res->contentlen &&
+             memcmp(entry->content, content, res->contentlen) == 0){
+        *unchanged = true;
+    }
+
+    if (!*unchanged){
+        u8_t * copy = realloc(entry->content, res->contentlen + 1);
+        assert(copy != NULL);
+
+        memcpy(copy, content, res->contentlen);
+        copy[res->contentlen] = '\0';
+
+        entry->content = copy;
+        entry->contentlen = res->contentlen;
+        entry->fingerprint = fingerprint;
+
+        // originator (o=..) is expected to follow version (v=0)
+        u8_t * o = aes67_memchr(copy, '\n', entry->contentlen);
+        entry->has_origin = o != NULL && aes67_sdp_origin_fromstr(&entry->origin, o + 1, entry->contentlen - (o + 1 - copy)) != AES67_SDP_ERROR;
+    }
+
+    // validators may change without content changing
+    strcpy(entry->etag, res->etag);
+    strcpy(entry->lastmod, res->lastmod);
+
+    cache_touch(cache, entry);
+
+    return entry;
+}
+
+
+void aes67_rtsp_dsc_mux_init(struct aes67_rtsp_dsc_mux * mux, aes67_rtsp_dsc_mux_callback callback, void * user_data)
+{
+    assert(mux != NULL);
+    assert(callback != NULL);
+
+    for(size_t i = 0; i < AES67_RTSP_DSC_MUX_SIZE; i++){
+        aes67_rtsp_dsc_init(&mux->res[i], false);
+        mux->req_data[i] = NULL;
+    }
+
+    mux->callback = callback;
+    mux->user_data = user_data;
+
+    mux->cache = NULL;
+}
+
+void aes67_rtsp_dsc_mux_setcache(struct aes67_rtsp_dsc_mux * mux, struct aes67_rtsp_dsc_cache * cache)
+{
+    assert(mux != NULL);
+
+    mux->cache = cache;
+}
+
+void aes67_rtsp_dsc_mux_deinit(struct aes67_rtsp_dsc_mux * mux)
+{
+    assert(mux != NULL);
+
+    for(size_t i = 0; i < AES67_RTSP_DSC_MUX_SIZE; i++){
+        aes67_rtsp_dsc_deinit(&mux->res[i]);
+        mux->req_data[i] = NULL;
+    }
+}
+
+static bool mux_pending(struct aes67_rtsp_dsc_res_st * res)
+{
+    return res->state == aes67_rtsp_dsc_state_querying ||
+           res->state == aes67_rtsp_dsc_state_connecting ||
+           res->state == aes67_rtsp_dsc_state_awaiting_response;
+}
+
+int aes67_rtsp_dsc_mux_start(struct aes67_rtsp_dsc_mux * mux, const enum aes67_net_ipver ipver, const u8_t *ip, const u16_t port, const char * encoded_uri, void * req_data)
+{
+    assert(mux != NULL);
+    assert(AES67_NET_IPVER_ISVALID(ipver));
+    assert(ip != NULL);
+    assert(encoded_uri != NULL);
+
+    // prefer an idle connection to the same device, then an unused slot, then the least recently used idle connection
+    ssize_t slot = -1;
+    int rank = 3;
+
+    for(size_t i = 0; i < AES67_RTSP_DSC_MUX_SIZE && rank > 0; i++){
+        struct aes67_rtsp_dsc_res_st * res = &mux->res[i];
+
+        if (mux_pending(res)){
+            continue;
+        }
+
+        int r;
+        if (res->sockfd == -1){
+            r = 1;
+        } else if (res->addr.ipver == ipver && res->addr.port == port && memcmp(res->addr.ip, ip, AES67_NET_IPVER_SIZE(ipver)) == 0){
+            r = 0;
+        } else {
+            r = 2;
+        }
+
+        if (r < rank || (r == 2 && rank == 2 && res->deadline < mux->res[slot].deadline)){
+            slot = i;
+            rank = r;
+        }
+    }
+
+    if (slot == -1 || strlen(encoded_uri) >= AES67_RTSP_DSC_URILEN){
+        return EXIT_FAILURE;
+    }
+
+    // revalidate cached response (if any)
+    struct aes67_rtsp_dsc_cache_entry * entry = NULL;
+    if (mux->cache != NULL){
+        entry = aes67_rtsp_dsc_cache_lookup(mux->cache, ipver, ip, port, encoded_uri);
+    }
+
+    if (rtsp_dsc_start(&mux->res[slot], ipver, ip, port, encoded_uri, entry ? entry->etag : NULL, entry ? entry->lastmod : NULL)){
+        return EXIT_FAILURE;
+    }
+
+    mux->req_data[slot] = req_data;
+    strcpy(mux->uri[slot], encoded_uri);
+
+    return EXIT_SUCCESS;
+}
+
+void aes67_rtsp_dsc_mux_cancel(struct aes67_rtsp_dsc_mux * mux, void * req_data)
+{
+    assert(mux != NULL);
+
+    for(size_t i = 0; i < AES67_RTSP_DSC_MUX_SIZE; i++){
+        if (mux->req_data[i] == req_data && mux_pending(&mux->res[i])){
+            aes67_rtsp_dsc_stop(&mux->res[i]);
+            mux->req_data[i] = NULL;
+        }
+    }
+}
+
+void aes67_rtsp_dsc_mux_process(struct aes67_rtsp_dsc_mux * mux)
+{
+    assert(mux != NULL);
+
+    time_t now = time(NULL);
+
+    for(size_t i = 0; i < AES67_RTSP_DSC_MUX_SIZE; i++){
+        struct aes67_rtsp_dsc_res_st * res = &mux->res[i];
+
+        if (mux_pending(res)){
+            aes67_rtsp_dsc_process(res);
+        }
+
+        if (res->state == aes67_rtsp_dsc_state_done){
+            void * req_data = mux->req_data[i];
+            mux->req_data[i] = NULL;
+
+            u16_t statuscode = res->statuscode;
+            u8_t * content = NULL;
+            u16_t contentlen = res->contentlen;
+            bool unchanged = false;
+
+            if (res->contentlen > 0){
+                content = &res->buf[res->hdrlen];
+                content[res->contentlen] = '\0';
+            }
+
+            if (mux->cache != NULL){
+                struct aes67_rtsp_dsc_cache_entry * entry = aes67_rtsp_dsc_cache_update(mux->cache, res, mux->uri[i], &unchanged);
+
+                // pass on cached content
+                if (entry != NULL && statuscode == AES67_RTSP_STATUS_NOT_MODIFIED){
+                    statuscode = AES67_RTSP_STATUS_OK;
+                    content = entry->content;
+                    contentlen = entry->contentlen;
+                }
+            }
+
+            mux->callback(mux, req_data, statuscode, content, contentlen, unchanged, mux->user_data);
+
+            res->state = aes67_rtsp_dsc_state_bored;
+        }
+        else if (res->state == aes67_rtsp_dsc_state_bored && res->sockfd != -1){
+            // idle connections are closed when expired or if the device closed it (or sent anything unexpected)
+            struct pollfd pfd = {
+                .fd = res->sockfd,
+                .events = POLLIN
+            };
+            if (now >= res->deadline || poll(&pfd, 1, 0) != 0){
+                aes67_rtsp_dsc_stop(res);
+            }
+        }
+    }
+}
+
+size_t aes67_rtsp_dsc_mux_available(struct aes67_rtsp_dsc_mux * mux)
+{
+    assert(mux != NULL);
+
+    size_t count = 0;
+
+    for(size_t i = 0; i < AES67_RTSP_DSC_MUX_SIZE; i++){
+        if (!mux_pending(&mux->res[i]) && mux->res[i].state != aes67_rtsp_dsc_state_done){
+            count++;
+        }
+    }
+
+    return count;
+}
+
+size_t aes67_rtsp_dsc_mux_count(struct aes67_rtsp_dsc_mux * mux, const enum aes67_net_ipver ipver, const u8_t *ip)
+{
+    assert(mux != NULL);
+    assert(ip != NULL);
+
+    size_t count = 0;
+
+    for(size_t i = 0; i < AES67_RTSP_DSC_MUX_SIZE; i++){
+        struct aes67_rtsp_dsc_res_st * res = &mux->res[i];
+        if (mux_pending(res) && res->addr.ipver == ipver && memcmp(res->addr.ip, ip, AES67_NET_IPVER_SIZE(ipver)) == 0){
+            count++;
+        }
+    }
+
+    return count;
+}
+
+size_t aes67_rtsp_dsc_mux_getpollfds(struct aes67_rtsp_dsc_mux * mux, struct pollfd * fds, size_t max)
+{
+    assert(mux != NULL);
+    assert(fds != NULL);
+
+    size_t count = 0;
+
+    for(size_t i = 0; i < AES67_RTSP_DSC_MUX_SIZE && count < max; i++){
+        if (aes67_rtsp_dsc_getpollfd(&mux->res[i], &fds[count])){
+            count++;
+        }
+    }
+
+    return count;
+}
+
+time_t aes67_rtsp_dsc_mux_deadline(struct aes67_rtsp_dsc_mux * mux)
+{
+    assert(mux != NULL);
+
+    time_t deadline = 0;
+
+    for(size_t i = 0; i < AES67_RTSP_DSC_MUX_SIZE; i++){
+        struct aes67_rtsp_dsc_res_st * res = &mux->res[i];
+        if (res->sockfd != -1 && (deadline == 0 || res->deadline < deadline)){
+            deadline = res->deadline;
+        }
+    }
+
+    return deadline;
+}
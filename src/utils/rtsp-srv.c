@@ -19,6 +19,7 @@
 #include "aes67/utils/rtsp-srv.h"
 
 #include <assert.h>
+#include <stdint.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/socket.h>
@@ -28,6 +29,15 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <syslog.h>
+#include <sys/uio.h>
+
+#if AES67_RTSP_SRV_EPOLL == 1
+#include <sys/epoll.h>
+#endif
+
+// epoll user data of listening socket and wakeup pipe (connections use their index)
+#define LISTEN_ID AES67_RTSP_SRV_MAXCONN
+#define WAKE_ID (AES67_RTSP_SRV_MAXCONN + 1)
 
 static int sock_set_blocking(int sockfd, bool blocking){
     // set non-blocking
@@ -39,720 +49,1184 @@ static int sock_set_blocking(int sockfd, bool blocking){
     return EXIT_SUCCESS;
 }
 
+static u32_t rtsp_srv_uri_hash(const u8_t * uri, u8_t urilen)
+{
+    // FNV-1a
+    u32_t hash = 2166136261U;
+    for(u8_t i = 0; i < urilen; i++){
+        hash ^= uri[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+static struct aes67_rtsp_srv_resource ** rtsp_srv_sdpref_bucket(struct aes67_rtsp_srv * srv, void * sdpref)
+{
+    // (drop alignment bits of pointer)
+    uintptr_t h = (uintptr_t)sdpref;
+    h ^= h >> 4;
+    h ^= h >> 12;
+    return &srv->sdpref_index[h & (AES67_RTSP_SRV_URI_HASHSIZE - 1)];
+}
+
 static struct aes67_rtsp_srv_resource * rtsp_resource_by_uri(struct aes67_rtsp_srv * srv, const u8_t * uri, u8_t urilen)
 {
     assert(srv);
     assert(uri);
     assert(urilen);
 
-    struct aes67_rtsp_srv_resource * res = srv->first_res;
+    u32_t hash = rtsp_srv_uri_hash(uri, urilen);
+
+    struct aes67_rtsp_srv_resource * res = srv->uri_index[hash & (AES67_RTSP_SRV_URI_HASHSIZE - 1)];
 
     while(res != NULL){
-        if (res->urilen == urilen && aes67_memcmp(res->uri, uri, urilen) == 0){
+        if (res->hash == hash && res->urilen == urilen && aes67_memcmp(res->uri, uri, urilen) == 0){
             return res;
         }
-        res = res->next;
+        res = res->hnext;
     }
     return NULL;
 }
 
-void aes67_rtsp_srv_init(struct aes67_rtsp_srv * srv, bool http_enabled, void * user_data)
+static void rtsp_srv_rendered_release(struct aes67_rtsp_srv_rendered * rendered)
 {
-    assert(srv);
+    assert(rendered->refs > 0);
 
-    srv->state = aes67_rtsp_srv_state_init;
-    srv->first_res = NULL;
+    if (--rendered->refs == 0){
+        free(rendered);
+    }
+}
 
-    srv->http_enabled = http_enabled;
-    srv->user_data = user_data;
+/**
+ * Cached response of resource, rendered (using aes67_rtsp_srv_sdp_getter() and given buffer) if not yet available.
+ * Returns NULL if the SDP is not available.
+ */
+static struct aes67_rtsp_srv_rendered * rtsp_srv_render(struct aes67_rtsp_srv * srv, struct aes67_rtsp_srv_resource * res, u8_t * buf, u16_t maxlen)
+{
+    if (res->rendered != NULL){
+        return res->rendered;
+    }
 
-    srv->listen_sockfd = -1;
-    srv->client_sockfd = -1;
-    srv->blocking = true;
+    u16_t len = aes67_rtsp_srv_sdp_getter(srv, res->sdpref, buf, maxlen);
+    if (len == 0){
+        return NULL;
+    }
+
+    struct aes67_rtsp_srv_rendered * rendered = malloc(sizeof(struct aes67_rtsp_srv_rendered) + len);
+    if (rendered == NULL){
+        return NULL;
+    }
+
+    rendered->refs = 1;
+    rendered->len = len;
+    aes67_memcpy(rendered->data, buf, len);
+
+    res->rendered = rendered;
+
+    return rendered;
 }
 
-void aes67_rtsp_srv_deinit(struct aes67_rtsp_srv * srv)
+/**
+ * Case-insensitive comparison of header name.
+ */
+static bool header_name_eq(const u8_t * name, size_t len, const char * expected)
 {
-    assert(srv);
+    if (len != strlen(expected)){
+        return false;
+    }
+    for(size_t i = 0; i < len; i++){
+        u8_t a = name[i], b = expected[i];
+        if ('A' <= a && a <= 'Z') a += 'a' - 'A';
+        if ('A' <= b && b <= 'Z') b += 'a' - 'A';
+        if (a != b){
+            return false;
+        }
+    }
+    return true;
+}
 
-    aes67_rtsp_srv_stop(srv);
+/**
+ * Updates the watched events of given fd (0 := not watched at all).
+ */
+static void rtsp_srv_watch(struct aes67_rtsp_srv * srv, int fd, u32_t id, short * current, short events)
+{
+    if (*current == events){
+        return;
+    }
 
-    while(srv->first_res){
-        aes67_rtsp_srv_sdp_remove(srv, srv->first_res->sdpref);
+#if AES67_RTSP_SRV_EPOLL == 1
+    if (srv->epfd != -1){
+        struct epoll_event ev = {
+            .events = (events & POLLIN ? EPOLLIN : 0) | (events & POLLOUT ? EPOLLOUT : 0),
+            .data.u32 = id
+        };
+        if (epoll_ctl(srv->epfd, EPOLL_CTL_MOD, fd, &ev) == -1 && errno == ENOENT){
+            epoll_ctl(srv->epfd, EPOLL_CTL_ADD, fd, &ev);
+        }
     }
+#endif
 
-    srv->state = aes67_rtsp_srv_state_init;
+    *current = events;
 }
 
-int aes67_rtsp_srv_start(struct aes67_rtsp_srv * srv, const enum aes67_net_ipver ipver, const u8_t *ip, u16_t port)
+static void rtsp_srv_req_reset(struct aes67_rtsp_srv_conn * conn)
 {
-    assert(srv);
-    assert(ipver == aes67_net_ipver_4);
-//    assert(ip);
-    assert(port);
+    conn->req.proto = aes67_rtsp_srv_proto_undefined;
+    conn->req.method = aes67_rtsp_srv_method_undefined;
+    conn->req.header_len = 0;
+    conn->req.content_length = 0;
+    conn->req.cseq = 0;
+
+    conn->res.len = 0;
+    conn->res.sent = 0;
+    conn->res.body = NULL;
+    conn->res.more = false;
+    conn->res.parked = false;
+    conn->res.response_state = NULL;
+}
 
-    aes67_rtsp_srv_stop(srv);
+static void rtsp_srv_conn_close(struct aes67_rtsp_srv * srv, struct aes67_rtsp_srv_conn * conn)
+{
+    if (conn->state == aes67_rtsp_srv_state_init){
+        return;
+    }
 
-    srv->listen_sockfd = socket (AF_INET, SOCK_STREAM, 0);
+    // let http handler clean up an unfinished response
+    if (conn->req.proto == aes67_rtsp_srv_proto_http && conn->res.more){
+        aes67_rtsp_srv_http_handler(srv, aes67_rtsp_srv_method_undefined, NULL, 0, NULL, NULL, 0, &conn->res.more, &conn->res.response_state);
+    }
 
-    if (srv->listen_sockfd < 0){
-        perror ("socket()");
-        return EXIT_FAILURE;
+    if (conn->res.body != NULL){
+        rtsp_srv_rendered_release(conn->res.body);
+        conn->res.body = NULL;
     }
 
-    memset(&srv->listen_addr, 0, sizeof(struct sockaddr_in));
+#if AES67_RTSP_SRV_EPOLL == 1
+    if (srv->epfd != -1){
+        epoll_ctl(srv->epfd, EPOLL_CTL_DEL, conn->sockfd, NULL);
+    }
+#endif
 
-    srv->listen_addr.sin_family = AF_INET;
-    srv->listen_addr.sin_port = htons(port);
-    if (ip){
-        srv->listen_addr.sin_addr.s_addr = *(uint32_t*)ip;
-    } else {
-        srv->listen_addr.sin_addr.s_addr = INADDR_ANY;
+    close(conn->sockfd);
+    conn->sockfd = -1;
+    conn->events = 0;
+    conn->state = aes67_rtsp_srv_state_init;
+
+    srv->nconn--;
+}
+
+/**
+ * Longest idle keep-alive connection (ie having served a request and waiting for another), NULL if none.
+ */
+static struct aes67_rtsp_srv_conn * rtsp_srv_conn_idle(struct aes67_rtsp_srv * srv)
+{
+    struct aes67_rtsp_srv_conn * idle = NULL;
+
+    for(u16_t i = 0; i < AES67_RTSP_SRV_MAXCONN; i++){
+        struct aes67_rtsp_srv_conn * conn = &srv->conn[i];
+        if (conn->state == aes67_rtsp_srv_state_receiving && conn->served > 0 && conn->req.data_len == 0 &&
+            (idle == NULL || conn->last_activity < idle->last_activity)){
+            idle = conn;
+        }
     }
 
+    return idle;
+}
 
-    if (bind (srv->listen_sockfd, (struct sockaddr *) &srv->listen_addr, sizeof(struct sockaddr_in)) < 0){
-        close(srv->listen_sockfd);
-        srv->listen_sockfd = -1;
-        perror ("bind()");
+/**
+ * Whether a new connection can be accepted (possibly by dropping an idle one).
+ */
+static bool rtsp_srv_can_accept(struct aes67_rtsp_srv * srv)
+{
+    return srv->nconn < AES67_RTSP_SRV_MAXCONN || rtsp_srv_conn_idle(srv) != NULL;
+}
+
+static void rtsp_srv_accept(struct aes67_rtsp_srv * srv)
+{
+    while(rtsp_srv_can_accept(srv)){
+
+        struct sockaddr_in addr;
+        socklen_t socklen = sizeof(addr);
+        int sockfd = accept(srv->listen_sockfd, (struct sockaddr *) &addr, &socklen);
+
+        if (sockfd == -1){
+            return;
+        }
+
+        if (sock_set_blocking(sockfd, false)){
+            close(sockfd);
+            continue;
+        }
+
+        struct aes67_rtsp_srv_conn * conn = NULL;
+
+        if (srv->nconn < AES67_RTSP_SRV_MAXCONN){
+            for(u16_t i = 0; i < AES67_RTSP_SRV_MAXCONN; i++){
+                if (srv->conn[i].state == aes67_rtsp_srv_state_init){
+                    conn = &srv->conn[i];
+                    break;
+                }
+            }
+        } else {
+            // make room by dropping the longest idle keep-alive connection
+            conn = rtsp_srv_conn_idle(srv);
+            rtsp_srv_conn_close(srv, conn);
+        }
+
+        assert(conn);
+
+        conn->sockfd = sockfd;
+        conn->addr = addr;
+        conn->state = aes67_rtsp_srv_state_receiving;
+        conn->last_activity = time(NULL);
+        conn->events = 0;
+        conn->keepalive = true;
+        conn->served = 0;
+        conn->req.data_len = 0;
+        rtsp_srv_req_reset(conn);
+
+        srv->nconn++;
+
+        rtsp_srv_watch(srv, conn->sockfd, conn - srv->conn, &conn->events, POLLIN);
+
+        u8_t ipstr[AES67_NET_ADDR_STR_MAX];
+        u8_t iplen = aes67_net_ip2str(ipstr, aes67_net_ipver_4, (u8_t*)&conn->addr.sin_addr.s_addr, ntohs(conn->addr.sin_port));
+        ipstr[iplen] = '\0';
+
+        syslog(LOG_DEBUG, "rtsp srv: connection from %s", ipstr);
+    }
+}
+
+/**
+ * Parses request line and header fields of a complete header.
+ */
+static int rtsp_srv_parse_header(struct aes67_rtsp_srv * srv, struct aes67_rtsp_srv_conn * conn, u16_t header_len)
+{
+    u8_t * data = conn->req.data;
+    u16_t rl; // readlen
+
+    u8_t * eol = aes67_memchr(data, '\n', header_len);
+
+    assert(eol);
+
+    u16_t llen = eol - data + 1;
+
+    // basic sanity check
+    if (llen < 15){
         return EXIT_FAILURE;
     }
 
+    // check if using carriage return
+    int CR = data[llen - 2] == '\r' ? 1 : 0;
 
-    if (listen(srv->listen_sockfd, AES67_RTSPSRV_LISTEN_BACKLOG) == -1){
-        close(srv->listen_sockfd);
-        srv->listen_sockfd = -1;
-        perror ("listen()");
+    u8_t * s = &data[llen - CR - sizeof("HTTP/1.0")];
+
+    if (s[0] == 'H' &&
+        s[1] == 'T' &&
+        s[2] == 'T' &&
+        s[3] == 'P' &&
+        s[4] == '/' &&
+        s[6] == '.'
+    ){
+        if (!srv->http_enabled){
+            return EXIT_FAILURE;
+        }
+
+        conn->req.proto = aes67_rtsp_srv_proto_http;
+    }
+    else if (s[0] == 'R' &&
+             s[1] == 'T' &&
+             s[2] == 'S' &&
+             s[3] == 'P' &&
+             s[4] == '/' &&
+             s[6] == '.'
+            ){
+
+        conn->req.proto = aes67_rtsp_srv_proto_rtsp;
+    }
+    // client error, just terminate connection without response
+    else {
         return EXIT_FAILURE;
     }
 
+    // without proper validation
+    conn->req.version.major = s[5] - '0';
+    conn->req.version.minor = s[7] - '0';
+
+    s = data;
+
+    syslog(LOG_DEBUG, "rtsp srv: request %.*s", llen - 1 - CR, s);
+
+    if (conn->req.proto == aes67_rtsp_srv_proto_rtsp &&
+        s[0] == 'D' &&
+        s[1] == 'E' &&
+        s[2] == 'S' &&
+        s[3] == 'C' &&
+        s[4] == 'R' &&
+        s[5] == 'I' &&
+        s[6] == 'B' &&
+        s[7] == 'E'
+            ) {
+        conn->req.method = aes67_rtsp_srv_method_describe;
+        conn->req.uri = &s[9];
+    }
+    else if (s[0] == 'O' && // supported by both rtsp and http
+             s[1] == 'P' &&
+             s[2] == 'T' &&
+             s[3] == 'I' &&
+             s[4] == 'O' &&
+             s[5] == 'N' &&
+             s[6] == 'S'
+            ) {
+        conn->req.method = aes67_rtsp_srv_method_options;
+        conn->req.uri = &s[8];
+    }
+    else if (conn->req.proto == aes67_rtsp_srv_proto_http &&
+             s[0] == 'G' &&
+             s[1] == 'E' &&
+             s[2] == 'T'
+            ) {
+        conn->req.method = aes67_rtsp_srv_method_get;
+        conn->req.uri = &s[4];
+    }
+    else if (conn->req.proto == aes67_rtsp_srv_proto_http &&
+             s[0] == 'P' &&
+             s[1] == 'O' &&
+             s[2] == 'S' &&
+             s[3] == 'T'
+            ) {
+        conn->req.method = aes67_rtsp_srv_method_post;
+        conn->req.uri = &s[5];
+    }
+    else if (conn->req.proto == aes67_rtsp_srv_proto_http &&
+             s[0] == 'P' &&
+             s[1] == 'U' &&
+             s[2] == 'T'
+            ) {
+        conn->req.method = aes67_rtsp_srv_method_put;
+        conn->req.uri = &s[4];
+    }
+    else if (conn->req.proto == aes67_rtsp_srv_proto_http &&
+             s[0] == 'D' &&
+             s[1] == 'E' &&
+             s[2] == 'L' &&
+             s[3] == 'E' &&
+             s[4] == 'T' &&
+             s[5] == 'E'
+            ) {
+        conn->req.method = aes67_rtsp_srv_method_delete;
+        conn->req.uri = &s[7];
+    }
+    else {
+        // method not supported/recognized, terminate without response
+        syslog(LOG_DEBUG, "rtsp srv: method not recognized");
+        return EXIT_FAILURE;
+    }
 
-    if (sock_set_blocking(srv->listen_sockfd, srv->blocking)){
-        fprintf(stderr, "Couldn't change non-/blocking\n");
+    // "RTSP/1.0" - "METHOD .."
+    u8_t * uri_end = &data[llen - CR - sizeof(" HTTP/1.0")];
+    if (uri_end <= conn->req.uri || uri_end - conn->req.uri > 255){
         return EXIT_FAILURE;
     }
+    conn->req.urilen = uri_end - conn->req.uri;
+
+    conn->req.uri[conn->req.urilen] = '\0';
+
+    // if  rtsp, discard scheme and host
+    if (conn->req.proto == aes67_rtsp_srv_proto_rtsp){
+
+        // basic validation
+        if (conn->req.urilen < 8 ||
+            conn->req.uri[0] != 'r' ||
+            conn->req.uri[1] != 't' ||
+            conn->req.uri[2] != 's' ||
+            conn->req.uri[3] != 'p' ||
+            conn->req.uri[4] != ':' ||
+            conn->req.uri[5] != '/' ||
+            conn->req.uri[6] != '/'
+                ){
+            return EXIT_FAILURE;
+        }
+        conn->req.uri += 7;
+        conn->req.urilen -= 7;
 
-    srv->state = aes67_rtsp_srv_state_listening;
+        u8_t * delim = aes67_memchr(conn->req.uri, '/', conn->req.urilen);
+        if (delim == NULL){
+            return EXIT_FAILURE;
+        }
+
+        conn->req.urilen -= delim - conn->req.uri;
+        conn->req.uri = delim;
+    }
+    else if (conn->req.proto == aes67_rtsp_srv_proto_http){
+        // sanity check
+        if (conn->req.uri[0] != '/'){
+            return EXIT_FAILURE;
+        }
+    }
+
+    // header fields: "<attr>: <value>\r\n"
+    u8_t * line = &data[llen];
+    while (line < &data[header_len]){
+
+        eol = aes67_memchr(line, '\n', &data[header_len] - line);
+        assert(eol);
+
+        llen = eol - line + 1;
+
+        u8_t * delim = aes67_memchr(line, ':', llen);
+        if (delim != NULL) {
+
+            u8_t * value = delim + 1;
+            while(*value == ' '){
+                value++;
+            }
+            int vlen = eol - value - CR;
+            if (vlen < 0){
+                vlen = 0;
+            }
+
+            if (vlen > 0 && header_name_eq(line, delim - line, "CSeq")){
+                conn->req.cseq = aes67_atoi(value, vlen, 10, &rl);
+            }
+
+            if (vlen > 0 && header_name_eq(line, delim - line, "Content-Length")){
+                conn->req.content_length = aes67_atoi(value, vlen, 10, &rl);
+            }
+
+            if (header_name_eq(line, delim - line, "Connection") && header_name_eq(value, vlen, "close")){
+                conn->keepalive = false;
+            }
+        }
+
+        line = eol + 1;
+    }
 
     return EXIT_SUCCESS;
 }
 
-void aes67_rtsp_srv_stop(struct aes67_rtsp_srv * srv)
+/**
+ * Returns 1 if a complete request is in the rx buffer, 0 if more data is needed, -1 on error.
+ */
+static int rtsp_srv_parse(struct aes67_rtsp_srv * srv, struct aes67_rtsp_srv_conn * conn)
 {
-    assert(srv);
+    u8_t * data = conn->req.data;
 
-    if (srv->listen_sockfd != -1){
-        sock_set_blocking(srv->listen_sockfd, true);
-        close(srv->listen_sockfd);
-        srv->listen_sockfd = -1;
-    }
+    if (conn->req.header_len == 0){
 
-    if (srv->client_sockfd != -1){
-        sock_set_blocking(srv->client_sockfd, true);
-        close(srv->client_sockfd);
-        srv->client_sockfd = -1;
-    }
+        // locate end of header, ie empty line ([CR]NL)
+        u16_t start = 0;
+        u16_t end = 0;
 
-}
+        while(start < conn->req.data_len){
+            u8_t * eol = aes67_memchr(&data[start], '\n', conn->req.data_len - start);
+            if (eol == NULL){
+                break;
+            }
+            u16_t pos = eol - data + 1;
+            if (start > 0 && (pos - start == 1 || (pos - start == 2 && data[start] == '\r'))){
+                end = pos;
+                break;
+            }
+            start = pos;
+        }
 
+        if (end == 0){
+            // fail if using too much memory (or a first line of excessive length)
+            if (conn->req.data_len >= AES67_RTSP_SRV_RXBUFSIZE || (start == 0 && conn->req.data_len >= 256)){
+                syslog(LOG_DEBUG, "rtsp srv: request too long");
+                return -1;
+            }
+            return 0;
+        }
 
-void aes67_rtsp_srv_blocking(struct aes67_rtsp_srv * srv, bool blocking)
-{
-    assert(srv);
+        if (rtsp_srv_parse_header(srv, conn, end)){
+            return -1;
+        }
 
-    if (srv->blocking == blocking){
-        return;
+        conn->req.header_len = end;
     }
-    srv->blocking = blocking;
 
-    if (srv->listen_sockfd != -1){
-        sock_set_blocking(srv->listen_sockfd, blocking);
+    // boundary check
+    if ((u32_t)conn->req.header_len + conn->req.content_length > AES67_RTSP_SRV_RXBUFSIZE){
+        syslog(LOG_DEBUG, "rtsp srv: request too long (hdr %d, content %d)", conn->req.header_len, conn->req.content_length);
+        return -1;
     }
-    if (srv->client_sockfd != -1){
-        sock_set_blocking(srv->client_sockfd, blocking);
+
+    if (conn->req.data_len < conn->req.header_len + conn->req.content_length){
+        return 0;
     }
+
+    return 1;
 }
 
-void aes67_rtsp_srv_process(struct aes67_rtsp_srv * srv)
+static u16_t rtsp_srv_status(struct aes67_rtsp_srv_conn * conn, u16_t status_code, u8_t * d)
 {
-    assert(srv);
+    u16_t l = 0;
+
+    d[0] = 'R';
+    d[1] = 'T';
+    d[2] = 'S';
+    d[3] = 'P';
+    d[4] = '/';
+    d[5] = '0' + conn->req.version.major;
+    d[6] = '.';
+    d[7] = '0' + conn->req.version.minor;
+    d[8] = ' ';
+    l = 9;
+
+    l += aes67_itoa(status_code, d + l , 10);
+
+    d[l++] = ' ';
+
+    switch(status_code){
+        case AES67_RTSP_STATUS_OK:
+            d[l++] = 'O';
+            d[l++] = 'K';
+            break;
+        case AES67_RTSP_STATUS_NOT_FOUND:
+            d[l++] = 'N';
+            d[l++] = 'O';
+            d[l++] = 'T';
+            d[l++] = ' ';
+            d[l++] = 'F';
+            d[l++] = 'O';
+            d[l++] = 'U';
+            d[l++] = 'N';
+            d[l++] = 'D';
+            break;
+        case AES67_RTSP_STATUS_NOT_IMPLEMENTED:
+            d[l++] = 'N';
+            d[l++] = 'O';
+            d[l++] = 'T';
+            d[l++] = ' ';
+            d[l++] = 'I';
+            d[l++] = 'M';
+            d[l++] = 'P';
+            d[l++] = 'L';
+            d[l++] = 'E';
+            d[l++] = 'M';
+            d[l++] = 'T';
+            d[l++] = 'E';
+            d[l++] = 'D';
+            break;
+        default:
+            d[l++] = '?';
+    }
 
-    if (srv->state == aes67_rtsp_srv_state_init){
-        return;
+    d[l++] = '\r';
+    d[l++] = '\n';
+
+    d[l++] = 'C';
+    d[l++] = 'S';
+    d[l++] = 'e';
+    d[l++] = 'q';
+    d[l++] = ':';
+    d[l++] = ' ';
+    l += aes67_itoa(conn->req.cseq, d + l, 10);
+    d[l++] = '\r';
+    d[l++] = '\n';
+
+    if (!conn->keepalive){
+        aes67_memcpy(d + l, "Connection: close\r\n", sizeof("Connection: close\r\n")-1);
+        l += sizeof("Connection: close\r\n")-1;
     }
-    if (srv->state == aes67_rtsp_srv_state_listening) {
-        socklen_t socklen;
-        if ((srv->client_sockfd = accept(srv->listen_sockfd, (struct sockaddr *) &srv->client_addr,
-                                         &socklen)) != -1) {
 
-            srv->state = aes67_rtsp_srv_state_receiving;
-            srv->req.proto = aes67_rtsp_srv_proto_undefined;
-            srv->req.data_len = 0;
-            srv->req.header_len = 0;
-            srv->req.content_length = 0;
-            srv->req.CR = 0;
-//            srv->res.status_code = 0;
+    return l;
+}
 
-            sock_set_blocking(srv->client_sockfd, srv->blocking);
+/**
+ * Lets http handler (initially or continuously) generate the response.
+ */
+static void rtsp_srv_http_call(struct aes67_rtsp_srv * srv, struct aes67_rtsp_srv_conn * conn)
+{
+    conn->res.len = 0;
+    conn->res.sent = 0;
+
+    srv->current = conn;
+    aes67_rtsp_srv_http_handler(srv, conn->req.method, (char *) conn->req.uri, conn->req.urilen, conn->res.data,
+                                &conn->res.len, AES67_RTSP_SRV_TXBUFSIZE, &conn->res.more,
+                                &conn->res.response_state);
+    srv->current = NULL;
+}
 
-            u8_t ipstr[AES67_NET_ADDR_STR_MAX];
-            u8_t iplen = aes67_net_ip2str(ipstr, aes67_net_ipver_4, (u8_t*)&srv->client_addr.sin_addr.s_addr, ntohs(srv->client_addr.sin_port));
-            ipstr[iplen] = '\0';
+static void rtsp_srv_respond(struct aes67_rtsp_srv * srv, struct aes67_rtsp_srv_conn * conn)
+{
+    conn->res.more = false;
+    conn->res.len = 0;
+    conn->res.sent = 0;
+    conn->res.body = NULL;
+    conn->res.response_state = NULL;
 
-            fprintf(stderr, "RTSP SRV connection from %s\n", ipstr);
-        }
-        return;
-    }
+    if (conn->req.proto == aes67_rtsp_srv_proto_rtsp){
 
-    //sanity check
-    if (srv->client_sockfd == -1){
-        srv->state = aes67_rtsp_srv_state_listening;
-        return;
-    }
+        u16_t status_code = AES67_RTSP_STATUS_INTERNAL_ERROR;
+        struct aes67_rtsp_srv_resource * res = NULL;
 
+        switch (conn->req.method){
 
-    if (srv->state == aes67_rtsp_srv_state_receiving){
+            case aes67_rtsp_srv_method_options:
+                status_code = AES67_RTSP_STATUS_OK;
+                break;
 
-        ssize_t r; // read result
-        u8_t c; // read buf
-        u16_t rl; // readlen
-        int CR = srv->req.CR;
+            case aes67_rtsp_srv_method_describe:
+                res = rtsp_resource_by_uri(srv, conn->req.uri, conn->req.urilen);
+                if (res == NULL){
+                    status_code  = AES67_RTSP_STATUS_NOT_FOUND;
+                } else {
+                    status_code = AES67_RTSP_STATUS_OK;
+                }
+                break;
 
-        // read first line
+            default:
+                // well, in principle this is what would be the answer (not necessarily RFC conform)
+                // but this case should be caught earlier on and execution should never reach here
+                status_code = AES67_RTSP_STATUS_NOT_IMPLEMENTED;
+        }
 
-        if (srv->req.proto == aes67_rtsp_srv_proto_undefined){
-            // read only a meaningful max
-            while(srv->req.data_len < 256 ){
+        u8_t * d = conn->res.data;
+        u16_t l = rtsp_srv_status(conn, status_code, d);
 
-                r = read(srv->client_sockfd, &c, 1);
+        switch (conn->req.method){
 
-                if (r == -1){ // timeout
-                    return;
-                } else if (r == 0) { // closed
-                    close(srv->client_sockfd);
-                    srv->client_sockfd = -1;
-                    srv->state = aes67_rtsp_srv_state_listening;
-                    return;
-                } else if (r == 1) {
-                    srv->req.data[srv->req.data_len++] = c;
-
-                    // if EOL
-                    if (c == '\n'){
-
-                        // basic sanity check
-                        if (srv->req.data_len < 15){
-                            close(srv->client_sockfd);
-                            srv->client_sockfd = -1;
-                            srv->state = aes67_rtsp_srv_state_listening;
-                            return;
-                        }
-                        // check if using carriage return
-                        if (srv->req.data[srv->req.data_len - 2] == '\r'){
-                            CR = srv->req.CR = 1;
-                        }
-
-                        u8_t * s = &srv->req.data[srv->req.data_len - CR - sizeof("HTTP/1.0")];
-
-//                        printf("[%s] [%s]\n", srv->req.data, s);
-
-                        if (s[0] == 'H' &&
-                            s[1] == 'T' &&
-                            s[2] == 'T' &&
-                            s[3] == 'P' &&
-                            s[4] == '/' &&
-                            s[6] == '.'
-                        ){
-                            if (!srv->http_enabled){
-                                close(srv->client_sockfd);
-                                srv->client_sockfd = -1;
-                                srv->state = aes67_rtsp_srv_state_listening;
-                                return;
-                            }
-
-                            srv->req.proto = aes67_rtsp_srv_proto_http;
-                        }
-                        else if (s[0] == 'R' &&
-                                 s[1] == 'T' &&
-                                 s[2] == 'S' &&
-                                 s[3] == 'P' &&
-                                 s[4] == '/' &&
-                                 s[6] == '.'
-                                ){
-
-                            srv->req.proto = aes67_rtsp_srv_proto_rtsp;
-                        }
-                        // client error, just terminate connection without response
-                        else {
-                            close(srv->client_sockfd);
-                            srv->client_sockfd = -1;
-                            srv->state = aes67_rtsp_srv_state_listening;
-                            return;
-                        }
-
-                        // without proper validation
-                        srv->req.version.major = s[5] - '0';
-                        srv->req.version.minor = s[7] - '0';
-
-                        s = srv->req.data;
-
-                        srv->req.data[srv->req.data_len] = '\0';
-                        fprintf(stderr, "REQUEST %s", s);
-
-                        if (srv->req.proto == aes67_rtsp_srv_proto_rtsp &&
-                            s[0] == 'D' &&
-                            s[1] == 'E' &&
-                            s[2] == 'S' &&
-                            s[3] == 'C' &&
-                            s[4] == 'R' &&
-                            s[5] == 'I' &&
-                            s[6] == 'B' &&
-                            s[7] == 'E'
-                                ) {
-                            srv->req.method = aes67_rtsp_srv_method_describe;
-                            srv->req.uri = &s[9];
-                        }
-                        else if (s[0] == 'O' && // supported by both rtsp and http
-                                 s[1] == 'P' &&
-                                 s[2] == 'T' &&
-                                 s[3] == 'I' &&
-                                 s[4] == 'O' &&
-                                 s[5] == 'N' &&
-                                 s[6] == 'S'
-                                ) {
-                            srv->req.method = aes67_rtsp_srv_method_options;
-                            srv->req.uri = &s[8];
-                        }
-                        else if (srv->req.proto == aes67_rtsp_srv_proto_http &&
-                                 s[0] == 'G' &&
-                                 s[1] == 'E' &&
-                                 s[2] == 'T'
-                                ) {
-                            srv->req.method = aes67_rtsp_srv_method_get;
-                            srv->req.uri = &s[4];
-                        }
-                        else if (srv->req.proto == aes67_rtsp_srv_proto_http &&
-                                 s[0] == 'P' &&
-                                 s[1] == 'O' &&
-                                 s[2] == 'S' &&
-                                 s[3] == 'T'
-                                ) {
-                            srv->req.method = aes67_rtsp_srv_method_post;
-                            srv->req.uri = &s[5];
-                        }
-                        else if (srv->req.proto == aes67_rtsp_srv_proto_http &&
-                                 s[0] == 'P' &&
-                                 s[1] == 'U' &&
-                                 s[2] == 'T'
-                                ) {
-                            srv->req.method = aes67_rtsp_srv_method_put;
-                            srv->req.uri = &s[4];
-                        }
-                        else if (srv->req.proto == aes67_rtsp_srv_proto_http &&
-                                 s[0] == 'D' &&
-                                 s[1] == 'E' &&
-                                 s[2] == 'L' &&
-                                 s[3] == 'E' &&
-                                 s[4] == 'T' &&
-                                 s[5] == 'E'
-                                ) {
-                            srv->req.method = aes67_rtsp_srv_method_delete;
-                            srv->req.uri = &s[7];
-                        }
-                        else {
-                            // method not supported/recognized, terminate without response
-                            close(srv->client_sockfd);
-                            srv->client_sockfd = -1;
-                            srv->state = aes67_rtsp_srv_state_listening;
-                            fprintf(stderr, "method not recognized\n");
-                            return;
-                        }
-
-                        // "RTSP/1.0" - "METHOD .."
-                        srv->req.urilen = &srv->req.data[srv->req.data_len - CR - sizeof(" HTTP/1.0")] - srv->req.uri;
-
-                        srv->req.uri[srv->req.urilen] = '\0';
-//                        printf("uri[%d] = [%s]\n", srv->req.urilen, srv->req.uri);
-                        // if  rtsp, discard scheme and host
-                        if (srv->req.proto == aes67_rtsp_srv_proto_rtsp){
-
-                            // basic validation
-                            if (srv->req.uri[0] != 'r' ||
-                                srv->req.uri[1] != 't' ||
-                                srv->req.uri[2] != 's' ||
-                                srv->req.uri[3] != 'p' ||
-                                srv->req.uri[4] != ':' ||
-                                srv->req.uri[5] != '/' ||
-                                srv->req.uri[6] != '/'
-                                    ){
-                                close(srv->client_sockfd);
-                                srv->client_sockfd = -1;
-                                srv->state = aes67_rtsp_srv_state_listening;
-                                return;
-                            }
-                            srv->req.uri += 7;
-                            srv->req.urilen -= 7;
-
-                            u8_t * delim = aes67_memchr(srv->req.uri, '/', srv->req.urilen);
-                            if (delim == NULL){
-                                close(srv->client_sockfd);
-                                srv->client_sockfd = -1;
-                                srv->state = aes67_rtsp_srv_state_listening;
-                                return;
-                            }
-
-                            srv->req.urilen -= delim - srv->req.uri;
-                            srv->req.uri = delim;
-                        }
-                        else if (srv->req.proto == aes67_rtsp_srv_proto_http){
-                            // sanity check
-                            if (srv->req.uri[0] != '/'){
-                                close(srv->client_sockfd);
-                                srv->client_sockfd = -1;
-                                srv->state = aes67_rtsp_srv_state_listening;
-                                return;
-                            }
-                        }
-//                        printf("uri[%d] = [%s]\n", srv->req.urilen, srv->req.uri);
-
-                        // set line start
-                        srv->req.line = &srv->req.data[srv->req.data_len];
-                        srv->req.llen = 0;
+            case aes67_rtsp_srv_method_options:
+                aes67_memcpy(d + l, "Public: DESCRIBE\r\n\r\n", sizeof("Public: DESCRIBE\r\n\r\n")-1);
+                l += sizeof("Public: DESCRIBE\r\n\r\n")-1;
+                break;
 
+            case aes67_rtsp_srv_method_describe:
+                if (res){
+                    // header fields and SDP are sent from the (shared) cached response
+                    conn->res.body = rtsp_srv_render(srv, res, d + l, AES67_RTSP_SRV_TXBUFSIZE - l);
+                    if (conn->res.body != NULL){
+                        conn->res.body->refs++;
                         break;
                     }
+                    // session (description) not available (anymore)
+                    l = rtsp_srv_status(conn, AES67_RTSP_STATUS_NOT_FOUND, d);
+                }
+                // add end of header / empty line
+                d[l++] = '\r';
+                d[l++] = '\n';
+                break;
+
+            default:
+                // add end of header / empty line
+                d[l++] = '\r';
+                d[l++] = '\n';
+                break;
+        }
+
+        conn->res.len = l;
+
+    } // proto == aes67_rtsp_srv_proto_rtsp
+    else if (conn->req.proto == aes67_rtsp_srv_proto_http){
+
+        // responses (including headers) are generated by the handler, thus the connection can not be reused
+        conn->keepalive = false;
+
+        rtsp_srv_http_call(srv, conn);
+
+    } // proto == aes67_rtsp_srv_proto_http
+}
+
+/**
+ * Advances connection state machine as far as possible without blocking.
+ */
+static void rtsp_srv_conn_process(struct aes67_rtsp_srv * srv, struct aes67_rtsp_srv_conn * conn)
+{
+    while(conn->state != aes67_rtsp_srv_state_init){
+
+        if (conn->state == aes67_rtsp_srv_state_receiving){
+
+            int r = rtsp_srv_parse(srv, conn);
+
+            if (r == 0){
+                ssize_t rlen = recv(conn->sockfd, &conn->req.data[conn->req.data_len], AES67_RTSP_SRV_RXBUFSIZE - conn->req.data_len, 0);
+
+                if (rlen == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)){
+                    rtsp_srv_watch(srv, conn->sockfd, conn - srv->conn, &conn->events, POLLIN);
+                    return;
+                }
+                if (rlen <= 0){ // closed or failed
+                    rtsp_srv_conn_close(srv, conn);
+                    return;
                 }
+
+                conn->req.data_len += rlen;
+                conn->last_activity = time(NULL);
+
+                r = rtsp_srv_parse(srv, conn);
             }
-            // fail if using too much memory
-            if (srv->req.data_len >= 256){
-                close(srv->client_sockfd);
-                srv->client_sockfd = -1;
-                srv->state = aes67_rtsp_srv_state_listening;
+
+            if (r == -1){
+                rtsp_srv_conn_close(srv, conn);
                 return;
             }
-        } // read first line
+            if (r == 0){
+                continue;
+            }
 
+            conn->state = aes67_rtsp_srv_state_processing;
+        }
 
-        // read complete header
-        if (srv->req.header_len == 0) {
+        if (conn->state == aes67_rtsp_srv_state_processing){
 
-            while (srv->req.data_len < AES67_RTSP_SRV_RXBUFSIZE) {
+            rtsp_srv_respond(srv, conn);
 
-                r = read(srv->client_sockfd, &c, 1);
+            if (conn->res.len == 0 && !conn->res.more){
+                rtsp_srv_conn_close(srv, conn);
+                return;
+            }
 
-                if (r == -1) { // timeout
-                    return;
-                } else if (r == 0) { // closed
-                    close(srv->client_sockfd);
-                    srv->client_sockfd = -1;
-                    srv->state = aes67_rtsp_srv_state_listening;
-//                    printf("closed!\n");
+            conn->state = aes67_rtsp_srv_state_sending;
+        }
+
+        if (conn->state == aes67_rtsp_srv_state_sending){
+
+            if (conn->res.parked){
+                // the client is not expected to send anything, but might close the connection
+                u8_t discard[64];
+                ssize_t r = recv(conn->sockfd, discard, sizeof(discard), 0);
+                if (r == 0 || (r == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)){
+                    rtsp_srv_conn_close(srv, conn);
+                }
+                return;
+            }
+
+            while (conn->res.sent < conn->res.len + (conn->res.body ? conn->res.body->len : 0)){
+
+                // status line, CSeq (and remaining header of http) followed by any cached response
+                struct iovec iov[2];
+                int iovcnt = 0;
+
+                if (conn->res.sent < conn->res.len){
+                    iov[iovcnt].iov_base = conn->res.data + conn->res.sent;
+                    iov[iovcnt].iov_len = conn->res.len - conn->res.sent;
+                    iovcnt++;
+                }
+                if (conn->res.body != NULL){
+                    u16_t offset = conn->res.sent > conn->res.len ? conn->res.sent - conn->res.len : 0;
+                    iov[iovcnt].iov_base = conn->res.body->data + offset;
+                    iov[iovcnt].iov_len = conn->res.body->len - offset;
+                    iovcnt++;
+                }
+
+                struct msghdr msg = {
+                    .msg_iov = iov,
+                    .msg_iovlen = iovcnt
+                };
+
+                ssize_t r = sendmsg(conn->sockfd, &msg, MSG_NOSIGNAL);
+
+                if (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)){
+                    rtsp_srv_watch(srv, conn->sockfd, conn - srv->conn, &conn->events, POLLOUT);
                     return;
-                } else if (r == 1) {
-                    srv->req.data[srv->req.data_len++] = c;
-                    srv->req.llen++;
-
-                    // if EOL
-                    if (c == '\n') {
-
-                        // end of header? ([CR]NL)
-                        if (srv->req.llen == 1 + CR && (!CR || srv->req.line[0] == '\r') && srv->req.line[CR] == '\n') {
-                            srv->req.header_len = srv->req.data_len;
-                            // break to start reading body
-                            break;
-                        }
-
-
-                        // expect a header line: "<attr>: <value>\r\n"
-                        u8_t *delim = aes67_memchr(srv->req.line, ':', srv->req.line - &srv->req.data[srv->req.data_len]);
-                        if (delim != NULL) {
-
-//                            res->buf[res->buflen] = '\0';
-//                            printf("line %d [%s]\n", res->llen, res->line);
-//                            printf("%d\n", aes67_ischar_insensitive(res->line[8], 'l'));
-
-                            // verify cseq?
-                            if (delim - srv->req.line == sizeof("CSeq") - 1 &&
-                                srv->req.llen >= sizeof("CSeq: 1") + CR &&
-                                aes67_ischar_insensitive(srv->req.line[0], 'c') &&
-                                aes67_ischar_insensitive(srv->req.line[1], 's') &&
-                                srv->req.line[2] == 'e' &&
-                                srv->req.line[3] == 'q'
-                                    ) {
-                                srv->req.cseq = aes67_atoi(delim + 2, srv->req.llen - sizeof("cseq: ") - CR, 10, &rl);
-                            }
-
-                            // look for content-length field
-                            if (delim - srv->req.line == sizeof("Content-Length") - 1 &&
-                                srv->req.llen >= sizeof("Content-Length: 1") + CR &&
-                                aes67_ischar_insensitive(srv->req.line[0], 'c') &&
-                                srv->req.line[1] == 'o' &&
-                                srv->req.line[2] == 'n' &&
-                                srv->req.line[3] == 't' &&
-                                srv->req.line[4] == 'e' &&
-                                srv->req.line[5] == 'n' &&
-                                srv->req.line[6] == 't' &&
-                                srv->req.line[7] == '-' &&
-                                aes67_ischar_insensitive(srv->req.line[8], 'l') &&
-                                srv->req.line[9] == 'e' &&
-                                srv->req.line[10] == 'n' &&
-                                srv->req.line[11] == 'g' &&
-                                srv->req.line[12] == 't' &&
-                                srv->req.line[13] == 'h'
-                                    ) {
-                                srv->req.content_length = aes67_atoi(delim + 2, srv->req.llen - sizeof("content-length: \r"), 10,
-                                                                     &rl);
-                            }
-
-                        }
-
-                        // reset line start
-                        srv->req.line = &srv->req.data[srv->req.data_len];
-                        srv->req.llen = 0;
-                    }
                 }
-                // fail if using too much memory
-                if (srv->req.data_len >= AES67_RTSP_SRV_RXBUFSIZE) {
-                    close(srv->client_sockfd);
-                    srv->client_sockfd = -1;
-                    srv->state = aes67_rtsp_srv_state_listening;
-                    fprintf(stderr, "overflow\n");
+                if (r <= 0){
+                    rtsp_srv_conn_close(srv, conn);
                     return;
                 }
+
+                conn->res.sent += r;
+                conn->last_activity = time(NULL);
+
+                // if http with more data to send, call handler again
+                if (conn->res.sent == conn->res.len && conn->req.proto == aes67_rtsp_srv_proto_http && conn->res.more) {
+                    rtsp_srv_http_call(srv, conn);
+                }
             }
-        } // header
-
-        // read body (if total data is less than header and expected content length..)
-        u16_t missing = srv->req.content_length - (srv->req.data_len - srv->req.header_len);
-        if (missing > 0) {
-
-            // boundary check
-            if (srv->req.data_len + missing >= AES67_RTSP_SRV_RXBUFSIZE){
-                close(srv->client_sockfd);
-                srv->client_sockfd = -1;
-                srv->state = aes67_rtsp_srv_state_listening;
-                fprintf(stderr, "would overflow (has %d, hdr %d, content %d, missing %d)\n", srv->req.data_len, srv->req.header_len, srv->req.content_length, missing);
+
+            // more data to come, but not yet available (see aes67_rtsp_srv_http_wake())
+            if (conn->req.proto == aes67_rtsp_srv_proto_http && conn->res.more){
+                conn->res.parked = true;
+                rtsp_srv_watch(srv, conn->sockfd, conn - srv->conn, &conn->events, POLLIN);
                 return;
             }
 
-            r = read(srv->client_sockfd, &srv->req.data[srv->req.data_len], missing);
+            if (conn->res.body != NULL){
+                rtsp_srv_rendered_release(conn->res.body);
+                conn->res.body = NULL;
+            }
+
+            conn->served++;
 
-            if (r == -1){ // timeout
-                return;
-            } else if (r == 0) { // closed prematurely
-                close(srv->client_sockfd);
-                srv->client_sockfd = -1;
-                srv->state = aes67_rtsp_srv_state_listening;
+            if (!conn->keepalive){
+                rtsp_srv_conn_close(srv, conn);
                 return;
-            } else if (r > 0) {
-                srv->req.data_len += r;
-                missing -= r;
             }
+
+            // discard served request, any remaining data is the next (pipelined) request
+            u16_t reqlen = conn->req.header_len + conn->req.content_length;
+            conn->req.data_len -= reqlen;
+            memmove(conn->req.data, &conn->req.data[reqlen], conn->req.data_len);
+
+            rtsp_srv_req_reset(conn);
+
+            conn->state = aes67_rtsp_srv_state_receiving;
         }
+    }
+}
 
-        if (missing == 0){
-            srv->state = aes67_rtsp_srv_state_processing;
+/**
+ * Asks http handler of parked response for more data.
+ */
+static void rtsp_srv_conn_resume(struct aes67_rtsp_srv * srv, struct aes67_rtsp_srv_conn * conn)
+{
+    conn->res.parked = false;
+
+    rtsp_srv_http_call(srv, conn);
+
+    rtsp_srv_conn_process(srv, conn);
+}
+
+#if AES67_RTSP_SRV_EPOLL == 0
+static size_t rtsp_srv_pollfds(struct aes67_rtsp_srv * srv, struct pollfd * fds, u32_t * ids, size_t max)
+{
+    size_t count = 0;
+
+    if (srv->listen_sockfd != -1 && count < max && rtsp_srv_can_accept(srv)){
+        fds[count].fd = srv->listen_sockfd;
+        fds[count].events = POLLIN;
+        fds[count].revents = 0;
+        if (ids){
+            ids[count] = LISTEN_ID;
         }
-    } // state == aes67_rtsp_srv_state_receiving
+        count++;
+    }
 
+    if (srv->wakefd[0] != -1 && count < max){
+        fds[count].fd = srv->wakefd[0];
+        fds[count].events = POLLIN;
+        fds[count].revents = 0;
+        if (ids){
+            ids[count] = WAKE_ID;
+        }
+        count++;
+    }
 
-    if (srv->state == aes67_rtsp_srv_state_processing){
-        if (srv->req.proto == aes67_rtsp_srv_proto_rtsp){
-//            fprintf(stderr, "is rtsp\n");
+    for(u16_t i = 0; i < AES67_RTSP_SRV_MAXCONN && count < max; i++){
+        struct aes67_rtsp_srv_conn * conn = &srv->conn[i];
+        if (conn->state == aes67_rtsp_srv_state_init){
+            continue;
+        }
+        fds[count].fd = conn->sockfd;
+        fds[count].events = conn->state == aes67_rtsp_srv_state_sending && !conn->res.parked ? POLLOUT : POLLIN;
+        fds[count].revents = 0;
+        if (ids){
+            ids[count] = i;
+        }
+        count++;
+    }
 
-            u16_t status_code = AES67_RTSP_STATUS_INTERNAL_ERROR;
-            struct aes67_rtsp_srv_resource * res = NULL;
+    return count;
+}
+#endif
 
-            switch (srv->req.method){
+void aes67_rtsp_srv_init(struct aes67_rtsp_srv * srv, bool http_enabled, void * user_data)
+{
+    assert(srv);
 
-                case aes67_rtsp_srv_method_options:
-                    status_code = AES67_RTSP_STATUS_OK;
-                    break;
+    srv->state = aes67_rtsp_srv_state_init;
+    srv->first_res = NULL;
+    for(u16_t i = 0; i < AES67_RTSP_SRV_URI_HASHSIZE; i++){
+        srv->uri_index[i] = NULL;
+        srv->sdpref_index[i] = NULL;
+    }
 
-                case aes67_rtsp_srv_method_describe:
-                    res = rtsp_resource_by_uri(srv, srv->req.uri, srv->req.urilen);
-                    if (res == NULL){
-                        status_code  = AES67_RTSP_STATUS_NOT_FOUND;
-                    } else {
-                        status_code = AES67_RTSP_STATUS_OK;
-                    }
-                    break;
+    srv->http_enabled = http_enabled;
+    srv->user_data = user_data;
 
-                default:
-                    // well, in principle this is what would be the answer (not necessarily RFC conform)
-                    // but this case should be caught earlier on and execution should never reach here
-                    status_code = AES67_RTSP_STATUS_NOT_IMPLEMENTED;
-            }
+    srv->listen_sockfd = -1;
+    srv->listen_events = 0;
+    srv->epfd = -1;
+    srv->wakefd[0] = -1;
+    srv->wakefd[1] = -1;
+    srv->blocking = true;
+    srv->current = NULL;
+
+    srv->nconn = 0;
+    for(u16_t i = 0; i < AES67_RTSP_SRV_MAXCONN; i++){
+        srv->conn[i].state = aes67_rtsp_srv_state_init;
+        srv->conn[i].sockfd = -1;
+        srv->conn[i].events = 0;
+        srv->conn[i].res.body = NULL;
+    }
+}
 
+void aes67_rtsp_srv_deinit(struct aes67_rtsp_srv * srv)
+{
+    assert(srv);
 
-            u8_t * d = srv->res.data;
-            u16_t l = 0;
+    aes67_rtsp_srv_stop(srv);
 
-            d[0] = 'R';
-            d[1] = 'T';
-            d[2] = 'S';
-            d[3] = 'P';
-            d[4] = '/';
-            d[5] = '0' + srv->req.version.major;
-            d[6] = '.';
-            d[7] = '0' + srv->req.version.minor;
-            d[8] = ' ';
-            l = 9;
+    while(srv->first_res){
+        aes67_rtsp_srv_sdp_remove(srv, srv->first_res->sdpref);
+    }
 
-            l += aes67_itoa(status_code, d + l , 10);
+    srv->state = aes67_rtsp_srv_state_init;
+}
 
-            d[l++] = ' ';
+int aes67_rtsp_srv_start(struct aes67_rtsp_srv * srv, const enum aes67_net_ipver ipver, const u8_t *ip, u16_t port)
+{
+    assert(srv);
+    assert(ipver == aes67_net_ipver_4);
+//    assert(ip);
+    assert(port);
 
-            switch(status_code){
-                case AES67_RTSP_STATUS_OK:
-                    d[l++] = 'O';
-                    d[l++] = 'K';
-                    break;
-                case AES67_RTSP_STATUS_NOT_FOUND:
-                    d[l++] = 'N';
-                    d[l++] = 'O';
-                    d[l++] = 'T';
-                    d[l++] = ' ';
-                    d[l++] = 'F';
-                    d[l++] = 'O';
-                    d[l++] = 'U';
-                    d[l++] = 'N';
-                    d[l++] = 'D';
-                    break;
-                case AES67_RTSP_STATUS_NOT_IMPLEMENTED:
-                    d[l++] = 'N';
-                    d[l++] = 'O';
-                    d[l++] = 'T';
-                    d[l++] = ' ';
-                    d[l++] = 'I';
-                    d[l++] = 'M';
-                    d[l++] = 'P';
-                    d[l++] = 'L';
-                    d[l++] = 'E';
-                    d[l++] = 'M';
-                    d[l++] = 'T';
-                    d[l++] = 'E';
-                    d[l++] = 'D';
-                    break;
-                default:
-                    d[l++] = '?';
-            }
+    aes67_rtsp_srv_stop(srv);
 
-            d[l++] = '\r';
-            d[l++] = '\n';
+    srv->listen_sockfd = socket (AF_INET, SOCK_STREAM, 0);
 
-            d[l++] = 'C';
-            d[l++] = 'S';
-            d[l++] = 'e';
-            d[l++] = 'q';
-            d[l++] = ':';
-            d[l++] = ' ';
-            l += aes67_itoa(srv->req.cseq, d + l, 10);
-            d[l++] = '\r';
-            d[l++] = '\n';
+    if (srv->listen_sockfd < 0){
+        perror ("socket()");
+        return EXIT_FAILURE;
+    }
 
-            switch (srv->req.method){
+    // allow restarts while connections closed by us linger (in TIME_WAIT)
+    int yes = 1;
+    setsockopt(srv->listen_sockfd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
 
-                case aes67_rtsp_srv_method_options:
-                    aes67_memcpy(d + l, "Public: DESCRIBE\r\n\r\n", sizeof("Public: DESCRIBE\r\n\r\n")-1);
-                    l += sizeof("Public: DESCRIBE\r\n\r\n")-1;
-                    break;
+    memset(&srv->listen_addr, 0, sizeof(struct sockaddr_in));
 
-                case aes67_rtsp_srv_method_describe:
-                    if (res){
-                        l += aes67_rtsp_srv_sdp_getter(srv, res->sdpref, d + l, AES67_RTSP_SRV_TXBUFSIZE - l);
-                    } else {
-                        // add end of header / empty line
-                        d[l++] = '\r';
-                        d[l++] = '\n';
-                    }
-                    break;
+    srv->listen_addr.sin_family = AF_INET;
+    srv->listen_addr.sin_port = htons(port);
+    if (ip){
+        srv->listen_addr.sin_addr.s_addr = *(uint32_t*)ip;
+    } else {
+        srv->listen_addr.sin_addr.s_addr = INADDR_ANY;
+    }
 
-                default:
-                    // add end of header / empty line
-                    d[l++] = '\r';
-                    d[l++] = '\n';
-                    break;
-            }
 
-            srv->res.len = l;
-            srv->res.sent = 0;
+    if (bind (srv->listen_sockfd, (struct sockaddr *) &srv->listen_addr, sizeof(struct sockaddr_in)) < 0){
+        close(srv->listen_sockfd);
+        srv->listen_sockfd = -1;
+        perror ("bind()");
+        return EXIT_FAILURE;
+    }
 
-            srv->state = aes67_rtsp_srv_state_sending;
 
-        } // proto == aes67_rtsp_srv_proto_rtsp
-        else if (srv->req.proto == aes67_rtsp_srv_proto_http){
+    if (listen(srv->listen_sockfd, AES67_RTSPSRV_LISTEN_BACKLOG) == -1){
+        close(srv->listen_sockfd);
+        srv->listen_sockfd = -1;
+        perror ("listen()");
+        return EXIT_FAILURE;
+    }
 
-            srv->res.more = false;
-            srv->res.len = 0;
-            srv->res.sent = 0;
-            srv->res.response_state = NULL;
 
-            // NULL-terminate just to make simpler for processor (note, we're altering the buffer hereby, obviously..)
-//            srv->req.uri[srv->req.urilen] = '\0';
+    if (sock_set_blocking(srv->listen_sockfd, false)){
+        fprintf(stderr, "Couldn't change non-/blocking\n");
+        return EXIT_FAILURE;
+    }
 
-            aes67_rtsp_srv_http_handler(srv, srv->req.method, (char*)srv->req.uri, srv->req.urilen, srv->res.data, &srv->res.len, AES67_RTSP_SRV_TXBUFSIZE, &srv->res.more, &srv->res.response_state);
+#if AES67_RTSP_SRV_EPOLL == 1
+    srv->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (srv->epfd == -1){
+        perror ("epoll_create1()");
+        close(srv->listen_sockfd);
+        srv->listen_sockfd = -1;
+        return EXIT_FAILURE;
+    }
+#endif
 
-            if (srv->res.len == 0){
-//                fprintf(stderr, "no http data, closing\n");
+    srv->listen_events = 0;
+    rtsp_srv_watch(srv, srv->listen_sockfd, LISTEN_ID, &srv->listen_events, POLLIN);
 
-                close(srv->client_sockfd);
-                srv->client_sockfd = -1;
-                srv->state = aes67_rtsp_srv_state_listening;
-            } else {
-                srv->state = aes67_rtsp_srv_state_sending;
-            }
+    // wakeup of parked http responses (possibly from other threads)
+    if (pipe(srv->wakefd) == -1){
+        perror ("pipe()");
+        aes67_rtsp_srv_stop(srv);
+        return EXIT_FAILURE;
+    }
+    sock_set_blocking(srv->wakefd[0], false);
+    sock_set_blocking(srv->wakefd[1], false);
 
-        } // proto == aes67_rtsp_srv_proto_http
-    } // state == aes67_rtsp_srv_state_processing
+    short wake_events = 0;
+    rtsp_srv_watch(srv, srv->wakefd[0], WAKE_ID, &wake_events, POLLIN);
 
-    if (srv->state == aes67_rtsp_srv_state_sending){
+    srv->state = aes67_rtsp_srv_state_listening;
 
-        if (srv->res.sent < srv->res.len){
-//            fprintf(stderr, "Sending %d bytes..\n", srv->res.len - srv->res.sent);
+    return EXIT_SUCCESS;
+}
 
-            int r = write(srv->client_sockfd, srv->res.data + srv->res.sent, srv->res.len - srv->res.sent);
+void aes67_rtsp_srv_stop(struct aes67_rtsp_srv * srv)
+{
+    assert(srv);
 
-            if (r > 0){
-                srv->res.sent += r;
+    for(u16_t i = 0; i < AES67_RTSP_SRV_MAXCONN; i++){
+        rtsp_srv_conn_close(srv, &srv->conn[i]);
+    }
 
-                // just some sanity check because I'm not sure how this behaves in real life
-                assert(r == srv->res.len);
+    if (srv->listen_sockfd != -1){
+        close(srv->listen_sockfd);
+        srv->listen_sockfd = -1;
+        srv->listen_events = 0;
+    }
 
-                srv->res.len = 0;
+    if (srv->wakefd[0] != -1){
+        close(srv->wakefd[0]);
+        close(srv->wakefd[1]);
+        srv->wakefd[0] = -1;
+        srv->wakefd[1] = -1;
+    }
 
-                // if http with more data to send, call handler again
-                if (srv->req.proto == aes67_rtsp_srv_proto_http && srv->res.more) {
-                    aes67_rtsp_srv_http_handler(srv, srv->req.method, (char *) srv->req.uri, srv->req.urilen, srv->res.data,
-                                                &srv->res.len, AES67_RTSP_SRV_TXBUFSIZE, &srv->res.more,
-                                                &srv->res.response_state);
-                }
+    if (srv->epfd != -1){
+        close(srv->epfd);
+        srv->epfd = -1;
+    }
 
-                // no more data, terminate
-                if (srv->res.len == 0){
+    srv->state = aes67_rtsp_srv_state_init;
+}
 
-                    close(srv->client_sockfd);
-                    srv->client_sockfd = -1;
 
-                    srv->state = aes67_rtsp_srv_state_listening;
-                }
-            }
-            // if socket closed
-            else if (r == 0){
+void aes67_rtsp_srv_blocking(struct aes67_rtsp_srv * srv, bool blocking)
+{
+    assert(srv);
 
-                if (srv->req.proto == aes67_rtsp_srv_proto_http){
-                    aes67_rtsp_srv_http_handler(srv, aes67_rtsp_srv_method_undefined, NULL, 0, NULL, NULL, 0, &srv->res.more, &srv->res.response_state);
-                }
+    srv->blocking = blocking;
+}
 
-                close(srv->client_sockfd);
-                srv->client_sockfd = -1;
+void aes67_rtsp_srv_http_wake(struct aes67_rtsp_srv * srv)
+{
+    assert(srv);
+
+    if (srv->wakefd[1] != -1){
+        // if the pipe is full a wakeup is pending anyway
+        u8_t c = 1;
+        if (write(srv->wakefd[1], &c, 1)){}
+    }
+}
 
-                srv->state = aes67_rtsp_srv_state_listening;
+const u8_t * aes67_rtsp_srv_http_header(struct aes67_rtsp_srv * srv, const char * name, u16_t * len)
+{
+    assert(srv);
+    assert(name);
+    assert(len);
+
+    struct aes67_rtsp_srv_conn * conn = srv->current;
+
+    if (conn == NULL){
+        return NULL;
+    }
+
+    u8_t * data = conn->req.data;
+    u8_t * end = &data[conn->req.header_len];
+
+    // skip request line
+    u8_t * line = aes67_memchr(data, '\n', conn->req.header_len);
+
+    while(line != NULL && ++line < end){
+
+        u8_t * eol = aes67_memchr(line, '\n', end - line);
+        if (eol == NULL){
+            break;
+        }
+
+        u8_t * delim = aes67_memchr(line, ':', eol - line);
+        if (delim != NULL && header_name_eq(line, delim - line, name)){
+            u8_t * value = delim + 1;
+            while(value < eol && *value == ' '){
+                value++;
             }
+            while(eol > value && (eol[-1] == '\r' || eol[-1] == '\n' || eol[-1] == ' ')){
+                eol--;
+            }
+            *len = eol - value;
+            return value;
+        }
 
+        line = eol;
+    }
 
+    return NULL;
+}
+
+size_t aes67_rtsp_srv_getpollfds(struct aes67_rtsp_srv * srv, struct pollfd * fds, size_t max)
+{
+    assert(srv);
+    assert(fds);
+
+#if AES67_RTSP_SRV_EPOLL == 1
+    if (srv->epfd == -1 || max == 0){
+        return 0;
+    }
+    fds[0].fd = srv->epfd;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    return 1;
+#else
+    return rtsp_srv_pollfds(srv, fds, NULL, max);
+#endif
+}
+
+void aes67_rtsp_srv_process(struct aes67_rtsp_srv * srv)
+{
+    assert(srv);
+
+    if (srv->state == aes67_rtsp_srv_state_init){
+        return;
+    }
+
+    // when blocking, wake up regularly while there are connections (to time out)
+    int timeout = srv->blocking ? (srv->nconn ? 1000 : -1) : 0;
+
+    bool wake = false;
+
+#if AES67_RTSP_SRV_EPOLL == 1
+
+    struct epoll_event events[AES67_RTSP_SRV_MAXPOLLFDS];
+
+    int n = epoll_wait(srv->epfd, events, AES67_RTSP_SRV_MAXPOLLFDS, timeout);
+
+    for(int i = 0; i < n; i++){
+        u32_t id = events[i].data.u32;
+
+#else
+
+    struct pollfd fds[AES67_RTSP_SRV_MAXPOLLFDS];
+    u32_t ids[AES67_RTSP_SRV_MAXPOLLFDS];
+
+    size_t nfds = rtsp_srv_pollfds(srv, fds, ids, AES67_RTSP_SRV_MAXPOLLFDS);
+
+    int n = poll(fds, nfds, timeout);
+
+    for(size_t i = 0; n > 0 && i < nfds; i++){
+        if (fds[i].revents == 0){
+            continue;
+        }
+        u32_t id = ids[i];
+
+#endif
+
+        if (id == LISTEN_ID){
+            rtsp_srv_accept(srv);
+        } else if (id == WAKE_ID){
+            u8_t c[32];
+            while(read(srv->wakefd[0], c, sizeof(c)) > 0){}
+            wake = true;
+        } else if (id < AES67_RTSP_SRV_MAXCONN){
+            rtsp_srv_conn_process(srv, &srv->conn[id]);
         }
+    }
 
-    } //state == aes67_rtsp_srv_state_sending
+    time_t now = time(NULL);
+    for(u16_t i = 0; i < AES67_RTSP_SRV_MAXCONN; i++){
+        struct aes67_rtsp_srv_conn * conn = &srv->conn[i];
+
+        // continue parked responses on wakeup or when idle for a while (to let handler send some keep-alive data)
+        if (conn->state == aes67_rtsp_srv_state_sending && conn->res.parked &&
+            (wake || now - conn->last_activity >= AES67_RTSP_SRV_TIMEOUT_SEC / 2)){
+            rtsp_srv_conn_resume(srv, conn);
+        }
+
+        // drop connections without progress
+        if (conn->state != aes67_rtsp_srv_state_init && now - conn->last_activity > AES67_RTSP_SRV_TIMEOUT_SEC){
+            rtsp_srv_conn_close(srv, conn);
+        }
+    }
+
+    // stop watching the listening socket while there is no room for a connection
+    rtsp_srv_watch(srv, srv->listen_sockfd, LISTEN_ID, &srv->listen_events, rtsp_srv_can_accept(srv) ? POLLIN : 0);
 }
 
 WEAK_FUN u16_t aes67_rtsp_srv_sdp_getter(struct aes67_rtsp_srv * srv, void * sdpref, u8_t * buf, u16_t maxlen)
@@ -781,10 +1255,24 @@ struct aes67_rtsp_srv_resource * aes67_rtsp_srv_sdp_add(struct aes67_rtsp_srv *
     res->urilen = urilen;
 
     res->sdpref = sdpref;
+    res->rendered = NULL;
 
+    res->prev = NULL;
     res->next = srv->first_res;
+    if (res->next != NULL){
+        res->next->prev = res;
+    }
     srv->first_res = res;
 
+    res->hash = rtsp_srv_uri_hash((u8_t*)uri, urilen);
+    struct aes67_rtsp_srv_resource ** bucket = &srv->uri_index[res->hash & (AES67_RTSP_SRV_URI_HASHSIZE - 1)];
+    res->hnext = *bucket;
+    *bucket = res;
+
+    bucket = rtsp_srv_sdpref_bucket(srv, sdpref);
+    res->snext = *bucket;
+    *bucket = res;
+
     return res;
 }
 
@@ -793,33 +1281,57 @@ void aes67_rtsp_srv_sdp_remove(struct aes67_rtsp_srv * srv, void * sdpref)
     assert(srv);
     assert(sdpref);
 
-    struct aes67_rtsp_srv_resource * res = srv->first_res;
-
-    // locate resource
-    while (res && res->sdpref != sdpref){
-        res = res->next;
+    // locate resource (and unlink from sdpref index)
+    struct aes67_rtsp_srv_resource ** link = rtsp_srv_sdpref_bucket(srv, sdpref);
+    while (*link != NULL && (*link)->sdpref != sdpref){
+        link = &(*link)->snext;
     }
 
     // safety check
-    if (!res){
+    if (*link == NULL){
         return;
     }
 
+    struct aes67_rtsp_srv_resource * res = *link;
+    *link = res->snext;
+
     // now free resource
-    if (srv->first_res == res){
-        srv->first_res = res->next;
+    if (res->prev != NULL){
+        res->prev->next = res->next;
     } else {
-        struct aes67_rtsp_srv_resource * before = srv->first_res;
-        while(before != NULL){
-
-            if (before->next == res){
-                before->next = res->next;
-                break;
-            }
+        srv->first_res = res->next;
+    }
+    if (res->next != NULL){
+        res->next->prev = res->prev;
+    }
 
-            before = before->next;
+    // and from URI index
+    struct aes67_rtsp_srv_resource ** bucket = &srv->uri_index[res->hash & (AES67_RTSP_SRV_URI_HASHSIZE - 1)];
+    while(*bucket != NULL){
+        if (*bucket == res){
+            *bucket = res->hnext;
+            break;
         }
+        bucket = &(*bucket)->hnext;
+    }
+
+    // connections still sending the response keep their reference
+    if (res->rendered != NULL){
+        rtsp_srv_rendered_release(res->rendered);
     }
 
     free(res);
+}
+
+void aes67_rtsp_srv_sdp_changed(struct aes67_rtsp_srv * srv, void * sdpref)
+{
+    assert(srv);
+    assert(sdpref);
+
+    for(struct aes67_rtsp_srv_resource * res = *rtsp_srv_sdpref_bucket(srv, sdpref); res != NULL; res = res->snext){
+        if (res->sdpref == sdpref && res->rendered != NULL){
+            rtsp_srv_rendered_release(res->rendered);
+            res->rendered = NULL;
+        }
+    }
 }
\ No newline at end of file
@@ -0,0 +1,268 @@
+/**
+ * AES67 Framework
+ * Copyright (C) 2021  Philip Tschiemer, https://github.com/tschiemer/aes67
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "aes67/sap.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#define SESSIONS_MIN    1000
+#define SESSIONS_MAX    1000000
+
+#define OWN_SESSIONS    16
+
+// re-arming timers involves a syscall, ie measure fewer rounds
+#define TIMER_ROUNDS(rounds)    ((rounds) / 100 + 1)
+
+static struct {
+    u32_t sessions;
+    u32_t rounds;
+    double threshold;
+    bool verbose;
+} opts = {
+    .sessions = 100000,
+    .rounds = 1000000,
+    .threshold = 4.0,
+    .verbose = false
+};
+
+static char * argv0;
+
+static u32_t events[aes67_sap_event_refreshed + 1];
+
+static const char payload[] = "v=0\r\n"
+                              "o=- 1 1 IN IP4 10.0.0.1\r\n"
+                              "s=bench\r\n"
+                              "c=IN IP4 239.0.0.1/32\r\n"
+                              "t=0 0\r\n"
+                              "m=audio 5004 RTP/AVP 96\r\n"
+                              "a=rtpmap:96 L24/48000/2\r\n";
+
+static void help(FILE * fd)
+{
+    fprintf( fd,
+             "Usage: %s [-h|-?] [-v] [-n <sessions>] [-r <rounds>] [-t <factor>]\n"
+             "Measures the CPU time the SAP service spends per (unchanged) re-announcement and per (re-)arming of\n"
+             "its timeout and announcement timers while the session table grows by factors of ten up to <sessions>.\n"
+             "Fails if either grows by more than the given factor compared to the smallest table.\n"
+             "Options:\n"
+             "\t -h,-?\t\t Prints this info.\n"
+             "\t -n <sessions>\t Max number of sessions (default %u)\n"
+             "\t -r <rounds>\t Number of re-announcements to measure per table size (default %u)\n"
+             "\t -t <factor>\t Max acceptable growth factor (default %.1f)\n"
+             "\t -v\t\t Print event counters to STDERR\n"
+             , argv0, opts.sessions, opts.rounds, opts.threshold);
+}
+
+void
+aes67_sap_service_event(struct aes67_sap_service *sap, enum aes67_sap_event event, u16_t hash,
+                        enum aes67_net_ipver ipver, u8_t *ip, u8_t *payloadtype, u16_t payloadtypelen,
+                        u8_t *payload, u16_t payloadlen, void *user_data)
+{
+    if (AES67_SAP_EVENT_IS_VALID(event)){
+        events[event]++;
+    }
+}
+
+/**
+ * Writes announcement of the n-th session, ie a unique combination of msg hash and originating source.
+ */
+static u16_t packet(u8_t * msg, u32_t n)
+{
+    msg[AES67_SAP_STATUS] = AES67_SAP_STATUS_VERSION_2 | AES67_SAP_STATUS_ADDRTYPE_IPv4 | AES67_SAP_STATUS_MSGTYPE_ANNOUNCE;
+    msg[AES67_SAP_AUTH_LEN] = 0;
+
+    // never a zero hash
+    u16_t hash = (n % UINT16_MAX) + 1;
+    msg[AES67_SAP_MSG_ID_HASH] = hash >> 8;
+    msg[AES67_SAP_MSG_ID_HASH + 1] = hash & 0xff;
+
+    n /= UINT16_MAX;
+    msg[AES67_SAP_ORIGIN_SRC] = 10;
+    msg[AES67_SAP_ORIGIN_SRC + 1] = (n >> 16) & 0xff;
+    msg[AES67_SAP_ORIGIN_SRC + 2] = (n >> 8) & 0xff;
+    msg[AES67_SAP_ORIGIN_SRC + 3] = n & 0xff;
+
+    u16_t len = AES67_SAP_ORIGIN_SRC + 4;
+
+    memcpy(&msg[len], AES67_SDP_MIMETYPE, sizeof(AES67_SDP_MIMETYPE));
+    len += sizeof(AES67_SDP_MIMETYPE);
+
+    memcpy(&msg[len], payload, sizeof(payload) - 1);
+    len += sizeof(payload) - 1;
+
+    return len;
+}
+
+static double elapsed_nsec(struct timespec * start, struct timespec * end)
+{
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 + (double)(end->tv_nsec - start->tv_nsec);
+}
+
+int main(int argc, char * argv[])
+{
+    argv0 = argv[0];
+
+    int opt;
+
+    while ((opt = getopt(argc, argv, "h?vn:r:t:")) != -1) {
+        switch (opt) {
+            case 'n':
+                opts.sessions = atoi(optarg);
+                if (opts.sessions < SESSIONS_MIN || SESSIONS_MAX < opts.sessions){
+                    fprintf(stderr, "ERROR sessions must be in range %u - %u\n", SESSIONS_MIN, SESSIONS_MAX);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'r':
+                opts.rounds = atoi(optarg);
+                if (opts.rounds == 0){
+                    fprintf(stderr, "ERROR rounds must be > 0\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 't':
+                opts.threshold = atof(optarg);
+                if (opts.threshold < 1.0){
+                    fprintf(stderr, "ERROR factor must be >= 1.0\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'v':
+                opts.verbose = true;
+                break;
+
+            case 'h':
+            case '?':
+            default:
+                help(stdout);
+                return EXIT_FAILURE;
+        }
+    }
+
+    static struct aes67_sap_service sap;
+
+    aes67_time_init_system();
+    aes67_timer_init_system();
+
+    aes67_sap_service_init(&sap);
+
+    u8_t msg[512];
+    u16_t len;
+
+    // a few own sessions, which the announcement timer has to look at
+    for(u32_t i = 0; i < OWN_SESSIONS; i++){
+        u8_t ip[4] = {192, 168, 0, 1};
+        aes67_sap_service_msg(&sap, msg, sizeof(msg), AES67_SAP_STATUS_MSGTYPE_ANNOUNCE, i + 1, aes67_net_ipver_4, ip, (u8_t*)payload, sizeof(payload) - 1, NULL);
+    }
+
+    // the core does not keep any payload, ie this is all there is per session (apart from allocator overhead)
+    printf("memory per session: %zu bytes", sizeof(struct aes67_sap_session));
+#if 0 < AES67_SAP_MEMORY_HASHTABLE_SIZE
+    printf(" (plus hashtable of %zu bytes)", sizeof(sap.hashtable));
+#endif
+    printf("\n");
+
+    printf("%10s %12s %10s %12s %10s\n", "sessions", "ns/packet", "factor", "ns/timers", "factor");
+
+    double first = 0, first_timers = 0;
+    double last = 0, last_timers = 0;
+    bool failed = false;
+
+    for(u32_t size = SESSIONS_MIN; size <= opts.sessions; size *= 10){
+
+        // grow table
+        for(u32_t n = aes67_sap_no_of_ads(&sap) - OWN_SESSIONS; n < size; n++){
+            len = packet(msg, n);
+            aes67_sap_service_handle(&sap, msg, len, NULL);
+        }
+
+        if (aes67_sap_no_of_ads(&sap) != size + OWN_SESSIONS){
+            fprintf(stderr, "ERROR expected %u sessions, got %u\n", size + OWN_SESSIONS, aes67_sap_no_of_ads(&sap));
+            return EXIT_FAILURE;
+        }
+
+        // steady state, ie re-announcements of known sessions in a pseudo-random order
+        struct timespec start, end;
+        u32_t n = 0;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        for(u32_t r = 0; r < opts.rounds; r++){
+            n = (n + 7919) % size;
+            len = packet(msg, n);
+            aes67_sap_service_handle(&sap, msg, len, NULL);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        last = elapsed_nsec(&start, &end) / opts.rounds;
+
+        // (re-)arming of timers, ie finding the next session to time out or to be announced
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        for(u32_t r = 0; r < TIMER_ROUNDS(opts.rounds); r++){
+            aes67_timer_unset(&sap.timeout_timer);
+            aes67_sap_service_set_timeout_timer(&sap);
+
+            aes67_timer_unset(&sap.announcement_timer);
+            aes67_sap_service_set_announcement_timer(&sap);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        last_timers = elapsed_nsec(&start, &end) / TIMER_ROUNDS(opts.rounds);
+
+        if (first == 0){
+            first = last;
+            first_timers = last_timers;
+        }
+
+        printf("%10u %12.1f %10.2f %12.1f %10.2f\n", size, last, last / first, last_timers, last_timers / first_timers);
+
+        if (last / first > opts.threshold || last_timers / first_timers > opts.threshold){
+            failed = true;
+        }
+    }
+
+    aes67_timer_unset(&sap.timeout_timer);
+    aes67_timer_unset(&sap.announcement_timer);
+
+    if (opts.verbose){
+        fprintf(stderr, "new %u, updated %u, refreshed %u\n", events[aes67_sap_event_new], events[aes67_sap_event_updated], events[aes67_sap_event_refreshed]);
+    }
+
+    aes67_sap_service_deinit(&sap);
+
+    aes67_timer_deinit_system();
+    aes67_time_deinit_system();
+
+    if (failed){
+        fprintf(stderr, "ERROR cost grew by more than factor %.1f\n", opts.threshold);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
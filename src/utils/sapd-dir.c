@@ -0,0 +1,462 @@
+/**
+ * AES67 Framework
+ * Copyright (C) 2021  Philip Tschiemer, https://github.com/tschiemer/aes67
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "aes67/utils/sapd-dir.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// readers give up after so many concurrent updates (the writer only updates every so often)
+#define READ_RETRIES    64
+
+// .. resp. if an update takes longer than so many yields (ie the writer is stuck or died while updating)
+#define READ_SPINS      4096
+
+// header is padded to a cache line, records follow, then the index and the heap
+#define RECORDS_OFFSET          64
+#define INDEX_OFFSET(capacity)  (RECORDS_OFFSET + (size_t)(capacity) * sizeof(struct aes67_sapd_dir_record))
+#define HEAP_OFFSET(capacity)   (INDEX_OFFSET(capacity) + (size_t)index_size(capacity) * sizeof(u32_t))
+
+_Static_assert(sizeof(struct aes67_sapd_dir_header) <= RECORDS_OFFSET, "header exceeds RECORDS_OFFSET");
+
+/**
+ * Index slots, ie power of two of at least twice the capacity (keeping probe sequences short).
+ */
+static u32_t index_size(u32_t capacity)
+{
+    u32_t size = 2;
+    while(size < 2 * (uint64_t)capacity){
+        size <<= 1;
+    }
+    return size;
+}
+
+static u32_t key_hash(const char * key)
+{
+    // FNV-1a
+    u32_t hash = 2166136261u;
+    for(; *key != '\0'; key++){
+        hash ^= (u8_t)*key;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static u16_t append(char * str, u16_t len, size_t maxlen, const u8_t * data, u16_t datalen)
+{
+    if (len + datalen >= maxlen){
+        return 0;
+    }
+    memcpy(&str[len], data, datalen);
+    return len + datalen;
+}
+
+u16_t aes67_sapd_dir_key(char * key, size_t maxlen, const struct aes67_sdp_originator * origin)
+{
+    assert(key != NULL);
+    assert(origin != NULL);
+
+    // "<username> <sess-id> IN IP<ipver> <address>", ie origin without session version (which changes with updates)
+    u16_t len = 0;
+
+#if 0 < AES67_SDP_MAXUSERNAME
+    if (origin->username.length > 0){
+        len = append(key, len, maxlen, origin->username.data, origin->username.length);
+    } else
+#endif
+    {
+        len = append(key, len, maxlen, (u8_t*)"-", 1);
+    }
+    if (len == 0 || (len = append(key, len, maxlen, (u8_t*)" ", 1)) == 0){
+        return 0;
+    }
+    if ((len = append(key, len, maxlen, origin->session_id.data, origin->session_id.length)) == 0){
+        return 0;
+    }
+    if (origin->ipver == aes67_net_ipver_6){
+        len = append(key, len, maxlen, (u8_t*)" IN IP6 ", sizeof(" IN IP6 ") - 1);
+    } else {
+        len = append(key, len, maxlen, (u8_t*)" IN IP4 ", sizeof(" IN IP4 ") - 1);
+    }
+    if (len == 0 || (len = append(key, len, maxlen, origin->address.data, origin->address.length)) == 0){
+        return 0;
+    }
+
+    key[len] = '\0';
+
+    return len;
+}
+
+static struct aes67_sapd_dir * dir_map(int fd, bool writable, size_t size)
+{
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+
+    u8_t * map = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED){
+        return NULL;
+    }
+
+    struct aes67_sapd_dir * dir = calloc(1, sizeof(struct aes67_sapd_dir));
+    if (dir == NULL){
+        munmap(map, size);
+        return NULL;
+    }
+
+    dir->writable = writable;
+    dir->size = size;
+    dir->map = map;
+    dir->header = (struct aes67_sapd_dir_header*)map;
+    dir->records = (struct aes67_sapd_dir_record*)&map[RECORDS_OFFSET];
+
+    return dir;
+}
+
+static void dir_layout(struct aes67_sapd_dir * dir, u32_t capacity)
+{
+    dir->index = (u32_t*)&dir->map[INDEX_OFFSET(capacity)];
+    dir->indexmask = index_size(capacity) - 1;
+    dir->heap = &dir->map[HEAP_OFFSET(capacity)];
+}
+
+struct aes67_sapd_dir * aes67_sapd_dir_create(u32_t capacity, u32_t heapsize)
+{
+    assert(capacity > 0 && capacity <= (1u << 30));
+
+    int fd = shm_open(AES67_SAPD_DIR_SHM, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1){
+        syslog(LOG_ERR, "sapd-dir shm_open(%s): %s", AES67_SAPD_DIR_SHM, strerror(errno));
+        return NULL;
+    }
+
+    size_t size = HEAP_OFFSET(capacity) + heapsize;
+
+    struct aes67_sapd_dir * dir = NULL;
+
+    if (ftruncate(fd, size) == 0){
+        dir = dir_map(fd, true, size);
+    }
+
+    close(fd);
+
+    if (dir == NULL){
+        syslog(LOG_ERR, "sapd-dir mmap(%s): %s", AES67_SAPD_DIR_SHM, strerror(errno));
+        shm_unlink(AES67_SAPD_DIR_SHM);
+        return NULL;
+    }
+
+    dir_layout(dir, capacity);
+
+    // freshly truncated, ie all zero
+    dir->header->capacity = capacity;
+    dir->header->heapsize = heapsize;
+    dir->header->version = AES67_SAPD_DIR_VERSION;
+
+    // magic last, readers check it
+    __atomic_store_n(&dir->header->magic, AES67_SAPD_DIR_MAGIC, __ATOMIC_RELEASE);
+
+    return dir;
+}
+
+void aes67_sapd_dir_destroy(struct aes67_sapd_dir * dir)
+{
+    assert(dir != NULL);
+    assert(dir->writable);
+
+    munmap(dir->map, dir->size);
+    shm_unlink(AES67_SAPD_DIR_SHM);
+
+    free(dir);
+}
+
+void aes67_sapd_dir_begin(struct aes67_sapd_dir * dir)
+{
+    assert(dir != NULL);
+    assert(dir->writable);
+
+    u32_t seq = __atomic_load_n(&dir->header->seq, __ATOMIC_RELAXED);
+
+    assert((seq & 1) == 0);
+
+    // odd: readers retry until commit
+    __atomic_store_n(&dir->header->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    dir->header->count = 0;
+    dir->header->flags = 0;
+    dir->heapused = 0;
+
+    memset(dir->index, 0, (dir->indexmask + 1) * sizeof(u32_t));
+}
+
+int aes67_sapd_dir_add(struct aes67_sapd_dir * dir, const struct aes67_sdp_originator * origin, u8_t managed_by,
+                       u32_t ifaces, int64_t last_activity, const u8_t * payload, u32_t payloadlen)
+{
+    assert(dir != NULL);
+    assert(dir->writable);
+    assert(origin != NULL);
+    assert(payload != NULL || payloadlen == 0);
+
+    struct aes67_sapd_dir_header * header = dir->header;
+
+    assert(header->seq & 1);
+
+    if (header->count >= header->capacity || dir->heapused + payloadlen > header->heapsize){
+        header->flags |= AES67_SAPD_DIR_FLAG_TRUNCATED;
+        return EXIT_FAILURE;
+    }
+
+    struct aes67_sapd_dir_record * record = &dir->records[header->count];
+
+    // sessions that can not be represented are missing just as well
+    if (aes67_sapd_dir_key(record->key, sizeof(record->key), origin) == 0 ||
+        origin->session_version.length >= sizeof(record->version)){
+        header->flags |= AES67_SAPD_DIR_FLAG_TRUNCATED;
+        return EXIT_FAILURE;
+    }
+
+    record->key_hash = key_hash(record->key);
+
+    // (there are at least twice as many slots as records, ie there is always a free one)
+    u32_t slot = record->key_hash & dir->indexmask;
+    while(dir->index[slot] != 0){
+        slot = (slot + 1) & dir->indexmask;
+    }
+    dir->index[slot] = header->count + 1;
+
+    memcpy(record->version, origin->session_version.data, origin->session_version.length);
+    record->version[origin->session_version.length] = '\0';
+
+    record->managed_by = managed_by;
+    record->ifaces = ifaces;
+    record->last_activity = last_activity;
+    record->payload_offset = dir->heapused;
+    record->payloadlen = payloadlen;
+
+    memcpy(&dir->heap[dir->heapused], payload, payloadlen);
+
+    dir->heapused += payloadlen;
+    header->count++;
+
+    return EXIT_SUCCESS;
+}
+
+void aes67_sapd_dir_commit(struct aes67_sapd_dir * dir)
+{
+    assert(dir != NULL);
+    assert(dir->writable);
+
+    u32_t seq = __atomic_load_n(&dir->header->seq, __ATOMIC_RELAXED);
+
+    assert(seq & 1);
+
+    dir->header->updated = time(NULL);
+
+    // even again: publish
+    __atomic_store_n(&dir->header->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+struct aes67_sapd_dir * aes67_sapd_dir_open(void)
+{
+    int fd = shm_open(AES67_SAPD_DIR_SHM, O_RDONLY, 0);
+    if (fd == -1){
+        return NULL;
+    }
+
+    struct stat st;
+    struct aes67_sapd_dir * dir = NULL;
+
+    if (fstat(fd, &st) == 0 && st.st_size >= RECORDS_OFFSET){
+        dir = dir_map(fd, false, st.st_size);
+    }
+
+    close(fd);
+
+    if (dir == NULL){
+        return NULL;
+    }
+
+    struct aes67_sapd_dir_header * header = dir->header;
+
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != AES67_SAPD_DIR_MAGIC ||
+        header->version != AES67_SAPD_DIR_VERSION ||
+        header->capacity == 0 || header->capacity > (1u << 30) ||
+        HEAP_OFFSET(header->capacity) + header->heapsize > dir->size){
+        aes67_sapd_dir_close(dir);
+        return NULL;
+    }
+
+    dir_layout(dir, header->capacity);
+
+    return dir;
+}
+
+void aes67_sapd_dir_close(struct aes67_sapd_dir * dir)
+{
+    assert(dir != NULL);
+    assert(!dir->writable);
+
+    munmap(dir->map, dir->size);
+    free(dir);
+}
+
+/**
+ * Waits (a bounded time) for the writer to complete an ongoing update, returns EXIT_FAILURE if it did not.
+ */
+static int read_begin(struct aes67_sapd_dir * dir, u32_t * seq)
+{
+    for(int i = 0; i < READ_SPINS; i++){
+        *seq = __atomic_load_n(&dir->header->seq, __ATOMIC_ACQUIRE);
+
+        if ((*seq & 1) == 0){
+            return EXIT_SUCCESS;
+        }
+
+        sched_yield();
+    }
+
+    return EXIT_FAILURE;
+}
+
+static bool read_retry(struct aes67_sapd_dir * dir, u32_t seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return __atomic_load_n(&dir->header->seq, __ATOMIC_RELAXED) != seq;
+}
+
+u32_t aes67_sapd_dir_seq(struct aes67_sapd_dir * dir)
+{
+    assert(dir != NULL);
+
+    u32_t seq;
+
+    read_begin(dir, &seq);
+
+    return seq;
+}
+
+/**
+ * Copies record at index and its payload, the result is only valid if the seqlock did not change meanwhile.
+ */
+static ssize_t read_record(struct aes67_sapd_dir * dir, u32_t index,
+                           struct aes67_sapd_dir_record * record, u8_t * payload, size_t maxlen)
+{
+    struct aes67_sapd_dir_header * header = dir->header;
+
+    if (index >= header->count || index >= header->capacity){
+        return -1;
+    }
+
+    memcpy(record, &dir->records[index], sizeof(struct aes67_sapd_dir_record));
+
+    // record may be torn, make sure to stay within heap
+    if (record->payloadlen > maxlen ||
+        (uint64_t)record->payload_offset + record->payloadlen > header->heapsize){
+        return -1;
+    }
+
+    if (payload != NULL){
+        memcpy(payload, &dir->heap[record->payload_offset], record->payloadlen);
+    }
+
+    return record->payloadlen;
+}
+
+ssize_t aes67_sapd_dir_get(struct aes67_sapd_dir * dir, u32_t index,
+                           struct aes67_sapd_dir_record * record, u8_t * payload, size_t maxlen)
+{
+    assert(dir != NULL);
+    assert(record != NULL);
+
+    for(int i = 0; i < READ_RETRIES; i++){
+        u32_t seq;
+        if (read_begin(dir, &seq)){
+            return -1;
+        }
+
+        ssize_t len = read_record(dir, index, record, payload, maxlen);
+
+        if (!read_retry(dir, seq)){
+            return len;
+        }
+    }
+
+    return -1;
+}
+
+ssize_t aes67_sapd_dir_lookup(struct aes67_sapd_dir * dir, const struct aes67_sdp_originator * origin,
+                              struct aes67_sapd_dir_record * record, u8_t * payload, size_t maxlen)
+{
+    assert(dir != NULL);
+    assert(origin != NULL);
+    assert(record != NULL);
+
+    char key[AES67_SAPD_DIR_KEYLEN];
+
+    if (aes67_sapd_dir_key(key, sizeof(key), origin) == 0){
+        return -1;
+    }
+
+    u32_t hash = key_hash(key);
+
+    for(int i = 0; i < READ_RETRIES; i++){
+        u32_t seq;
+        if (read_begin(dir, &seq)){
+            return -1;
+        }
+
+        ssize_t len = -1;
+
+        u32_t count = dir->header->count;
+
+        // probe index (which may be torn, ie visit every slot at most once and validate entries)
+        u32_t slot = hash & dir->indexmask;
+        for(u32_t probe = 0; probe <= dir->indexmask; probe++, slot = (slot + 1) & dir->indexmask){
+            u32_t entry = __atomic_load_n(&dir->index[slot], __ATOMIC_RELAXED);
+
+            if (entry == 0){
+                break;
+            }
+            if (entry > count || entry > dir->header->capacity){
+                continue;
+            }
+
+            struct aes67_sapd_dir_record * r = &dir->records[entry - 1];
+
+            if (r->key_hash == hash && strncmp(r->key, key, sizeof(r->key)) == 0){
+                len = read_record(dir, entry - 1, record, payload, maxlen);
+                break;
+            }
+        }
+
+        if (!read_retry(dir, seq)){
+            return len;
+        }
+    }
+
+    return -1;
+}
@@ -31,6 +31,7 @@
 #define AES67_SAP_MEMORY_HARD_LIMIT     1
 #define AES67_SAP_MEMORY_MAX_SESSIONS   1024
 #define AES67_SAPSRV_SDP_MAXLEN         1024
+#define AES67_SAP_MEMORY_HASHTABLE_SIZE 256
 
 
 // roughly all 30 sec announcement
@@ -47,4 +48,10 @@
 
 #define aes67_sapsrv_time_t time_t
 
+// receive and parse SAP packets in a separate thread, the main loop only dispatches events
+#define AES67_SAPSRV_THREADED   1
+
+// keep DESCRIBE responses of (a rack full of) ravenna sessions for revalidation
+#define AES67_RTSP_DSC_CACHE_SIZE       1024
+
 #endif //AES67_AES67OPTS_H_H
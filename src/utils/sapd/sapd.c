@@ -20,6 +20,7 @@
 
 #include "aes67/utils/sapsrv.h"
 #include "aes67/utils/daemonize.h"
+#include "aes67/utils/sapd-dir.h"
 #include "aes67/sap.h"
 
 #if AES67_SAPD_WITH_RAV == 1
@@ -45,7 +46,15 @@
 #include <sys/errno.h>
 #include <fcntl.h>
 #include <sys/select.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
 #include <dirent.h>
+#include <fnmatch.h>
+
+#if AES67_SAPD_EPOLL == 1
+#include <sys/epoll.h>
+#endif
 
 //#define BUFSIZE 1024
 #define MAX_CMDLINE 256
@@ -53,6 +62,36 @@
 #define DEFAULT_LISTEN_SCOPES   AES67_SAPSRV_SCOPE_IPv4_ADMINISTERED
 #define DEFAULT_SEND_SCOPES     AES67_SAPSRV_SCOPE_IPv4_ADMINISTERED
 
+// checkpoint interval of session snapshot (see --snapshot)
+#define SNAPSHOT_INTERVAL_SEC   10
+
+// session directory is rebuilt on changes, but at least this often to reflect activity (see --shm)
+#define DIR_INTERVAL_SEC        5
+
+// max number of fds other than local connections (sapsrv, mdns, rtsp)
+#if AES67_SAPD_WITH_RAV == 1
+#define LOOP_MAX_AUX            (32 + AES67_RTSP_SRV_MAXPOLLFDS)
+#else
+#define LOOP_MAX_AUX            32
+#endif
+#define LOOP_MAX_EVENTS         64
+
+#define MAX_CLIENTS_MAX         65536
+
+// pending output per client (bytes), above the high watermark commands of the client are not read anymore and
+// broadcast messages are subject to the laggard policy until the output drops below the low watermark
+#define OUTQ_HIGH_WATERMARK     (256*1024)
+#define OUTQ_LOW_WATERMARK      (64*1024)
+// a client's own command output is bounded by not reading further commands above the high watermark, beyond this
+// limit (well above a full listing) it is subject to the laggard policy as well
+#define OUTQ_HARD_LIMIT         (4*1024*1024)
+#define OUTQ_IOV_MAX            64
+
+enum laggard_policy {
+    laggard_disconnect,
+    laggard_drop
+};
+
 
 #define MSG_VERSIONWELCOME         AES67_SAPD_MSGU_INFO " " AES67_SAPD_NAME_LONG
 
@@ -66,6 +105,15 @@
 
 #define RAV_RTSP_NERR_BEFORE_FAIL 5
 
+// number of concurrent DESCRIBE requests per device (in total see AES67_RTSP_DSC_MUX_SIZE)
+#define RAV_RTSP_PER_DEVICE     2
+
+// failed requests are retried after 2, 4, 8.. sec (at most this long)
+#define RAV_RTSP_BACKOFF_MAX    60
+
+// max number of ready sessions passed over per dispatch because their device is busy
+#define RAV_RTSP_DEFER_MAX      32
+
 enum rav_state {
     rav_state_error = 0,
     rav_state_discovered,
@@ -91,10 +139,48 @@ struct rav_session_st {
 
     aes67_mdns_resource_t * mdns_service;
 
+    bool fetching;                  // DESCRIBE in progress
+    struct rav_queue_st * queue;    // queue waiting in (if any)
+    size_t queue_pos;
+    time_t due;                     // earliest time for next DESCRIBE
+
     struct rav_session_st * next;
 };
+
+/**
+ * Min-heap of sessions by due time.
+ */
+struct rav_queue_st {
+    struct rav_session_st ** items;
+    size_t count;
+    size_t size;
+};
 #endif //AES67_SAPD_WITH_RAV == 1
 
+/**
+ * Subscription filter of a connection (see cmd_filter()), unset criteria match anything.
+ */
+struct filter_st {
+    enum aes67_audio_encoding encoding;
+    u32_t samplerate;
+    u8_t nchannels;
+    struct aes67_net_addr mcast;    // ipver undefined if not set
+    u8_t mcast_prefix;
+    struct aes67_net_addr origin;   // ipver undefined if not set
+    char name[64];                  // fnmatch() pattern, empty if not set
+};
+
+/**
+ * What an unsolicited message is about, matched against connection filters (see filter_match()).
+ */
+struct subject_st {
+    const struct aes67_sdp_originator * origin;     // NULL if none
+    const u8_t * sdp;                               // NULL if unknown
+    u16_t sdplen;
+    const char * name;                              // ravenna session name, NULL if none
+    s8_t parsed;                                    // 0 not yet, 1 successfully, -1 failed (see subject_sdp())
+};
+
 struct connection_st {
     int sockfd;
     struct sockaddr_un addr;
@@ -103,9 +189,57 @@ struct connection_st {
     uid_t euid;
     gid_t egid;
 
+    // partially received commandline
+    u8_t cmdline[MAX_CMDLINE];
+    size_t len;
+    ssize_t cmdlen;
+
+    // pending output (ring of outcap entries), see con_flush()
+    struct out_st * out;
+    size_t outcap;
+    size_t outhead;
+    size_t outcount;
+    size_t outbytes;
+
+    bool throttled;     // above high watermark
+    u32_t dropped;      // broadcast messages dropped while throttled
+    bool dead;          // to be closed (see local_reap())
+
+    struct filter_st * filter;  // NULL if all messages are to be delivered
+
     struct connection_st * next;
 };
 
+/**
+ * Reference counted message, shared by all output queues it is queued in (see write_toall_except()).
+ */
+struct msg_st {
+    u32_t refcount;
+    size_t len;
+    u8_t data[];
+};
+
+/**
+ * Output queue entry, data (still to be written) points into either msg or payload (referenced sapsrv payload).
+ */
+struct out_st {
+    struct msg_st * msg;
+    u8_t * payload;
+    u8_t * data;
+    size_t len;
+};
+
+/**
+ * State of event stream client (see aes67_rtsp_srv_http_handler()).
+ */
+struct sse_client_st {
+    uint64_t last;      // id of last notification sent
+    u8_t * snapshot;    // listing (still) to be sent
+    size_t snaplen;
+    size_t snapsent;
+    time_t last_write;
+};
+
 typedef void (*cmd_handler)(struct connection_st * con, u8_t * cmdline, size_t len);
 
 struct cmd_st {
@@ -124,14 +258,22 @@ struct cmd_st {
 static void help(FILE * fd);
 
 static void sig_int(int sig);
+#ifndef AES67_TIMER_FD
 static void sig_alrm(int sig);
+#endif
 
 static int sock_nonblock(int sockfd);
 
+static void raise_fd_limit();
+static int loop_setup();
+static void loop_teardown();
+static size_t aux_getsockfds(struct pollfd * fds, size_t max);
 static void block_until_event();
+static bool fd_ready(int fd);
 
 static int sapsrv_setup();
 static void sapsrv_teardown();
+static void sapsrv_process();
 static void sapsrv_callback(aes67_sapsrv_t sapserver, aes67_sapsrv_session_t sapsession, enum aes67_sapsrv_event event, const struct aes67_sdp_originator * origin, u8_t * payload, u16_t payloadlen, void * user_data);
 
 #if AES67_SAPD_WITH_RAV == 1
@@ -140,10 +282,20 @@ static struct rav_session_st * rav_session_find_by_name(const char * name);
 static struct rav_session_st * rav_session_find_by_origin(struct aes67_sdp_originator * origin);
 static struct rav_session_st * rav_session_new(const char * name, const char * hosttarget, enum aes67_net_ipver ipver, const u8_t * ip, u16_t port, u32_t ttl);
 static void rav_session_delete(struct rav_session_st * session);
+static void rav_session_uri(struct rav_session_st * session, char * uri, size_t maxlen);
 // rav core functions
 static int rav_setup();
 static void rav_teardown();
 static void rav_process();
+static void rav_queue_push(struct rav_queue_st * queue, struct rav_session_st * session, time_t due);
+static void rav_queue_remove(struct rav_session_st * session);
+static void rav_fetch_callback(struct aes67_rtsp_dsc_mux * mux, void * req_data, u16_t statuscode, u8_t * content, u16_t contentlen, bool unchanged, void * user_data);
+static void rav_fetch_failed(struct rav_session_st * session, time_t now);
+static void rav_fetch_dispatch(time_t now);
+static void rav_publish_due();
+#ifdef AES67_TIMER_FD
+static void rav_timer_callback(struct aes67_timer * timer, void * user_data);
+#endif
 // lookup
 static void rav_publish_by(struct rav_session_st * session, struct connection_st * con);
 static void rav_resolve_callback(aes67_mdns_resource_t res, enum aes67_mdns_result result, const char * type, const char * name, const char * hosttarget, u16_t port, u16_t txtlen, const u8_t * txt, enum aes67_net_ipver ipver, const u8_t * ip, u32_t ttl, void * context);
@@ -151,7 +303,15 @@ static void rav_resolve_callback(aes67_mdns_resource_t res, enum aes67_mdns_resu
 static void rav_announce_callback(aes67_mdns_resource_t res, enum aes67_mdns_result result, const char *type, const char *name, const char *domain, void * context);
 static int rav_announce(aes67_sapsrv_session_t session);
 static int rav_unannounce(aes67_sapsrv_session_t session);
+static void rav_announce_changed(struct aes67_sdp_originator * origin);
+
+static void sse_setup();
+static void sse_teardown();
+static void sse_journal(struct msg_st * msg);
+static int sse_snapshot(struct sse_client_st * client);
+static bool sse_since(const u8_t * str, u16_t len, uint64_t * since);
 u16_t aes67_rtsp_srv_sdp_getter(struct aes67_rtsp_srv * srv, void * sdpref, u8_t * buf, u16_t maxlen);
+void aes67_rtsp_srv_http_handler(struct aes67_rtsp_srv * srv, const enum aes67_rtsp_srv_method method, char * uri, u8_t urilen, u8_t * buf, u16_t * len, u16_t maxlen, bool * more, void ** response_state);
 #endif //AES67_SAPD_WITH_RAV == 1
 
 static int load_sdp_file(char * fname);
@@ -164,27 +324,49 @@ static int local_setup(const char * fname);
 static void local_teardown();
 static void local_accept();
 static void local_process();
+static bool local_read(struct connection_st * con);
+
+static void local_reap();
+
+static void dir_update();
+
+static struct msg_st * msg_new(const void * data, size_t len);
+static void msg_unref(struct msg_st * msg);
+static void con_enqueue(struct connection_st * con, struct msg_st * msg, u8_t * payload, u8_t * data, size_t len);
+static void con_release(struct out_st * out);
+static void con_flush(struct connection_st * con);
+static size_t con_trywrite(struct connection_st * con, const u8_t * data, size_t len);
+static void con_write(struct connection_st * con, const void * data, size_t len);
+static void con_write_payload(struct connection_st * con, u8_t * payload, size_t len);
+static void con_send(struct connection_st * con, struct msg_st * msg, bool broadcast);
+static void con_lagging(struct connection_st * con);
 
 static void write_error(struct connection_st * con, const u32_t code, const char * str);
 static void write_ok(struct connection_st * con);
-static void write_toall_except(u8_t * msg, u16_t len, struct connection_st * except);
+static void write_toall_except(u8_t * msg, u16_t len, struct subject_st * subject, struct connection_st * except);
 
-static void write_new_by(aes67_sapsrv_session_t session, struct connection_st * by);
-static void write_updated_by(aes67_sapsrv_session_t session, struct connection_st * by);
-static void write_deleted_by(aes67_sapsrv_session_t session, struct connection_st * by);
-static void write_timeout_by(aes67_sapsrv_session_t session, struct connection_st * by);
-static void write_handover_by(aes67_sapsrv_session_t session, struct connection_st * by);
-static void write_takeover_by(aes67_sapsrv_session_t session, struct connection_st * by);
+static struct aes67_sdp * subject_sdp(struct subject_st * subject);
+static bool filter_match(struct filter_st * filter, struct subject_st * subject);
+
+static void write_session_by(const char * msgu, const struct aes67_sdp_originator * origin, const u8_t * sdp, u16_t sdplen, struct connection_st * by);
+static void write_new_by(const struct aes67_sdp_originator * origin, const u8_t * sdp, u16_t sdplen, struct connection_st * by);
+static void write_updated_by(const struct aes67_sdp_originator * origin, const u8_t * sdp, u16_t sdplen, struct connection_st * by);
+static void write_deleted_by(const struct aes67_sdp_originator * origin, const u8_t * sdp, u16_t sdplen, struct connection_st * by);
+static void write_timeout_by(const struct aes67_sdp_originator * origin, const u8_t * sdp, u16_t sdplen, struct connection_st * by);
+static void write_handover_by(const struct aes67_sdp_originator * origin, const u8_t * sdp, u16_t sdplen, struct connection_st * by);
+static void write_takeover_by(const struct aes67_sdp_originator * origin, const u8_t * sdp, u16_t sdplen, struct connection_st * by);
 
 
 static void write_list_entry(struct connection_st * con, aes67_sapsrv_session_t session, bool return_payload);
 
 //static void cmd_help(struct connection_st * con, u8_t * cmdline, size_t len);
 static void cmd_list(struct connection_st * con, u8_t * cmdline, size_t len);
+static void cmd_list_since(struct connection_st * con, u8_t * cmdline, size_t len);
 static void cmd_set(struct connection_st * con, u8_t * cmdline, size_t len);
 static void cmd_unset(struct connection_st * con, u8_t * cmdline, size_t len);
 static void cmd_handover(struct connection_st * con, u8_t * cmdline, size_t len);
 static void cmd_takeover(struct connection_st * con, u8_t * cmdline, size_t len);
+static void cmd_filter(struct connection_st * con, u8_t * cmdline, size_t len);
 
 #if AES67_SAPD_WITH_RAV == 1
 static void write_rav_new(struct rav_session_st * session);
@@ -210,8 +392,13 @@ static struct {
     u32_t listen_scopes;
     u32_t send_scopes;
     s32_t port;
-    unsigned int ipv6_if;
+    unsigned int ifaces[AES67_SAPSRV_IFACES_MAX];
+    size_t ifcount;
+    u32_t max_clients;
+    enum laggard_policy laggards;
     char * sdp_dir;
+    char * snapshot;
+    bool shm;
 #if AES67_SAPD_WITH_RAV == 1
     bool rav_enabled;
     bool rav_auto_publish;
@@ -221,6 +408,7 @@ static struct {
     bool rav_server_enabled;
     uint16_t rav_server_port;
     bool rav_auto_announce;
+    bool rav_sse;
 #endif// AES67_SAPD_WITH_RAV == 1
 
 } opts = {
@@ -229,8 +417,12 @@ static struct {
         .listen_scopes = 0,
         .send_scopes = 0,
         .port = AES67_SAP_PORT,
-        .ipv6_if = 0,
+        .ifcount = 0,
+        .max_clients = AES67_SAPD_LOCAL_MAX_CONNECTIONS,
+        .laggards = laggard_disconnect,
         .sdp_dir = NULL,
+        .snapshot = NULL,
+        .shm = false,
 #if AES67_SAPD_WITH_RAV == 1
         .rav_enabled = false,
         .rav_auto_publish = true,
@@ -239,7 +431,8 @@ static struct {
         .rav_handover = true,
         .rav_server_enabled = true,
         .rav_server_port = 9191,
-        .rav_auto_announce = true
+        .rav_auto_announce = true,
+        .rav_sse = false
 #endif // AES67_SAPD_WITH_RAV == 1
 };
 
@@ -247,25 +440,67 @@ static volatile bool keep_running;
 
 static aes67_sapsrv_t * sapsrv = NULL;
 
+// session as copied for directory update (see dir_update())
+struct dir_entry_st {
+    struct aes67_sdp_originator origin;
+    u8_t managed_by;
+    u32_t ifaces;
+    time_t last_activity;
+    u8_t * payload;     // referenced
+    u16_t payloadlen;
+};
+
+static struct {
+    struct aes67_sapd_dir * dir;
+    bool dirty;
+    time_t updated;
+
+    struct dir_entry_st * entries;
+    size_t nentries;
+} shm = {
+    .dir = NULL,
+    .dirty = false,
+    .updated = 0,
+    .entries = NULL,
+    .nentries = 0
+};
+
 #if AES67_SAPD_WITH_RAV == 1
 static struct {
     aes67_mdns_context_t mdns_context;
     aes67_mdns_resource_t mdns_browse_res;
     struct rav_session_st * first_session;
-    struct aes67_rtsp_dsc_res_st rtsp_dsc;
-    struct rav_session_st * rtsp_session;
-    struct aes67_timer retry_timer;
+    struct aes67_rtsp_dsc_mux rtsp_dsc;
+    struct aes67_rtsp_dsc_cache rtsp_cache;
+    struct rav_queue_st discovered;     // sessions whose SDP yet has to be retrieved (have precedence)
+    struct rav_queue_st update;         // sessions whose SDP should be refreshed (see --rav-upd-interval)
+    struct aes67_timer retry_timer;    // next queued session due
+    time_t retry_due;
     struct aes67_timer publish_timer;
-    struct aes67_timer update_timer;
 
     struct aes67_rtsp_srv rtsp_srv;
+    struct aes67_timer server_timer;    // housekeeping of RTSP server connections (timeouts, event stream keep-alive)
 } rav = {
     .mdns_context = NULL,
     .mdns_browse_res = NULL,
-    .first_session = NULL,
-    .rtsp_session = NULL
+    .first_session = NULL
 };
 
+/**
+ * Journal of recent notifications as replayed to event stream clients (see aes67_rtsp_srv_http_handler()),
+ * notification with id N is kept at msgs[N % AES67_SAPD_SSE_JOURNAL] (for ids first .. last).
+ */
+static struct {
+    uint64_t first;
+    uint64_t last;
+    struct msg_st * msgs[AES67_SAPD_SSE_JOURNAL];
+    u16_t nclients;
+} sse;
+
+#if AES67_SAPD_SSE_MAXCLIENTS >= AES67_RTSP_SRV_MAXCONN
+#error AES67_SAPD_SSE_MAXCLIENTS must be less than AES67_RTSP_SRV_MAXCONN
+#endif
+
 #endif //AES67_SAPD_WITH_RAV == 1
 
 static struct {
@@ -276,9 +511,37 @@ static struct {
 
     int nconnections;
     struct connection_st * first_connection;
+
+    // reserved fd to reject clients when running out of fds (see local_accept())
+    int spare_fd;
 } local = {
     .fname = NULL,
-    .sockfd = -1
+    .sockfd = -1,
+    .spare_fd = -1
+};
+
+static struct {
+#if AES67_SAPD_EPOLL == 1
+    int epfd;
+
+    // registered aux fds (see loop_sync_aux()) with their events and which of them are ready
+    int aux[LOOP_MAX_AUX];
+    short aux_events[LOOP_MAX_AUX];
+    bool aux_ready[LOOP_MAX_AUX];
+    time_t aux_resync;
+
+    // ready local connections
+    struct connection_st * ready[LOOP_MAX_EVENTS];
+    size_t nready;
+#else
+    fd_set rfds;
+    fd_set wfds;
+    fd_set xfds;
+#endif
+} loop = {
+#if AES67_SAPD_EPOLL == 1
+    .epfd = -1
+#endif
 };
 
 
@@ -288,6 +551,7 @@ static const struct cmd_st commands[] = {
         CMD_INIT(AES67_SAPD_CMD_UNSET, cmd_unset),
         CMD_INIT(AES67_SAPD_CMD_HANDOVER, cmd_handover),
         CMD_INIT(AES67_SAPD_CMD_TAKEOVER, cmd_takeover),
+        CMD_INIT(AES67_SAPD_CMD_FILTER, cmd_filter),
 #if AES67_SAPD_WITH_RAV == 1
         CMD_INIT(AES67_SAPD_CMD_RAV_LIST, cmd_rav_list),
         CMD_INIT(AES67_SAPD_CMD_RAV_PUBLISH, cmd_rav_publish),
@@ -316,7 +580,7 @@ static const char * error_msg[] = {
 static void help(FILE * fd)
 {
     fprintf(fd,
-             "Usage: %s [-h|-?] | [-d] [-p <port>] [--l <mcast-scope>] [--s <mcast-scope>] [--ipv6-if <ifname>] ..\n"
+             "Usage: %s [-h|-?] | [-d] [-p <port>] [--l <mcast-scope>] [--s <mcast-scope>] [--iface <ifname>] ..\n"
              "Starts an (SDP-only) SAP server that maintains incoming SDPs, informs about updates and keeps announcing\n"
              "specified SDPs on network.\n"
              "Communicates through local port (" AES67_SAPD_LOCAL_SOCK ")\n"
@@ -337,8 +601,16 @@ static void help(FILE * fd)
             "\t\t\t\t 6sl\t IPv6 SAP site local (" AES67_SAP_IPv6_SL_STR ")\n"
             "\t\t\t Default listen: 4a\n"
             "\t\t\t Default send: 4a\n"
-            "\t --ipv6-if\t IPv6 interface to listen on (default interface can fail)\n"
+            "\t --iface <ifname>\t Interface to listen/send on (multiple possible, max %d, default: system default)\n"
+            "\t\t\t ipv4 uses the system default interface if <ifname> has no ipv4 address\n"
+            "\t --ipv6-if <ifname>\t Same as --iface (deprecated)\n"
             "\t --sdp-dir <path>\t Load all .sdp files from given directory on startup (equal to dynamically adding them)\n"
+            "\t --snapshot <file>\t Regularly save discovered sessions to file and restore them on startup\n"
+            "\t --shm\t\t Publish session directory in shared memory (" AES67_SAPD_DIR_SHM ")\n"
+            "\t --max-clients <n>\t Max number of local clients (default %d)\n"
+            "\t --laggards <disconnect|drop>\n"
+            "\t\t\t Clients not reading their notifications fast enough are disconnected (default)\n"
+            "\t\t\t or miss notifications until they catch up\n"
  #if AES67_SAPD_WITH_RAV == 1
             "\t --rav\t\t Enable Ravenna session lookups\n"
             "\t --rav-no-autopub\n"
@@ -359,13 +631,16 @@ static void help(FILE * fd)
              "\t --rav-no-autoannounce\n"
              "\t\t\t Local services will not be automatically announced as ravenna services and\n"
              "\t\t\t made available through the built in RTSP server (default enabled).\n"
+             "\t --rav-sse\n"
+             "\t\t\t Serve notifications as (http) event stream through RTSP server\n"
+             "\t\t\t (GET " AES67_SAPD_SSE_PATH ", resumable using Last-Event-ID or ?since=<id>).\n"
  #endif //AES67_SAPD_WITH_RAV == 1
             "\nCompile time options:\n"
             "\t AES67_SAP_MIN_INTERVAL_SEC \t %d \t // +- announce time, depends on SAP traffic\n"
             "\t AES67_SAP_MIN_TIMEOUT_SEC \t %d \n"
             "\t AES67_SAPD_WITH_RAV \t\t %d \t // Ravenna sessions supported?\n"
              "\nExamples:\n"
-             "sudo %s -v --ipv6-if en7\n"
+             "sudo %s -v --iface en7\n"
              "sudo %s -v --sdp-dir /usr/local/my-sdp-files\n"
  #if AES67_SAPD_WITH_RAV == 1
              "sudo %s -v --sdp-dir /usr/local/my-sdp-files --rav\n"
@@ -374,6 +649,8 @@ static void help(FILE * fd)
              "socat - UNIX-CONNECT:" AES67_SAPD_LOCAL_SOCK ",keepalive # to connect to local sock\n"
             , argv0,
             (u16_t)AES67_SAP_PORT,
+            AES67_SAPSRV_IFACES_MAX,
+            AES67_SAPD_LOCAL_MAX_CONNECTIONS,
             RAV_PUBLISH_DELAY_MAX, RAV_PUBLISH_DELAY_DEFAULT,
             RAV_UPDATE_INTERVAL_MAX, RAV_UPDATE_INTERVAL_DEFAULT,
             AES67_SAP_MIN_INTERVAL_SEC,
@@ -387,10 +664,12 @@ static void sig_int(int sig)
     keep_running = false;
 }
 
+#ifndef AES67_TIMER_FD
 static void sig_alrm(int sig)
 {
     // do nothing, hurray!
 }
+#endif
 
 static int sock_nonblock(int sockfd){
     // set non-blocking
@@ -402,39 +681,47 @@ static int sock_nonblock(int sockfd){
     return EXIT_SUCCESS;
 }
 
-static void block_until_event()
+/**
+ * Every local client takes an fd, ie make sure the (soft) limit allows for the configured number of clients.
+ */
+static void raise_fd_limit()
 {
-    int nfds = 0;
-    fd_set rfds;
-    fd_set xfds;
-//    sigset_t sigmask;
+    rlim_t needed = opts.max_clients + LOOP_MAX_AUX + 16;
 
-    FD_ZERO(&rfds);
-    FD_ZERO(&xfds);
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) || rl.rlim_cur == RLIM_INFINITY || needed <= rl.rlim_cur){
+        return;
+    }
 
-    // set all AF_LOCAL sockets
-    FD_SET(local.sockfd, &rfds);
-    FD_SET(local.sockfd, &xfds);
-    nfds = local.sockfd;
+    rl.rlim_cur = (rl.rlim_max != RLIM_INFINITY && rl.rlim_max < needed) ? rl.rlim_max : needed;
 
-    struct connection_st * con = local.first_connection;
-    for(;con != NULL; con = con->next){
-        FD_SET(con->sockfd, &rfds);
-        FD_SET(con->sockfd, &xfds);
-        if (con->sockfd > nfds){
-            nfds = con->sockfd;
-        }
+    if (setrlimit(RLIMIT_NOFILE, &rl) || rl.rlim_cur < needed){
+        syslog(LOG_WARNING, "fd limit (%lu) too low for %u clients", (unsigned long)rl.rlim_cur, opts.max_clients);
     }
+}
+
+/**
+ * Collects all fds (and events) to wait on but local connections (ie local listening socket, sapsrv, mdns, rtsp).
+ */
+static size_t aux_getsockfds(struct pollfd * fds, size_t max)
+{
+    size_t n = 0;
+
+#define AUX_ADD_EVENTS(sockfd, ev) if (n < max) { fds[n].fd = (sockfd); fds[n].events = (ev); n++; }
+#define AUX_ADD(sockfd) AUX_ADD_EVENTS(sockfd, POLLIN)
+
+    AUX_ADD(local.sockfd);
+
+#ifdef AES67_TIMER_FD
+    // timer expiries wake the loop through the timerfd (rather than SIGALRM)
+    AUX_ADD(aes67_timer_getfd());
+#endif
 
     int * sockfds;
     size_t count = 0;
     aes67_sapsrv_getsockfds(sapsrv, &sockfds, &count);
     for(size_t i = 0; i < count; i++){
-        FD_SET(sockfds[i], &rfds);
-        FD_SET(sockfds[i], &xfds);
-        if (sockfds[i] > nfds){
-            nfds = sockfds[i];
-        }
+        AUX_ADD(sockfds[i]);
     }
 
 #if AES67_SAPD_WITH_RAV == 1
@@ -442,43 +729,237 @@ static void block_until_event()
 
         aes67_mdns_getsockfds(rav.mdns_context, &sockfds, &count);
         for (size_t i = 0; i < count; i++) {
-            FD_SET(sockfds[i], &rfds);
-            FD_SET(sockfds[i], &xfds);
-            if (sockfds[i] > nfds) {
-                nfds = sockfds[i];
-            }
+            AUX_ADD(sockfds[i]);
         }
 
-        if (rav.rtsp_dsc.state == aes67_rtsp_dsc_state_awaiting_response && rav.rtsp_dsc.sockfd != -1){
-            FD_SET(rav.rtsp_dsc.sockfd, &rfds);
-            FD_SET(rav.rtsp_dsc.sockfd, &xfds);
-            if (rav.rtsp_dsc.sockfd > nfds){
-                nfds = rav.rtsp_dsc.sockfd;
-            }
+        struct pollfd pfds[AES67_RTSP_DSC_MUX_SIZE];
+        count = aes67_rtsp_dsc_mux_getpollfds(&rav.rtsp_dsc, pfds, AES67_RTSP_DSC_MUX_SIZE);
+        for (size_t i = 0; i < count; i++) {
+            AUX_ADD_EVENTS(pfds[i].fd, pfds[i].events);
         }
 
         if (opts.rav_server_enabled){
-            FD_SET(rav.rtsp_srv.listen_sockfd, &rfds);
-            FD_SET(rav.rtsp_srv.listen_sockfd, &xfds);
-            if (rav.rtsp_srv.listen_sockfd > nfds){
-                nfds = rav.rtsp_srv.listen_sockfd;
-            }
-            if (rav.rtsp_srv.client_sockfd != -1){
-                FD_SET(rav.rtsp_srv.client_sockfd, &rfds);
-                FD_SET(rav.rtsp_srv.client_sockfd, &xfds);
-                if (rav.rtsp_srv.client_sockfd > nfds){
-                    nfds = rav.rtsp_srv.client_sockfd;
-                }
+            struct pollfd srvfds[AES67_RTSP_SRV_MAXPOLLFDS];
+            count = aes67_rtsp_srv_getpollfds(&rav.rtsp_srv, srvfds, AES67_RTSP_SRV_MAXPOLLFDS);
+            for (size_t i = 0; i < count; i++) {
+                AUX_ADD_EVENTS(srvfds[i].fd, srvfds[i].events);
             }
         }
     }
 #endif //AES67_SAPD_WITH_RAV == 1
 
+#undef AUX_ADD
+#undef AUX_ADD_EVENTS
+
+    return n;
+}
+
+#if AES67_SAPD_EPOLL == 1
+
+static int loop_setup()
+{
+    loop.epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop.epfd == -1){
+        syslog(LOG_ERR, "epoll_create1(): %s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    for(size_t i = 0; i < LOOP_MAX_AUX; i++){
+        loop.aux[i] = -1;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static void loop_teardown()
+{
+    if (loop.epfd != -1){
+        close(loop.epfd);
+        loop.epfd = -1;
+    }
+}
+
+/**
+ * Aux fds come and go with the respective modules (and are processed by polling them), so they are registered
+ * level-triggered and synced before every wait: only new resp. gone fds and changed events are passed to epoll.
+ * A closed fd is dropped by epoll implicitly, ie should its number be reused before the next sync with the same events,
+ * it would go unnoticed; so once a second all fds are registered anew (which is harmless for registered ones).
+ */
+static void loop_sync_aux()
+{
+    struct pollfd fds[LOOP_MAX_AUX];
+    size_t count = aux_getsockfds(fds, LOOP_MAX_AUX);
+
+    time_t now = time(NULL);
+    bool resync = now != loop.aux_resync;
+    loop.aux_resync = now;
+
+    // unregister gone fds
+    for(size_t i = 0; i < LOOP_MAX_AUX; i++){
+        if (loop.aux[i] == -1){
+            continue;
+        }
+        bool keep = false;
+        for(size_t j = 0; j < count && !keep; j++){
+            keep = loop.aux[i] == fds[j].fd;
+        }
+        if (!keep){
+            epoll_ctl(loop.epfd, EPOLL_CTL_DEL, loop.aux[i], NULL);
+            loop.aux[i] = -1;
+        }
+    }
+
+    // register new fds (and changed events), each with a fixed slot
+    for(size_t j = 0; j < count; j++){
+        ssize_t slot = -1;
+        for(size_t i = 0; i < LOOP_MAX_AUX; i++){
+            if (loop.aux[i] == fds[j].fd){
+                slot = i;
+                break;
+            }
+            if (slot == -1 && loop.aux[i] == -1){
+                slot = i;
+            }
+        }
+        assert(slot != -1);
+
+        bool known = loop.aux[slot] == fds[j].fd;
+
+        if (known && loop.aux_events[slot] == fds[j].events && !resync){
+            continue;
+        }
+
+        loop.aux[slot] = fds[j].fd;
+        loop.aux_events[slot] = fds[j].events;
+
+        struct epoll_event ev = {
+            .events = (fds[j].events & POLLIN ? EPOLLIN : 0) | (fds[j].events & POLLOUT ? EPOLLOUT : 0),
+            .data.ptr = &loop.aux[slot]
+        };
+        // events of an fd may change (ie rtsp connect completes), a known fd might have been closed meanwhile
+        int op = known ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        if (epoll_ctl(loop.epfd, op, fds[j].fd, &ev) == -1){
+            if (errno == EEXIST){
+                epoll_ctl(loop.epfd, EPOLL_CTL_MOD, fds[j].fd, &ev);
+            } else if (errno == ENOENT){
+                epoll_ctl(loop.epfd, EPOLL_CTL_ADD, fds[j].fd, &ev);
+            }
+        }
+    }
+}
+
+static void block_until_event()
+{
+    loop_sync_aux();
+
+    loop.nready = 0;
+    memset(loop.aux_ready, 0, sizeof(loop.aux_ready));
+
+    struct epoll_event events[LOOP_MAX_EVENTS];
+
+    // just wait until something interesting happens
+    int n = epoll_wait(loop.epfd, events, LOOP_MAX_EVENTS, -1);
+
+    // (most likely) interrupted by SIGALRM
+    for(int i = 0; i < n; i++){
+        int * aux = events[i].data.ptr;
+
+        if (&loop.aux[0] <= aux && aux < &loop.aux[LOOP_MAX_AUX]){
+            loop.aux_ready[aux - loop.aux] = true;
+        } else {
+            // local connections (edge-triggered), see local_read()
+            loop.ready[loop.nready++] = events[i].data.ptr;
+        }
+    }
+}
+
+static bool fd_ready(int fd)
+{
+    for(size_t i = 0; i < LOOP_MAX_AUX; i++){
+        if (loop.aux[i] == fd){
+            return loop.aux_ready[i];
+        }
+    }
+    return false;
+}
+
+#else //AES67_SAPD_EPOLL == 0
+
+static int loop_setup()
+{
+    return EXIT_SUCCESS;
+}
+
+static void loop_teardown()
+{
+}
+
+static void block_until_event()
+{
+    struct pollfd fds[LOOP_MAX_AUX];
+    size_t count = aux_getsockfds(fds, LOOP_MAX_AUX);
+    int nfds = 0;
+
+    FD_ZERO(&loop.rfds);
+    FD_ZERO(&loop.wfds);
+    FD_ZERO(&loop.xfds);
+
+    for(size_t i = 0; i < count; i++){
+        if (fds[i].events & POLLIN){
+            FD_SET(fds[i].fd, &loop.rfds);
+        }
+        if (fds[i].events & POLLOUT){
+            FD_SET(fds[i].fd, &loop.wfds);
+        }
+        FD_SET(fds[i].fd, &loop.xfds);
+        if (fds[i].fd > nfds){
+            nfds = fds[i].fd;
+        }
+    }
+
+    struct connection_st * con = local.first_connection;
+    for(;con != NULL; con = con->next){
+        FD_SET(con->sockfd, &loop.rfds);
+        FD_SET(con->sockfd, &loop.xfds);
+        if (con->outcount > 0){
+            FD_SET(con->sockfd, &loop.wfds);
+        }
+        if (con->sockfd > nfds){
+            nfds = con->sockfd;
+        }
+    }
 
     nfds++;
 
     // just wait until something interesting happens
-    select(nfds, &rfds, NULL, &xfds, NULL);
+    if (select(nfds, &loop.rfds, &loop.wfds, &loop.xfds, NULL) == -1){
+        // (most likely) interrupted by SIGALRM, the fd sets are undefined
+        FD_ZERO(&loop.rfds);
+        FD_ZERO(&loop.wfds);
+        FD_ZERO(&loop.xfds);
+    }
+}
+
+static bool fd_ready(int fd)
+{
+    return FD_ISSET(fd, &loop.rfds);
+}
+
+#endif //AES67_SAPD_EPOLL == 1
+
+static void sapsrv_process()
+{
+    int * sockfds;
+    size_t count = 0;
+
+    aes67_sapsrv_getsockfds(sapsrv, &sockfds, &count);
+    for(size_t i = 0; i < count; i++){
+        if (fd_ready(sockfds[i])){
+            aes67_sapsrv_process_sockfd(sapsrv, sockfds[i]);
+        }
+    }
+
+    aes67_sapsrv_process_timers(sapsrv);
 }
 
 static int sapsrv_setup()
@@ -486,10 +967,12 @@ static int sapsrv_setup()
     aes67_time_init_system();
     aes67_timer_init_system();
 
+#ifndef AES67_TIMER_FD
     // set SIGALRM handler (triggered by timer)
     signal(SIGALRM, sig_alrm);
+#endif
 
-    sapsrv = aes67_sapsrv_start(opts.send_scopes, opts.port, opts.listen_scopes, opts.ipv6_if, sapsrv_callback, NULL);
+    sapsrv = aes67_sapsrv_start_ifaces(opts.send_scopes, opts.port, opts.listen_scopes, opts.ifaces, opts.ifcount, sapsrv_callback, NULL);
 
     if (sapsrv == NULL){
         syslog(LOG_ERR, "Failed to start sapsrv ..");
@@ -551,7 +1034,7 @@ static void sapsrv_callback(aes67_sapsrv_t sapserver, aes67_sapsrv_session_t sap
     if (event == aes67_sapsrv_event_discovered){
         syslog(LOG_INFO, "SAP: discovered (payload %d): %s", payloadlen, ostr);
 
-        write_new_by(sapsession, NULL);
+        write_new_by(origin, payload, payloadlen, NULL);
 //        mlen = snprintf((char*)msg, sizeof(msg), AES67_SAPD_MSGU_NEW " %d %s\n", payloadlen, ostr);
 //
 //        if (mlen + payloadlen + 1 >= sizeof(msg)){
@@ -569,7 +1052,11 @@ static void sapsrv_callback(aes67_sapsrv_t sapserver, aes67_sapsrv_session_t sap
     else if (event == aes67_sapsrv_event_updated){
         syslog(LOG_INFO, "SAP: updated (payload %d): %s", payloadlen, ostr);
 
-        write_updated_by(sapsession, NULL);
+#if AES67_SAPD_WITH_RAV == 1
+        rav_announce_changed((struct aes67_sdp_originator*)origin);
+#endif
+
+        write_updated_by(origin, payload, payloadlen, NULL);
 //        mlen = snprintf((char*)msg, sizeof(msg), AES67_SAPD_MSGU_UPDATED " %d %s\n", payloadlen, ostr);
 //
 //        if (mlen + payloadlen + 1 >= sizeof(msg)){
@@ -587,7 +1074,7 @@ static void sapsrv_callback(aes67_sapsrv_t sapserver, aes67_sapsrv_session_t sap
     else if (event == aes67_sapsrv_event_deleted){
         syslog(LOG_INFO, "SAP: deleted: %s", ostr);
 
-        write_deleted_by(sapsession, NULL);
+        write_deleted_by(origin, payload, payloadlen, NULL);
 //        mlen = snprintf((char*)msg, sizeof(msg), AES67_SAPD_MSGU_DELETED " %s\n", ostr);
 //
 //        write_toall_except(msg, mlen, NULL);
@@ -595,7 +1082,7 @@ static void sapsrv_callback(aes67_sapsrv_t sapserver, aes67_sapsrv_session_t sap
     else if (event == aes67_sapsrv_event_timeout){
         syslog(LOG_INFO, "SAP: timeout: %s", ostr);
 
-        write_timeout_by(sapsession, NULL);
+        write_timeout_by(origin, payload, payloadlen, NULL);
 //        mlen = snprintf((char*)msg, sizeof(msg), AES67_SAPD_MSGU_TIMEOUT " %s\n", ostr);
 //
 //        write_toall_except(msg, mlen, NULL);
@@ -618,7 +1105,7 @@ static void sapsrv_callback(aes67_sapsrv_t sapserver, aes67_sapsrv_session_t sap
                 ravsession->state = rav_state_sdp_not_published;
 
                 // notify all about handover
-                write_handover_by(sapsession, NULL);
+                write_handover_by(origin, payload, payloadlen, NULL);
             }
 
             return;
@@ -628,7 +1115,13 @@ static void sapsrv_callback(aes67_sapsrv_t sapserver, aes67_sapsrv_session_t sap
         // notify all about duplicate
         mlen = snprintf((char*)msg, sizeof(msg), AES67_SAPD_MSGU_DUPLICATE " %s\n", ostr);
 
-        write_toall_except(msg, mlen, NULL);
+        struct subject_st subject = {
+            .origin = origin,
+            .sdp = payload,
+            .sdplen = payloadlen
+        };
+
+        write_toall_except(msg, mlen, &subject, NULL);
     }
     else {
         syslog(LOG_ERR, "SAP: unrecognized event %d: %s", event, ostr);
@@ -694,6 +1187,11 @@ static struct rav_session_st * rav_session_new(const char * name, const char * h
     session->last_activity = 0;
     session->error_count = 0;
 
+    session->fetching = false;
+    session->queue = NULL;
+    session->queue_pos = 0;
+    session->due = 0;
+
     session->next = rav.first_session;
     rav.first_session = session;
 
@@ -717,14 +1215,21 @@ static void rav_session_delete(struct rav_session_st * session)
     }
 
     // if currently SDP lookup is in process with given session, abort
-    if (rav.rtsp_session == session){
-        aes67_rtsp_dsc_stop(&rav.rtsp_dsc);
-        rav.rtsp_session = NULL;
+    if (session->fetching){
+        aes67_rtsp_dsc_mux_cancel(&rav.rtsp_dsc, session);
+        session->fetching = false;
     }
 
+    char uri[AES67_RTSP_DSC_URILEN];
+    rav_session_uri(session, uri, sizeof(uri));
+    aes67_rtsp_dsc_cache_remove(&rav.rtsp_cache, session->addr.ipver, session->addr.ip, session->addr.port, uri);
+
+    rav_queue_remove(session);
+
     // if registered with sapsrv, remove
     if (session->state == rav_state_sdp_updated || session->state == rav_state_sdp_published){
         fprintf(stderr, "asdf\n");
+        aes67_sapsrv_lock(sapsrv);
         aes67_sapsrv_session_t sapsrvSession = aes67_sapsrv_session_by_origin(sapsrv, &session->origin);
         fprintf(stderr, "asdf2\n");
         if (sapsrvSession != NULL){
@@ -732,6 +1237,7 @@ static void rav_session_delete(struct rav_session_st * session)
         } else {
             syslog(LOG_ERR, "trying to unpublish a session that was not found?!");
         }
+        aes67_sapsrv_unlock(sapsrv);
     }
 
     if (session->sdp != NULL){
@@ -747,6 +1253,14 @@ static void rav_session_delete(struct rav_session_st * session)
     free(session);
 }
 
+static void rav_session_uri(struct rav_session_st * session, char * uri, size_t maxlen)
+{
+    char name[128];
+    uri_encode(session->name, strlen(session->name), name, sizeof(name));
+
+    snprintf(uri, maxlen, "/by-name/%s", name);
+}
+
 static int rav_setup()
 {
     rav.mdns_context = aes67_mdns_new();
@@ -759,16 +1273,25 @@ static int rav_setup()
         return EXIT_FAILURE;
     }
 
-    aes67_rtsp_dsc_init(&rav.rtsp_dsc, false);
+    aes67_rtsp_dsc_mux_init(&rav.rtsp_dsc, rav_fetch_callback, NULL);
+    aes67_rtsp_dsc_cache_init(&rav.rtsp_cache);
+    aes67_rtsp_dsc_mux_setcache(&rav.rtsp_dsc, &rav.rtsp_cache);
 
     aes67_timer_init(&rav.retry_timer);
     aes67_timer_init(&rav.publish_timer);
-    aes67_timer_init(&rav.update_timer);
+    aes67_timer_init(&rav.server_timer);
+
+#ifdef AES67_TIMER_FD
+    // expiries are handled from within aes67_timer_process() (main loop)
+    aes67_timer_setcallback(&rav.retry_timer, rav_timer_callback, NULL);
+    aes67_timer_setcallback(&rav.publish_timer, rav_timer_callback, NULL);
+    aes67_timer_setcallback(&rav.server_timer, rav_timer_callback, NULL);
+#endif
 
     syslog(LOG_INFO, "Browsing for Ravenna sessions");
 
     if (opts.rav_server_enabled){
-        aes67_rtsp_srv_init(&rav.rtsp_srv, false, NULL);
+        aes67_rtsp_srv_init(&rav.rtsp_srv, opts.rav_sse, NULL);
 
         aes67_rtsp_srv_blocking(&rav.rtsp_srv, false);
 
@@ -779,15 +1302,23 @@ static int rav_setup()
 
         syslog(LOG_INFO, "Started RTSP server on port %hu", opts.rav_server_port);
 
+        if (opts.rav_sse){
+            sse_setup();
+            syslog(LOG_INFO, "Serving event stream at http://*:%hu" AES67_SAPD_SSE_PATH, opts.rav_server_port);
+        }
+
         if (opts.rav_auto_announce){
+            aes67_sapsrv_lock(sapsrv);
             aes67_sapsrv_session_t session = aes67_sapsrv_session_first(sapsrv);
             while(session){
                 if (rav_announce(session)){
+                    aes67_sapsrv_unlock(sapsrv);
                     syslog(LOG_ERR, "Failed to register ravenna session");
                     return EXIT_FAILURE;
                 }
                 session = aes67_sapsrv_session_next(session);
             }
+            aes67_sapsrv_unlock(sapsrv);
         }
     }
 
@@ -798,13 +1329,23 @@ static void rav_teardown()
 {
     if (opts.rav_server_enabled){
         aes67_rtsp_srv_deinit(&rav.rtsp_srv);
+
+        if (opts.rav_sse){
+            sse_teardown();
+        }
     }
 
+    aes67_timer_deinit(&rav.server_timer);
     aes67_timer_deinit(&rav.publish_timer);
-    aes67_timer_deinit(&rav.update_timer);
     aes67_timer_deinit(&rav.retry_timer);
 
-    aes67_rtsp_dsc_deinit(&rav.rtsp_dsc);
+    aes67_rtsp_dsc_mux_deinit(&rav.rtsp_dsc);
+    aes67_rtsp_dsc_cache_deinit(&rav.rtsp_cache);
+
+    free(rav.discovered.items);
+    free(rav.update.items);
+    memset(&rav.discovered, 0, sizeof(rav.discovered));
+    memset(&rav.update, 0, sizeof(rav.update));
 
     if (rav.mdns_context == NULL){
         return;
@@ -819,231 +1360,429 @@ static void rav_process()
     // non-blocking processing
     aes67_mdns_process(rav.mdns_context, 0);
 
-    //// check if rtsp sdp lookup has anything to do
-    // first process pending
-    if (rav.rtsp_dsc.state == aes67_rtsp_dsc_state_awaiting_response){
+    //// check if rtsp sdp lookups have anything to do
+    aes67_rtsp_dsc_mux_process(&rav.rtsp_dsc);
 
-        aes67_rtsp_dsc_process(&rav.rtsp_dsc);
-    }
-    // if done
-    if (rav.rtsp_dsc.state == aes67_rtsp_dsc_state_done){
+    // start further lookups (if any)
+    rav_fetch_dispatch(time(NULL));
 
-        // update last activity?
-        rav.rtsp_session->last_activity = time(NULL);
+    rav_publish_due();
 
-        // checking for some meaningful min-length
-        if (rav.rtsp_dsc.statuscode == AES67_RTSP_STATUS_OK && rav.rtsp_dsc.contentlen > 32){
+    if (opts.rav_server_enabled){
+#ifdef AES67_TIMER_FD
+        size_t nconn = rav.rtsp_srv.nconn;
 
-            u8_t *sdp = (u8_t*)aes67_rtsp_dsc_content(&rav.rtsp_dsc);
-            assert(sdp != NULL); // should not occur
+        aes67_rtsp_srv_process(&rav.rtsp_srv);
 
-            // get origin (o=..) offset v=0\r\n
-            u8_t * o = sdp[4] == '\n' ? &sdp[5] : &sdp[4];
+        // (kept going by rav_timer_callback() as long as there are connections)
+        if (nconn == 0 && rav.rtsp_srv.nconn > 0){
+            aes67_timer_set(&rav.server_timer, 1000);
+        }
+#else
+        aes67_rtsp_srv_process(&rav.rtsp_srv);
 
-            sdp[rav.rtsp_dsc.contentlen] = '\0';
+        if (rav.rtsp_srv.nconn > 0 && aes67_timer_getstate(&rav.server_timer) != aes67_timer_state_set){
+            aes67_timer_set(&rav.server_timer, 1000);
+        }
+#endif
+    }
+}
 
-//            printf("%s\n", o);
-//            printf("origin %c%c%c %d\n", o[0], o[1] ,o[2], rav.rtsp.contentlen - (o - sdp));
+#ifdef AES67_TIMER_FD
+static void rav_timer_callback(struct aes67_timer * timer, void * user_data)
+{
+    if (timer == &rav.retry_timer){
+        // (not armed anymore, see rav_fetch_dispatch())
+        rav.retry_due = 0;
 
-            struct aes67_sdp_originator origin;
+        // request timeouts
+        aes67_rtsp_dsc_mux_process(&rav.rtsp_dsc);
 
-            if (aes67_sdp_origin_fromstr(&origin, o, rav.rtsp_dsc.contentlen - (o - sdp)) == AES67_SDP_ERROR){
-                if (rav.rtsp_session->state == rav_state_sdp_available || rav.rtsp_session->state == rav_state_sdp_published){
-                    // if prior sdp retrieved, ignore error, assume a temporary fail
-                    //TODO anything to consider? if device went offline, the rtsp start operation will fail
-                } else {
-                    rav.rtsp_session->state = rav_state_error;
-                    syslog(LOG_ERR, "rav failed to extract originator");
-                }
-            }
-            // if originators are equal (and same version!) this implies that nothing has changed
-            // and that this rav session actually previously retrieved identical SDP data
-            else if (aes67_sdp_origin_eq(&rav.rtsp_session->origin, &origin) == 1 && aes67_sdp_origin_cmpversion(&rav.rtsp_session->origin, &origin) == 0){
-                // nothing to do, hurray!
-//                rav.rtsp_session->state = rav_state_error;
-                fprintf(stderr, "???\n");
-            }
-            else {
-
-                // if originators are equal (but newer version!) this implies that nothing has changed
-                // and that this rav session actually previously retrieved the SDP data
-                if (aes67_sdp_origin_eq(&rav.rtsp_session->origin, &origin) == 1 && aes67_sdp_origin_cmpversion(&rav.rtsp_session->origin, &origin) == -1){
-                // free previous sdp
-//                if (rav.rtsp_session->sdp != NULL){
-                    free(rav.rtsp_session->sdp);
-                    rav.rtsp_session->sdp = NULL;
-                    rav.rtsp_session->sdplen = 0;
-                }
+        rav_fetch_dispatch(time(NULL));
+    }
+    else if (timer == &rav.publish_timer){
+        rav_publish_due();
+    }
+    else if (timer == &rav.server_timer){
+        // housekeeping (connection timeouts, event stream keep-alive)
+        aes67_rtsp_srv_process(&rav.rtsp_srv);
 
-                assert(rav.rtsp_session->sdp == NULL);
+        if (rav.rtsp_srv.nconn > 0){
+            aes67_timer_set(&rav.server_timer, 1000);
+        }
+    }
+}
+#endif //AES67_TIMER_FD
 
-                // update SDP info
-                memcpy(&rav.rtsp_session->origin, &origin, sizeof(struct aes67_sdp_originator));
+/**
+ * Publishes (resp. updates) discovered sessions through SAP once they have been around for the publish delay.
+ */
+static void rav_publish_due()
+{
+    time_t publish_if_older = time(NULL) - opts.rav_publish_delay;
+    struct rav_session_st * session = rav.first_session;
+    struct rav_session_st * oldest = NULL;
 
-                rav.rtsp_session->sdp = malloc(rav.rtsp_dsc.contentlen + 1);
+    aes67_sapsrv_lock(sapsrv);
 
-                assert(rav.rtsp_session->sdp != NULL);
+    while(session != NULL){
+        if (session->state == rav_state_sdp_available && opts.rav_auto_publish){
 
-                memcpy(rav.rtsp_session->sdp, sdp, rav.rtsp_dsc.contentlen);
-                rav.rtsp_session->sdp[rav.rtsp_dsc.contentlen] = '\0'; // not needed, but in case dumping
-                rav.rtsp_session->sdplen = rav.rtsp_dsc.contentlen;
+            if (session->last_activity <= publish_if_older){
 
+                assert(session->sdp != NULL);
 
-                if (rav.rtsp_session->state == rav_state_discovered || (!opts.rav_auto_publish && rav.rtsp_session->state == rav_state_sdp_available)){
-                    rav.rtsp_session->state = rav_state_sdp_available;
-                } else if (rav.rtsp_session->state == rav_state_sdp_published){
-                    rav.rtsp_session->state = rav_state_sdp_updated;
-                } else {
-                    syslog(LOG_ERR, "sdp retrieved from unexpected state %d", rav.rtsp_session->state);
-                    // should not reach here
-                    rav.rtsp_session->state = rav_state_error;
-                }
-            }
+                aes67_sapsrv_session_t sapsrvSession = aes67_sapsrv_session_by_origin(sapsrv, &session->origin);
+
+                // if it already exists, the device has published the SDp itself
+                if (sapsrvSession != NULL){
+                    session->state = rav_state_sdp_not_published;
+                    syslog(LOG_INFO, "Published through SAP, ignoring: %s", session->name);
+                } else {
+                    rav_publish_by(session, NULL);
+                }
+            } else if (oldest == NULL || session->last_activity < oldest->last_activity ){
+                oldest = session;
+            }
 
-        } else {
-            rav.rtsp_session->state = rav_state_error;
-            syslog(LOG_ERR, "rtsp describe fail: %s", rav.rtsp_session->name);
         }
+        else if (session->state == rav_state_sdp_updated){
 
-        // make available for next describe operation
-        rav.rtsp_session = NULL;
-        rav.rtsp_dsc.state = aes67_rtsp_dsc_state_bored;
-    }
-    // if actually nothing to do
-    if (rav.rtsp_dsc.state == aes67_rtsp_dsc_state_bored){
+            aes67_sapsrv_session_t sapsrvSession = aes67_sapsrv_session_by_origin(sapsrv, &session->origin);
 
-        struct rav_session_st * session = rav.first_session;
-        struct rav_session_st * oldest = NULL;
+            if (sapsrvSession != NULL){
 
-        // try to find sessions whose SDP yet has to be retrieved (and look for oldest
-        time_t now = time(NULL);
+                session->state = rav_state_sdp_published;
 
-        while(session != NULL){
+                aes67_sapsrv_session_update(sapsrv, sapsrvSession, session->sdp, session->sdplen);
 
-            if (session->state == rav_state_discovered && session->last_activity + session->error_count <= now){
-                break;
-            }
+                write_updated_by(aes67_sapsrv_session_get_origin(sapsrvSession), session->sdp, session->sdplen, NULL);
 
-            // consider only published sdps that might have to be updated
-            if (opts.rav_update_interval > 0 &&
-                (session->state == rav_state_sdp_published || (!opts.rav_auto_publish && session->state == rav_state_sdp_available)) &&
-                (oldest == NULL || session->last_activity < oldest->last_activity )){
-                oldest = session;
             }
 
-            session = session->next;
         }
 
-        if (session == NULL && oldest != NULL){
-            // if the oldest is too old, let's update it directly
-            // otherwise set an alarm
-            if (oldest->last_activity < time(NULL) - opts.rav_update_interval){
-                session = oldest;
-            } else {
-                u32_t wait_sec = opts.rav_update_interval - (time(NULL) - oldest->last_activity);
-                aes67_timer_set(&rav.update_timer, 1000 * wait_sec);
-            }
+        session = session->next;
+    }
+
+    aes67_sapsrv_unlock(sapsrv);
+
+    // if oldest is set, this means we should set an alarm
+    if (oldest != NULL){
+        u32_t wait_sec = opts.rav_publish_delay - (time(NULL) - oldest->last_activity);
+        aes67_timer_set(&rav.publish_timer, 1000 * wait_sec);
+    }
+}
+
+static void rav_queue_set(struct rav_queue_st * queue, size_t pos, struct rav_session_st * session)
+{
+    queue->items[pos] = session;
+    session->queue_pos = pos;
+}
+
+static void rav_queue_sift_up(struct rav_queue_st * queue, size_t pos)
+{
+    struct rav_session_st * session = queue->items[pos];
 
-            printf("set oldest\n");
+    while(pos > 0){
+        size_t parent = (pos - 1) / 2;
+        if (queue->items[parent]->due <= session->due){
+            break;
         }
+        rav_queue_set(queue, pos, queue->items[parent]);
+        pos = parent;
+    }
 
-        if (session != NULL ){
-            char name[128];
-            uri_encode(session->name, strlen(session->name), name, sizeof(name));
+    rav_queue_set(queue, pos, session);
+}
 
-            char uri[256];
-            snprintf(uri, sizeof(uri), "/by-name/%s", name);
+static void rav_queue_sift_down(struct rav_queue_st * queue, size_t pos)
+{
+    struct rav_session_st * session = queue->items[pos];
 
-            if (aes67_rtsp_dsc_start(&rav.rtsp_dsc, session->addr.ipver, session->addr.ip, session->addr.port, uri)){
+    for(;;){
+        size_t child = 2 * pos + 1;
+        if (child >= queue->count){
+            break;
+        }
+        if (child + 1 < queue->count && queue->items[child + 1]->due < queue->items[child]->due){
+            child++;
+        }
+        if (session->due <= queue->items[child]->due){
+            break;
+        }
+        rav_queue_set(queue, pos, queue->items[child]);
+        pos = child;
+    }
 
-                //TODO what can a start fail signify?
-                // - a device gone offline without telling anyone
+    rav_queue_set(queue, pos, session);
+}
 
+static void rav_queue_push(struct rav_queue_st * queue, struct rav_session_st * session, time_t due)
+{
+    assert(queue != NULL);
+    assert(session != NULL);
 
-                if (session->error_count >= RAV_RTSP_NERR_BEFORE_FAIL){
+    rav_queue_remove(session);
 
-                    syslog(LOG_INFO, "device not reachable, ignoring: %s@%s:%hu", session->name, session->hosttarget, session->addr.port);
+    if (queue->count == queue->size){
+        queue->size = queue->size ? 2 * queue->size : 64;
+        queue->items = realloc(queue->items, queue->size * sizeof(struct rav_session_st *));
+        assert(queue->items != NULL);
+    }
 
-                    if (session->state == rav_state_sdp_published){
-                        //TODO actually delete session or let linger in case host comes back?
-                        aes67_sapsrv_session_t * ss = aes67_sapsrv_session_by_origin(sapsrv, &session->origin);
-                        if (ss != NULL){
-                            aes67_sapsrv_session_delete(sapsrv, ss, true);
-                            write_deleted_by(ss, NULL);
-                        }
-                    }
+    session->due = due;
+    session->queue = queue;
 
-                    session->state = rav_state_error;
+    rav_queue_set(queue, queue->count++, session);
+    rav_queue_sift_up(queue, session->queue_pos);
+}
 
-                } else {
-                    session->error_count++;
+static void rav_queue_remove(struct rav_session_st * session)
+{
+    assert(session != NULL);
 
-                    // set timer to wait as many seconds as errors occured (unless timer already set for another connection)
-                    if (aes67_timer_getstate(&rav.retry_timer) != aes67_timer_state_set){
-                        aes67_timer_set(&rav.retry_timer, 1000 * session->error_count);
-                    }
-                }
+    struct rav_queue_st * queue = session->queue;
+
+    if (queue == NULL){
+        return;
+    }
 
+    size_t pos = session->queue_pos;
+
+    queue->count--;
+
+    if (pos < queue->count){
+        rav_queue_set(queue, pos, queue->items[queue->count]);
+        rav_queue_sift_down(queue, pos);
+        rav_queue_sift_up(queue, queue->items[pos]->queue_pos);
+    }
+
+    session->queue = NULL;
+}
+
+static void rav_fetch_callback(struct aes67_rtsp_dsc_mux * mux, void * req_data, u16_t statuscode, u8_t * content, u16_t contentlen, bool unchanged, void * user_data)
+{
+    struct rav_session_st * session = req_data;
+
+    assert(session != NULL);
+
+    time_t now = time(NULL);
+
+    session->fetching = false;
+
+    // update last activity?
+    session->last_activity = now;
+
+    // same content as retrieved before (see rtsp cache), nothing to parse nor to publish
+    if (unchanged && session->sdp != NULL){
+        session->error_count = 0;
+    }
+    // checking for some meaningful min-length
+    else if (statuscode == AES67_RTSP_STATUS_OK && contentlen > 32){
+
+        u8_t *sdp = content;
+        assert(sdp != NULL); // should not occur
+
+        // get origin (o=..) offset v=0\r\n
+        u8_t * o = sdp[4] == '\n' ? &sdp[5] : &sdp[4];
+
+//            printf("%s\n", o);
+//            printf("origin %c%c%c %d\n", o[0], o[1] ,o[2], rav.rtsp.contentlen - (o - sdp));
+
+        struct aes67_sdp_originator origin;
+
+        if (aes67_sdp_origin_fromstr(&origin, o, contentlen - (o - sdp)) == AES67_SDP_ERROR){
+            if (session->state == rav_state_sdp_available || session->state == rav_state_sdp_published){
+                // if prior sdp retrieved, ignore error, assume a temporary fail
+                //TODO anything to consider? if device went offline, the rtsp start operation will fail
             } else {
-                rav.rtsp_session = session;
-                session->error_count = 0;
+                session->state = rav_state_error;
+                syslog(LOG_ERR, "rav failed to extract originator");
             }
         }
-    }
+        // if originators are equal (and same version!) this implies that nothing has changed
+        // and that this rav session actually previously retrieved identical SDP data
+        else if (aes67_sdp_origin_eq(&session->origin, &origin) == 1 && aes67_sdp_origin_cmpversion(&session->origin, &origin) == 0){
+            // nothing to do, hurray!
+//                session->state = rav_state_error;
+            fprintf(stderr, "???\n");
+        }
+        else {
+
+            // if originators are equal (but newer version!) this implies that nothing has changed
+            // and that this rav session actually previously retrieved the SDP data
+            if (aes67_sdp_origin_eq(&session->origin, &origin) == 1 && aes67_sdp_origin_cmpversion(&session->origin, &origin) == -1){
+            // free previous sdp
+//                if (session->sdp != NULL){
+                free(session->sdp);
+                session->sdp = NULL;
+                session->sdplen = 0;
+            }
 
-    //// check if we now should publish
-    time_t publish_if_older = time(NULL) - opts.rav_publish_delay;
-    struct rav_session_st * session = rav.first_session;
-    struct rav_session_st * oldest = NULL;
-    while(session != NULL){
-        if (session->state == rav_state_sdp_available && opts.rav_auto_publish){
+            assert(session->sdp == NULL);
 
-            if (session->last_activity <= publish_if_older){
+            // update SDP info
+            memcpy(&session->origin, &origin, sizeof(struct aes67_sdp_originator));
 
-                assert(session->sdp != NULL);
+            session->sdp = malloc(contentlen + 1);
 
-                aes67_sapsrv_session_t sapsrvSession = aes67_sapsrv_session_by_origin(sapsrv, &session->origin);
+            assert(session->sdp != NULL);
 
-                // if it already exists, the device has published the SDp itself
-                if (sapsrvSession != NULL){
-                    session->state = rav_state_sdp_not_published;
-                    syslog(LOG_INFO, "Published through SAP, ignoring: %s", session->name);
-                } else {
-                    rav_publish_by(session, NULL);
-                }
-            } else if (oldest == NULL || session->last_activity < oldest->last_activity ){
-                oldest = session;
+            memcpy(session->sdp, sdp, contentlen);
+            session->sdp[contentlen] = '\0'; // not needed, but in case dumping
+            session->sdplen = contentlen;
+
+
+            if (session->state == rav_state_discovered || (!opts.rav_auto_publish && session->state == rav_state_sdp_available)){
+                session->state = rav_state_sdp_available;
+            } else if (session->state == rav_state_sdp_published){
+                session->state = rav_state_sdp_updated;
+            } else {
+                syslog(LOG_ERR, "sdp retrieved from unexpected state %d", session->state);
+                // should not reach here
+                session->state = rav_state_error;
             }
+        }
 
+        session->error_count = 0;
+
+    } else {
+        syslog(LOG_ERR, "rtsp describe fail: %s", session->name);
+        rav_fetch_failed(session, now);
+    }
+
+    // schedule next refresh (unless to be retried anyways)
+    if (opts.rav_update_interval > 0 && session->state != rav_state_error && session->queue == NULL){
+        rav_queue_push(&rav.update, session, now + opts.rav_update_interval);
+    }
+
+}
+
+static void rav_fetch_failed(struct rav_session_st * session, time_t now)
+{
+    if (session->error_count >= RAV_RTSP_NERR_BEFORE_FAIL){
+
+        syslog(LOG_INFO, "device not reachable, ignoring: %s@%s:%hu", session->name, session->hosttarget, session->addr.port);
+
+        if (session->state == rav_state_sdp_published){
+            //TODO actually delete session or let linger in case host comes back?
+            aes67_sapsrv_lock(sapsrv);
+            aes67_sapsrv_session_t ss = aes67_sapsrv_session_by_origin(sapsrv, &session->origin);
+            if (ss != NULL){
+                aes67_sapsrv_session_delete(sapsrv, ss, true);
+                write_deleted_by(&session->origin, session->sdp, session->sdplen, NULL);
+            }
+            aes67_sapsrv_unlock(sapsrv);
         }
-        else if (session->state == rav_state_sdp_updated){
 
-            aes67_sapsrv_session_t sapsrvSession = aes67_sapsrv_session_by_origin(sapsrv, &session->origin);
+        session->state = rav_state_error;
 
-            if (sapsrvSession != NULL){
+        return;
+    }
 
-                session->state = rav_state_sdp_published;
+    session->error_count++;
 
-                aes67_sapsrv_session_update(sapsrv, sapsrvSession, session->sdp, session->sdplen);
+    // exponential backoff (exponent clamped, the shift must stay within int)
+    time_t backoff = RAV_RTSP_BACKOFF_MAX;
+    if (session->error_count < 16 && (1 << session->error_count) < RAV_RTSP_BACKOFF_MAX){
+        backoff = 1 << session->error_count;
+    }
+
+    rav_queue_push(session->state == rav_state_discovered ? &rav.discovered : &rav.update, session, now + backoff);
+}
+
+/**
+ * Next session due for a DESCRIBE: newly discovered sessions first, then the stalest ones.
+ * Sessions whose device is busy are passed over (and must be queued again by the caller).
+ */
+static struct rav_session_st * rav_fetch_next(time_t now, struct rav_session_st ** deferred, size_t * ndeferred)
+{
+    struct rav_queue_st * queues[] = {&rav.discovered, &rav.update};
+
+    for(size_t q = 0; q < sizeof(queues) / sizeof(queues[0]); q++){
+        struct rav_queue_st * queue = queues[q];
 
-                write_updated_by(sapsrvSession, NULL);
+        while(queue->count > 0 && queue->items[0]->due <= now){
+            struct rav_session_st * session = queue->items[0];
 
+            rav_queue_remove(session);
+
+            if (queue == &rav.discovered && session->state != rav_state_discovered){
+                continue;
             }
 
-        }
+            // consider only published sdps that might have to be updated
+            if (queue == &rav.update &&
+                session->state != rav_state_sdp_published && (opts.rav_auto_publish || session->state != rav_state_sdp_available)){
+                // (yet) not to be updated, check again later
+                if (session->state != rav_state_error && opts.rav_update_interval > 0){
+                    rav_queue_push(queue, session, now + opts.rav_update_interval);
+                }
+                continue;
+            }
 
-        session = session->next;
+            if (aes67_rtsp_dsc_mux_count(&rav.rtsp_dsc, session->addr.ipver, session->addr.ip) >= RAV_RTSP_PER_DEVICE){
+                if (*ndeferred == RAV_RTSP_DEFER_MAX){
+                    rav_queue_push(queue, session, session->due);
+                    break;
+                }
+                deferred[(*ndeferred)++] = session;
+                continue;
+            }
+
+            return session;
+        }
     }
 
-    // if oldest is set, this means we should set an alarm
-    if (oldest != NULL){
-        u32_t wait_sec = opts.rav_publish_delay - (time(NULL) - oldest->last_activity);
-        aes67_timer_set(&rav.publish_timer, 1000 * wait_sec);
+    return NULL;
+}
+
+static void rav_fetch_dispatch(time_t now)
+{
+    struct rav_session_st * deferred[RAV_RTSP_DEFER_MAX];
+    size_t ndeferred = 0;
+
+    while(aes67_rtsp_dsc_mux_available(&rav.rtsp_dsc) > 0){
+        struct rav_session_st * session = rav_fetch_next(now, deferred, &ndeferred);
+
+        if (session == NULL){
+            break;
+        }
+
+        char uri[AES67_RTSP_DSC_URILEN];
+        rav_session_uri(session, uri, sizeof(uri));
+
+        if (aes67_rtsp_dsc_mux_start(&rav.rtsp_dsc, session->addr.ipver, session->addr.ip, session->addr.port, uri, session)){
+            //TODO what can a start fail signify?
+            // - a device gone offline without telling anyone
+            rav_fetch_failed(session, now);
+        } else {
+            session->fetching = true;
+        }
     }
 
+    for(size_t d = 0; d < ndeferred; d++){
+        rav_queue_push(deferred[d]->state == rav_state_discovered ? &rav.discovered : &rav.update, deferred[d], deferred[d]->due);
+    }
 
-    if (opts.rav_server_enabled){
-        aes67_rtsp_srv_process(&rav.rtsp_srv);
+    // wake up when the next session is due (or a request times out), sessions already due but passed over are
+    // considered again once their device completes a request
+    time_t due = aes67_rtsp_dsc_mux_deadline(&rav.rtsp_dsc);
+    struct rav_queue_st * queues[] = {&rav.discovered, &rav.update};
+    for(size_t q = 0; q < sizeof(queues) / sizeof(queues[0]); q++){
+        if (queues[q]->count > 0 && queues[q]->items[0]->due > now && (due == 0 || queues[q]->items[0]->due < due)){
+            due = queues[q]->items[0]->due;
+        }
+    }
+#ifdef AES67_TIMER_FD
+    // (retry_due is cleared upon expiry)
+    if (due > now && due != rav.retry_due){
+#else
+    if (due > now && (due != rav.retry_due || aes67_timer_getstate(&rav.retry_timer) != aes67_timer_state_set)){
+#endif
+        rav.retry_due = due;
+        aes67_timer_set(&rav.retry_timer, 1000 * (due - now));
     }
 }
 
@@ -1053,6 +1792,8 @@ static void rav_publish_by(struct rav_session_st * session, struct connection_st
 
     u16_t hash = rand();//atoi((char*)session->origin.session_id.data);
 
+    aes67_sapsrv_lock(sapsrv);
+
     aes67_sapsrv_session_t * ss = aes67_sapsrv_session_add(sapsrv, hash, session->addr.ipver, session->addr.ip, session->sdp, session->sdplen);
 
     session->state = rav_state_sdp_published;
@@ -1060,7 +1801,9 @@ static void rav_publish_by(struct rav_session_st * session, struct connection_st
     assert(ss != NULL);
 
     write_rav_publish_by(session, con);
-    write_new_by(ss, con);
+    write_new_by(aes67_sapsrv_session_get_origin(ss), session->sdp, session->sdplen, con);
+
+    aes67_sapsrv_unlock(sapsrv);
 }
 
 
@@ -1090,6 +1833,8 @@ static void rav_resolve_callback(aes67_mdns_resource_t res, enum aes67_mdns_resu
             if (session->state == rav_state_error){
 //                printf("err -> disco\n");
                 session->state = rav_state_discovered;
+                session->error_count = 0;
+                rav_queue_push(&rav.discovered, session, time(NULL));
             }
 
             session->last_activity = time(NULL);
@@ -1102,6 +1847,8 @@ static void rav_resolve_callback(aes67_mdns_resource_t res, enum aes67_mdns_resu
         session->last_activity = time(NULL);
         session->state = rav_state_discovered;
 
+        rav_queue_push(&rav.discovered, session, session->last_activity);
+
         write_rav_new(session);
 
     }
@@ -1130,9 +1877,12 @@ u16_t aes67_rtsp_srv_sdp_getter(struct aes67_rtsp_srv * srv, void * sdpref, u8_t
 
     struct rav_session_st * rav_session = sdpref;
 
+    aes67_sapsrv_lock(sapsrv);
+
     aes67_sapsrv_session_t session = aes67_sapsrv_session_by_origin(sapsrv, &rav_session->origin);
 
     if (!session){
+        aes67_sapsrv_unlock(sapsrv);
         return 0;
     }
 
@@ -1144,12 +1894,15 @@ u16_t aes67_rtsp_srv_sdp_getter(struct aes67_rtsp_srv * srv, void * sdpref, u8_t
     u16_t len = snprintf((char*)buf, maxlen, "Content-Length: %u\r\n\r\n", sdplen);
 
     if (sdplen + len > maxlen){
+        aes67_sapsrv_unlock(sapsrv);
         fprintf(stderr, "sdp file too big for compiled in buffer size");
         return 0;
     }
 
     memcpy(buf + len, sdp, sdplen);
 
+    aes67_sapsrv_unlock(sapsrv);
+
     return len + sdplen;
 
 //
@@ -1161,6 +1914,273 @@ u16_t aes67_rtsp_srv_sdp_getter(struct aes67_rtsp_srv * srv, void * sdpref, u8_t
     return 0;
 }
 
+static void sse_setup()
+{
+    // ids (as sapsrv change sequence) do not repeat across restarts, thus clients notice they have to resync
+    sse.last = (uint64_t)time(NULL) << 20;
+    sse.first = sse.last + 1;
+    memset(sse.msgs, 0, sizeof(sse.msgs));
+    sse.nclients = 0;
+}
+
+static void sse_teardown()
+{
+    for(size_t i = 0; i < AES67_SAPD_SSE_JOURNAL; i++){
+        if (sse.msgs[i] != NULL){
+            msg_unref(sse.msgs[i]);
+            sse.msgs[i] = NULL;
+        }
+    }
+}
+
+/**
+ * Adds (shared) notification to journal and wakes up event stream clients.
+ */
+static void sse_journal(struct msg_st * msg)
+{
+    sse.last++;
+
+    struct msg_st ** slot = &sse.msgs[sse.last % AES67_SAPD_SSE_JOURNAL];
+
+    if (*slot != NULL){
+        msg_unref(*slot);
+    }
+    msg->refcount++;
+    *slot = msg;
+
+    if (sse.last - sse.first >= AES67_SAPD_SSE_JOURNAL){
+        sse.first = sse.last - AES67_SAPD_SSE_JOURNAL + 1;
+    }
+
+    aes67_rtsp_srv_http_wake(&rav.rtsp_srv);
+}
+
+/**
+ * Renders listing of all currently known sessions (as if newly discovered) to be sent to client which can not resume.
+ * Returns EXIT_FAILURE if out of memory (client state unchanged).
+ */
+static int sse_snapshot(struct sse_client_st * client)
+{
+    size_t size = 256;
+    size_t len = 0;
+    u8_t * snapshot = malloc(size);
+
+    if (snapshot == NULL){
+        syslog(LOG_ERR, "sse_snapshot(): out of memory");
+        return EXIT_FAILURE;
+    }
+
+    len += snprintf((char*)snapshot, size, "event: reset\ndata:\n\n");
+
+    aes67_sapsrv_lock(sapsrv);
+
+    aes67_sapsrv_session_t session = aes67_sapsrv_session_first(sapsrv);
+    struct rav_session_st * rav_session = rav.first_session;
+
+    while(session != NULL || rav_session != NULL){
+
+        if (size - len < 512){
+            u8_t * grown = realloc(snapshot, 2 * size);
+            if (grown == NULL){
+                aes67_sapsrv_unlock(sapsrv);
+                free(snapshot);
+                syslog(LOG_ERR, "sse_snapshot(): out of memory");
+                return EXIT_FAILURE;
+            }
+            snapshot = grown;
+            size *= 2;
+        }
+
+        if (session != NULL){
+            u8_t ostr[256];
+            s32_t olen = aes67_sdp_origin_tostr(ostr, sizeof(ostr), aes67_sapsrv_session_get_origin(session));
+
+            // (skip session if origin can not be rendered)
+            if (olen > 2){
+                ostr[olen-2] = '\0'; // remove CRNL
+
+                len += snprintf((char*)&snapshot[len], size - len, "data: " AES67_SAPD_MSGU_NEW " %s\n\n", ostr);
+            }
+
+            session = aes67_sapsrv_session_next(session);
+        } else {
+            u8_t ipstr[AES67_NET_ADDR_STR_MAX];
+            u16_t iplen = aes67_net_ip2str(ipstr, rav_session->addr.ipver, rav_session->addr.ip, 0);
+            ipstr[iplen] = '\0';
+
+            len += snprintf((char*)&snapshot[len], size - len, "data: " AES67_SAPD_MSGU_RAV_DSCV_FMT "\n\n", rav_session->hosttarget, ipstr, rav_session->addr.port, rav_session->name);
+
+            rav_session = rav_session->next;
+        }
+    }
+
+    aes67_sapsrv_unlock(sapsrv);
+
+    // further notifications follow the listing
+    len += snprintf((char*)&snapshot[len], size - len, "id: %" PRIu64 "\nevent: synced\ndata:\n\n", sse.last);
+
+    free(client->snapshot);
+
+    client->snapshot = snapshot;
+    client->snaplen = len;
+    client->snapsent = 0;
+    client->last = sse.last;
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Parses id to resume from (if any and still journaled).
+ */
+static bool sse_since(const u8_t * str, u16_t len, uint64_t * since)
+{
+    char tmp[24];
+
+    if (str == NULL || len == 0 || len >= sizeof(tmp)){
+        return false;
+    }
+
+    memcpy(tmp, str, len);
+    tmp[len] = '\0';
+
+    char * end = NULL;
+    errno = 0;
+    *since = strtoull(tmp, &end, 10);
+    if (errno != 0 || end == tmp || *end != '\0'){
+        return false;
+    }
+
+    return sse.first - 1 <= *since && *since <= sse.last;
+}
+
+void aes67_rtsp_srv_http_handler(struct aes67_rtsp_srv * srv, const enum aes67_rtsp_srv_method method, char * uri, u8_t urilen, u8_t * buf, u16_t * len, u16_t maxlen, bool * more, void ** response_state)
+{
+    struct sse_client_st * client = *response_state;
+
+    // connection terminated
+    if (buf == NULL){
+        if (client != NULL){
+            free(client->snapshot);
+            free(client);
+            *response_state = NULL;
+            sse.nclients--;
+        }
+        return;
+    }
+
+    time_t now = time(NULL);
+
+    if (client == NULL){
+
+        const u16_t pathlen = sizeof(AES67_SAPD_SSE_PATH)-1;
+
+        if (method != aes67_rtsp_srv_method_get || urilen < pathlen || memcmp(uri, AES67_SAPD_SSE_PATH, pathlen) != 0 ||
+            (urilen > pathlen && uri[pathlen] != '?')){
+            *len = snprintf((char*)buf, maxlen, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+            *more = false;
+            return;
+        }
+
+        // leave connections for DESCRIBE requests (EventSource retries later)
+        if (sse.nclients >= AES67_SAPD_SSE_MAXCLIENTS){
+            *len = snprintf((char*)buf, maxlen, "HTTP/1.1 503 Service Unavailable\r\nRetry-After: %d\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", AES67_RTSP_SRV_TIMEOUT_SEC);
+            *more = false;
+            return;
+        }
+
+        client = calloc(1, sizeof(struct sse_client_st));
+
+        // resume from Last-Event-ID (as set by reconnecting EventSource) or query
+        u16_t idlen = 0;
+        const u8_t * id = aes67_rtsp_srv_http_header(srv, "Last-Event-ID", &idlen);
+        if (id == NULL && urilen > sizeof(AES67_SAPD_SSE_PATH "?since=")-1 &&
+            memcmp(uri, AES67_SAPD_SSE_PATH "?since=", sizeof(AES67_SAPD_SSE_PATH "?since=")-1) == 0){
+            id = (u8_t*)&uri[sizeof(AES67_SAPD_SSE_PATH "?since=")-1];
+            idlen = urilen - (sizeof(AES67_SAPD_SSE_PATH "?since=")-1);
+        }
+
+        if (client == NULL || (!sse_since(id, idlen, &client->last) && sse_snapshot(client))){
+            free(client);
+            *len = snprintf((char*)buf, maxlen, "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+            *more = false;
+            return;
+        }
+
+        *response_state = client;
+        sse.nclients++;
+
+        *len = snprintf((char*)buf, maxlen, "HTTP/1.1 200 OK\r\n"
+                                            "Content-Type: text/event-stream\r\n"
+                                            "Cache-Control: no-cache\r\n"
+                                            "Connection: close\r\n"
+                                            "\r\n");
+        client->last_write = now;
+        *more = true;
+        return;
+    }
+
+    *len = 0;
+    *more = true;
+
+    // client missed notifications no longer journaled (if a listing can not be rendered, end stream to let it reconnect)
+    if (client->snapshot == NULL && client->last + 1 < sse.first && sse_snapshot(client)){
+        // (handler is not called again once done)
+        free(client);
+        *response_state = NULL;
+        sse.nclients--;
+        *more = false;
+        return;
+    }
+
+    if (client->snapshot != NULL){
+        size_t l = client->snaplen - client->snapsent;
+        if (l > maxlen){
+            l = maxlen;
+        }
+        memcpy(buf, &client->snapshot[client->snapsent], l);
+        client->snapsent += l;
+        *len = l;
+
+        if (client->snapsent < client->snaplen){
+            client->last_write = now;
+            return;
+        }
+
+        free(client->snapshot);
+        client->snapshot = NULL;
+    }
+
+    // journaled notifications, only complete events are written
+    while(client->last < sse.last){
+        struct msg_st * msg = sse.msgs[(client->last + 1) % AES67_SAPD_SSE_JOURNAL];
+
+        u8_t tmp[48];
+        u16_t tlen = snprintf((char*)tmp, sizeof(tmp), "id: %" PRIu64 "\ndata: ", client->last + 1);
+
+        // notifications are single lines (ending with NL)
+        if (*len + tlen + msg->len + 1 > maxlen){
+            break;
+        }
+
+        memcpy(&buf[*len], tmp, tlen);
+        *len += tlen;
+        memcpy(&buf[*len], msg->data, msg->len);
+        *len += msg->len;
+        buf[(*len)++] = '\n';
+
+        client->last++;
+    }
+
+    // keep (idle) connection alive
+    if (*len == 0 && now - client->last_write >= AES67_RTSP_SRV_TIMEOUT_SEC / 2){
+        *len = snprintf((char*)buf, maxlen, ": keep-alive\n\n");
+    }
+
+    if (*len > 0){
+        client->last_write = now;
+    }
+}
+
 static void rav_announce_callback(aes67_mdns_resource_t res, enum aes67_mdns_result result, const char *type, const char *name, const char *domain, void * context)
 {
     assert(result == aes67_mdns_result_error || result == aes67_mdns_result_registered);
@@ -1299,6 +2319,18 @@ static int rav_unannounce(aes67_sapsrv_session_t session)
     return EXIT_SUCCESS;
 }
 
+static void rav_announce_changed(struct aes67_sdp_originator * origin)
+{
+    assert(origin);
+
+    struct rav_session_st * rav_session = rav_session_find_by_origin(origin);
+
+    // drop cached DESCRIBE response of self hosted session
+    if (rav_session != NULL && rav_session->state == rav_state_sdp_hosted){
+        aes67_rtsp_srv_sdp_changed(&rav.rtsp_srv, rav_session);
+    }
+}
+
 #endif //AES67_SAPD_WITH_RAV == 1
 
 static int load_sdp_file(char * fname)
@@ -1419,7 +2451,7 @@ static struct connection_st * connection_new(int sockfd, struct sockaddr_un * ad
     assert(sockfd > 0);
     assert(addr != NULL);
     assert(socklen > 0);
-    assert(local.nconnections < AES67_SAPD_LOCAL_MAX_CONNECTIONS);
+    assert(local.nconnections < opts.max_clients);
 
     struct connection_st * con = calloc(1, sizeof(struct connection_st));
 
@@ -1428,9 +2460,33 @@ static struct connection_st * connection_new(int sockfd, struct sockaddr_un * ad
         return NULL;
     }
 
+#if AES67_SAPD_EPOLL == 1
+    // edge-triggered, ie local_read() must always read until EAGAIN (resp. con_flush() write)
+    struct epoll_event ev = {
+        .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+        .data.ptr = con
+    };
+    if (epoll_ctl(loop.epfd, EPOLL_CTL_ADD, sockfd, &ev) == -1){
+        syslog(LOG_ERR, "epoll_ctl(): %s", strerror(errno));
+        free(con);
+        return NULL;
+    }
+#endif
+
     local.nconnections++;
 
     con->sockfd = sockfd;
+    con->len = 0;
+    con->cmdlen = -1;
+
+    con->out = NULL;
+    con->outcap = 0;
+    con->outhead = 0;
+    con->outcount = 0;
+    con->outbytes = 0;
+    con->throttled = false;
+    con->dropped = 0;
+    con->dead = false;
 
     con->euid = 0;
     con->egid = 0;
@@ -1462,11 +2518,35 @@ static void connection_close(struct connection_st * con)
         }
     }
 
+#if AES67_SAPD_EPOLL == 1
+    // connection might still be pending
+    for(size_t i = 0; i < loop.nready; i++){
+        if (loop.ready[i] == con){
+            loop.ready[i] = NULL;
+        }
+    }
+#endif
+
     if (con->sockfd != -1){
+#if AES67_SAPD_EPOLL == 1
+        epoll_ctl(loop.epfd, EPOLL_CTL_DEL, con->sockfd, NULL);
+#endif
         close(con->sockfd);
         con->sockfd = -1;
     }
 
+    if (con->filter != NULL){
+        free(con->filter);
+    }
+
+    // release pending output
+    for(; con->outcount > 0; con->outcount--, con->outhead = (con->outhead + 1) % con->outcap){
+        con_release(&con->out[con->outhead]);
+    }
+    if (con->out != NULL){
+        free(con->out);
+    }
+
     free(con);
 
     if (local.nconnections > 0){
@@ -1520,6 +2600,8 @@ static int local_setup(const char * fname)
     local.nconnections = 0;
     local.first_connection = NULL;
 
+    local.spare_fd = open("/dev/null", O_RDONLY);
+
     // change sock access rights to allow for non-sudoer access (r/w by all)
     if (chmod(AES67_SAPD_LOCAL_SOCK, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)){
         close(local.sockfd);
@@ -1542,6 +2624,11 @@ static void local_teardown()
     close(local.sockfd);
     local.sockfd = -1;
 
+    if (local.spare_fd != -1){
+        close(local.spare_fd);
+        local.spare_fd = -1;
+    }
+
     if( access(AES67_SAPD_LOCAL_SOCK, F_OK ) == 0 ){
         //TODO is this generally safe??
         remove(AES67_SAPD_LOCAL_SOCK);
@@ -1552,11 +2639,12 @@ static void local_accept()
 {
     int sockfd;
     struct sockaddr_un addr;
-    socklen_t socklen;
+    socklen_t socklen = sizeof(addr);
 
-    if ((sockfd = accept(local.sockfd, (struct sockaddr *)&addr, &socklen)) != -1) {
+    // accept all pending
+    while ((sockfd = accept(local.sockfd, (struct sockaddr *)&addr, &socklen)) != -1) {
 
-        if (local.nconnections >= AES67_SAPD_LOCAL_MAX_CONNECTIONS){
+        if (local.nconnections >= opts.max_clients){
 
             syslog(LOG_NOTICE, "Too many clients");
 
@@ -1570,115 +2658,473 @@ static void local_accept()
 
             struct connection_st * con = connection_new(sockfd, &addr, socklen);
 
-            if (write(sockfd, MSG_VERSIONWELCOME "\n", sizeof(MSG_VERSIONWELCOME)) == -1){
-                syslog(LOG_ERR, "local_accept(): %s", strerror(errno));
+            if (con == NULL){
+                close(sockfd);
+                continue;
             }
 
+            con_write(con, MSG_VERSIONWELCOME "\n", sizeof(MSG_VERSIONWELCOME));
+
             syslog(LOG_INFO, "client connected: uid %d gid %d (count = %d)", con->euid, con->egid, local.nconnections);
+        }
+
+        socklen = sizeof(addr);
+    }
+
+    // out of fds, the pending client would keep the (level-triggered) listening socket ready, so drop it
+    if ((errno == EMFILE || errno == ENFILE) && local.spare_fd != -1){
+
+        syslog(LOG_NOTICE, "Too many clients (out of fds)");
+
+        close(local.spare_fd);
 
-            // well, shouldn't happen......
-            assert(con != NULL);
+        sockfd = accept(local.sockfd, NULL, NULL);
+        if (sockfd != -1){
+            close(sockfd);
         }
+
+        local.spare_fd = open("/dev/null", O_RDONLY);
     }
 }
 
 static void local_process()
 {
-    local_accept();
+#if AES67_SAPD_EPOLL == 1
+    if (fd_ready(local.sockfd)){
+        local_accept();
+    }
 
+    // only connections with pending data resp. writable again
+    for(size_t i = 0; i < loop.nready; i++){
+        struct connection_st * con = loop.ready[i];
 
-    u8_t cmdline[MAX_CMDLINE];
+        // closed meanwhile
+        if (con == NULL || con->dead){
+            continue;
+        }
+
+        if (con->outcount > 0){
+            con_flush(con);
+        }
+
+        // throttled clients are read once they have caught up (which is signalled by another writable edge)
+        if (!con->dead && !con->throttled && local_read(con)){
+            con->dead = true;
+        }
+    }
+
+    loop.nready = 0;
+#else
+    local_accept();
 
     // check all connections if commands have been issued
+    for(struct connection_st * con = local.first_connection; con != NULL; con = con->next){
+
+        if (con->dead){
+            continue;
+        }
+
+        if (con->outcount > 0){
+            con_flush(con);
+        }
+
+        if (!con->dead && !con->throttled && local_read(con)){
+            con->dead = true;
+        }
+    }
+#endif
+}
+
+/**
+ * Closes connections marked dead, ie connections are never closed while possibly being referenced.
+ */
+static void local_reap()
+{
     struct connection_st * con = local.first_connection;
     while(con != NULL){
+        struct connection_st * next = con->next;
+
+        if (con->dead){
+            connection_close(con);
 
-        bool close_con = false;
-        size_t len = 0;
-        ssize_t cmdlen = -1;
+            syslog(LOG_INFO, "client disconnected: (count = %d)", local.nconnections);
+        }
 
-        ssize_t retval;
+        con = next;
+    }
+}
 
-        // attempt to read single commandline in one go
-        do {
-            retval = read(con->sockfd, &cmdline[len], 1);
+/**
+ * Rebuilds shared memory session directory from scratch (readers see either the old or the new state).
+ * Sessions are copied (payloads referenced) while holding the server lock, the directory is written without it.
+ */
+static void dir_update()
+{
+    assert(shm.dir != NULL);
 
-            if (retval == 0){
+    size_t count = 0;
+
+    aes67_sapsrv_lock(sapsrv);
+
+    for(aes67_sapsrv_session_t session = aes67_sapsrv_session_first(sapsrv); session != NULL; session = aes67_sapsrv_session_next(session)){
+
+        if (count == shm.nentries){
+            size_t n = shm.nentries ? 2 * shm.nentries : 64;
+            struct dir_entry_st * entries = realloc(shm.entries, n * sizeof(struct dir_entry_st));
+            if (entries == NULL){
+                // just publish what we have
+                syslog(LOG_ERR, "dir_update(): out of memory");
+                break;
+            }
+            shm.entries = entries;
+            shm.nentries = n;
+        }
+
+        struct dir_entry_st * entry = &shm.entries[count++];
+
+        memcpy(&entry->origin, aes67_sapsrv_session_get_origin(session), sizeof(struct aes67_sdp_originator));
+        entry->managed_by = aes67_sapsrv_session_get_managedby(session);
+        entry->ifaces = aes67_sapsrv_session_get_ifaces(session);
+        entry->last_activity = aes67_sapsrv_session_get_lastactivity(session);
+        aes67_sapsrv_session_get_payload(session, &entry->payload, &entry->payloadlen);
+        entry->payload = aes67_sapsrv_payload_ref(entry->payload);
+    }
+
+    aes67_sapsrv_unlock(sapsrv);
+
+    aes67_sapd_dir_begin(shm.dir);
+
+    for(size_t i = 0; i < count; i++){
+        struct dir_entry_st * entry = &shm.entries[i];
+
+        // (sessions that do not fit mark the directory as truncated)
+        aes67_sapd_dir_add(shm.dir, &entry->origin, entry->managed_by, entry->ifaces, entry->last_activity,
+                           entry->payload, entry->payloadlen);
+    }
+
+    aes67_sapd_dir_commit(shm.dir);
+
+    for(size_t i = 0; i < count; i++){
+        aes67_sapsrv_payload_unref(shm.entries[i].payload);
+    }
+
+    shm.dirty = false;
+    shm.updated = time(NULL);
+}
+
+/**
+ * Reads (and handles) all commands available from connection, ie until EAGAIN.
+ * Returns true iff the connection is to be closed.
+ */
+static bool local_read(struct connection_st * con)
+{
+    bool close_con = false;
+
+    ssize_t retval;
+
+    // connections are edge-triggered (epoll), ie read until there is nothing more (or the connection is closed)
+    // but stop once the client's output is throttled, further commands are read when it has caught up (see con_flush())
+    while(con->len < MAX_CMDLINE && !con->throttled){
+        retval = read(con->sockfd, &con->cmdline[con->len], 1);
+
+        if (retval == -1){
+            if (errno == EINTR){
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK){
                 close_con = true;
+            }
+            // else nothing more to read for now, a partial commandline is kept until completed
+            break;
+        }
+
+        if (retval == 0){
+            close_con = true;
+            break;
+        }
+
+        // NL terminates command-line
+        if (con->cmdline[con->len] == '\n'){
 
-//            syslog(LOG_INFO, "client discconnected:  (count = %d)", local.nconnections);
+            // make things simpler for parser
+            con->cmdline[con->len] = '\0';
+
+            if (con->cmdlen == -1){
+                con->cmdlen = con->len;
             }
-            else if (retval == 1){
-                // NL terminates command-line
-                if (cmdline[len] == '\n'){
-
-                    // make things simpler for parser
-                    cmdline[len] = '\0';
-
-                    if (cmdlen == -1){
-                        cmdlen = len;
-                    }
-
-                    // try to match command
-                    const struct cmd_st * cmd = NULL;
-                    for(int i = 0; i < COMMAND_COUNT; i++){
-                        if (cmdlen == commands[i].cmdlen && memcmp(cmdline, commands[i].cmd, cmdlen) == 0){
-                            cmd = &commands[i];
-                            break;
-                        }
-                    }
-
-                    // if command (not) found
-                    if (cmd == NULL){
-                        write_error(con, AES67_SAPD_ERR_UNRECOGNIZED, NULL);
-                    } else {
-                        cmdline[len] = '\0';
-                        syslog(LOG_DEBUG, "command: %s", cmdline);
-
-                        cmd->handler(con, cmdline, len);
-                    }
-
-                    // don't break, there might be another command coming
-                    // although, a very active client could thus deny service to other clients
-
-                    // reset lengths;
-                    len = 0;
-                    cmdlen = -1;
 
-                } else {
-                    if (cmdline[len] == ' ' && cmdlen == -1){
-                        cmdlen = len;
-                    }
-                    len++;
+            // try to match command
+            const struct cmd_st * cmd = NULL;
+            for(int i = 0; i < COMMAND_COUNT; i++){
+                if (con->cmdlen == commands[i].cmdlen && memcmp(con->cmdline, commands[i].cmd, con->cmdlen) == 0){
+                    cmd = &commands[i];
+                    break;
                 }
             }
-            else {
-                // timeout, any passed data will be discarded
+
+            // if command (not) found
+            if (cmd == NULL){
+                write_error(con, AES67_SAPD_ERR_UNRECOGNIZED, NULL);
+            } else {
+                syslog(LOG_DEBUG, "command: %s", con->cmdline);
+
+                // session handles obtained by command must not be released by the sapsrv thread while in use
+                aes67_sapsrv_lock(sapsrv);
+                cmd->handler(con, con->cmdline, con->len);
+                aes67_sapsrv_unlock(sapsrv);
+            }
+
+            // don't break, there might be another command coming
+            // although, a very active client could thus deny service to other clients
+
+            // reset lengths;
+            con->len = 0;
+            con->cmdlen = -1;
+
+        } else {
+            if (con->cmdline[con->len] == ' ' && con->cmdlen == -1){
+                con->cmdlen = con->len;
             }
+            con->len++;
+        }
+    }
+
+    if (con->len >= MAX_CMDLINE){
+        syslog(LOG_NOTICE, "Rejecting unfriendly client");
+
+        close_con = true;
+    }
+
+    return close_con;
+}
+
+static struct msg_st * msg_new(const void * data, size_t len)
+{
+    struct msg_st * msg = malloc(sizeof(struct msg_st) + len);
+
+    assert(msg != NULL);
+
+    msg->refcount = 1;
+    msg->len = len;
+    memcpy(msg->data, data, len);
+
+    return msg;
+}
+
+static void msg_unref(struct msg_st * msg)
+{
+    assert(msg->refcount > 0);
+
+    if (--msg->refcount == 0){
+        free(msg);
+    }
+}
+
+/**
+ * Appends (referenced) data to output queue, the queue takes over the reference.
+ */
+static void con_enqueue(struct connection_st * con, struct msg_st * msg, u8_t * payload, u8_t * data, size_t len)
+{
+    if (con->outcount == con->outcap){
+        size_t cap = con->outcap ? 2 * con->outcap : 16;
+        struct out_st * out = malloc(cap * sizeof(struct out_st));
+
+        assert(out != NULL);
+
+        // unwrap ring
+        for(size_t i = 0; i < con->outcount; i++){
+            out[i] = con->out[(con->outhead + i) % con->outcap];
+        }
+        if (con->out != NULL){
+            free(con->out);
+        }
+
+        con->out = out;
+        con->outcap = cap;
+        con->outhead = 0;
+    }
+
+    struct out_st * out = &con->out[(con->outhead + con->outcount) % con->outcap];
+    out->msg = msg;
+    out->payload = payload;
+    out->data = data;
+    out->len = len;
+
+    con->outcount++;
+    con->outbytes += len;
+
+    if (con->outbytes > OUTQ_HIGH_WATERMARK){
+        con->throttled = true;
+    }
+}
+
+static void con_release(struct out_st * out)
+{
+    if (out->msg != NULL){
+        msg_unref(out->msg);
+    } else {
+        aes67_sapsrv_payload_unref(out->payload);
+    }
+}
+
+/**
+ * Writes as much pending output as possible (ie until EAGAIN).
+ */
+static void con_flush(struct connection_st * con)
+{
+    while(con->outcount > 0){
+
+        struct iovec iov[OUTQ_IOV_MAX];
+        int iovcnt = 0;
+
+        for(; iovcnt < OUTQ_IOV_MAX && iovcnt < con->outcount; iovcnt++){
+            struct out_st * out = &con->out[(con->outhead + iovcnt) % con->outcap];
+            iov[iovcnt].iov_base = out->data;
+            iov[iovcnt].iov_len = out->len;
+        }
+
+        ssize_t written = writev(con->sockfd, iov, iovcnt);
+
+        if (written == -1){
+            if (errno == EINTR){
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK){
+                con->dead = true;
+            }
+            break;
+        }
+
+        con->outbytes -= written;
+
+        // release written entries, adjust partially written one
+        while(written > 0){
+            struct out_st * out = &con->out[con->outhead];
+
+            if (written < out->len){
+                out->data += written;
+                out->len -= written;
+                break;
+            }
+
+            written -= out->len;
+
+            con_release(out);
+
+            con->outhead = (con->outhead + 1) % con->outcap;
+            con->outcount--;
+        }
+    }
+
+    if (con->throttled && con->outbytes < OUTQ_LOW_WATERMARK){
+        con->throttled = false;
+
+        if (con->dropped > 0){
+            syslog(LOG_NOTICE, "client caught up, dropped %u messages", con->dropped);
+            con->dropped = 0;
+        }
+    }
+}
+
+/**
+ * Writes data right away if nothing is pending, returns number of bytes written.
+ */
+static size_t con_trywrite(struct connection_st * con, const u8_t * data, size_t len)
+{
+    if (con->outcount > 0){
+        return 0;
+    }
+
+    ssize_t w;
+    do {
+        w = write(con->sockfd, data, len);
+    } while(w == -1 && errno == EINTR);
+
+    if (w == -1){
+        if (errno != EAGAIN && errno != EWOULDBLOCK){
+            con->dead = true;
+        }
+        return 0;
+    }
+
+    return w;
+}
+
+/**
+ * Writes data to client, whatever can not be written right away is copied to output queue.
+ */
+static void con_write(struct connection_st * con, const void * data, size_t len)
+{
+    if (con->dead){
+        return;
+    }
+
+    size_t written = con_trywrite(con, data, len);
+
+    if (written < len && !con->dead){
+        if (con->outbytes + len - written > OUTQ_HARD_LIMIT){
+            con_lagging(con);
+            return;
+        }
+        struct msg_st * msg = msg_new((u8_t*)data + written, len - written);
+        con_enqueue(con, msg, NULL, msg->data, msg->len);
+    }
+}
 
-        } while(retval > 0 && len < MAX_CMDLINE);
+/**
+ * Writes sapsrv payload to client, whatever can not be written right away is queued (by reference).
+ */
+static void con_write_payload(struct connection_st * con, u8_t * payload, size_t len)
+{
+    if (con->dead){
+        return;
+    }
 
-        if (len >= MAX_CMDLINE){
-            syslog(LOG_NOTICE, "Rejecting unfriendly client");
+    size_t written = con_trywrite(con, payload, len);
 
-            close_con = true;
+    if (written < len && !con->dead){
+        if (con->outbytes + len - written > OUTQ_HARD_LIMIT){
+            con_lagging(con);
+            return;
         }
+        con_enqueue(con, NULL, aes67_sapsrv_payload_ref(payload), payload + written, len - written);
+    }
+}
+
+/**
+ * Writes shared message to client (queued by reference), broadcasts to throttled clients are subject to the laggard
+ * policy.
+ */
+static void con_send(struct connection_st * con, struct msg_st * msg, bool broadcast)
+{
+    if (con->dead){
+        return;
+    }
 
-        // if closing a connection, make sure to set next before freeing memory
-        if (close_con){
-            struct connection_st * prev = con;
-            con = con->next;
+    if (broadcast && con->throttled){
+        con_lagging(con);
+        return;
+    }
 
-//            uid_t euid = con->euid;
-//            gid_t egid = con->egid;
+    size_t written = con_trywrite(con, msg->data, msg->len);
 
-            connection_close(prev);
+    if (written < msg->len && !con->dead){
+        msg->refcount++;
+        con_enqueue(con, msg, NULL, &msg->data[written], msg->len - written);
+    }
+}
 
-            // why does this segfault??
-//            printf("client disconnected: uid %d gid %d (count = %d)\n", egid, 0, local.nconnections);
-            syslog(LOG_INFO, "client disconnected: (count = %d)", local.nconnections);
-        } else {
-            con = con->next;
+/**
+ * Applies laggard policy to a message that is not to be queued.
+ */
+static void con_lagging(struct connection_st * con)
+{
+    if (opts.laggards == laggard_disconnect){
+        syslog(LOG_NOTICE, "disconnecting lagging client");
+        con->dead = true;
+    } else {
+        if (con->dropped++ == 0){
+            syslog(LOG_NOTICE, "client lagging, dropping messages");
         }
     }
 }
@@ -1701,152 +3147,213 @@ static void write_error(struct connection_st * con, const u32_t code, const char
         return;
     }
 
-    if (write(con->sockfd, buf, len) == -1){
-        syslog(LOG_ERR, "write_error(): %s", strerror(errno));
-    }
+    con_write(con, buf, len);
 }
 
 static void write_ok(struct connection_st * con)
 {
-    if (write(con->sockfd, AES67_SAPD_MSG_OK "\n", sizeof(AES67_SAPD_MSG_OK)) == -1){
-        syslog(LOG_ERR, "write_ok(): %s", strerror(errno));
-    }
+    con_write(con, AES67_SAPD_MSG_OK "\n", sizeof(AES67_SAPD_MSG_OK));
 }
 
-static void write_toall_except(u8_t * msg, u16_t len, struct connection_st * except)
+static void write_toall_except(u8_t * msg, u16_t len, struct subject_st * subject, struct connection_st * except)
 {
+    // shared by all queues
+    struct msg_st * shared = msg_new(msg, len);
+
     struct connection_st * current = local.first_connection;
 
     while(current != NULL){
 
-        if (current != except){
-            if (write(current->sockfd, msg, len) == -1){
-                syslog(LOG_ERR, "write_toall_except(): %s", strerror(errno));
-            }
-
+        if (current != except && filter_match(current->filter, subject)){
+            con_send(current, shared, true);
         }
 
         current = current->next;
     }
-}
-
-static void write_new_by(aes67_sapsrv_session_t session, struct connection_st * by)
-{
-    assert(session != NULL);
-
-    struct aes67_sdp_originator * origin = aes67_sapsrv_session_get_origin(session);
-
-    assert(origin != NULL);
-
-    u8_t ostr[256];
-    u16_t olen = aes67_sdp_origin_tostr(ostr, sizeof(ostr), origin);
-    ostr[olen-2] = '\0'; // remove CRNL
-
-    u8_t buf[256];
 
-    ssize_t blen = snprintf((char*)buf, sizeof(buf), AES67_SAPD_MSGU_NEW " %s\n", ostr);
+#if AES67_SAPD_WITH_RAV == 1
+    if (opts.rav_sse && opts.rav_server_enabled){
+        sse_journal(shared);
+    }
+#endif
 
-    write_toall_except(buf, blen, by);
+    msg_unref(shared);
 }
 
-static void write_updated_by(aes67_sapsrv_session_t session, struct connection_st * by)
+/**
+ * Parsed SDP of subject (parsed at most once per message), NULL if not available.
+ */
+static struct aes67_sdp * subject_sdp(struct subject_st * subject)
 {
-    assert(session != NULL);
-
-    struct aes67_sdp_originator * origin = aes67_sapsrv_session_get_origin(session);
-
-    assert(origin != NULL);
-
-    u8_t ostr[256];
-    u16_t olen = aes67_sdp_origin_tostr(ostr, sizeof(ostr), origin);
-    ostr[olen-2] = '\0'; // remove CRNL
+    // only one message is dispatched at a time
+    static struct aes67_sdp sdp;
 
-    u8_t buf[256];
+    if (subject->parsed == 0){
+        subject->parsed = -1;
 
-    ssize_t blen = snprintf((char*)buf, sizeof(buf), AES67_SAPD_MSGU_UPDATED " %s\n", ostr);
+        u32_t r = AES67_SDP_ERROR;
+        if (subject->sdp != NULL && subject->sdplen > 0){
+            r = aes67_sdp_fromstr(&sdp, (u8_t*)subject->sdp, subject->sdplen, NULL);
+        }
+        if (r == AES67_SDP_OK || r == AES67_SDP_INCOMPLETE){
+            subject->parsed = 1;
+        }
+    }
 
-    write_toall_except(buf, blen, by);
+    return subject->parsed == 1 ? &sdp : NULL;
 }
 
-static void write_deleted_by(aes67_sapsrv_session_t session, struct connection_st * by)
+static bool addr_in_prefix(const struct aes67_net_addr * addr, const struct aes67_net_addr * net, u8_t prefix)
 {
-    assert(session != NULL);
-
-    struct aes67_sdp_originator * origin = aes67_sapsrv_session_get_origin(session);
-
-    assert(origin != NULL);
-
-    u8_t ostr[256];
-    u16_t olen = aes67_sdp_origin_tostr(ostr, sizeof(ostr), origin);
-    ostr[olen-2] = '\0'; // remove CRNL
-
-    u8_t buf[256];
+    if (addr->ipver != net->ipver){
+        return false;
+    }
 
-    ssize_t blen = snprintf((char*)buf, sizeof(buf), AES67_SAPD_MSGU_DELETED " %s\n", ostr);
+    u8_t i = 0;
+    for(; prefix >= 8; prefix -= 8, i++){
+        if (addr->ip[i] != net->ip[i]){
+            return false;
+        }
+    }
+    if (prefix > 0){
+        u8_t mask = 0xff << (8 - prefix);
+        if ((addr->ip[i] & mask) != (net->ip[i] & mask)){
+            return false;
+        }
+    }
 
-    write_toall_except(buf, blen, by);
+    return true;
 }
 
-static void write_timeout_by(aes67_sapsrv_session_t session, struct connection_st * by)
+/**
+ * Tests if a message concerning subject passes filter, ie is to be delivered.
+ * Criteria that can not be evaluated (eg because the SDP is not known yet) do not match.
+ */
+static bool filter_match(struct filter_st * filter, struct subject_st * subject)
 {
-    assert(session != NULL);
+    // no filter or message not about any particular session
+    if (filter == NULL || subject == NULL){
+        return true;
+    }
 
-    struct aes67_sdp_originator * origin = aes67_sapsrv_session_get_origin(session);
+    if (filter->origin.ipver != aes67_net_ipver_undefined){
+        struct aes67_net_addr addr;
+        if (subject->origin == NULL ||
+            aes67_net_str2addr(&addr, (u8_t*)subject->origin->address.data, subject->origin->address.length) == false ||
+            addr_in_prefix(&addr, &filter->origin, 8 * AES67_NET_IPVER_SIZE(addr.ipver)) == false){
+            return false;
+        }
+    }
 
-    assert(origin != NULL);
+    if (filter->name[0] != '\0'){
+        const char * name = subject->name;
+#if 0 < AES67_SDP_MAXSESSIONNAME
+        char sname[AES67_SDP_MAXSESSIONNAME + 1];
+        if (name == NULL){
+            struct aes67_sdp * sdp = subject_sdp(subject);
+            if (sdp != NULL){
+                memcpy(sname, sdp->name.data, sdp->name.length);
+                sname[sdp->name.length] = '\0';
+                name = sname;
+            }
+        }
+#endif
+        if (name == NULL || fnmatch(filter->name, name, 0) != 0){
+            return false;
+        }
+    }
 
-    u8_t ostr[256];
-    u16_t olen = aes67_sdp_origin_tostr(ostr, sizeof(ostr), origin);
-    ostr[olen-2] = '\0'; // remove CRNL
+    // stream criteria must all be met by the same stream
+    if (filter->encoding != aes67_audio_encoding_undefined || filter->samplerate != 0 || filter->nchannels != 0 ||
+        filter->mcast.ipver != aes67_net_ipver_undefined){
 
-    u8_t buf[256];
+        struct aes67_sdp * sdp = subject_sdp(subject);
+        if (sdp == NULL){
+            return false;
+        }
+
+        for(u8_t s = 0; s < sdp->streams.count; s++){
+            if (!aes67_sdp_stream_match(sdp, s, filter->encoding, filter->samplerate, filter->nchannels)){
+                continue;
+            }
+            if (filter->mcast.ipver != aes67_net_ipver_undefined){
+                struct aes67_sdp_connection * con = aes67_sdp_get_connection(sdp, s);
+                struct aes67_net_addr addr;
+                if (aes67_net_str2addr(&addr, con->address.data, con->address.length) == false ||
+                    addr_in_prefix(&addr, &filter->mcast, filter->mcast_prefix) == false){
+                    continue;
+                }
+            }
+            return true;
+        }
 
-    ssize_t blen = snprintf((char*)buf, sizeof(buf), AES67_SAPD_MSGU_TIMEOUT " %s\n", ostr);
+        return false;
+    }
 
-    write_toall_except(buf, blen, by);
+    return true;
 }
 
-static void write_handover_by(aes67_sapsrv_session_t session, struct connection_st * by)
+static void write_session_by(const char * msgu, const struct aes67_sdp_originator * origin, const u8_t * sdp, u16_t sdplen, struct connection_st * by)
 {
-    assert(session != NULL);
-
-    struct aes67_sdp_originator * origin = aes67_sapsrv_session_get_origin(session);
-
+    assert(msgu != NULL);
     assert(origin != NULL);
 
+    shm.dirty = true;
+
     u8_t ostr[256];
-    u16_t olen = aes67_sdp_origin_tostr(ostr, sizeof(ostr), origin);
+    s32_t olen = aes67_sdp_origin_tostr(ostr, sizeof(ostr), (struct aes67_sdp_originator *)origin);
+    if (olen <= 2){
+        syslog(LOG_ERR, "unexpected origin tostr err");
+        return;
+    }
     ostr[olen-2] = '\0'; // remove CRNL
 
     u8_t buf[256];
 
-    ssize_t blen = snprintf((char*)buf, sizeof(buf), AES67_SAPD_MSGU_HANDOVER " %s\n", ostr);
+    ssize_t blen = snprintf((char*)buf, sizeof(buf), "%s %s\n", msgu, ostr);
+
+    struct subject_st subject = {
+        .origin = origin,
+        .sdp = sdp,
+        .sdplen = sdplen
+    };
 
-    write_toall_except(buf, blen, by);
+    write_toall_except(buf, blen, &subject, by);
 }
 
-static void write_takeover_by(aes67_sapsrv_session_t session, struct connection_st * by)
+static void write_new_by(const struct aes67_sdp_originator * origin, const u8_t * sdp, u16_t sdplen, struct connection_st * by)
 {
-    assert(session != NULL);
-
-    struct aes67_sdp_originator * origin = aes67_sapsrv_session_get_origin(session);
+    write_session_by(AES67_SAPD_MSGU_NEW, origin, sdp, sdplen, by);
+}
 
-    assert(origin != NULL);
+static void write_updated_by(const struct aes67_sdp_originator * origin, const u8_t * sdp, u16_t sdplen, struct connection_st * by)
+{
+    write_session_by(AES67_SAPD_MSGU_UPDATED, origin, sdp, sdplen, by);
+}
 
-    u8_t ostr[256];
-    u16_t olen = aes67_sdp_origin_tostr(ostr, sizeof(ostr), origin);
-    ostr[olen-2] = '\0'; // remove CRNL
+static void write_deleted_by(const struct aes67_sdp_originator * origin, const u8_t * sdp, u16_t sdplen, struct connection_st * by)
+{
+    write_session_by(AES67_SAPD_MSGU_DELETED, origin, sdp, sdplen, by);
+}
 
-    u8_t buf[256];
+static void write_timeout_by(const struct aes67_sdp_originator * origin, const u8_t * sdp, u16_t sdplen, struct connection_st * by)
+{
+    write_session_by(AES67_SAPD_MSGU_TIMEOUT, origin, sdp, sdplen, by);
+}
 
-    ssize_t blen = snprintf((char*)buf, sizeof(buf), AES67_SAPD_MSGU_TAKEOVER " %s\n", ostr);
+static void write_handover_by(const struct aes67_sdp_originator * origin, const u8_t * sdp, u16_t sdplen, struct connection_st * by)
+{
+    write_session_by(AES67_SAPD_MSGU_HANDOVER, origin, sdp, sdplen, by);
+}
 
-    write_toall_except(buf, blen, by);
+static void write_takeover_by(const struct aes67_sdp_originator * origin, const u8_t * sdp, u16_t sdplen, struct connection_st * by)
+{
+    write_session_by(AES67_SAPD_MSGU_TAKEOVER, origin, sdp, sdplen, by);
 }
 
 static void write_list_entry(struct connection_st * con, aes67_sapsrv_session_t session, bool return_payload)
 {
-    u8_t buf[256 + AES67_SAPSRV_SDP_MAXLEN];
+    u8_t buf[256];
     size_t blen = 0;
 
     // assuming 256 is enough for first line...
@@ -1890,15 +3397,11 @@ static void write_list_entry(struct connection_st * con, aes67_sapsrv_session_t
 
     buf[blen++] = '\n';
 
-    if (payloadlen > 0){
-        assert(payload != NULL);
-
-        memcpy(&buf[blen], payload, payloadlen);
-        blen += payloadlen;
-    }
+    con_write(con, buf, blen);
 
-    if (write(con->sockfd, buf, blen) == -1){
-        syslog(LOG_ERR, "write_list_entry: %s", strerror(errno));
+    // write (shared) payload as is
+    if (payloadlen > 0){
+        con_write_payload(con, payload, payloadlen);
     }
 }
 
@@ -1906,6 +3409,11 @@ static void cmd_list(struct connection_st * con, u8_t * cmdline, size_t len)
 {
     bool return_payload = false;
 
+    if (len >= sizeof(AES67_SAPD_CMD_LIST_SINCE " 0")-1 && memcmp(cmdline, AES67_SAPD_CMD_LIST_SINCE " ", sizeof(AES67_SAPD_CMD_LIST_SINCE)) == 0){
+        cmd_list_since(con, cmdline, len);
+        return;
+    }
+
     // check wether payload should be returned
     if (len >= sizeof(AES67_SAPD_CMD_LIST " 0")-1){
         if (cmdline[sizeof(AES67_SAPD_CMD_LIST)] == '1'){
@@ -1949,6 +3457,70 @@ static void cmd_list(struct connection_st * con, u8_t * cmdline, size_t len)
     write_ok(con);
 }
 
+static void cmd_list_since(struct connection_st * con, u8_t * cmdline, size_t len)
+{
+    char * str = (char*)&cmdline[sizeof(AES67_SAPD_CMD_LIST_SINCE)];
+    char * end = NULL;
+
+    errno = 0;
+    uint64_t since = strtoull(str, &end, 10);
+    if (errno != 0 || end == str){
+        write_error(con, AES67_SAPD_ERR_SYNTAX, NULL);
+        return;
+    }
+
+    // check wether payload should be returned
+    bool return_payload = false;
+    if (strcmp(end, " 1") == 0){
+        return_payload = true;
+    } else if (strcmp(end, " 0") != 0 && *end != '\0'){
+        write_error(con, AES67_SAPD_ERR_SYNTAX, NULL);
+        return;
+    }
+
+    u8_t buf[256];
+    ssize_t blen;
+
+    // changes not known (anymore, or from another run) -> client has to start over
+    if (since < aes67_sapsrv_changes_horizon(sapsrv) || aes67_sapsrv_changes_seq(sapsrv) < since){
+        con_write(con, AES67_SAPD_RESULT_LIST_RESET "\n", sizeof(AES67_SAPD_RESULT_LIST_RESET));
+        since = 0;
+    } else {
+        // deleted sessions first, sessions listed thereafter might have been re-added since
+        u32_t count = aes67_sapsrv_tombstone_count(sapsrv);
+        for(u32_t i = 0; i < count; i++){
+            uint64_t seq;
+            const struct aes67_sdp_originator * origin = aes67_sapsrv_tombstone_get(sapsrv, i, &seq);
+
+            if (seq <= since){
+                continue;
+            }
+
+            blen = snprintf((char*)buf, sizeof(buf), AES67_SAPD_RESULT_LIST_DELETED " %" PRIu64 " ", seq);
+
+            s32_t olen = aes67_sdp_origin_tostr(&buf[blen], sizeof(buf) - blen, (struct aes67_sdp_originator*)origin);
+            if (olen <= 0){
+                continue;
+            }
+            blen += olen - 2; // remove CRNL
+            buf[blen++] = '\n';
+
+            con_write(con, buf, blen);
+        }
+    }
+
+    aes67_sapsrv_session_t session = aes67_sapsrv_session_changed_since(sapsrv, since);
+
+    for(; session != NULL; session = aes67_sapsrv_session_next_changed(session)){
+        write_list_entry(con, session, return_payload);
+    }
+
+    blen = snprintf((char*)buf, sizeof(buf), AES67_SAPD_RESULT_LIST_SEQ_FMT "\n", aes67_sapsrv_changes_seq(sapsrv));
+    con_write(con, buf, blen);
+
+    write_ok(con);
+}
+
 static void cmd_set(struct connection_st * con, u8_t * cmdline, size_t len)
 {
     if (len < sizeof(AES67_SAPD_CMD_SET " 1")){
@@ -2021,6 +3593,9 @@ static void cmd_set(struct connection_st * con, u8_t * cmdline, size_t len)
         if (aes67_sdp_origin_cmpversion(sorigin, &origin) == -1){
             is_new = false;
             aes67_sapsrv_session_update(sapsrv, session, sdp, sdplen);
+#if AES67_SAPD_WITH_RAV == 1
+            rav_announce_changed(&origin);
+#endif
         } else {
             write_error(con, AES67_SAPD_ERR, "session version is not newer");
             return;
@@ -2039,9 +3614,9 @@ static void cmd_set(struct connection_st * con, u8_t * cmdline, size_t len)
 
     // now inform all other clients that session added/updated
     if (is_new){
-        write_new_by(session, con);
+        write_new_by(aes67_sapsrv_session_get_origin(session), sdp, sdplen, con);
     } else {
-        write_updated_by(session, con);
+        write_updated_by(aes67_sapsrv_session_get_origin(session), sdp, sdplen, con);
     }
 }
 
@@ -2082,13 +3657,21 @@ static void cmd_unset(struct connection_st * con, u8_t * cmdline, size_t len)
     }
 #endif
 
+    // keep payload for notification (filters), session is gone thereafter
+    u8_t * payload;
+    u16_t payloadlen;
+    aes67_sapsrv_session_get_payload(session, &payload, &payloadlen);
+    payload = aes67_sapsrv_payload_ref(payload);
+
     // delete session
     aes67_sapsrv_session_delete(sapsrv, session, true);
 
     write_ok(con);
 
     // now inform all other clients that session was deleted
-    write_deleted_by(session, con);
+    write_deleted_by(&origin, payload, payloadlen, con);
+
+    aes67_sapsrv_payload_unref(payload);
 }
 
 
@@ -2134,8 +3717,12 @@ static void cmd_handover(struct connection_st * con, u8_t * cmdline, size_t len)
 
     write_ok(con);
 
+    u8_t * payload;
+    u16_t payloadlen;
+    aes67_sapsrv_session_get_payload(session, &payload, &payloadlen);
+
     // now inform all other clients that session was handed over
-    write_handover_by(session, con);
+    write_handover_by(aes67_sapsrv_session_get_origin(session), payload, payloadlen, con);
 }
 
 static void cmd_takeover(struct connection_st * con, u8_t * cmdline, size_t len)
@@ -2170,8 +3757,114 @@ static void cmd_takeover(struct connection_st * con, u8_t * cmdline, size_t len)
 
     write_ok(con);
 
+    u8_t * payload;
+    u16_t payloadlen;
+    aes67_sapsrv_session_get_payload(session, &payload, &payloadlen);
+
     // now inform all other clients that session was taken over
-    write_takeover_by(session, con);
+    write_takeover_by(aes67_sapsrv_session_get_origin(session), payload, payloadlen, con);
+}
+
+static void cmd_filter(struct connection_st * con, u8_t * cmdline, size_t len)
+{
+    struct filter_st filter;
+
+    memset(&filter, 0, sizeof(filter));
+
+    bool enabled = false;
+
+    // filter [<key>=<value> ..]
+    char * saveptr = NULL;
+    for(char * tok = strtok_r((char*)&cmdline[sizeof(AES67_SAPD_CMD_FILTER) - 1], " ", &saveptr); tok != NULL; tok = strtok_r(NULL, " ", &saveptr)){
+
+        char * value = strchr(tok, '=');
+        if (value == NULL || value[1] == '\0'){
+            write_error(con, AES67_SAPD_ERR_SYNTAX, NULL);
+            return;
+        }
+        *value++ = '\0';
+
+        if (strcmp(tok, "enc") == 0){
+            int e = atoi(value);
+            if (e == 8){
+                filter.encoding = aes67_audio_encoding_L8;
+            } else if (e == 16){
+                filter.encoding = aes67_audio_encoding_L16;
+            } else if (e == 24){
+                filter.encoding = aes67_audio_encoding_L24;
+            } else if (e == 32){
+                filter.encoding = aes67_audio_encoding_L32;
+            } else if (strcmp(AES67_AUDIO_ENC_AM824_STR, value) == 0){
+                filter.encoding = aes67_audio_encoding_AM824;
+            } else {
+                write_error(con, AES67_SAPD_ERR_INVALID, "enc");
+                return;
+            }
+        } else if (strcmp(tok, "rate") == 0){
+            filter.samplerate = atoi(value);
+            if (filter.samplerate == 0){
+                write_error(con, AES67_SAPD_ERR_INVALID, "rate");
+                return;
+            }
+        } else if (strcmp(tok, "ch") == 0){
+            int ch = atoi(value);
+            if (ch < 1 || ch > 255){
+                write_error(con, AES67_SAPD_ERR_INVALID, "ch");
+                return;
+            }
+            filter.nchannels = ch;
+        } else if (strcmp(tok, "mcast") == 0){
+            char * prefix = strchr(value, '/');
+            if (prefix != NULL){
+                *prefix++ = '\0';
+            }
+            if (aes67_net_str2addr(&filter.mcast, (u8_t*)value, strlen(value)) == false || filter.mcast.port != 0){
+                write_error(con, AES67_SAPD_ERR_INVALID, "mcast");
+                return;
+            }
+            filter.mcast_prefix = 8 * AES67_NET_IPVER_SIZE(filter.mcast.ipver);
+            if (prefix != NULL){
+                int p = atoi(prefix);
+                if (p < 0 || p > filter.mcast_prefix){
+                    write_error(con, AES67_SAPD_ERR_INVALID, "mcast");
+                    return;
+                }
+                filter.mcast_prefix = p;
+            }
+        } else if (strcmp(tok, "origin") == 0){
+            if (aes67_net_str2addr(&filter.origin, (u8_t*)value, strlen(value)) == false || filter.origin.port != 0){
+                write_error(con, AES67_SAPD_ERR_INVALID, "origin");
+                return;
+            }
+        } else if (strcmp(tok, "name") == 0){
+            if (strlen(value) >= sizeof(filter.name)){
+                write_error(con, AES67_SAPD_ERR_INVALID, "name");
+                return;
+            }
+            strcpy(filter.name, value);
+        } else {
+            write_error(con, AES67_SAPD_ERR_SYNTAX, tok);
+            return;
+        }
+
+        enabled = true;
+    }
+
+    if (enabled){
+        if (con->filter == NULL){
+            con->filter = malloc(sizeof(struct filter_st));
+            if (con->filter == NULL){
+                write_error(con, AES67_SAPD_ERR, "out of memory");
+                return;
+            }
+        }
+        memcpy(con->filter, &filter, sizeof(struct filter_st));
+    } else if (con->filter != NULL){
+        free(con->filter);
+        con->filter = NULL;
+    }
+
+    write_ok(con);
 }
 
 #if AES67_SAPD_WITH_RAV == 1
@@ -2190,7 +3883,14 @@ static void write_rav_new(struct rav_session_st * session)
 
     len = snprintf((char*)buf, sizeof(buf), AES67_SAPD_MSGU_RAV_DSCV_FMT "\n", session->hosttarget, ipstr, session->addr.port, session->name);
 
-    write_toall_except(buf, len, NULL);
+    struct subject_st subject = {
+        .origin = session->sdplen > 0 ? &session->origin : NULL,
+        .sdp = session->sdp,
+        .sdplen = session->sdplen,
+        .name = session->name
+    };
+
+    write_toall_except(buf, len, &subject, NULL);
 }
 
 static void write_rav_del(struct rav_session_st * session)
@@ -2201,7 +3901,14 @@ static void write_rav_del(struct rav_session_st * session)
 
     u16_t len = snprintf((char*)buf, sizeof(buf), AES67_SAPD_MSGU_RAV_TERM_FMT "\n", session->name);
 
-    write_toall_except(buf, len, NULL);
+    struct subject_st subject = {
+        .origin = session->sdplen > 0 ? &session->origin : NULL,
+        .sdp = session->sdp,
+        .sdplen = session->sdplen,
+        .name = session->name
+    };
+
+    write_toall_except(buf, len, &subject, NULL);
 }
 
 static void write_rav_publish_by(struct rav_session_st * session, struct connection_st * con)
@@ -2212,7 +3919,14 @@ static void write_rav_publish_by(struct rav_session_st * session, struct connect
 
     u16_t len = snprintf((char*)buf, sizeof(buf), AES67_SAPD_MSGU_RAV_PUB_FMT "\n", session->name);
 
-    write_toall_except(buf, len, con);
+    struct subject_st subject = {
+        .origin = session->sdplen > 0 ? &session->origin : NULL,
+        .sdp = session->sdp,
+        .sdplen = session->sdplen,
+        .name = session->name
+    };
+
+    write_toall_except(buf, len, &subject, con);
 }
 
 static void write_rav_unpublish_by(struct rav_session_st * session, struct connection_st * con)
@@ -2223,7 +3937,14 @@ static void write_rav_unpublish_by(struct rav_session_st * session, struct conne
 
     u16_t len = snprintf((char*)buf, sizeof(buf), AES67_SAPD_MSGU_RAV_UNPUB_FMT "\n", session->name);
 
-    write_toall_except(buf, len, con);
+    struct subject_st subject = {
+        .origin = session->sdplen > 0 ? &session->origin : NULL,
+        .sdp = session->sdp,
+        .sdplen = session->sdplen,
+        .name = session->name
+    };
+
+    write_toall_except(buf, len, &subject, con);
 }
 
 static void write_rav_list_entry(struct connection_st * con, struct rav_session_st * session, bool return_payload)
@@ -2247,16 +3968,12 @@ static void write_rav_list_entry(struct connection_st * con, struct rav_session_
                           session->name
     );
 
-    if (write(con->sockfd, buf, blen) == -1){
-        syslog(LOG_ERR,"write_rav_list_entry() %s", strerror(errno));
-    }
+    con_write(con, buf, blen);
 
     if (return_payload && session->sdplen > 0){
         assert(session->sdp != NULL);
 
-        if (write(con->sockfd, session->sdp, session->sdplen) == -1){
-            syslog(LOG_ERR,"write_rav_list_entry() %s", strerror(errno));
-        }
+        con_write(con, session->sdp, session->sdplen);
     }
 }
 
@@ -2499,6 +4216,7 @@ int main(int argc, char * argv[]){
                 {"s6sl", no_argument, 0, 12},
                 {"port", required_argument, 0, 'p'},
                 {"ipv6-if", required_argument, 0, 13},
+                {"iface", required_argument, 0, 13},
 #if AES67_SAPD_WITH_RAV == 1
                 {"rav", no_argument, 0, 14},
                 {"rav-pub-delay", required_argument, 0, 15},
@@ -2510,6 +4228,13 @@ int main(int argc, char * argv[]){
                 {"rav-disable-server", no_argument, 0, 20},
                 {"rav-no-autoannounce", no_argument, 0, 21},
                 {"rav-server-port", required_argument, 0, 22},
+                {"snapshot", required_argument, 0, 23},
+                {"max-clients", required_argument, 0, 24},
+                {"laggards", required_argument, 0, 25},
+                {"shm", no_argument, 0, 26},
+#if AES67_SAPD_WITH_RAV == 1
+                {"rav-sse", no_argument, 0, 27},
+#endif
                 {0,         0,                 0,  0 }
         };
 
@@ -2568,8 +4293,17 @@ int main(int argc, char * argv[]){
                 opts.send_scopes |= AES67_SAPSRV_SCOPE_IPv6_SITELOCAL;
                 break;
 
-            case 13: // ipv6-if
-                opts.ipv6_if = if_nametoindex(optarg);
+            case 13: // --iface, --ipv6-if
+                if (opts.ifcount >= AES67_SAPSRV_IFACES_MAX){
+                    fprintf(stderr, "Too many interfaces (max %d)\n", AES67_SAPSRV_IFACES_MAX);
+                    return EXIT_FAILURE;
+                }
+                opts.ifaces[opts.ifcount] = if_nametoindex(optarg);
+                if (opts.ifaces[opts.ifcount] == 0){
+                    fprintf(stderr, "Unknown interface: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                opts.ifcount++;
                 break;
 
 #if AES67_SAPD_WITH_RAV == 1
@@ -2622,6 +4356,10 @@ int main(int argc, char * argv[]){
                     return EXIT_FAILURE;
                 }
                 break;
+
+            case 27: // --rav-sse
+                opts.rav_sse = true;
+                break;
 #endif
 
             case 19: // --sdp-dir
@@ -2645,6 +4383,40 @@ int main(int argc, char * argv[]){
                 opts.sdp_dir = optarg;
                 break;
 
+            case 23: // --snapshot
+                opts.snapshot = optarg;
+                break;
+
+            case 24: // --max-clients
+                opts.max_clients = atoi(optarg);
+                if (opts.max_clients < 1 || MAX_CLIENTS_MAX < opts.max_clients){
+                    fprintf(stderr, "max-clients must be in range 1 - %d\n", MAX_CLIENTS_MAX);
+                    return EXIT_FAILURE;
+                }
+#if AES67_SAPD_EPOLL == 0
+                // select() can not handle more
+                if (FD_SETSIZE - LOOP_MAX_AUX - 16 < opts.max_clients){
+                    fprintf(stderr, "max-clients must be <= %d (no epoll)\n", FD_SETSIZE - LOOP_MAX_AUX - 16);
+                    return EXIT_FAILURE;
+                }
+#endif
+                break;
+
+            case 25: // --laggards
+                if (strcmp(optarg, "disconnect") == 0){
+                    opts.laggards = laggard_disconnect;
+                } else if (strcmp(optarg, "drop") == 0){
+                    opts.laggards = laggard_drop;
+                } else {
+                    fprintf(stderr, "laggards must be disconnect or drop\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 26: // --shm
+                opts.shm = true;
+                break;
+
             case 'd':
                 opts.daemonize = true;
                 break;
@@ -2696,6 +4468,12 @@ int main(int argc, char * argv[]){
 
     syslog(LOG_INFO, "starting");
 
+    raise_fd_limit();
+
+    if (loop_setup()){
+        goto sapd_stop;
+    }
+
     if (local_setup(AES67_SAPD_LOCAL_SOCK)){
         syslog(LOG_ERR, "Failed to open AF_LOCAL sock: " AES67_SAPD_LOCAL_SOCK);
         goto sapd_stop;
@@ -2705,6 +4483,11 @@ int main(int argc, char * argv[]){
         goto sapd_stop;
     }
 
+    // sessions discovered before restart are provisional until announced again
+    if (opts.snapshot && aes67_sapsrv_snapshot_load(sapsrv, opts.snapshot) == EXIT_SUCCESS){
+        syslog(LOG_INFO, "restored sessions from snapshot %s", opts.snapshot);
+    }
+
     if (opts.sdp_dir && load_sdp_dir(opts.sdp_dir)){
         goto sapd_stop;
     }
@@ -2716,21 +4499,60 @@ int main(int argc, char * argv[]){
     }
 #endif //AES67_SAPD_WITH_RAV == 1
 
+    if (opts.shm){
+        shm.dir = aes67_sapd_dir_create(AES67_SAPD_DIR_CAPACITY, AES67_SAPD_DIR_HEAPSIZE);
+        if (shm.dir == NULL){
+            goto sapd_stop;
+        }
+        dir_update();
+    }
+
     syslog(LOG_INFO, "started");
 
+    time_t snapshot_time = time(NULL);
+
     signal(SIGINT, sig_int);
+
+    // write errors are handled per client
+    signal(SIGPIPE, SIG_IGN);
+
     keep_running = true;
     while(keep_running){
+        local_reap();
+
         block_until_event();
 
+#ifdef AES67_TIMER_FD
+        // expiry callbacks (sapsrv service, ravenna timers)
+        if (fd_ready(aes67_timer_getfd())){
+            aes67_timer_process();
+        }
+#endif
+
+        if (opts.snapshot && time(NULL) - snapshot_time >= SNAPSHOT_INTERVAL_SEC){
+            aes67_sapsrv_snapshot_save(sapsrv, opts.snapshot);
+            snapshot_time = time(NULL);
+        }
+
+        // (session handles are only used while holding the server lock, which is taken just where needed so the sapsrv
+        // thread is not kept from handling network traffic)
         local_process();
-        aes67_sapsrv_process(sapsrv);
+
+        sapsrv_process();
 
 #if AES67_SAPD_WITH_RAV == 1
         if (opts.rav_enabled){
             rav_process();
         }
 #endif
+
+        if (shm.dir != NULL && (shm.dirty || time(NULL) - shm.updated >= DIR_INTERVAL_SEC)){
+            dir_update();
+        }
+    }
+
+    if (opts.snapshot){
+        aes67_sapsrv_snapshot_save(sapsrv, opts.snapshot);
     }
 
 sapd_stop:
@@ -2743,10 +4565,21 @@ sapd_stop:
     }
 #endif
 
+    if (shm.dir != NULL){
+        aes67_sapd_dir_destroy(shm.dir);
+        shm.dir = NULL;
+
+        free(shm.entries);
+        shm.entries = NULL;
+        shm.nentries = 0;
+    }
+
     sapsrv_teardown();
 
     local_teardown();
 
+    loop_teardown();
+
     syslog(LOG_INFO, "stopped");
 
     return EXIT_SUCCESS;
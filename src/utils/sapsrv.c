@@ -16,6 +16,16 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#ifdef __linux__
+// sendmmsg(), recvmmsg(), struct in6_pktinfo
+#define _GNU_SOURCE
+#endif
+
+#ifdef __APPLE__
+// struct in6_pktinfo, IPV6_RECVPKTINFO
+#define __APPLE_USE_RFC_3542
+#endif
+
 #include "aes67/utils/sapsrv.h"
 
 #include "aes67/sap.h"
@@ -27,28 +37,127 @@
 #include <netinet/in.h>
 #include <netdb.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 //#include <libproc.h>
 #include <ifaddrs.h>
+#include <net/if.h>
 #include <syslog.h>
 #include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <limits.h>
+
+#if AES67_SAPSRV_THREADED == 1
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+
+/**
+ * Immutable, reference counted payload buffer (see aes67_sapsrv_payload_ref())
+ * Payload pointers handed out point to data, the header precedes it.
+ */
+typedef struct {
+    u32_t refcount;
+    u16_t len;
+    u8_t data[];
+} payload_buf_t;
 
+#define PAYLOAD_BUF(payload) ((payload_buf_t*)((u8_t*)(payload) - offsetof(payload_buf_t, data)))
 
 typedef struct sapsrv_session_st {
+    u32_t refcount;         // table + queued events, see session_unref()
+    bool deleted;
+    bool provisional;       // restored from snapshot and not seen since (see aes67_sapsrv_snapshot_load())
     u8_t managed_by;
     time_t last_activity;
+    u32_t ifaces;           // interface mask, see AES67_SAPSRV_IFACES_ALL
+    u32_t ifaces_seen;      // (remote sessions) interfaces received on since ifaces_since, see session_rx_ifaces()
+    time_t ifaces_since;
     u16_t hash;
     struct aes67_net_addr ip;
     u16_t payloadlen;
-    u8_t * payload;
+    u8_t * payload;         // see payload_new()
+
+    // serialized announcement (locally managed sessions only), invalidated by session_update()
+    u16_t saplen;
+    u8_t * sap;
 
     struct aes67_sdp_originator origin;
+    u32_t origin_hash;      // of origin username, session id and address (see aes67_sdp_origin_eq())
+    u64_t version;          // origin session version as integer
+
+    uint64_t changeseq;     // see aes67_sapsrv_changes_seq()
+
     struct sapsrv_session_st * next;
+    struct sapsrv_session_st * prev_changed;    // list ordered by changeseq
+    struct sapsrv_session_st * next_changed;
+    struct sapsrv_session_st * next_by_id;
+    struct sapsrv_session_st * next_by_origin;
 } sapsrv_session_t;
 
+#if AES67_SAPSRV_THREADED == 1
+
+typedef struct sapsrv_event_st {
+    struct sapsrv_event_st * next;
+    enum aes67_sapsrv_event event;
+    sapsrv_session_t * session;     // referenced
+    struct aes67_sdp_originator origin;
+    u8_t * payload;                 // referenced
+    u16_t payloadlen;
+} sapsrv_event_t;
+
+/**
+ * Intrusive lock-free MPSC queue (D. Vyukov), producers push at head, the (single) consumer pops from tail.
+ */
+typedef struct {
+    sapsrv_event_t * head;
+    sapsrv_event_t * tail;
+    sapsrv_event_t stub;
+} sapsrv_queue_t;
+
+#endif //AES67_SAPSRV_THREADED == 1
+
+/**
+ * Snapshot file layout (host byte order, ie not meant to be moved between machines):
+ * header followed by count records, each padded to 8 bytes.
+ */
+#define SNAPSHOT_MAGIC      0x53415053 // "SAPS"
+#define SNAPSHOT_VERSION    1
+
+typedef struct {
+    u32_t magic;
+    u32_t version;
+    u32_t count;
+    u32_t size;             // total file size
+} snapshot_header_t;
+
+typedef struct {
+    int64_t last_activity;
+    u32_t ifaces;
+    u16_t hash;
+    u16_t payloadlen;
+    u8_t ipver;
+    u8_t ip[AES67_NET_IPVER_SIZE(aes67_net_ipver_6)];
+    u8_t payload[];         // origin is restored from payload
+} snapshot_record_t;
+
+#define SNAPSHOT_RECORD_SIZE(payloadlen) ((offsetof(snapshot_record_t, payload) + (payloadlen) + 7) & ~((size_t)7))
+
+typedef struct {
+    uint64_t seq;
+    struct aes67_sdp_originator origin;
+} tombstone_t;
+
 typedef struct {
     struct aes67_sap_service service;
     sapsrv_session_t * first_session;
 
+    // lookup tables (by SAP msg hash + originating source, by SDP origin)
+    sapsrv_session_t * by_id[AES67_SAPSRV_HASHTABLE_SIZE];
+    sapsrv_session_t * by_origin[AES67_SAPSRV_HASHTABLE_SIZE];
+
     aes67_sapsrv_event_handler event_handler;
     void * user_data;
 
@@ -56,6 +165,19 @@ typedef struct {
     u32_t send_scopes;
     u16_t port;
 
+    // number of provisional sessions and time of last check for their timeouts
+    u32_t provisional;
+    time_t provisional_check;
+
+    // change tracking, tombstones is a ring of the last deleted sessions (see aes67_sapsrv_changes_seq())
+    uint64_t changeseq;
+    uint64_t horizon;
+    sapsrv_session_t * first_changed;
+    sapsrv_session_t * last_changed;
+    tombstone_t tombstones[AES67_SAPSRV_TOMBSTONES];
+    u32_t tombstone_head;
+    u32_t tombstone_count;
+
     bool blocking;
 
 //    int sockfd[2];
@@ -66,9 +188,41 @@ typedef struct {
     int sockfd6;
 //#define sockfd6 sockfd[1]
     struct sockaddr_in6 addr6;
-    unsigned int ipv6_if;
+
+    // network interfaces (none means default interface)
+    size_t ifcount;
+    unsigned int ifaces[AES67_SAPSRV_IFACES_MAX];
+    struct in_addr ifaddrs4[AES67_SAPSRV_IFACES_MAX];
+
+    // interfaces without ipv4 address, ipv4 for these goes through the default interface (see iface_skip4())
+    u32_t ifaces_any4;
+
+    // interface mask of message currently being handled
+    u32_t rx_ifaces;
+
+    // receive buffers (see sock_drain())
+    u8_t rxbuf[AES67_SAPSRV_RX_BATCH][AES67_SAPSRV_SDP_MAXLEN+20]; // 20 for SAP header
+
+#if AES67_SAPSRV_THREADED == 1
+    pthread_t thread;
+    bool thread_running;
+    pthread_mutex_t mutex;          // recursive, guards everything but the event queue
+
+    sapsrv_queue_t events;
+    bool events_pending;            // (atomic) host was notified about queued events, see publish()
+    int notifyfd[2];                // io thread -> host (pipe)
+    int wakefd[2];                  // host -> io thread (pipe), see aes67_sapsrv_process_timers()
+#endif
 } sapsrv_t;
 
+#if AES67_SAPSRV_THREADED == 1
+#define SAPSRV_LOCK(server)     pthread_mutex_lock(&(server)->mutex)
+#define SAPSRV_UNLOCK(server)   pthread_mutex_unlock(&(server)->mutex)
+#else
+#define SAPSRV_LOCK(server)
+#define SAPSRV_UNLOCK(server)
+#endif
+
 
 #if AES67_SAP_MEMORY == AES67_MEMORY_POOL
 static sapserver_t sapserver_singleton;
@@ -78,25 +232,82 @@ static u8_t initialized = false;
 static sapsrv_session_t * session_new(sapsrv_t *server, u8_t managed_by, const u16_t hash, const enum aes67_net_ipver ipver, const u8_t *ip, const struct aes67_sdp_originator *origin, const u8_t *payload, const u16_t payloadlen);
 static sapsrv_session_t * session_update(sapsrv_t *  sapserver, sapsrv_session_t * session, const struct aes67_sdp_originator *origin, const u8_t * payload, const u16_t payloadlen);
 static void session_delete(sapsrv_t * server, sapsrv_session_t * session);
+static void session_changed(sapsrv_t * server, sapsrv_session_t * session, bool relink);
 
 static sapsrv_session_t * aes67_sapsrv_session_by_id(aes67_sapsrv_t sapserver, const u16_t hash, enum aes67_net_ipver ipver, u8_t * ip);
 
+static u32_t id_hash(const u16_t hash, const enum aes67_net_ipver ipver, const u8_t * ip);
+static u32_t origin_hash(const struct aes67_sdp_originator * origin);
+static u64_t origin_version(const struct aes67_sdp_originator * origin);
+static s32_t session_cmpversion(sapsrv_session_t * session, const struct aes67_sdp_originator * origin, const u64_t version);
+static void session_set_hash(sapsrv_t * server, sapsrv_session_t * session, const u16_t hash);
+
 static int set_sock_reuse(int sockfd);
-static int aes67_sapsrv_join_mcast_group(int sockfd, u32_t scope, unsigned int ipv6_if);
-static int aes67_sapsrv_leave_mcast_group(int sockfd, u32_t scope, unsigned int ipv6_if);
+static int aes67_sapsrv_join_mcast_group(int sockfd, u32_t scope, struct in_addr ifaddr4, unsigned int ifindex);
+static int aes67_sapsrv_leave_mcast_group(int sockfd, u32_t scope, struct in_addr ifaddr4, unsigned int ifindex);
 static int join_mcast_groups(sapsrv_t * server, u32_t scopes);
 static int leave_mcast_groups(sapsrv_t * server, u32_t scopes);
 
 static void sap_send(sapsrv_t * server, sapsrv_session_t * session, u8_t opt);
 
+static void sock_drain(sapsrv_t * server, int sockfd);
+
+static void session_unref(sapsrv_session_t * session);
+static void publish(sapsrv_t * server, sapsrv_session_t * session, enum aes67_sapsrv_event event, const struct aes67_sdp_originator * origin, u8_t * payload, u16_t payloadlen);
+
+#if AES67_SAPSRV_THREADED == 1
+static void session_ref(sapsrv_session_t * session);
+static void queue_init(sapsrv_queue_t * queue);
+static void queue_push(sapsrv_queue_t * queue, sapsrv_event_t * event);
+static sapsrv_event_t * queue_pop(sapsrv_queue_t * queue);
+static void * thread_func(void * data);
+static void thread_wake(sapsrv_t * server);
+static void dispatch_events(sapsrv_t * server);
+static int pipe_nonblock(int fds[2]);
+static void pipe_close(int fds[2]);
+#endif
+static int payload_origin(struct aes67_sdp_originator * origin, const u8_t * payload, const u16_t payloadlen);
+static void session_touch(sapsrv_t * server, sapsrv_session_t * session);
+static void session_rx_ifaces(sapsrv_t * server, sapsrv_session_t * session);
+static void provisional_timeouts(sapsrv_t * server);
+static void service_timers(sapsrv_t * server);
+#ifdef AES67_TIMER_FD
+static void service_timer_callback(struct aes67_timer * timer, void * user_data);
+#endif
+
+static int set_sock_pktinfo(int sockfd, int family);
+static unsigned int msg_ifindex(struct msghdr * msg);
+static u32_t ifindex_mask(sapsrv_t * server, unsigned int ifindex, u8_t ipv4);
+static u8_t iface_skip4(sapsrv_t * server, size_t i);
+static int get_ifaddr4(unsigned int ifindex, struct in_addr * addr);
+
+
+
+static u8_t * payload_new(const u8_t * data, const u16_t len)
+{
+    payload_buf_t * buf = malloc(sizeof(payload_buf_t) + len);
+
+    assert(buf != NULL);
 
+    buf->refcount = 1;
+    buf->len = len;
+    memcpy(buf->data, data, len);
+
+    return buf->data;
+}
 
 static sapsrv_session_t * session_new(sapsrv_t *server, u8_t managed_by, const u16_t hash, const enum aes67_net_ipver ipver, const u8_t *ip, const struct aes67_sdp_originator *origin, const u8_t *payload, const u16_t payloadlen)
 {
     sapsrv_session_t * session = malloc(sizeof(sapsrv_session_t));
 
+    session->refcount = 1;
+    session->deleted = false;
+    session->provisional = false;
     session->managed_by = managed_by;
     session->last_activity = 0;
+    session->ifaces = managed_by == AES67_SAPSRV_MANAGEDBY_LOCAL ? AES67_SAPSRV_IFACES_ALL : server->rx_ifaces;
+    session->ifaces_seen = session->ifaces;
+    session->ifaces_since = time(NULL);
 
     session->hash = hash;
 
@@ -104,17 +315,28 @@ static sapsrv_session_t * session_new(sapsrv_t *server, u8_t managed_by, const u
     memcpy(session->ip.ip, ip, AES67_NET_IPVER_SIZE(ipver));
 
     memcpy(&session->origin, origin, sizeof(struct aes67_sdp_originator));
+    session->origin_hash = origin_hash(origin);
+    session->version = origin_version(origin);
 
     session->payloadlen = payloadlen;
-    session->payload = malloc(payloadlen);
+    session->payload = payload_new(payload, payloadlen);
 
-    assert(session->payload);
+    session->saplen = 0;
+    session->sap = NULL;
 
-    memcpy(session->payload, payload, payloadlen);
+    session_changed(server, session, false);
 
     session->next = server->first_session;
     server->first_session = session;
 
+    u32_t i = id_hash(hash, ipver, ip);
+    session->next_by_id = server->by_id[i];
+    server->by_id[i] = session;
+
+    i = session->origin_hash % AES67_SAPSRV_HASHTABLE_SIZE;
+    session->next_by_origin = server->by_origin[i];
+    server->by_origin[i] = session;
+
     return session;
 }
 
@@ -124,22 +346,76 @@ static sapsrv_session_t * session_update(sapsrv_t *  sapserver, sapsrv_session_t
 
     memcpy(&session->origin.session_version.data, origin->session_version.data, origin->session_version.length);
     session->origin.session_version.length = origin->session_version.length;
+    session->version = origin_version(origin);
 
-    u8_t * changed = malloc(payloadlen);
-    memcpy(changed, payload, payloadlen);
+    // previous payload stays valid for whoever still holds a reference
+    aes67_sapsrv_payload_unref(session->payload);
 
-    u8_t * previous = session->payload;
-
-    session->payload = changed;
+    session->payload = payload_new(payload, payloadlen);
     session->payloadlen = payloadlen;
 
-    free(previous);
+    if (session->sap != NULL){
+        free(session->sap);
+        session->sap = NULL;
+        session->saplen = 0;
+    }
+
+    session_changed(sapserver, session, true);
 
     return session;
 }
 
+static void changed_unlink(sapsrv_t * server, sapsrv_session_t * session)
+{
+    if (session->prev_changed == NULL){
+        server->first_changed = session->next_changed;
+    } else {
+        session->prev_changed->next_changed = session->next_changed;
+    }
+    if (session->next_changed == NULL){
+        server->last_changed = session->prev_changed;
+    } else {
+        session->next_changed->prev_changed = session->prev_changed;
+    }
+}
+
+/**
+ * Assigns session the next change sequence number, ie moves it to the end of the changed list.
+ */
+static void session_changed(sapsrv_t * server, sapsrv_session_t * session, bool relink)
+{
+    if (relink){
+        changed_unlink(server, session);
+    }
+
+    session->changeseq = ++server->changeseq;
+
+    session->next_changed = NULL;
+    session->prev_changed = server->last_changed;
+    if (server->last_changed == NULL){
+        server->first_changed = session;
+    } else {
+        server->last_changed->next_changed = session;
+    }
+    server->last_changed = session;
+}
+
 static void session_delete(sapsrv_t * server, sapsrv_session_t * session)
 {
+    sapsrv_session_t ** link = &server->by_id[id_hash(session->hash, session->ip.ipver, session->ip.ip)];
+    while(*link != session){
+        assert(*link != NULL);
+        link = &(*link)->next_by_id;
+    }
+    *link = session->next_by_id;
+
+    link = &server->by_origin[session->origin_hash % AES67_SAPSRV_HASHTABLE_SIZE];
+    while(*link != session){
+        assert(*link != NULL);
+        link = &(*link)->next_by_origin;
+    }
+    *link = session->next_by_origin;
+
     if (server->first_session == session){
         server->first_session = session->next;
     } else {
@@ -153,12 +429,176 @@ static void session_delete(sapsrv_t * server, sapsrv_session_t * session)
         }
     }
 
+    if (session->provisional){
+        server->provisional--;
+    }
+
+    changed_unlink(server, session);
+
+    // leave a tombstone, the oldest one is forgotten if full
+    if (server->tombstone_count == AES67_SAPSRV_TOMBSTONES){
+        server->horizon = server->tombstones[server->tombstone_head].seq;
+        server->tombstone_head = (server->tombstone_head + 1) % AES67_SAPSRV_TOMBSTONES;
+        server->tombstone_count--;
+    }
+    tombstone_t * tombstone = &server->tombstones[(server->tombstone_head + server->tombstone_count) % AES67_SAPSRV_TOMBSTONES];
+    tombstone->seq = ++server->changeseq;
+    memcpy(&tombstone->origin, &session->origin, sizeof(struct aes67_sdp_originator));
+    server->tombstone_count++;
+
+    session->deleted = true;
+
+    session_unref(session);
+}
+
+/**
+ * Marks (remote) session as alive, which also confirms a provisional session.
+ */
+/**
+ * Adds interfaces of current message to (remote) session.
+ *
+ * Interfaces a session has not been received on for a full timeout period are dropped again, ie the mask follows
+ * sessions moving between interfaces (within at most two timeout periods).
+ */
+static void session_rx_ifaces(sapsrv_t * server, sapsrv_session_t * session)
+{
+    time_t now = time(NULL);
+
+    session->ifaces |= server->rx_ifaces;
+    session->ifaces_seen |= server->rx_ifaces;
+
+    if (now - session->ifaces_since >= (time_t)server->service.timeout_sec){
+        session->ifaces = session->ifaces_seen;
+        session->ifaces_seen = 0;
+        session->ifaces_since = now;
+    }
+}
+
+static void session_touch(sapsrv_t * server, sapsrv_session_t * session)
+{
+    session->last_activity = time(NULL);
+
+    if (session->provisional){
+        session->provisional = false;
+        server->provisional--;
+    }
+}
+
+/**
+ * Provisional sessions are unknown to the SAP service, ie they have to be timed out here (checked at most once per second).
+ */
+static void provisional_timeouts(sapsrv_t * server)
+{
+    if (server->provisional == 0){
+        return;
+    }
+
+    time_t now = time(NULL);
+
+    if (now == server->provisional_check){
+        return;
+    }
+    server->provisional_check = now;
+
+    sapsrv_session_t * session = server->first_session;
+    while(session != NULL){
+        sapsrv_session_t * next = session->next;
+
+        if (session->provisional && session->last_activity + AES67_SAP_MIN_TIMEOUT_SEC <= now){
+
+            publish(server, session, aes67_sapsrv_event_timeout, &session->origin, session->payload, session->payloadlen);
+
+            session_delete(server, session);
+        }
+
+        session = next;
+    }
+}
+
+/**
+ * (Re-)arms the service timers after its sessions changed (as otherwise done by aes67_sap_service_process() only).
+ */
+static void service_timers(sapsrv_t * server)
+{
+    aes67_sap_service_set_timeout_timer(&server->service);
+    aes67_sap_service_set_announcement_timer(&server->service);
+}
+
+#ifdef AES67_TIMER_FD
+/**
+ * Service timer expiry, called from within aes67_timer_process() (ie in the host's context).
+ */
+static void service_timer_callback(struct aes67_timer * timer, void * user_data)
+{
+    sapsrv_t * server = user_data;
+
+#if AES67_SAPSRV_THREADED == 1
+    // timers are processed by the io thread
+    thread_wake(server);
+#else
+    aes67_sap_service_process(&server->service, server);
+#endif
+}
+#endif //AES67_TIMER_FD
+
+#if AES67_SAPSRV_THREADED == 1
+static void session_ref(sapsrv_session_t * session)
+{
+    __atomic_add_fetch(&session->refcount, 1, __ATOMIC_RELAXED);
+}
+#endif
+
+static void session_unref(sapsrv_session_t * session)
+{
+    if (__atomic_sub_fetch(&session->refcount, 1, __ATOMIC_ACQ_REL) > 0){
+        return;
+    }
+
     if (session->payload != NULL){
-        free(session->payload);
+        aes67_sapsrv_payload_unref(session->payload);
+    }
+    if (session->sap != NULL){
+        free(session->sap);
     }
     free(session);
 }
 
+/**
+ * Passes event to host, either directly or (in threaded mode) through the event queue.
+ */
+static void publish(sapsrv_t * server, sapsrv_session_t * session, enum aes67_sapsrv_event event, const struct aes67_sdp_originator * origin, u8_t * payload, u16_t payloadlen)
+{
+#if AES67_SAPSRV_THREADED == 1
+    sapsrv_event_t * evt = malloc(sizeof(sapsrv_event_t));
+
+    assert(evt != NULL);
+
+    evt->event = event;
+
+    session_ref(session);
+    evt->session = session;
+
+    memcpy(&evt->origin, origin, sizeof(struct aes67_sdp_originator));
+
+    // session payloads are shared, anything else (remote duplicates) must be copied
+    evt->payload = payload == session->payload ? aes67_sapsrv_payload_ref(payload) : payload_new(payload, payloadlen);
+    evt->payloadlen = payloadlen;
+
+    queue_push(&server->events, evt);
+
+    // (events are also published by the host itself, eg when deleting local sessions)
+    // only the first event since the last dispatch needs to notify
+    if (!__atomic_exchange_n(&server->events_pending, true, __ATOMIC_ACQ_REL)){
+        // if the pipe is full the host has yet to be woken up anyways
+        if (write(server->notifyfd[1], "", 1) == -1 && errno != EAGAIN){
+            syslog(LOG_ERR, "sapsrv notify: %s", strerror(errno));
+        }
+    }
+#else
+    server->event_handler(server, session, event, origin, payload, payloadlen, server->user_data);
+#endif
+}
+
 static sapsrv_session_t * aes67_sapsrv_session_by_id(aes67_sapsrv_t sapserver, const u16_t hash, enum aes67_net_ipver ipver, u8_t * ip)
 {
     assert( sapserver != NULL );
@@ -167,9 +607,9 @@ static sapsrv_session_t * aes67_sapsrv_session_by_id(aes67_sapsrv_t sapserver, c
 
     sapsrv_t * server = sapserver;
 
-    sapsrv_session_t * current = server->first_session;
+    sapsrv_session_t * current = server->by_id[id_hash(hash, ipver, ip)];
 
-    for(; current != NULL; current = current->next ){
+    for(; current != NULL; current = current->next_by_id ){
         if (current->hash == hash && current->ip.ipver == ipver && memcmp(current->ip.ip, ip, AES67_NET_IPVER_SIZE(ipver)) == 0){
             return current;
         }
@@ -178,8 +618,111 @@ static sapsrv_session_t * aes67_sapsrv_session_by_id(aes67_sapsrv_t sapserver, c
     return NULL;
 }
 
+static u32_t id_hash(const u16_t hash, const enum aes67_net_ipver ipver, const u8_t * ip)
+{
+    u32_t h = hash;
+
+    for(u16_t i = 0; i < AES67_NET_IPVER_SIZE(ipver); i++){
+        h = 31 * h + ip[i];
+    }
+
+    return (h ^ (h >> 16)) % AES67_SAPSRV_HASHTABLE_SIZE;
+}
+
+static u32_t origin_hash(const struct aes67_sdp_originator * origin)
+{
+    // FNV-1a over the same fields as compared by aes67_sdp_origin_eq()
+    u32_t h = 0x811c9dc5;
+
+    for(u16_t i = 0; i < origin->username.length; i++){
+        h = (h ^ origin->username.data[i]) * 0x01000193;
+    }
+    h = (h ^ ' ') * 0x01000193;
+    for(u16_t i = 0; i < origin->session_id.length; i++){
+        h = (h ^ origin->session_id.data[i]) * 0x01000193;
+    }
+    h = (h ^ ' ') * 0x01000193;
+    for(u16_t i = 0; i < origin->address.length; i++){
+        h = (h ^ origin->address.data[i]) * 0x01000193;
+    }
+
+    return h;
+}
+
+static u64_t origin_version(const struct aes67_sdp_originator * origin)
+{
+    u64_t version = {
+        .msb = 0,
+        .lsb = 0
+    };
+
+    // versions beyond 64 bit (or not numeric) are marked as such and compared as strings
+    if (origin->session_version.length > 19){
+        version.msb = UINT32_MAX;
+        version.lsb = UINT32_MAX;
+        return version;
+    }
+
+    uint64_t v = 0;
+
+    for(u16_t i = 0; i < origin->session_version.length; i++){
+        u8_t c = origin->session_version.data[i];
+        if (c < '0' || '9' < c){
+            version.msb = UINT32_MAX;
+            version.lsb = UINT32_MAX;
+            return version;
+        }
+        v = 10 * v + (c - '0');
+    }
+
+    version.msb = v >> 32;
+    version.lsb = v & UINT32_MAX;
+
+    return version;
+}
+
+static s32_t session_cmpversion(sapsrv_session_t * session, const struct aes67_sdp_originator * origin, const u64_t version)
+{
+    static const u64_t invalid = {
+        .msb = UINT32_MAX,
+        .lsb = UINT32_MAX
+    };
+
+    if (u64_eq(session->version, invalid) || u64_eq(version, invalid)){
+        return aes67_sdp_origin_cmpversion(&session->origin, (struct aes67_sdp_originator *)origin);
+    }
+
+    if (u64_le(session->version, version)){
+        return -1;
+    }
+    if (u64_gr(session->version, version)){
+        return 1;
+    }
+    return 0;
+}
+
+static void session_set_hash(sapsrv_t * server, sapsrv_session_t * session, const u16_t hash)
+{
+    if (session->hash == hash){
+        return;
+    }
+
+    sapsrv_session_t ** link = &server->by_id[id_hash(session->hash, session->ip.ipver, session->ip.ip)];
+    while(*link != session){
+        assert(*link != NULL);
+        link = &(*link)->next_by_id;
+    }
+    *link = session->next_by_id;
+
+    session->hash = hash;
+
+    u32_t i = id_hash(hash, session->ip.ipver, session->ip.ip);
+    session->next_by_id = server->by_id[i];
+    server->by_id[i] = session;
+}
+
 
-int aes67_sapsrv_join_mcast_group(int sockfd, u32_t scope, unsigned int ipv6_if)
+int aes67_sapsrv_join_mcast_group(int sockfd, u32_t scope, struct in_addr ifaddr4, unsigned int ifindex)
 {
     int proto;
     int optname;
@@ -200,7 +743,7 @@ int aes67_sapsrv_join_mcast_group(int sockfd, u32_t scope, unsigned int ipv6_if)
             memcpy(&mreq.v4.imr_multiaddr.s_addr, (u8_t[])AES67_SAP_IPv4_ADMIN, 4);
             syslog(LOG_INFO, "sapsrv joining mcast " AES67_SAP_IPv4_ADMIN_STR);
         }
-        mreq.v4.imr_interface.s_addr = htonl(INADDR_ANY);//*(in_addr_t*)server->iface_addr.addr;
+        mreq.v4.imr_interface = ifaddr4;
         optlen = sizeof(struct ip_mreq);
     } else if (scope & AES67_SAPSRV_SCOPE_IPv6){
         proto = IPPROTO_IPV6;
@@ -224,7 +767,7 @@ int aes67_sapsrv_join_mcast_group(int sockfd, u32_t scope, unsigned int ipv6_if)
 //                       ntohl(((struct in6_addr*)&mreq.v6.ipv6mr_multiaddr)->__u6_addr.__u6_addr32[2]),
 //               ntohl(((struct in6_addr*)&mreq.v6.ipv6mr_multiaddr)->__u6_addr.__u6_addr32[3])
 //       );
-        mreq.v6.ipv6mr_interface = ipv6_if; // default interface // get_ifindex(&server->iface_addr);
+        mreq.v6.ipv6mr_interface = ifindex;
         optlen = sizeof(struct ipv6_mreq);
     } else {
         return EXIT_FAILURE;
@@ -240,34 +783,48 @@ int aes67_sapsrv_join_mcast_group(int sockfd, u32_t scope, unsigned int ipv6_if)
 
 static int join_mcast_groups(sapsrv_t * server, u32_t scopes)
 {
-    if ( (scopes & AES67_SAPSRV_SCOPE_IPv4_GLOBAL) && aes67_sapsrv_join_mcast_group(server->sockfd4, AES67_SAPSRV_SCOPE_IPv4_GLOBAL, server->ipv6_if)){
-        syslog(LOG_ERR, "sapsrv 4gl: %s", strerror(errno));
-        return EXIT_FAILURE;
-    }
-    if ( (scopes & AES67_SAPSRV_SCOPE_IPv4_ADMINISTERED) && aes67_sapsrv_join_mcast_group(server->sockfd4, AES67_SAPSRV_SCOPE_IPv4_ADMINISTERED, server->ipv6_if)){
-        syslog(LOG_ERR, "sapsrv 4al: %s", strerror(errno));
-        return EXIT_FAILURE;
-    }
-    if ( (scopes & AES67_SAPSRV_SCOPE_IPv6_LINKLOCAL) && aes67_sapsrv_join_mcast_group(server->sockfd6, AES67_SAPSRV_SCOPE_IPv6_LINKLOCAL, server->ipv6_if)){
-        syslog(LOG_ERR, "sapsrv 6ll: %s", strerror(errno));
-        return EXIT_FAILURE;
-    }
-    if ( (scopes & AES67_SAPSRV_SCOPE_IPv6_IPv4) && aes67_sapsrv_join_mcast_group(server->sockfd6, AES67_SAPSRV_SCOPE_IPv6_IPv4, server->ipv6_if)){
-        syslog(LOG_ERR, "sapsrv 6al: %s", strerror(errno));
-        return EXIT_FAILURE;
-    }
-    if ( (scopes & AES67_SAPSRV_SCOPE_IPv6_ADMINLOCAL) && aes67_sapsrv_join_mcast_group(server->sockfd6, AES67_SAPSRV_SCOPE_IPv6_ADMINLOCAL, server->ipv6_if)){
-        syslog(LOG_ERR, "sapsrv 6al: %s", strerror(errno));
-        return EXIT_FAILURE;
-    }
-    if ( (scopes & AES67_SAPSRV_SCOPE_IPv6_SITELOCAL) && aes67_sapsrv_join_mcast_group(server->sockfd6, AES67_SAPSRV_SCOPE_IPv6_SITELOCAL, server->ipv6_if)){
-        syslog(LOG_ERR, "sapsrv 6sl: %s", strerror(errno));
-        return EXIT_FAILURE;
+    static const struct {
+        u32_t scope;
+        const char * str;
+    } groups[] = {
+        {AES67_SAPSRV_SCOPE_IPv4_GLOBAL, "4gl"},
+        {AES67_SAPSRV_SCOPE_IPv4_ADMINISTERED, "4al"},
+        {AES67_SAPSRV_SCOPE_IPv6_LINKLOCAL, "6ll"},
+        {AES67_SAPSRV_SCOPE_IPv6_IPv4, "6ip4"},
+        {AES67_SAPSRV_SCOPE_IPv6_ADMINLOCAL, "6al"},
+        {AES67_SAPSRV_SCOPE_IPv6_SITELOCAL, "6sl"},
+    };
+
+    // join every group on every interface (or once on the default interface)
+    for(size_t i = 0; i < (server->ifcount ? server->ifcount : 1); i++){
+
+        struct in_addr ifaddr4 = { .s_addr = htonl(INADDR_ANY) };
+        unsigned int ifindex = 0;
+
+        if (server->ifcount){
+            ifaddr4 = server->ifaddrs4[i];
+            ifindex = server->ifaces[i];
+        }
+
+        for(size_t g = 0; g < sizeof(groups) / sizeof(groups[0]); g++){
+            if ((scopes & groups[g].scope) == 0){
+                continue;
+            }
+            if ((groups[g].scope & AES67_SAPSRV_SCOPE_IPv4) && iface_skip4(server, i)){
+                continue;
+            }
+            int sockfd = (groups[g].scope & AES67_SAPSRV_SCOPE_IPv4) ? server->sockfd4 : server->sockfd6;
+            if (aes67_sapsrv_join_mcast_group(sockfd, groups[g].scope, ifaddr4, ifindex)){
+                syslog(LOG_ERR, "sapsrv %s (if %u): %s", groups[g].str, ifindex, strerror(errno));
+                return EXIT_FAILURE;
+            }
+        }
     }
+
     return EXIT_SUCCESS;
 }
 
-int aes67_sapsrv_leave_mcast_group(int sockfd, u32_t scope, unsigned int ipv6_if)
+int aes67_sapsrv_leave_mcast_group(int sockfd, u32_t scope, struct in_addr ifaddr4, unsigned int ifindex)
 {
     assert(sockfd>0);
     // only
@@ -290,7 +847,7 @@ int aes67_sapsrv_leave_mcast_group(int sockfd, u32_t scope, unsigned int ipv6_if
         } else if (scope & AES67_SAPSRV_SCOPE_IPv4_ADMINISTERED){
             memcpy(&mreq.v4.imr_multiaddr.s_addr, (u8_t[])AES67_SAP_IPv4_ADMIN, 4);
         }
-        mreq.v4.imr_interface.s_addr = htonl(INADDR_ANY);//*(in_addr_t*)server->iface_addr.addr;
+        mreq.v4.imr_interface = ifaddr4;
         optlen = sizeof(mreq.v4);
     } else if (scope & AES67_SAPSRV_SCOPE_IPv6){
         proto = IPPROTO_IPV6;
@@ -304,7 +861,7 @@ int aes67_sapsrv_leave_mcast_group(int sockfd, u32_t scope, unsigned int ipv6_if
         } else if (scope & AES67_SAPSRV_SCOPE_IPv6_SITELOCAL){
             memcpy(&mreq.v6.ipv6mr_multiaddr, (u8_t[])AES67_SAP_IPv6_SL, 16);
         }
-        mreq.v6.ipv6mr_interface = ipv6_if; // default interface // get_ifindex(&server->iface_addr);
+        mreq.v6.ipv6mr_interface = ifindex;
         optlen = sizeof(mreq.v6);
     } else {
         return EXIT_FAILURE;
@@ -323,24 +880,39 @@ static int leave_mcast_groups(sapsrv_t * server, u32_t scopes)
 {
     assert(server);
 
-    if ( (scopes & AES67_SAPSRV_SCOPE_IPv4_GLOBAL) && aes67_sapsrv_leave_mcast_group(server->sockfd4, AES67_SAPSRV_SCOPE_IPv4_GLOBAL, server->ipv6_if)){
-        return EXIT_FAILURE;
-    }
-    if ( (scopes & AES67_SAPSRV_SCOPE_IPv4_ADMINISTERED) && aes67_sapsrv_leave_mcast_group(server->sockfd4, AES67_SAPSRV_SCOPE_IPv4_ADMINISTERED, server->ipv6_if)){
-        return EXIT_FAILURE;
-    }
-    if ( (scopes & AES67_SAPSRV_SCOPE_IPv6_LINKLOCAL) && aes67_sapsrv_leave_mcast_group(server->sockfd6, AES67_SAPSRV_SCOPE_IPv6_LINKLOCAL, server->ipv6_if)){
-        return EXIT_FAILURE;
-    }
-    if ( (scopes & AES67_SAPSRV_SCOPE_IPv6_ADMINLOCAL) && aes67_sapsrv_leave_mcast_group(server->sockfd6, AES67_SAPSRV_SCOPE_IPv6_ADMINLOCAL, server->ipv6_if)){
-        return EXIT_FAILURE;
-    }
-    if ( (scopes & AES67_SAPSRV_SCOPE_IPv6_IPv4) && aes67_sapsrv_leave_mcast_group(server->sockfd6, AES67_SAPSRV_SCOPE_IPv6_IPv4, server->ipv6_if)){
-        return EXIT_FAILURE;
-    }
-    if ( (scopes & AES67_SAPSRV_SCOPE_IPv6_SITELOCAL) && aes67_sapsrv_leave_mcast_group(server->sockfd6, AES67_SAPSRV_SCOPE_IPv6_SITELOCAL, server->ipv6_if)){
-        return EXIT_FAILURE;
+    static const u32_t groups[] = {
+        AES67_SAPSRV_SCOPE_IPv4_GLOBAL,
+        AES67_SAPSRV_SCOPE_IPv4_ADMINISTERED,
+        AES67_SAPSRV_SCOPE_IPv6_LINKLOCAL,
+        AES67_SAPSRV_SCOPE_IPv6_ADMINLOCAL,
+        AES67_SAPSRV_SCOPE_IPv6_IPv4,
+        AES67_SAPSRV_SCOPE_IPv6_SITELOCAL,
+    };
+
+    for(size_t i = 0; i < (server->ifcount ? server->ifcount : 1); i++){
+
+        struct in_addr ifaddr4 = { .s_addr = htonl(INADDR_ANY) };
+        unsigned int ifindex = 0;
+
+        if (server->ifcount){
+            ifaddr4 = server->ifaddrs4[i];
+            ifindex = server->ifaces[i];
+        }
+
+        for(size_t g = 0; g < sizeof(groups) / sizeof(groups[0]); g++){
+            if ((scopes & groups[g]) == 0){
+                continue;
+            }
+            if ((groups[g] & AES67_SAPSRV_SCOPE_IPv4) && iface_skip4(server, i)){
+                continue;
+            }
+            int sockfd = (groups[g] & AES67_SAPSRV_SCOPE_IPv4) ? server->sockfd4 : server->sockfd6;
+            if (aes67_sapsrv_leave_mcast_group(sockfd, groups[g], ifaddr4, ifindex)){
+                return EXIT_FAILURE;
+            }
+        }
     }
+
     return EXIT_SUCCESS;
 }
 
@@ -373,6 +945,14 @@ void aes67_sapsrv_getsockfds(aes67_sapsrv_t sapserver, int * fds[], size_t * cou
 
     static int __fds[2];
 
+#if AES67_SAPSRV_THREADED == 1
+    // sockets are served by io thread, the host just waits for events
+    __fds[c++] = server->notifyfd[0];
+    *fds = __fds;
+    *count = c;
+    return;
+#endif
+
     if (server->sockfd4 != -1){
         __fds[c++] = server->sockfd4;
     }
@@ -396,84 +976,222 @@ int aes67_sapsrv_setblocking(aes67_sapsrv_t sapserver, bool state)
     return EXIT_SUCCESS;
 }
 
-static void sap_send(sapsrv_t * server, sapsrv_session_t * session, u8_t opt)
+static void sap_tx(sapsrv_t * server, int sockfd, int iface, struct sockaddr * addrs, socklen_t addrlen, unsigned int count, u8_t * sap, u16_t saplen)
 {
-    assert(server != NULL);
-    assert(session != NULL);
-    assert(AES67_NET_IPVER_ISVALID(session->ip.ipver));
-
-    u8_t sap[AES67_SAPSRV_SDP_MAXLEN+60];
-
-    u16_t saplen = aes67_sap_service_msg(&server->service, sap, sizeof(sap), opt, session->hash, session->ip.ipver, session->ip.ip, session->payload, session->payloadlen, server);
-
-    if (saplen == 0){
-        syslog(LOG_ERR, "failed to generate SAP msg");
+    if (count == 0){
         return;
     }
 
-    struct sockaddr_in addr_in;
-    struct sockaddr_in6 addr_in6;
+#ifdef __linux__
+    struct mmsghdr msgs[4];
+    struct iovec iov = {
+        .iov_base = sap,
+        .iov_len = saplen
+    };
+    // outgoing interface
+    union {
+        struct cmsghdr align;
+        u8_t buf[CMSG_SPACE(sizeof(struct in6_pktinfo))];
+    } ctl;
+    socklen_t ctllen = 0;
+
+    assert(count <= sizeof(msgs) / sizeof(msgs[0]));
 
-    addr_in.sin_family = AF_INET;
-    addr_in.sin_port = htons(server->port);
+    memset(msgs, 0, sizeof(msgs));
 
-    addr_in6.sin6_family = AF_INET6;
-    addr_in6.sin6_port = htons(server->port);
+    if (iface != -1){
+        memset(&ctl, 0, sizeof(ctl));
 
-    ssize_t s;
+        struct cmsghdr * cmsg = (struct cmsghdr *)ctl.buf;
 
-    if ( (server->send_scopes & AES67_SAPSRV_SCOPE_IPv4_GLOBAL)){
-        memcpy(&addr_in.sin_addr, (u8_t[])AES67_SAP_IPv4_GLOBAL, 4);
-        if ( (s = sendto(server->sockfd4, sap, saplen, 0, (struct sockaddr*)&addr_in, sizeof(struct sockaddr_in))) != saplen){
-            syslog(LOG_ERR, "ipv4-g tx (%zd)", s);
+        if (addrs->sa_family == AF_INET){
+            cmsg->cmsg_level = IPPROTO_IP;
+            cmsg->cmsg_type = IP_PKTINFO;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
+            // (0 meaning the default interface)
+            ((struct in_pktinfo*)CMSG_DATA(cmsg))->ipi_ifindex = (server->ifaces_any4 & ((u32_t)1 << iface)) ? 0 : server->ifaces[iface];
+            ctllen = CMSG_SPACE(sizeof(struct in_pktinfo));
         } else {
-            syslog(LOG_DEBUG, "ipv4-g tx %zd", s);
+            cmsg->cmsg_level = IPPROTO_IPV6;
+            cmsg->cmsg_type = IPV6_PKTINFO;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(struct in6_pktinfo));
+            ((struct in6_pktinfo*)CMSG_DATA(cmsg))->ipi6_ifindex = server->ifaces[iface];
+            ctllen = CMSG_SPACE(sizeof(struct in6_pktinfo));
         }
     }
-    if ( (server->send_scopes & AES67_SAPSRV_SCOPE_IPv4_ADMINISTERED)){
-        memcpy(&addr_in.sin_addr, (u8_t[])AES67_SAP_IPv4_ADMIN, 4);
-        if ( (s = sendto(server->sockfd4, sap, saplen, 0, (struct sockaddr*)&addr_in, sizeof(struct sockaddr_in))) != saplen){
-            syslog(LOG_ERR, "ipv4-a tx (%zd)", s);
-        } else {
-            syslog(LOG_DEBUG, "ipv4-a tx %zd", s);
+
+    for(unsigned int i = 0; i < count; i++){
+        msgs[i].msg_hdr.msg_name = (u8_t*)addrs + i * addrlen;
+        msgs[i].msg_hdr.msg_namelen = addrlen;
+        msgs[i].msg_hdr.msg_iov = &iov;
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        if (ctllen){
+            msgs[i].msg_hdr.msg_control = ctl.buf;
+            msgs[i].msg_hdr.msg_controllen = ctllen;
         }
     }
-    if ( (server->send_scopes & AES67_SAPSRV_SCOPE_IPv6_LINKLOCAL)){
-        memcpy(&addr_in6.sin6_addr, (u8_t[])AES67_SAP_IPv6_LL, 16);
-        if ( (s = sendto(server->sockfd6, sap, saplen, 0, (struct sockaddr*)&addr_in6, sizeof(struct sockaddr_in6))) != saplen){
-            syslog(LOG_ERR, "ipv6-ll tx (%zd)", s);
+
+    int s = sendmmsg(sockfd, msgs, count, 0);
+
+    if (s < 0){
+        syslog(LOG_ERR, "sapsrv tx %u: %s", count, strerror(errno));
+    } else if ((unsigned int)s != count){
+        // (succeeded, ie errno is meaningless)
+        syslog(LOG_ERR, "sapsrv tx partial: sent %d of %u", s, count);
+    } else {
+        syslog(LOG_DEBUG, "sapsrv tx %u x %hu", count, saplen);
+    }
+#else
+    // select outgoing interface
+    if (iface != -1){
+        int r;
+        if (addrs->sa_family == AF_INET){
+            r = setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_IF, &server->ifaddrs4[iface], sizeof(struct in_addr));
         } else {
-            syslog(LOG_DEBUG, "ipv6-ll tx %zd", s);
+            r = setsockopt(sockfd, IPPROTO_IPV6, IPV6_MULTICAST_IF, &server->ifaces[iface], sizeof(unsigned int));
+        }
+        if (r == -1){
+            syslog(LOG_ERR, "sapsrv setsockopt(IP_MULTICAST_IF/IPV6_MULTICAST_IF) (if %u): %s", server->ifaces[iface], strerror(errno));
+            return;
         }
     }
-    if ( (server->send_scopes & AES67_SAPSRV_SCOPE_IPv6_ADMINLOCAL)){
-        memcpy(&addr_in6.sin6_addr, (u8_t[])AES67_SAP_IPv6_AL, 16);
-        if ( (s = sendto(server->sockfd6, sap, saplen, 0, (struct sockaddr*)&addr_in6, sizeof(struct sockaddr_in6))) != saplen){
-            syslog(LOG_ERR, "ipv6-al tx (%zd)", s);
+
+    for(unsigned int i = 0; i < count; i++){
+        ssize_t s = sendto(sockfd, sap, saplen, 0, (struct sockaddr*)((u8_t*)addrs + i * addrlen), addrlen);
+        if (s != saplen){
+            syslog(LOG_ERR, "sapsrv tx (%zd): %s", s, strerror(errno));
         } else {
-            syslog(LOG_DEBUG, "ipv6-al tx %zd", s);
+            syslog(LOG_DEBUG, "sapsrv tx %zd", s);
         }
     }
-    if ( (server->send_scopes & AES67_SAPSRV_SCOPE_IPv6_IPv4)){
-        memcpy(&addr_in6.sin6_addr, (u8_t[])AES67_SAP_IPv6_IP4, 16);
-        if ( (s = sendto(server->sockfd6, sap, saplen, 0, (struct sockaddr*)&addr_in6, sizeof(struct sockaddr_in6))) != saplen){
-            syslog(LOG_ERR, "ipv6-v4 tx (%zd)", s);
-        } else {
-            syslog(LOG_DEBUG, "ipv6-v4 tx %zd", s);
+#endif
+}
+
+static void sap_send(sapsrv_t * server, sapsrv_session_t * session, u8_t opt)
+{
+    assert(server != NULL);
+    assert(session != NULL);
+    assert(AES67_NET_IPVER_ISVALID(session->ip.ipver));
+
+    u8_t buf[AES67_SAPSRV_SDP_MAXLEN+60];
+    u8_t * sap;
+    u16_t saplen;
+
+    if (opt == AES67_SAP_STATUS_MSGTYPE_ANNOUNCE && session->sap != NULL){
+
+        // just let the service know the message has been sent (again)
+        aes67_sap_service_announced(&server->service, session->hash, session->ip.ipver, session->ip.ip, session->saplen);
+
+        sap = session->sap;
+        saplen = session->saplen;
+
+    } else {
+
+        saplen = aes67_sap_service_msg(&server->service, buf, sizeof(buf), opt, session->hash, session->ip.ipver, session->ip.ip, session->payload, session->payloadlen, server);
+
+        if (saplen == 0){
+            syslog(LOG_ERR, "failed to generate SAP msg");
+            return;
+        }
+
+        sap = buf;
+
+        // keep announcement for subsequent periodic (re-)announcements
+        if (opt == AES67_SAP_STATUS_MSGTYPE_ANNOUNCE){
+            session->sap = malloc(saplen);
+            if (session->sap != NULL){
+                memcpy(session->sap, buf, saplen);
+                session->saplen = saplen;
+            }
         }
     }
+
+    struct sockaddr_in addr_in[2];
+    struct sockaddr_in6 addr_in6[4];
+    unsigned int n4 = 0, n6 = 0;
+
+    memset(addr_in, 0, sizeof(addr_in));
+    memset(addr_in6, 0, sizeof(addr_in6));
+
+    for(int i = 0; i < 2; i++){
+        addr_in[i].sin_family = AF_INET;
+        addr_in[i].sin_port = htons(server->port);
+    }
+    for(int i = 0; i < 4; i++){
+        addr_in6[i].sin6_family = AF_INET6;
+        addr_in6[i].sin6_port = htons(server->port);
+    }
+
+    if ( (server->send_scopes & AES67_SAPSRV_SCOPE_IPv4_GLOBAL)){
+        memcpy(&addr_in[n4++].sin_addr, (u8_t[])AES67_SAP_IPv4_GLOBAL, 4);
+    }
+    if ( (server->send_scopes & AES67_SAPSRV_SCOPE_IPv4_ADMINISTERED)){
+        memcpy(&addr_in[n4++].sin_addr, (u8_t[])AES67_SAP_IPv4_ADMIN, 4);
+    }
+    if ( (server->send_scopes & AES67_SAPSRV_SCOPE_IPv6_LINKLOCAL)){
+        memcpy(&addr_in6[n6++].sin6_addr, (u8_t[])AES67_SAP_IPv6_LL, 16);
+    }
+    if ( (server->send_scopes & AES67_SAPSRV_SCOPE_IPv6_ADMINLOCAL)){
+        memcpy(&addr_in6[n6++].sin6_addr, (u8_t[])AES67_SAP_IPv6_AL, 16);
+    }
+    if ( (server->send_scopes & AES67_SAPSRV_SCOPE_IPv6_IPv4)){
+        memcpy(&addr_in6[n6++].sin6_addr, (u8_t[])AES67_SAP_IPv6_IP4, 16);
+    }
     if ( (server->send_scopes & AES67_SAPSRV_SCOPE_IPv6_SITELOCAL)){
-        memcpy(&addr_in6.sin6_addr, (u8_t[])AES67_SAP_IPv6_SL, 16);
-        if ( (s = sendto(server->sockfd6, sap, saplen, 0, (struct sockaddr*)&addr_in6, sizeof(struct sockaddr_in6))) != saplen){
-            syslog(LOG_ERR, "ipv6-sl tx (%zd)", s);
-        } else {
-            syslog(LOG_DEBUG, "ipv6-sl tx %zd", s);
+        memcpy(&addr_in6[n6++].sin6_addr, (u8_t[])AES67_SAP_IPv6_SL, 16);
+    }
+
+    // one (batched) send per socket and interface the session is configured for
+    if (server->ifcount == 0){
+        sap_tx(server, server->sockfd4, -1, (struct sockaddr*)addr_in, sizeof(struct sockaddr_in), n4, sap, saplen);
+        sap_tx(server, server->sockfd6, -1, (struct sockaddr*)addr_in6, sizeof(struct sockaddr_in6), n6, sap, saplen);
+    } else {
+        for(size_t i = 0; i < server->ifcount; i++){
+            if ((session->ifaces & ((u32_t)1 << i)) == 0){
+                continue;
+            }
+            if (!iface_skip4(server, i)){
+                sap_tx(server, server->sockfd4, i, (struct sockaddr*)addr_in, sizeof(struct sockaddr_in), n4, sap, saplen);
+            }
+            sap_tx(server, server->sockfd6, i, (struct sockaddr*)addr_in6, sizeof(struct sockaddr_in6), n6, sap, saplen);
         }
     }
 
     session->last_activity = time(NULL);
 }
 
+/**
+ * Extracts SDP originator from payload (which must start with the version or origin line).
+ */
+static int payload_origin(struct aes67_sdp_originator * origin, const u8_t * payload, const u16_t payloadlen)
+{
+    // simple sanity check
+    if (payloadlen < sizeof("v=0\r\no=- 1 2 IN IP4 2")){
+        return EXIT_FAILURE;
+    }
+
+    // try to detect originator start
+    u8_t * o;
+    if (payload[0] == 'v' && payload[1] == '=' && payload[2] == '0'){
+        o = aes67_memchr(payload, '\n', 5);
+        if (o == NULL){
+            return EXIT_FAILURE;
+        }
+        o++;
+    } else if (payload[0] == 'o' && payload[1] == '='){
+        o = (u8_t*)payload;
+    } else {
+        // ignore messages that miss expected payload start to begin with
+        return EXIT_FAILURE;
+    }
+
+    if (AES67_SDP_OK != aes67_sdp_origin_fromstr(origin, o, payloadlen - (o - payload))){
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
 void aes67_sap_service_event(struct aes67_sap_service *sap, enum aes67_sap_event event, u16_t hash,
                              enum aes67_net_ipver ipver, u8_t *ip, u8_t *type, u16_t typelen,
                              u8_t *payload, u16_t payloadlen, void *user_data)
@@ -528,40 +1246,36 @@ void aes67_sap_service_event(struct aes67_sap_service *sap, enum aes67_sap_event
         }
 
         // publish
-        server->event_handler(server, session, aes67_sapsrv_event_timeout, &session->origin, session->payload, session->payloadlen, server->user_data);
+        publish(server, session, aes67_sapsrv_event_timeout, &session->origin, session->payload, session->payloadlen);
 
         session_delete(server, session);
 
         return;
     }
 
-    // because we require sdp payload types, don't check payload type (see AES67_SAP_FILTER_SDP)
-
-    // let's ignore the SAP originator and just focus on the SDP originator
-    // so.. let's extract the origin
+    // unchanged re-announcements (see AES67_SAP_FILTER_FINGERPRINT) come without payload, so no need to parse anything
+    if (event == aes67_sap_event_refreshed){
 
-    // simple sanity check
-    if (payloadlen < sizeof("v=0\r\no=- 1 2 IN IP4 2")){
-        return;
-    }
+        sapsrv_session_t * session = aes67_sapsrv_session_by_id(server, hash, ipver, ip);
 
-    // try to detect originator start
-    u8_t * o;
-    if (payload[0] == 'v' && payload[1] == '=' && payload[2] == '0'){
-        o = aes67_memchr(payload, '\n', 5);
-        if (o == NULL){
+        // if the originator has meanwhile switched to another hash, the session is kept alive by that one
+        if (session == NULL || session->managed_by == AES67_SAPSRV_MANAGEDBY_LOCAL){
             return;
         }
-        o++;
-    } else if (payload[0] == 'o' && payload[1] == '='){
-        o = payload;
-    } else {
-        // ignore messages that miss expected payload start to begin with
+
+        session_rx_ifaces(server, session);
+        session_touch(server, session);
+
         return;
     }
 
+    // because we require sdp payload types, don't check payload type (see AES67_SAP_FILTER_SDP)
+
+    // let's ignore the SAP originator and just focus on the SDP originator
+    // so.. let's extract the origin
+
     struct aes67_sdp_originator origin;
-    if (AES67_SDP_OK != aes67_sdp_origin_fromstr(&origin, o, payloadlen - (o - payload))){
+    if (payload_origin(&origin, payload, payloadlen)){
         // ignore messages that do not have a valid origin
         return;
     }
@@ -577,7 +1291,7 @@ void aes67_sap_service_event(struct aes67_sap_service *sap, enum aes67_sap_event
             // pass received data to host
             // (but only when it's an announcement message)
             if (event == aes67_sap_event_new || event == aes67_sap_event_updated){
-                server->event_handler(server, session, aes67_sapsrv_event_remote_duplicate, &origin, payload, payloadlen, server->user_data);
+                publish(server, session, aes67_sapsrv_event_remote_duplicate, &origin, payload, payloadlen);
             }
             return;
         }
@@ -598,26 +1312,29 @@ void aes67_sap_service_event(struct aes67_sap_service *sap, enum aes67_sap_event
         } else {
 
             // IMPORTANT set hash to value of last announced one because this will be the last announcement to timeout
-            session->hash = hash;
+            session_set_hash(server, session, hash);
+
+            session_rx_ifaces(server, session);
 
             // if previous session is not older, just skip (because is just a SAP message to prevent timeout)
-            if (aes67_sdp_origin_cmpversion(&session->origin, &origin) != -1){
+            if (session_cmpversion(session, &origin, origin_version(&origin)) != -1){
 
-                session->last_activity = time(NULL);
+                session_touch(server, session);
 
                 return;
             }
 
             evt = aes67_sapsrv_event_updated;
 
-            // update originator
+            // update originator and payload
+            session_update(server, session, &origin, payload, payloadlen);
             memcpy(&session->origin, &origin, sizeof(struct aes67_sdp_originator));
         }
 
-        session->last_activity = time(NULL);
+        session_touch(server, session);
 
         // publish
-        server->event_handler(server, session, evt, &session->origin, session->payload, session->payloadlen, server->user_data);
+        publish(server, session, evt, &session->origin, session->payload, session->payloadlen);
 
 
     } else if (event == aes67_sap_event_deleted){
@@ -631,7 +1348,7 @@ void aes67_sap_service_event(struct aes67_sap_service *sap, enum aes67_sap_event
         // do not check hash, assume that a delete message will first come from the originating device itself
 
         // publish
-        server->event_handler(server, session, aes67_sapsrv_event_deleted, &session->origin, session->payload, session->payloadlen, server->user_data);
+        publish(server, session, aes67_sapsrv_event_deleted, &session->origin, session->payload, session->payloadlen);
 
         session_delete(server, session);
     }
@@ -641,6 +1358,15 @@ aes67_sapsrv_t
 aes67_sapsrv_start(u32_t send_scopes, u16_t port, u32_t listen_scopes, unsigned int ipv6_if,
                    aes67_sapsrv_event_handler event_handler, void *user_data)
 {
+    return aes67_sapsrv_start_ifaces(send_scopes, port, listen_scopes, &ipv6_if, ipv6_if ? 1 : 0, event_handler, user_data);
+}
+
+aes67_sapsrv_t
+aes67_sapsrv_start_ifaces(u32_t send_scopes, u16_t port, u32_t listen_scopes, const unsigned int * ifaces, size_t ifcount,
+                          aes67_sapsrv_event_handler event_handler, void *user_data)
+{
+    assert(ifcount <= AES67_SAPSRV_IFACES_MAX);
+    assert(ifcount == 0 || ifaces != NULL);
     assert(AES67_SAPSRV_SCOPES_HAS(listen_scopes));
     assert(AES67_SAPSRV_SCOPES_HAS(send_scopes));
     assert(port > 0);
@@ -658,18 +1384,44 @@ aes67_sapsrv_start(u32_t send_scopes, u16_t port, u32_t listen_scopes, unsigned
 #endif
     memset(server, 0, sizeof(sapsrv_t));
 
+    server->sockfd4 = -1;
+    server->sockfd6 = -1;
+
     aes67_sap_service_init(&server->service);
 
+#ifdef AES67_TIMER_FD
+    aes67_timer_setcallback(&server->service.announcement_timer, service_timer_callback, server);
+    aes67_timer_setcallback(&server->service.timeout_timer, service_timer_callback, server);
+#endif
+
     server->listen_scopes = listen_scopes;
     server->send_scopes = send_scopes;
     server->port = port;
     server->blocking = true;
-    server->ipv6_if = ipv6_if;
+
+    for(size_t i = 0; i < ifcount; i++){
+        server->ifaces[i] = ifaces[i];
+        server->ifaddrs4[i].s_addr = htonl(INADDR_ANY);
+
+        // ipv4 joins (and on non-linux sends) select the interface by address
+        // (without one, ipv4 is served on the default interface as aes67_sapsrv_start() always did)
+        if (((listen_scopes | send_scopes) & AES67_SAPSRV_SCOPE_IPv4) && get_ifaddr4(ifaces[i], &server->ifaddrs4[i])){
+            syslog(LOG_WARNING, "sapsrv no ipv4 address for interface %u, using default interface for ipv4", ifaces[i]);
+            server->ifaddrs4[i].s_addr = htonl(INADDR_ANY);
+            server->ifaces_any4 |= (u32_t)1 << i;
+        }
+    }
+    server->ifcount = ifcount;
+    server->rx_ifaces = 1;
     server->event_handler = event_handler;
     server->user_data = user_data;
 
     server->first_session = NULL;
 
+    // any sequence number of a previous run is older than the horizon
+    server->changeseq = (uint64_t)time(NULL) << 20;
+    server->horizon = server->changeseq;
+
     if ((listen_scopes | send_scopes) & AES67_SAPSRV_SCOPE_IPv4){
         server->addr4.sin_family = AF_INET;
         server->addr4.sin_port = htons(port);
@@ -707,6 +1459,12 @@ aes67_sapsrv_start(u32_t send_scopes, u16_t port, u32_t listen_scopes, unsigned
             return NULL;
         }
 
+        // receiving interface is needed to tell interfaces apart
+        if (ifcount > 0 && set_sock_pktinfo(server->sockfd4, AF_INET)){
+            close(server->sockfd4);
+            free(server);
+            return NULL;
+        }
     }
 
     if ((listen_scopes | send_scopes) & AES67_SAPSRV_SCOPE_IPv6){
@@ -723,12 +1481,13 @@ aes67_sapsrv_start(u32_t send_scopes, u16_t port, u32_t listen_scopes, unsigned
             return NULL;
         }
 
-        if (set_sock_reuse(server->sockfd4)){
+        if (set_sock_reuse(server->sockfd6)){
             if (server->sockfd4 != -1){
                 close(server->sockfd4);
             }
             close(server->sockfd6);
             free(server);
+            return NULL;
         }
 
         if (bind(server->sockfd6, (struct sockaddr*)&server->addr6, sizeof(struct sockaddr_in6)) == -1){
@@ -751,6 +1510,15 @@ aes67_sapsrv_start(u32_t send_scopes, u16_t port, u32_t listen_scopes, unsigned
             free(server);
             return NULL;
         }
+
+        if (ifcount > 0 && set_sock_pktinfo(server->sockfd6, AF_INET6)){
+            if (server->sockfd4 != -1){
+                close(server->sockfd4);
+            }
+            close(server->sockfd6);
+            free(server);
+            return NULL;
+        }
     }
 
     if (join_mcast_groups(server, listen_scopes)){
@@ -764,6 +1532,51 @@ aes67_sapsrv_start(u32_t send_scopes, u16_t port, u32_t listen_scopes, unsigned
         return NULL;
     }
 
+#if AES67_SAPSRV_THREADED == 1
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&server->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    queue_init(&server->events);
+
+    server->notifyfd[0] = server->notifyfd[1] = -1;
+    server->wakefd[0] = server->wakefd[1] = -1;
+
+    if (pipe_nonblock(server->notifyfd) || pipe_nonblock(server->wakefd)){
+        syslog(LOG_ERR, "sapsrv pipe(): %s", strerror(errno));
+        pipe_close(server->notifyfd);
+        pipe_close(server->wakefd);
+        leave_mcast_groups(server, listen_scopes);
+        if (server->sockfd4 != -1){
+            close(server->sockfd4);
+        }
+        if (server->sockfd6 != -1){
+            close(server->sockfd6);
+        }
+        free(server);
+        return NULL;
+    }
+
+    server->thread_running = true;
+
+    if (pthread_create(&server->thread, NULL, thread_func, server)){
+        syslog(LOG_ERR, "sapsrv pthread_create(): %s", strerror(errno));
+        leave_mcast_groups(server, listen_scopes);
+        if (server->sockfd4 != -1){
+            close(server->sockfd4);
+        }
+        if (server->sockfd6 != -1){
+            close(server->sockfd6);
+        }
+        pipe_close(server->notifyfd);
+        pipe_close(server->wakefd);
+        free(server);
+        return NULL;
+    }
+#endif
+
     return server;
 }
 
@@ -773,6 +1586,23 @@ void aes67_sapsrv_stop(aes67_sapsrv_t sapserver)
 
     sapsrv_t * server = sapserver;
 
+#if AES67_SAPSRV_THREADED == 1
+    __atomic_store_n(&server->thread_running, false, __ATOMIC_RELEASE);
+    thread_wake(server);
+    pthread_join(server->thread, NULL);
+
+    // drop undelivered events
+    sapsrv_event_t * evt;
+    while( (evt = queue_pop(&server->events)) != NULL){
+        aes67_sapsrv_payload_unref(evt->payload);
+        session_unref(evt->session);
+        free(evt);
+    }
+
+    pipe_close(server->notifyfd);
+    pipe_close(server->wakefd);
+#endif
+
     leave_mcast_groups(server, server->listen_scopes);
 
     if (server->sockfd4 != -1){
@@ -785,6 +1615,13 @@ void aes67_sapsrv_stop(aes67_sapsrv_t sapserver)
 
     aes67_sap_service_deinit(&server->service);
 
+    while(server->first_session != NULL){
+        session_delete(server, server->first_session);
+    }
+
+#if AES67_SAPSRV_THREADED == 1
+    pthread_mutex_destroy(&server->mutex);
+#endif
 
 #if AES67_SAP_MEMORY == AES67_MEMORY_POOL
     initialized = false;
@@ -801,8 +1638,23 @@ void aes67_sapsrv_process(aes67_sapsrv_t sapserver)
 
     assert(server->sockfd4 != -1 || server->sockfd6 != -1);
 
-    u8_t buf[AES67_SAPSRV_SDP_MAXLEN+20]; // 20 for SAP header
-    ssize_t rlen;
+#if AES67_SAPSRV_THREADED == 1
+    if (server->blocking){
+        fd_set rfds;
+
+        FD_ZERO(&rfds);
+        FD_SET(server->notifyfd[0], &rfds);
+
+        select(server->notifyfd[0] + 1, &rfds, NULL, NULL, NULL);
+    }
+
+    // (timers are signalled to the host thread only)
+    aes67_sapsrv_process_timers(server);
+
+    dispatch_events(server);
+
+    return;
+#endif
 
     if (server->blocking){
 
@@ -822,120 +1674,583 @@ void aes67_sapsrv_process(aes67_sapsrv_t sapserver)
             FD_SET(server->sockfd6, &xfds);
         }
 
-        int s = select(nfds, &rfds, NULL, &xfds, NULL);
-        if (s > 0){
-            if ( (rlen = recv(s, buf, sizeof(buf), 0)) > 0){
-                syslog(LOG_DEBUG, "sapsrv %s rx %zd", s == server->sockfd4 ? "ipv4" : "ipv6", rlen);
-                aes67_sap_service_handle(&server->service, buf, rlen, server);
+        if (select(nfds, &rfds, NULL, &xfds, NULL) > 0){
+            if (server->sockfd4 != -1 && FD_ISSET(server->sockfd4, &rfds)){
+                sock_drain(server, server->sockfd4);
+            }
+            if (server->sockfd6 != -1 && FD_ISSET(server->sockfd6, &rfds)){
+                sock_drain(server, server->sockfd6);
             }
         }
     } else {
 
         if (server->sockfd4 != -1){
-            if ( (rlen = recv(server->sockfd4, buf, sizeof(buf), 0)) > 0){
-                syslog(LOG_DEBUG, "sapsrv ipv4 rx %zd", rlen);
-                aes67_sap_service_handle(&server->service, buf, rlen, server);
-            }
+            sock_drain(server, server->sockfd4);
         }
 
         if (server->sockfd6 != -1){
-            if ( (rlen = recv(server->sockfd6, buf, sizeof(buf), 0)) > 0){
-                syslog(LOG_DEBUG, "sapsrv ipv6 rx %zd", rlen);
-                aes67_sap_service_handle(&server->service, buf, rlen, server);
-            }
+            sock_drain(server, server->sockfd6);
         }
     }
 
     aes67_sap_service_process(&server->service, sapserver);
+
+    provisional_timeouts(server);
 }
 
-aes67_sapsrv_session_t aes67_sapsrv_session_add(aes67_sapsrv_t sapserver, const u16_t hash, const enum aes67_net_ipver ipver, const u8_t * ip, const u8_t * payload, const u16_t payloadlen)
+void aes67_sapsrv_process_sockfd(aes67_sapsrv_t sapserver, int sockfd)
 {
     assert(sapserver != NULL);
-    assert(payload != NULL);
-    assert(payloadlen <= AES67_SAPSRV_SDP_MAXLEN);
 
-    u8_t * o = (u8_t*)(payload[4] == '\n' ? &payload[5] : &payload[4]);
+    sapsrv_t * server = sapserver;
 
-    struct aes67_sdp_originator origin;
-    if (aes67_sdp_origin_fromstr(&origin, o, payloadlen - (o - payload)) == AES67_SDP_ERROR){
-//        fprintf(stderr, "invalid origin\n", o[0], o[1], o[2]);
-        return NULL;
-    }
+#if AES67_SAPSRV_THREADED == 1
+    assert(sockfd == server->notifyfd[0]);
 
-    sapsrv_t * server = (sapsrv_t*)sapserver;
-    sapsrv_session_t * session = session_new(server, AES67_SAPSRV_MANAGEDBY_LOCAL, hash, ipver, ip, &origin, payload, payloadlen);
+    dispatch_events(server);
+#else
+    assert(sockfd != -1 && (sockfd == server->sockfd4 || sockfd == server->sockfd6));
 
-    sap_send(server, session, AES67_SAP_STATUS_MSGTYPE_ANNOUNCE);
+    sock_drain(server, sockfd);
 
-    return session;
+    service_timers(server);
+#endif
 }
 
-void aes67_sapsrv_session_update(aes67_sapsrv_t sapserver, aes67_sapsrv_session_t sapsession, const u8_t * payload, const u16_t payloadlen)
+void aes67_sapsrv_process_timers(aes67_sapsrv_t sapserver)
 {
     assert(sapserver != NULL);
-    assert(sapsession != NULL);
-    assert(payload != NULL);
-    assert(payloadlen <= AES67_SAPSRV_SDP_MAXLEN);
-
-    u8_t * o = (u8_t*)&payload[(payload[sizeof("v=0\n")] == 'o') ? sizeof("v=0\n") : sizeof("v=0\r\n")];
 
-    struct aes67_sdp_originator origin;
-    if (aes67_sdp_origin_fromstr(&origin, o, payloadlen - (o - payload)) == AES67_SDP_ERROR){
-        printf("invalid origin\n");
-        return;
-    }
+    sapsrv_t * server = sapserver;
 
-    sapsrv_t * server = (sapsrv_t*)sapserver;
+#if AES67_SAPSRV_THREADED == 0
 
-    sapsrv_session_t * session = (sapsrv_session_t *)sapsession;
+#ifndef AES67_TIMER_FD
+    aes67_sap_service_process(&server->service, sapserver);
+#endif
 
-    session_update(server, session, &origin, payload, payloadlen);
+    provisional_timeouts(server);
 
-    sap_send(server, session, AES67_SAP_STATUS_MSGTYPE_ANNOUNCE);
+#elif !defined(AES67_TIMER_FD)
+    // timers are processed by io thread, but expire in the host's context (signals) so wake the io thread when needed
+    // (it otherwise sleeps until network traffic arrives)
+    if (aes67_timer_getstate(&server->service.announcement_timer) == aes67_timer_state_expired ||
+        aes67_timer_getstate(&server->service.timeout_timer) == aes67_timer_state_expired){
+        thread_wake(server);
+    }
+#else
+    // (expiries wake the io thread through service_timer_callback())
+    (void)server;
+#endif
 }
 
-void aes67_sapsrv_session_delete(aes67_sapsrv_t sapserver, aes67_sapsrv_session_t sapsession, bool announce)
+void aes67_sapsrv_lock(aes67_sapsrv_t sapserver)
 {
     assert(sapserver != NULL);
-    assert(sapsession != NULL);
 
-    sapsrv_t * server = (sapsrv_t*)sapserver;
+    SAPSRV_LOCK((sapsrv_t*)sapserver);
+}
 
-    sapsrv_session_t * session = (sapsrv_session_t *)sapsession;
+void aes67_sapsrv_unlock(aes67_sapsrv_t sapserver)
+{
+    assert(sapserver != NULL);
 
-    if (announce) {
-        sap_send(server, session, AES67_SAP_STATUS_MSGTYPE_DELETE);
-    } else {
-        struct aes67_sap_session * ss = aes67_sap_service_find(&server->service, session->hash, session->ip.ipver, session->ip.ip);
-        if (ss == NULL){
-            syslog(LOG_ERR, "sapsrv trying to silently delete a session that isn't registered");
-        } else {
-            aes67_sap_service_unregister(&server->service, ss);
-        }
-    }
+    SAPSRV_UNLOCK((sapsrv_t*)sapserver);
+}
 
-    session_delete(sapserver, session);
+#if AES67_SAPSRV_THREADED == 1
+
+static void queue_init(sapsrv_queue_t * queue)
+{
+    queue->stub.next = NULL;
+    queue->head = &queue->stub;
+    queue->tail = &queue->stub;
 }
 
-aes67_sapsrv_session_t aes67_sapsrv_session_by_origin(aes67_sapsrv_t sapserver, const struct aes67_sdp_originator * origin)
+static void queue_push(sapsrv_queue_t * queue, sapsrv_event_t * event)
 {
-    assert( sapserver != NULL );
-    assert( origin != NULL );
+    __atomic_store_n(&event->next, NULL, __ATOMIC_RELAXED);
 
-    sapsrv_t * server = sapserver;
+    sapsrv_event_t * prev = __atomic_exchange_n(&queue->head, event, __ATOMIC_ACQ_REL);
+
+    __atomic_store_n(&prev->next, event, __ATOMIC_RELEASE);
+}
 
-    sapsrv_session_t * current = server->first_session;
+static sapsrv_event_t * queue_pop(sapsrv_queue_t * queue)
+{
+    sapsrv_event_t * tail = queue->tail;
+    sapsrv_event_t * next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
 
-    for(; current != NULL; current = current->next ){
-        if (aes67_sdp_origin_eq((struct aes67_sdp_originator *)origin, &current->origin)){
-            return current;
+    if (tail == &queue->stub){
+        if (next == NULL){
+            return NULL;
         }
+        queue->tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+
+    if (next != NULL){
+        queue->tail = next;
+        return tail;
+    }
+
+    // a producer is just linking in a new event, try again later
+    if (tail != __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE)){
+        return NULL;
+    }
+
+    queue_push(queue, &queue->stub);
+
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+    if (next != NULL){
+        queue->tail = next;
+        return tail;
     }
 
     return NULL;
 }
 
+/**
+ * Receives and handles all SAP traffic (and timers), events are passed on to the host through the event queue.
+ */
+static void * thread_func(void * data)
+{
+    sapsrv_t * server = data;
+
+    // signals are for the host
+    sigset_t mask;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    int nfds = (server->sockfd4 > server->sockfd6 ? server->sockfd4 : server->sockfd6);
+    if (server->wakefd[0] > nfds){
+        nfds = server->wakefd[0];
+    }
+    nfds++;
+
+    bool provisional = false;
+
+    while(__atomic_load_n(&server->thread_running, __ATOMIC_ACQUIRE)){
+
+        fd_set rfds;
+
+        FD_ZERO(&rfds);
+
+        if (server->sockfd4 != -1){
+            FD_SET(server->sockfd4, &rfds);
+        }
+        if (server->sockfd6 != -1){
+            FD_SET(server->sockfd6, &rfds);
+        }
+        FD_SET(server->wakefd[0], &rfds);
+
+        // expired timers wake us up (see aes67_sapsrv_process_timers()), provisional sessions are checked once a
+        // second (see provisional_timeouts())
+        struct timeval timeout = {
+            .tv_sec = 1,
+            .tv_usec = 0
+        };
+
+        if (select(nfds, &rfds, NULL, NULL, provisional ? &timeout : NULL) == -1){
+            FD_ZERO(&rfds);
+        }
+
+        if (FD_ISSET(server->wakefd[0], &rfds)){
+            u8_t buf[64];
+            while(read(server->wakefd[0], buf, sizeof(buf)) > 0){
+                // just clearing wakeups
+            }
+        }
+
+        SAPSRV_LOCK(server);
+
+        if (server->sockfd4 != -1 && FD_ISSET(server->sockfd4, &rfds)){
+            sock_drain(server, server->sockfd4);
+        }
+        if (server->sockfd6 != -1 && FD_ISSET(server->sockfd6, &rfds)){
+            sock_drain(server, server->sockfd6);
+        }
+
+        aes67_sap_service_process(&server->service, server);
+
+        provisional_timeouts(server);
+
+        provisional = server->provisional > 0;
+
+        SAPSRV_UNLOCK(server);
+    }
+
+    return NULL;
+}
+
+static void thread_wake(sapsrv_t * server)
+{
+    // if the pipe is full the io thread has yet to wake up anyways
+    if (write(server->wakefd[1], "", 1) == -1 && errno != EAGAIN){
+        syslog(LOG_ERR, "sapsrv wake: %s", strerror(errno));
+    }
+}
+
+static int pipe_nonblock(int fds[2])
+{
+    if (pipe(fds) == -1){
+        return EXIT_FAILURE;
+    }
+    if (fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK) == -1 ||
+        fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL, 0) | O_NONBLOCK) == -1){
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+static void pipe_close(int fds[2])
+{
+    for(int i = 0; i < 2; i++){
+        if (fds[i] != -1){
+            close(fds[i]);
+            fds[i] = -1;
+        }
+    }
+}
+
+/**
+ * Delivers queued events to host (without holding the lock, ie a slow host does not delay the io thread).
+ */
+static void dispatch_events(sapsrv_t * server)
+{
+    u8_t buf[64];
+
+    // any event published from now on notifies again (see publish())
+    (void)__atomic_exchange_n(&server->events_pending, false, __ATOMIC_ACQ_REL);
+
+    while(read(server->notifyfd[0], buf, sizeof(buf)) > 0){
+        // just clearing notifications
+    }
+
+    sapsrv_event_t * evt;
+
+    while( (evt = queue_pop(&server->events)) != NULL){
+
+        server->event_handler(server, evt->session, evt->event, &evt->origin, evt->payload, evt->payloadlen, server->user_data);
+
+        aes67_sapsrv_payload_unref(evt->payload);
+        session_unref(evt->session);
+        free(evt);
+    }
+}
+
+#endif //AES67_SAPSRV_THREADED == 1
+
+/**
+ * Reads (and handles) all pending messages of given (non-blocking) socket until EAGAIN.
+ */
+static void sock_drain(sapsrv_t * server, int sockfd)
+{
+    assert(server != NULL);
+
+    // receiving interface (if enabled, see set_sock_pktinfo())
+    union {
+        struct cmsghdr align;
+        u8_t buf[CMSG_SPACE(sizeof(struct in6_pktinfo))];
+    } ctl[AES67_SAPSRV_RX_BATCH];
+
+#ifdef __linux__
+    struct mmsghdr msgs[AES67_SAPSRV_RX_BATCH];
+    struct iovec iovs[AES67_SAPSRV_RX_BATCH];
+
+    for(;;){
+
+        memset(msgs, 0, sizeof(msgs));
+
+        for(int i = 0; i < AES67_SAPSRV_RX_BATCH; i++){
+            iovs[i].iov_base = server->rxbuf[i];
+            iovs[i].iov_len = sizeof(server->rxbuf[i]);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_control = ctl[i].buf;
+            msgs[i].msg_hdr.msg_controllen = sizeof(ctl[i].buf);
+        }
+
+        int n = recvmmsg(sockfd, msgs, AES67_SAPSRV_RX_BATCH, MSG_DONTWAIT, NULL);
+        if (n == -1){
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
+                syslog(LOG_ERR, "sapsrv recvmmsg(): %s", strerror(errno));
+            }
+            return;
+        }
+        if (n == 0){
+            return;
+        }
+
+        syslog(LOG_DEBUG, "sapsrv %s rx %d msgs", sockfd == server->sockfd4 ? "ipv4" : "ipv6", n);
+
+        for(int i = 0; i < n; i++){
+            // ignore empty and truncated messages
+            if (msgs[i].msg_len == 0 || (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)){
+                continue;
+            }
+            // and messages from interfaces we do not serve
+            server->rx_ifaces = ifindex_mask(server, msg_ifindex(&msgs[i].msg_hdr), sockfd == server->sockfd4);
+            if (server->rx_ifaces == 0){
+                continue;
+            }
+            aes67_sap_service_handle(&server->service, server->rxbuf[i], msgs[i].msg_len, server);
+        }
+    }
+#else
+    ssize_t rlen;
+    struct iovec iov = {
+        .iov_base = server->rxbuf[0],
+        .iov_len = sizeof(server->rxbuf[0])
+    };
+    struct msghdr msg;
+
+    for(;;){
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctl[0].buf;
+        msg.msg_controllen = sizeof(ctl[0].buf);
+
+        if ( (rlen = recvmsg(sockfd, &msg, MSG_DONTWAIT)) < 0){
+            return;
+        }
+
+        syslog(LOG_DEBUG, "sapsrv %s rx %zd", sockfd == server->sockfd4 ? "ipv4" : "ipv6", rlen);
+
+        // ignore empty (but keep draining) and truncated messages
+        if (rlen == 0 || (msg.msg_flags & MSG_TRUNC)){
+            continue;
+        }
+        server->rx_ifaces = ifindex_mask(server, msg_ifindex(&msg), sockfd == server->sockfd4);
+        if (server->rx_ifaces == 0){
+            continue;
+        }
+        aes67_sap_service_handle(&server->service, server->rxbuf[0], rlen, server);
+    }
+#endif
+}
+
+static int set_sock_pktinfo(int sockfd, int family)
+{
+    int r;
+
+    if (family == AF_INET){
+#if defined(IP_RECVPKTINFO)
+        r = setsockopt(sockfd, IPPROTO_IP, IP_RECVPKTINFO, &(int){1}, sizeof(int));
+#elif defined(IP_PKTINFO)
+        r = setsockopt(sockfd, IPPROTO_IP, IP_PKTINFO, &(int){1}, sizeof(int));
+#else
+        r = -1;
+        errno = ENOPROTOOPT;
+#endif
+    } else {
+        r = setsockopt(sockfd, IPPROTO_IPV6, IPV6_RECVPKTINFO, &(int){1}, sizeof(int));
+    }
+
+    if (r == -1){
+        syslog(LOG_ERR, "sapsrv setsockopt(IP_PKTINFO/IPV6_RECVPKTINFO): %s", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static unsigned int msg_ifindex(struct msghdr * msg)
+{
+    for(struct cmsghdr * cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)){
+#ifdef IP_PKTINFO
+        if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO){
+            return ((struct in_pktinfo*)CMSG_DATA(cmsg))->ipi_ifindex;
+        }
+#endif
+        if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO){
+            return ((struct in6_pktinfo*)CMSG_DATA(cmsg))->ipi6_ifindex;
+        }
+    }
+
+    // unknown
+    return 0;
+}
+
+static u32_t ifindex_mask(sapsrv_t * server, unsigned int ifindex, u8_t ipv4)
+{
+    // default interface only
+    if (server->ifcount == 0){
+        return 1;
+    }
+
+    // if the interface is unknown, assume any
+    if (ifindex == 0){
+        return (u32_t)(((uint64_t)1 << server->ifcount) - 1);
+    }
+
+    for(size_t i = 0; i < server->ifcount; i++){
+        if (server->ifaces[i] == ifindex){
+            return (u32_t)1 << i;
+        }
+    }
+
+    // ipv4 of interfaces without address is received on the default interface
+    return ipv4 ? server->ifaces_any4 : 0;
+}
+
+/**
+ * Wether ipv4 of i-th interface is already served by another interface (interfaces without ipv4 address all share the
+ * default interface, which must be joined/sent on only once)
+ */
+static u8_t iface_skip4(sapsrv_t * server, size_t i)
+{
+    u32_t bit = (u32_t)1 << i;
+
+    return (server->ifaces_any4 & bit) && (server->ifaces_any4 & (bit - 1));
+}
+
+static int get_ifaddr4(unsigned int ifindex, struct in_addr * addr)
+{
+    char ifname[IF_NAMESIZE];
+    struct ifaddrs * ifaddrs;
+
+    if (if_indextoname(ifindex, ifname) == NULL || getifaddrs(&ifaddrs) == -1){
+        return EXIT_FAILURE;
+    }
+
+    int r = EXIT_FAILURE;
+
+    for(struct ifaddrs * ifa = ifaddrs; ifa != NULL; ifa = ifa->ifa_next){
+        if (ifa->ifa_addr != NULL && ifa->ifa_addr->sa_family == AF_INET && strcmp(ifa->ifa_name, ifname) == 0){
+            *addr = ((struct sockaddr_in*)ifa->ifa_addr)->sin_addr;
+            r = EXIT_SUCCESS;
+            break;
+        }
+    }
+
+    freeifaddrs(ifaddrs);
+
+    return r;
+}
+
+aes67_sapsrv_session_t aes67_sapsrv_session_add(aes67_sapsrv_t sapserver, const u16_t hash, const enum aes67_net_ipver ipver, const u8_t * ip, const u8_t * payload, const u16_t payloadlen)
+{
+    assert(sapserver != NULL);
+    assert(payload != NULL);
+    assert(payloadlen <= AES67_SAPSRV_SDP_MAXLEN);
+
+    u8_t * o = (u8_t*)(payload[4] == '\n' ? &payload[5] : &payload[4]);
+
+    struct aes67_sdp_originator origin;
+    if (aes67_sdp_origin_fromstr(&origin, o, payloadlen - (o - payload)) == AES67_SDP_ERROR){
+//        fprintf(stderr, "invalid origin\n", o[0], o[1], o[2]);
+        return NULL;
+    }
+
+    sapsrv_t * server = (sapsrv_t*)sapserver;
+
+    SAPSRV_LOCK(server);
+
+    sapsrv_session_t * session = session_new(server, AES67_SAPSRV_MANAGEDBY_LOCAL, hash, ipver, ip, &origin, payload, payloadlen);
+
+    sap_send(server, session, AES67_SAP_STATUS_MSGTYPE_ANNOUNCE);
+
+    service_timers(server);
+
+    SAPSRV_UNLOCK(server);
+
+    return session;
+}
+
+void aes67_sapsrv_session_update(aes67_sapsrv_t sapserver, aes67_sapsrv_session_t sapsession, const u8_t * payload, const u16_t payloadlen)
+{
+    assert(sapserver != NULL);
+    assert(sapsession != NULL);
+    assert(payload != NULL);
+    assert(payloadlen <= AES67_SAPSRV_SDP_MAXLEN);
+
+    u8_t * o = (u8_t*)&payload[(payload[sizeof("v=0\n")] == 'o') ? sizeof("v=0\n") : sizeof("v=0\r\n")];
+
+    struct aes67_sdp_originator origin;
+    if (aes67_sdp_origin_fromstr(&origin, o, payloadlen - (o - payload)) == AES67_SDP_ERROR){
+        printf("invalid origin\n");
+        return;
+    }
+
+    sapsrv_t * server = (sapsrv_t*)sapserver;
+
+    sapsrv_session_t * session = (sapsrv_session_t *)sapsession;
+
+    SAPSRV_LOCK(server);
+
+    // might have been deleted by now (threaded mode)
+    if (!session->deleted){
+        session_update(server, session, &origin, payload, payloadlen);
+
+        sap_send(server, session, AES67_SAP_STATUS_MSGTYPE_ANNOUNCE);
+
+        service_timers(server);
+    }
+
+    SAPSRV_UNLOCK(server);
+}
+
+void aes67_sapsrv_session_delete(aes67_sapsrv_t sapserver, aes67_sapsrv_session_t sapsession, bool announce)
+{
+    assert(sapserver != NULL);
+    assert(sapsession != NULL);
+
+    sapsrv_t * server = (sapsrv_t*)sapserver;
+
+    sapsrv_session_t * session = (sapsrv_session_t *)sapsession;
+
+    SAPSRV_LOCK(server);
+
+    // might have been deleted by now (threaded mode)
+    if (session->deleted){
+        SAPSRV_UNLOCK(server);
+        return;
+    }
+
+    if (announce) {
+        sap_send(server, session, AES67_SAP_STATUS_MSGTYPE_DELETE);
+    } else {
+        struct aes67_sap_session * ss = aes67_sap_service_find(&server->service, session->hash, session->ip.ipver, session->ip.ip);
+        if (ss == NULL){
+            syslog(LOG_ERR, "sapsrv trying to silently delete a session that isn't registered");
+        } else {
+            aes67_sap_service_unregister(&server->service, ss);
+        }
+    }
+
+    session_delete(sapserver, session);
+
+    service_timers(server);
+
+    SAPSRV_UNLOCK(server);
+}
+
+aes67_sapsrv_session_t aes67_sapsrv_session_by_origin(aes67_sapsrv_t sapserver, const struct aes67_sdp_originator * origin)
+{
+    assert( sapserver != NULL );
+    assert( origin != NULL );
+
+    sapsrv_t * server = sapserver;
+
+    u32_t h = origin_hash(origin);
+
+    // (no locking here, the returned session is only valid as long as the caller holds the lock anyways)
+    sapsrv_session_t * current = server->by_origin[h % AES67_SAPSRV_HASHTABLE_SIZE];
+
+    for(; current != NULL; current = current->next_by_origin ){
+        if (current->origin_hash == h && aes67_sdp_origin_eq((struct aes67_sdp_originator *)origin, &current->origin)){
+            break;
+        }
+    }
+
+    return current;
+}
+
 aes67_sapsrv_session_t aes67_sapsrv_session_first(aes67_sapsrv_t sapserver)
 {
     assert(sapserver != NULL);
@@ -994,10 +2309,327 @@ void aes67_sapsrv_session_set_managedby(aes67_sapsrv_t sapserver, aes67_sapsrv_s
     sapsrv_t * server = sapserver;
     sapsrv_session_t * session = sapsession;
 
+    SAPSRV_LOCK(server);
+
     struct aes67_sap_session * ss = aes67_sap_service_find(&server->service, session->hash, session->ip.ipver, session->ip.ip);
     if (ss != NULL){
         ss->stat = (ss->stat & ~AES67_SAP_SESSION_STAT_SRC) | (managed_by == AES67_SAPSRV_MANAGEDBY_LOCAL ? AES67_SAP_SESSION_STAT_SRC_IS_SELF : AES67_SAP_SESSION_STAT_SRC_IS_OTHER);
     }
 
-    session->managed_by = managed_by;
-}
\ No newline at end of file
+    if (session->managed_by != managed_by){
+        session->managed_by = managed_by;
+        session_changed(server, session, true);
+    }
+
+    // a taken over session is not going to time out
+    if (managed_by == AES67_SAPSRV_MANAGEDBY_LOCAL && session->provisional){
+        session->provisional = false;
+        server->provisional--;
+    }
+
+    SAPSRV_UNLOCK(server);
+}
+
+u32_t aes67_sapsrv_session_get_ifaces(aes67_sapsrv_session_t session)
+{
+    assert(session != NULL);
+
+    return ((sapsrv_session_t*)session)->ifaces;
+}
+
+void aes67_sapsrv_session_set_ifaces(aes67_sapsrv_t sapserver, aes67_sapsrv_session_t sapsession, u32_t ifaces)
+{
+    assert(sapserver != NULL);
+    assert(sapsession != NULL);
+
+    SAPSRV_LOCK((sapsrv_t*)sapserver);
+
+    ((sapsrv_session_t*)sapsession)->ifaces = ifaces;
+
+    SAPSRV_UNLOCK((sapsrv_t*)sapserver);
+}
+
+bool aes67_sapsrv_session_is_provisional(aes67_sapsrv_session_t session)
+{
+    assert(session != NULL);
+
+    return ((sapsrv_session_t*)session)->provisional;
+}
+
+uint64_t aes67_sapsrv_changes_seq(aes67_sapsrv_t sapserver)
+{
+    assert(sapserver != NULL);
+
+    return ((sapsrv_t*)sapserver)->changeseq;
+}
+
+uint64_t aes67_sapsrv_changes_horizon(aes67_sapsrv_t sapserver)
+{
+    assert(sapserver != NULL);
+
+    return ((sapsrv_t*)sapserver)->horizon;
+}
+
+uint64_t aes67_sapsrv_session_get_changeseq(aes67_sapsrv_session_t session)
+{
+    assert(session != NULL);
+
+    return ((sapsrv_session_t*)session)->changeseq;
+}
+
+aes67_sapsrv_session_t aes67_sapsrv_session_changed_since(aes67_sapsrv_t sapserver, uint64_t seq)
+{
+    assert(sapserver != NULL);
+
+    sapsrv_t * server = sapserver;
+
+    // walk back from the most recent change, ie O(changes)
+    sapsrv_session_t * session = server->last_changed;
+    if (session == NULL || session->changeseq <= seq){
+        return NULL;
+    }
+    while(session->prev_changed != NULL && session->prev_changed->changeseq > seq){
+        session = session->prev_changed;
+    }
+
+    return session;
+}
+
+aes67_sapsrv_session_t aes67_sapsrv_session_next_changed(aes67_sapsrv_session_t session)
+{
+    assert(session != NULL);
+
+    return ((sapsrv_session_t*)session)->next_changed;
+}
+
+u32_t aes67_sapsrv_tombstone_count(aes67_sapsrv_t sapserver)
+{
+    assert(sapserver != NULL);
+
+    return ((sapsrv_t*)sapserver)->tombstone_count;
+}
+
+const struct aes67_sdp_originator * aes67_sapsrv_tombstone_get(aes67_sapsrv_t sapserver, u32_t index, uint64_t * seq)
+{
+    assert(sapserver != NULL);
+    assert(seq != NULL);
+
+    sapsrv_t * server = sapserver;
+
+    if (index >= server->tombstone_count){
+        return NULL;
+    }
+
+    tombstone_t * tombstone = &server->tombstones[(server->tombstone_head + index) % AES67_SAPSRV_TOMBSTONES];
+
+    *seq = tombstone->seq;
+
+    return &tombstone->origin;
+}
+
+int aes67_sapsrv_snapshot_save(aes67_sapsrv_t sapserver, const char * path)
+{
+    assert(sapserver != NULL);
+    assert(path != NULL);
+
+    sapsrv_t * server = sapserver;
+
+    // write to temporary file and move into place, ie a crash never leaves a partial snapshot
+    char tmppath[PATH_MAX];
+    if (snprintf(tmppath, sizeof(tmppath), "%s.tmp", path) >= sizeof(tmppath)){
+        return EXIT_FAILURE;
+    }
+
+    int fd = open(tmppath, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1){
+        syslog(LOG_ERR, "sapsrv snapshot open(%s): %s", tmppath, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    SAPSRV_LOCK(server);
+
+    // only remotely managed sessions are of interest, local ones are restored by whoever manages them
+    u32_t count = 0;
+    size_t size = sizeof(snapshot_header_t);
+    for(sapsrv_session_t * session = server->first_session; session != NULL; session = session->next){
+        if (session->managed_by == AES67_SAPSRV_MANAGEDBY_REMOTE){
+            count++;
+            size += SNAPSHOT_RECORD_SIZE(session->payloadlen);
+        }
+    }
+
+    u8_t * map = MAP_FAILED;
+
+    if (ftruncate(fd, size) == 0){
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (map == MAP_FAILED){
+        SAPSRV_UNLOCK(server);
+
+        syslog(LOG_ERR, "sapsrv snapshot mmap(%s): %s", tmppath, strerror(errno));
+        close(fd);
+        unlink(tmppath);
+        return EXIT_FAILURE;
+    }
+
+    snapshot_header_t * header = (snapshot_header_t*)map;
+    header->magic = SNAPSHOT_MAGIC;
+    header->version = SNAPSHOT_VERSION;
+    header->count = count;
+    header->size = size;
+
+    size_t offset = sizeof(snapshot_header_t);
+    for(sapsrv_session_t * session = server->first_session; session != NULL; session = session->next){
+        if (session->managed_by != AES67_SAPSRV_MANAGEDBY_REMOTE){
+            continue;
+        }
+
+        snapshot_record_t * record = (snapshot_record_t*)&map[offset];
+
+        record->last_activity = session->last_activity;
+        record->ifaces = session->ifaces;
+        record->hash = session->hash;
+        record->payloadlen = session->payloadlen;
+        record->ipver = session->ip.ipver;
+        memcpy(record->ip, session->ip.ip, AES67_NET_IPVER_SIZE(session->ip.ipver));
+        memcpy(record->payload, session->payload, session->payloadlen);
+
+        offset += SNAPSHOT_RECORD_SIZE(session->payloadlen);
+    }
+
+    SAPSRV_UNLOCK(server);
+
+    int result = msync(map, size, MS_SYNC);
+
+    munmap(map, size);
+    close(fd);
+
+    if (result == -1 || rename(tmppath, path) == -1){
+        syslog(LOG_ERR, "sapsrv snapshot %s: %s", path, strerror(errno));
+        unlink(tmppath);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int aes67_sapsrv_snapshot_load(aes67_sapsrv_t sapserver, const char * path)
+{
+    assert(sapserver != NULL);
+    assert(path != NULL);
+
+    sapsrv_t * server = sapserver;
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1){
+        return EXIT_FAILURE;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < sizeof(snapshot_header_t)){
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    size_t size = st.st_size;
+    u8_t * map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (map == MAP_FAILED){
+        return EXIT_FAILURE;
+    }
+
+    snapshot_header_t * header = (snapshot_header_t*)map;
+    if (header->magic != SNAPSHOT_MAGIC || header->version != SNAPSHOT_VERSION || header->size != size){
+        syslog(LOG_WARNING, "sapsrv snapshot invalid: %s", path);
+        munmap(map, size);
+        return EXIT_FAILURE;
+    }
+
+    // records must add up to the file exactly, otherwise the file is not to be trusted at all
+    size_t offset = sizeof(snapshot_header_t);
+    for(u32_t i = 0; i < header->count && offset <= size; i++){
+        if (offset + offsetof(snapshot_record_t, payload) > size){
+            offset = size + 1;
+            break;
+        }
+        offset += SNAPSHOT_RECORD_SIZE(((snapshot_record_t*)&map[offset])->payloadlen);
+    }
+    if (offset != size){
+        syslog(LOG_WARNING, "sapsrv snapshot corrupt: %s", path);
+        munmap(map, size);
+        return EXIT_FAILURE;
+    }
+
+    time_t now = time(NULL);
+
+    SAPSRV_LOCK(server);
+
+    offset = sizeof(snapshot_header_t);
+    for(u32_t i = 0; i < header->count; i++){
+
+        snapshot_record_t * record = (snapshot_record_t*)&map[offset];
+
+        offset += SNAPSHOT_RECORD_SIZE(record->payloadlen);
+
+        // skip anything broken, timed out or known by now
+        if (!AES67_NET_IPVER_ISVALID(record->ipver) || AES67_SAPSRV_SDP_MAXLEN < record->payloadlen){
+            continue;
+        }
+        if (record->last_activity + AES67_SAP_MIN_TIMEOUT_SEC <= now){
+            continue;
+        }
+
+        struct aes67_sdp_originator origin;
+        if (payload_origin(&origin, record->payload, record->payloadlen)){
+            continue;
+        }
+        if (aes67_sapsrv_session_by_origin(server, &origin) != NULL ||
+            aes67_sapsrv_session_by_id(server, record->hash, record->ipver, record->ip) != NULL){
+            continue;
+        }
+
+        sapsrv_session_t * session = session_new(server, AES67_SAPSRV_MANAGEDBY_REMOTE, record->hash, record->ipver, record->ip, &origin, record->payload, record->payloadlen);
+
+        session->last_activity = record->last_activity;
+        session->ifaces = record->ifaces;
+        session->provisional = true;
+        server->provisional++;
+
+        publish(server, session, aes67_sapsrv_event_discovered, &session->origin, session->payload, session->payloadlen);
+    }
+
+    SAPSRV_UNLOCK(server);
+
+#if AES67_SAPSRV_THREADED == 1
+    // let io thread start checking provisional sessions
+    thread_wake(server);
+#endif
+
+    munmap(map, size);
+
+    return EXIT_SUCCESS;
+}
+
+u8_t * aes67_sapsrv_payload_ref(u8_t * payload)
+{
+    assert(payload != NULL);
+
+    __atomic_add_fetch(&PAYLOAD_BUF(payload)->refcount, 1, __ATOMIC_RELAXED);
+
+    return payload;
+}
+
+void aes67_sapsrv_payload_unref(u8_t * payload)
+{
+    assert(payload != NULL);
+
+    payload_buf_t * buf = PAYLOAD_BUF(payload);
+
+    assert(__atomic_load_n(&buf->refcount, __ATOMIC_RELAXED) > 0);
+
+    if (__atomic_sub_fetch(&buf->refcount, 1, __ATOMIC_ACQ_REL) == 0){
+        free(buf);
+    }
+}
@@ -157,36 +157,9 @@ int main(int argc, char * argv[])
                 }
 
                 for( int s = 0; s < sdp.streams.count; s++){
-
-                    // skip stream if no valid connection given (shouldn't be the case in a valid SDP packet)
-                    if (NULL == aes67_sdp_get_connection(&sdp, s)){
-                        continue;
-                    }
-
-                    // skip if stream has no valid refclock
-                    if (0 == aes67_sdp_get_refclk_count(&sdp, s)){
-                        continue;
-                    }
-
-                    // skip if stream has no encoding
-                    if (0 == aes67_sdp_get_stream_encoding_count(&sdp, s)){
-                        continue;
-                    }
-
-                    struct aes67_sdp_attr_encoding * encoding = aes67_sdp_get_stream_encoding(&sdp, s, 0);
-
-                    if (opts.nchannels > 0 && opts.nchannels != encoding->nchannels){
-                        continue;
-                    }
-                    if (opts.encoding != aes67_audio_encoding_undefined && opts.encoding != encoding->encoding){
-                        continue;
+                    if (aes67_sdp_stream_match(&sdp, s, opts.encoding, opts.samplerate, opts.nchannels)){
+                        return EXIT_SUCCESS;
                     }
-                    if (opts.samplerate != 0 && opts.samplerate != encoding->samplerate){
-                        continue;
-                    }
-
-
-                    return EXIT_SUCCESS;
                 }
 
                 return EXIT_FAILURE;
@@ -155,4 +155,21 @@ TEST(Def_TestGroup, atoi)
 
     CHECK_EQUAL(0x2C7A0CD5, aes67_atoi((uint8_t*)"2c7a0cd5", sizeof("2c7a0cd5")-1, 16, &len));
     CHECK_EQUAL(sizeof("2c7a0cd5")-1, len);
-}
\ No newline at end of file
+}
+
+TEST(Def_TestGroup, fnv1a64)
+{
+    u64_t h;
+
+    h = aes67_fnv1a64((uint8_t*)"", 0);
+    CHECK_EQUAL(0xcbf29ce4, h.msb);
+    CHECK_EQUAL(0x84222325, h.lsb);
+
+    h = aes67_fnv1a64((uint8_t*)"a", 1);
+    CHECK_EQUAL(0xaf63dc4c, h.msb);
+    CHECK_EQUAL(0x8601ec8c, h.lsb);
+
+    h = aes67_fnv1a64((uint8_t*)"foobar", sizeof("foobar")-1);
+    CHECK_EQUAL(0x85944171, h.msb);
+    CHECK_EQUAL(0xf73967e8, h.lsb);
+}
@@ -307,6 +307,25 @@ TEST(SAP_TestGroup, sap_handle_v2)
 
 #if AES67_SAP_FILTER_XOR8 == 1
     CHECK_FALSE(sap_event.isset);
+#elif AES67_SAP_FILTER_FINGERPRINT == 1 && (AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC || AES67_SAP_MEMORY_MAX_SESSIONS > 0)
+    CHECK_TRUE(sap_event.isset);
+    CHECK_EQUAL(1, sap.no_of_ads_other);
+    CHECK_EQUAL(aes67_sap_event_refreshed, sap_event.event);
+    CHECK_EQUAL(0, sap_event.payloadlen);
+    POINTERS_EQUAL(NULL, sap_event.payload);
+
+    // announce changed payload with same msg hash id + originating source
+    p1.data[p1.datalen - 3] = '8';
+    len = packet2mem(data, p1);
+
+    sap_event_reset();
+    aes67_sap_service_handle(&sap, data, len, gl_user_data);
+
+    CHECK_TRUE(sap_event.isset);
+    CHECK_EQUAL(1, sap.no_of_ads_other);
+    CHECK_EQUAL(aes67_sap_event_updated, sap_event.event);
+    CHECK_EQUAL(p1.datalen, sap_event.payloadlen);
+    MEMCMP_EQUAL(p1.data, sap_event.payload, p1.datalen);
 #else // AES67_SAP_HASH_CHECK == 0
     CHECK_TRUE(sap_event.isset);
 
@@ -417,6 +436,12 @@ TEST(SAP_TestGroup, sap_handle_v1)
     aes67_sap_service_handle(&sap, data, len, gl_user_data);
 #if AES67_SAP_FILTER_XOR8 == 1
     CHECK_FALSE(sap_event.isset);
+#elif AES67_SAP_FILTER_FINGERPRINT == 1 && (AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC || AES67_SAP_MEMORY_MAX_SESSIONS > 0)
+    CHECK_TRUE(sap_event.isset);
+    CHECK_EQUAL(1, sap.no_of_ads_other);
+    CHECK_EQUAL(aes67_sap_event_refreshed, sap_event.event);
+    CHECK_EQUAL(0, sap_event.payloadlen);
+    POINTERS_EQUAL(NULL, sap_event.payload);
 #else // AES67_SAP_HASH_CHECK == 1
     CHECK_TRUE(sap_event.isset);
     CHECK_EQUAL(0, sap_event.payloadtypelen);
@@ -640,6 +665,10 @@ TEST(SAP_TestGroup, sap_handle_pooloverflow)
 
 #if AES67_SAP_FILTER_XOR8 == 1
     CHECK_FALSE(sap_event.isset);
+#elif AES67_SAP_FILTER_FINGERPRINT == 1 && AES67_SAP_MEMORY_MAX_SESSIONS > 0
+    CHECK_TRUE(sap_event.isset);
+    CHECK_EQUAL( 1, sap.no_of_ads_other);
+    CHECK_EQUAL(aes67_sap_event_refreshed, sap_event.event);
 #else // AES67_SAP_HASH_CHECK == 0
     CHECK_TRUE(sap_event.isset);
 #if AES67_SAP_MEMORY_MAX_SESSIONS == 0
@@ -1039,11 +1068,12 @@ TEST(SAP_TestGroup, sap_announcement_timer)
 
     CHECK_EQUAL(aes67_timer_state_unset, aes67_sap_service_announcement_timer_state(&sap));
 
-    // this should trigger the timer to be called as soon as possible.
+    // timer is set to the (randomized) deadline of the session, ie interval +- 1/3
     aes67_sap_service_set_announcement_timer(&sap);
 
     CHECK_EQUAL(aes67_timer_state_set, aes67_timer_getstate(&sap.announcement_timer));
-    CHECK_EQUAL(0 , timer_gettimeout(&sap.announcement_timer));
+    CHECK_COMPARE(2 * 1000 * AES67_SAP_MIN_INTERVAL_SEC / 3 - 10, <=, timer_gettimeout(&sap.announcement_timer));
+    CHECK_COMPARE(4 * 1000 * AES67_SAP_MIN_INTERVAL_SEC / 3, >=, timer_gettimeout(&sap.announcement_timer));
 
     aes67_sap_service_announcement_check(&sap, gl_user_data);
 
@@ -1051,7 +1081,7 @@ TEST(SAP_TestGroup, sap_announcement_timer)
     CHECK_EQUAL(aes67_timer_state_set, aes67_sap_service_announcement_timer_state(&sap));
 
 
-    time_add_now_ms(1000*sap.announcement_sec);
+    time_add_now_ms(timer_gettimeout(&sap.announcement_timer));
 
     timer_expire(&sap.announcement_timer);
 
@@ -1067,6 +1097,42 @@ TEST(SAP_TestGroup, sap_announcement_timer)
     CHECK_EQUAL(p1.ip.ipver, sap_event.src.ipver);
     MEMCMP_EQUAL(p1.ip.ip, sap_event.src.ip, AES67_NET_IPVER_SIZE(p1.ip.ipver));
 
+    // resending a previously generated message
+    sap_event_reset();
+
+    aes67_sap_service_announced(&sap, p1.msg_id_hash, p1.ip.ipver, p1.ip.ip, len + 1);
+
+    CHECK_EQUAL(len + 1, sap.announcement_size);
+    CHECK_EQUAL(1, sap.no_of_ads_self);
+
+    time_add_now_ms(500*sap.announcement_sec);
+
+    aes67_sap_service_set_announcement_timer(&sap);
+    timer_expire(&sap.announcement_timer);
+    aes67_sap_service_announcement_check(&sap, gl_user_data);
+
+    // not due yet
+    CHECK_EQUAL(false, sap_event.isset);
+
+    // unknown sessions are registered
+    aes67_sap_service_announced(&sap, p1.msg_id_hash + 1, p1.ip.ipver, p1.ip.ip, len);
+
+    CHECK_EQUAL(2, sap.no_of_ads_self);
+
+    // when both sessions are due, only one is to be announced at a time
+    time_add_now_ms(2000 * AES67_SAP_MIN_INTERVAL_SEC);
+
+    sap_event_reset();
+    aes67_sap_service_process(&sap, gl_user_data);
+    timer_expire(&sap.announcement_timer);
+    aes67_sap_service_process(&sap, gl_user_data);
+
+    CHECK_EQUAL(true, sap_event.isset);
+    CHECK_EQUAL(aes67_sap_event_announcement_request, sap_event.event);
+
+    // ... and the next one after the minimal spacing bandwidth-wise
+    CHECK_EQUAL(aes67_timer_state_set, aes67_sap_service_announcement_timer_state(&sap));
+    CHECK_EQUAL(8 * 1000 * sap.announcement_size / AES67_SAP_BANDWITH, timer_gettimeout(&sap.announcement_timer));
 
     aes67_sap_service_deinit(&sap);
 }
@@ -1158,6 +1224,10 @@ TEST(SAP_TestGroup, sap_timeouts)
     // this should not fail (depends on timer implementation)
     CHECK_EQUAL(aes67_timer_state_set, aes67_sap_service_timeout_timer_state(&sap));
 
+    // the oldest session was announced just now, ie the timer spans (about) the whole timeout
+    CHECK_COMPARE(1000 * (sap.timeout_sec - 1), <=, timer_gettimeout(&sap.timeout_timer));
+    CHECK_COMPARE(1000 * (sap.timeout_sec + 1), >=, timer_gettimeout(&sap.timeout_timer));
+
     // try to clean up timeouts (timeout should not have happened yet)
     sap_event_reset();
     aes67_sap_service_timeouts_cleanup(&sap, gl_user_data);
@@ -1239,4 +1309,66 @@ TEST(SAP_TestGroup, sap_timeouts)
     aes67_sap_service_deinit(&sap);
 
 #endif //AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC || 0 < AES67_SAP_MEMORY_MAX_SESSIONS
-}
\ No newline at end of file
+}
+TEST(SAP_TestGroup, sap_times_large)
+{
+    // 8 * 1400 * 200000 bits exceed 32 bits, neither interval nor timeout may wrap around
+    u32_t last_timeout = 0;
+
+    for(u32_t n = 1000; n <= 400000; n += 1000){
+
+        u32_t announce_sec = 0, timeout_sec = 0;
+
+        aes67_sap_compute_times_sec(n, 1400, &announce_sec, &timeout_sec);
+
+        uint64_t interval = (uint64_t)8 * 1400 * n / AES67_SAP_BANDWITH;
+        if (interval < AES67_SAP_MIN_INTERVAL_SEC) interval = AES67_SAP_MIN_INTERVAL_SEC;
+        if (interval > AES67_SAP_MAX_INTERVAL_SEC) interval = AES67_SAP_MAX_INTERVAL_SEC;
+
+        // interval +- 1/3 interval
+        CHECK_COMPARE(interval - interval / 3, <=, announce_sec);
+        CHECK_COMPARE(interval + interval / 3, >=, announce_sec);
+
+        CHECK_COMPARE(last_timeout, <=, timeout_sec);
+        CHECK_COMPARE(AES67_SAP_MIN_TIMEOUT_SEC, <=, timeout_sec);
+        CHECK_COMPARE(UINT32_MAX / 1000, >=, timeout_sec);
+
+        last_timeout = timeout_sec;
+    }
+
+    u32_t announce_sec = 0, timeout_sec = 0;
+    aes67_sap_compute_times_sec(200000, 1400, &announce_sec, &timeout_sec);
+
+    CHECK_COMPARE(2 * AES67_SAP_MAX_INTERVAL_SEC / 3, <=, announce_sec);
+    CHECK_COMPARE(4 * AES67_SAP_MAX_INTERVAL_SEC / 3, >=, announce_sec);
+    CHECK_EQUAL(10 * AES67_SAP_MAX_INTERVAL_SEC, timeout_sec);
+
+#if AES67_SAP_MEMORY == AES67_MEMORY_DYNAMIC || 0 < AES67_SAP_MEMORY_MAX_SESSIONS
+    struct aes67_sap_service sap;
+
+    aes67_sap_service_init(&sap);
+
+    // (counters only, no sessions are actually registered)
+    sap.announcement_size = 1400;
+
+    u32_t last_ms = 0;
+
+    for(u32_t n = 50000; n <= 250000; n += 50000){
+
+        sap.no_of_ads_other = n;
+
+        aes67_timer_unset(&sap.timeout_timer);
+        aes67_sap_service_set_timeout_timer(&sap);
+
+        CHECK_EQUAL(aes67_timer_state_set, aes67_sap_service_timeout_timer_state(&sap));
+        CHECK_COMPARE(last_ms, <=, timer_gettimeout(&sap.timeout_timer));
+        CHECK_COMPARE(1000 * AES67_SAP_MIN_TIMEOUT_SEC, <=, timer_gettimeout(&sap.timeout_timer));
+
+        last_ms = timer_gettimeout(&sap.timeout_timer);
+    }
+
+    sap.no_of_ads_other = 0;
+
+    aes67_sap_service_deinit(&sap);
+#endif
+}
@@ -347,6 +347,58 @@ TEST(SDP_TestGroup, sdp_get_stream_encodings)
 }
 
 
+TEST(SDP_TestGroup, sdp_stream_match)
+{
+    struct aes67_sdp sdp;
+
+    uint8_t s1[] = "v=0\r\n"
+                   "o=- 123 45678 IN IP4 ipaddr1\r\n"
+                   "s= \r\n"
+                   "c=IN IP4 ipaddr2/44/36\r\n"
+                   "t=0 0\r\n"
+                   "a=recvonly\r\n"
+                   "a=ts-refclk:ptp=IEEE1588-2008:39-A7-94-FF-FE-07-CB-D0:2\r\n"
+                   "a=mediaclk:direct=963214424\r\n"
+                   "m=audio 5000 RTP/AVP 96\r\n"
+                   "a=rtpmap:96 L16/48000/2\r\n"
+                   "m=audio 5002 RTP/AVP 97 98\r\n"
+                   "a=rtpmap:97 L24/96000/8\r\n"
+                   "a=rtpmap:98 L16/48000/8\r\n"
+                   ;
+
+    std::memset(&sdp, 0, sizeof(struct aes67_sdp));
+    CHECK_EQUAL(AES67_SDP_OK, aes67_sdp_fromstr(&sdp, s1, sizeof(s1) - 1, NULL));
+    CHECK_EQUAL(2, sdp.streams.count);
+
+    // any
+    CHECK_TRUE(aes67_sdp_stream_match(&sdp, 0, aes67_audio_encoding_undefined, 0, 0));
+    CHECK_TRUE(aes67_sdp_stream_match(&sdp, 1, aes67_audio_encoding_undefined, 0, 0));
+
+    CHECK_TRUE(aes67_sdp_stream_match(&sdp, 0, aes67_audio_encoding_L16, 48000, 2));
+    CHECK_FALSE(aes67_sdp_stream_match(&sdp, 0, aes67_audio_encoding_L24, 0, 0));
+    CHECK_FALSE(aes67_sdp_stream_match(&sdp, 0, aes67_audio_encoding_undefined, 96000, 0));
+    CHECK_FALSE(aes67_sdp_stream_match(&sdp, 0, aes67_audio_encoding_undefined, 0, 8));
+
+    // only primary encoding is considered
+    CHECK_TRUE(aes67_sdp_stream_match(&sdp, 1, aes67_audio_encoding_L24, 96000, 8));
+    CHECK_FALSE(aes67_sdp_stream_match(&sdp, 1, aes67_audio_encoding_L16, 0, 0));
+    CHECK_FALSE(aes67_sdp_stream_match(&sdp, 1, aes67_audio_encoding_undefined, 48000, 0));
+
+    // unusable without refclock
+    uint8_t s2[] = "v=0\r\n"
+                   "o=- 123 45678 IN IP4 ipaddr1\r\n"
+                   "s= \r\n"
+                   "c=IN IP4 ipaddr2/44/36\r\n"
+                   "t=0 0\r\n"
+                   "m=audio 5000 RTP/AVP 96\r\n"
+                   "a=rtpmap:96 L16/48000/2\r\n"
+                   ;
+
+    std::memset(&sdp, 0, sizeof(struct aes67_sdp));
+    CHECK_EQUAL(AES67_SDP_INCOMPLETE, aes67_sdp_fromstr(&sdp, s2, sizeof(s2) - 1, NULL));
+    CHECK_FALSE(aes67_sdp_stream_match(&sdp, 0, aes67_audio_encoding_undefined, 0, 0));
+}
+
 TEST(SDP_TestGroup, sdp_get_ptps)
 {
     aes67_sdp s1 = {
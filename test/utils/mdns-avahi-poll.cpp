@@ -0,0 +1,370 @@
+/**
+ * AES67 Framework
+ * Copyright (C) 2021  Philip Tschiemer, https://github.com/tschiemer/aes67
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CppUTest/TestHarness.h"
+
+#include "aes67/utils/mdns-avahi-poll.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/timerfd.h>
+
+/**
+ * Records calls (and what the callbacks are told to do) of any watch or timeout.
+ */
+struct calls_st {
+    const AvahiPoll * api;
+
+    std::vector<void*> calls;
+    std::vector<AvahiWatchEvent> events;        // as passed to callback
+    std::vector<AvahiWatchEvent> get_events;    // as returned by watch_get_events() within callback
+
+    AvahiWatch * free_watch;        // watch to free within next watch callback
+    AvahiTimeout * free_timeout;    // timeout to free within next timeout callback
+    int new_watch_fd;               // to add a watch for within next watch callback (if != -1)
+    AvahiWatch * new_watch;
+    uint32_t rearm;                    // number of times timeouts re-arm themselves (msec ahead)
+    uint32_t rearm_msec;
+};
+
+static calls_st calls;
+
+static void watch_callback(AvahiWatch * w, int fd, AvahiWatchEvent event, void * userdata)
+{
+    calls.calls.push_back(w);
+    calls.events.push_back(event);
+    calls.get_events.push_back(calls.api->watch_get_events(w));
+
+    // drain
+    uint8_t buf[64];
+    if (read(fd, buf, sizeof(buf))){}
+
+    if (calls.free_watch != NULL){
+        calls.api->watch_free(calls.free_watch);
+        calls.free_watch = NULL;
+    }
+    if (calls.new_watch_fd != -1){
+        calls.new_watch = calls.api->watch_new(calls.api, calls.new_watch_fd, AVAHI_WATCH_IN, watch_callback, NULL);
+        calls.new_watch_fd = -1;
+    }
+}
+
+static struct timeval in_msec(uint32_t msec)
+{
+    struct timeval tv, d = {(time_t)(msec / 1000), (suseconds_t)((msec % 1000) * 1000)};
+    gettimeofday(&tv, NULL);
+    timeradd(&tv, &d, &tv);
+    return tv;
+}
+
+static void timeout_callback(AvahiTimeout * t, void * userdata)
+{
+    calls.calls.push_back(t);
+
+    if (calls.free_timeout != NULL){
+        calls.api->timeout_free(calls.free_timeout);
+        calls.free_timeout = NULL;
+    }
+    if (calls.rearm > 0){
+        calls.rearm--;
+        struct timeval tv = in_msec(calls.rearm_msec);
+        calls.api->timeout_update(t, &tv);
+    }
+}
+
+TEST_GROUP(MDNS_AVAHI_POLL_TestGroup)
+{
+    struct aes67_mdns_avahi_poll adapter;
+    const AvahiPoll * api;
+    int p1[2], p2[2];
+
+    void setup()
+    {
+        CHECK_EQUAL(EXIT_SUCCESS, aes67_mdns_avahi_poll_init(&adapter));
+        api = &adapter.api;
+
+        calls.api = api;
+        calls.calls.clear();
+        calls.events.clear();
+        calls.get_events.clear();
+        calls.free_watch = NULL;
+        calls.free_timeout = NULL;
+        calls.new_watch_fd = -1;
+        calls.new_watch = NULL;
+        calls.rearm = 0;
+        calls.rearm_msec = 0;
+
+        CHECK_EQUAL(0, pipe(p1));
+        CHECK_EQUAL(0, pipe(p2));
+    }
+
+    void teardown()
+    {
+        // (releases anything not freed)
+        aes67_mdns_avahi_poll_deinit(&adapter);
+
+        for(int fd : {p1[0], p1[1], p2[0], p2[1]}){
+            if (fd != -1){
+                close(fd);
+            }
+        }
+    }
+
+    bool armed()
+    {
+        struct itimerspec its;
+        CHECK_EQUAL(0, timerfd_gettime(adapter.timerfd, &its));
+        return its.it_value.tv_sec != 0 || its.it_value.tv_nsec != 0;
+    }
+
+    // as the host would, ie poll the epoll fd and dispatch if ready
+    bool ready(int timeout_msec)
+    {
+        struct pollfd pfd = {adapter.epfd, POLLIN, 0};
+        return poll(&pfd, 1, timeout_msec) == 1;
+    }
+};
+
+TEST(MDNS_AVAHI_POLL_TestGroup, watch)
+{
+    AvahiWatch * w = api->watch_new(api, p1[0], AVAHI_WATCH_IN, watch_callback, NULL);
+    CHECK_TRUE(w != NULL);
+
+    CHECK_FALSE(ready(0));
+    aes67_mdns_avahi_poll_dispatch(&adapter, 0);
+    CHECK_EQUAL(0, calls.calls.size());
+
+    CHECK_EQUAL(1, write(p1[1], "x", 1));
+
+    CHECK_TRUE(ready(100));
+    aes67_mdns_avahi_poll_dispatch(&adapter, 0);
+    CHECK_EQUAL(1, calls.calls.size());
+    POINTERS_EQUAL(w, calls.calls[0]);
+    CHECK_EQUAL(AVAHI_WATCH_IN, calls.events[0]);
+    CHECK_EQUAL(AVAHI_WATCH_IN, calls.get_events[0]);
+
+    // (only while dispatching)
+    CHECK_EQUAL(0, api->watch_get_events(w));
+
+    // not watching for anything
+    api->watch_update(w, (AvahiWatchEvent)0);
+    CHECK_EQUAL(1, write(p1[1], "x", 1));
+    aes67_mdns_avahi_poll_dispatch(&adapter, 20);
+    CHECK_EQUAL(1, calls.calls.size());
+
+    api->watch_update(w, AVAHI_WATCH_IN);
+    aes67_mdns_avahi_poll_dispatch(&adapter, 100);
+    CHECK_EQUAL(2, calls.calls.size());
+
+    // hang up
+    close(p1[1]);
+    p1[1] = -1;
+    aes67_mdns_avahi_poll_dispatch(&adapter, 100);
+    CHECK_EQUAL(3, calls.calls.size());
+    CHECK_TRUE(calls.events[2] & AVAHI_WATCH_HUP);
+
+    api->watch_free(w);
+}
+
+TEST(MDNS_AVAHI_POLL_TestGroup, watch_free_in_callback)
+{
+    // frees itself
+    AvahiWatch * w1 = api->watch_new(api, p1[0], AVAHI_WATCH_IN, watch_callback, NULL);
+    calls.free_watch = w1;
+
+    CHECK_EQUAL(1, write(p1[1], "x", 1));
+    aes67_mdns_avahi_poll_dispatch(&adapter, 100);
+    CHECK_EQUAL(1, calls.calls.size());
+    CHECK_TRUE(adapter.watches == NULL);
+
+    CHECK_EQUAL(1, write(p1[1], "x", 1));
+    aes67_mdns_avahi_poll_dispatch(&adapter, 20);
+    CHECK_EQUAL(1, calls.calls.size());
+
+    // frees the other one ready in the same dispatch (whichever comes first)
+    calls.calls.clear();
+
+    w1 = api->watch_new(api, p1[0], AVAHI_WATCH_IN, watch_callback, NULL);
+    AvahiWatch * w2 = api->watch_new(api, p2[0], AVAHI_WATCH_IN, watch_callback, NULL);
+
+    CHECK_EQUAL(1, write(p1[1], "x", 1));
+    CHECK_EQUAL(1, write(p2[1], "x", 1));
+
+    // (both ready)
+    usleep(10000);
+
+    calls.free_watch = w2;
+    aes67_mdns_avahi_poll_dispatch(&adapter, 0);
+
+    if (calls.calls.size() == 1){
+        // w1 first, w2 not dispatched anymore
+        POINTERS_EQUAL(w1, calls.calls[0]);
+    } else {
+        // w2 first (freeing itself), then w1
+        CHECK_EQUAL(2, calls.calls.size());
+        POINTERS_EQUAL(w2, calls.calls[0]);
+        POINTERS_EQUAL(w1, calls.calls[1]);
+    }
+
+    // w2 gone
+    calls.calls.clear();
+    CHECK_EQUAL(1, write(p2[1], "x", 1));
+    aes67_mdns_avahi_poll_dispatch(&adapter, 20);
+    CHECK_EQUAL(0, calls.calls.size());
+
+    // a watch added from within a callback (on the fd of the freed one) is dispatched next time
+    calls.calls.clear();
+    calls.new_watch_fd = p2[0];
+
+    CHECK_EQUAL(1, write(p1[1], "x", 1));
+    aes67_mdns_avahi_poll_dispatch(&adapter, 100);
+    CHECK_EQUAL(1, calls.calls.size());
+    CHECK_TRUE(calls.new_watch != NULL);
+
+    CHECK_EQUAL(1, write(p2[1], "x", 1));
+    aes67_mdns_avahi_poll_dispatch(&adapter, 100);
+    CHECK_EQUAL(2, calls.calls.size());
+    POINTERS_EQUAL(calls.new_watch, calls.calls[1]);
+}
+
+TEST(MDNS_AVAHI_POLL_TestGroup, timeout)
+{
+    // disabled
+    AvahiTimeout * t0 = api->timeout_new(api, NULL, timeout_callback, NULL);
+    CHECK_TRUE(t0 != NULL);
+    CHECK_FALSE(armed());
+
+    struct timeval tv = in_msec(30);
+    AvahiTimeout * t = api->timeout_new(api, &tv, timeout_callback, NULL);
+    CHECK_TRUE(armed());
+
+    // epoll fd becomes ready by timerfd
+    CHECK_FALSE(ready(0));
+    CHECK_TRUE(ready(500));
+
+    aes67_mdns_avahi_poll_dispatch(&adapter, 0);
+    CHECK_EQUAL(1, calls.calls.size());
+    POINTERS_EQUAL(t, calls.calls[0]);
+
+    // one-shot until updated
+    CHECK_FALSE(armed());
+    CHECK_FALSE(ready(50));
+    aes67_mdns_avahi_poll_dispatch(&adapter, 0);
+    CHECK_EQUAL(1, calls.calls.size());
+
+    // already due
+    tv = in_msec(0);
+    api->timeout_update(t, &tv);
+    CHECK_TRUE(armed() || ready(0));
+    CHECK_TRUE(ready(100));
+    aes67_mdns_avahi_poll_dispatch(&adapter, 0);
+    CHECK_EQUAL(2, calls.calls.size());
+
+    // disabled by update
+    tv = in_msec(10);
+    api->timeout_update(t, &tv);
+    api->timeout_update(t, NULL);
+    CHECK_FALSE(armed());
+    CHECK_FALSE(ready(30));
+
+    // first of several
+    struct timeval tv1 = in_msec(200), tv2 = in_msec(20);
+    api->timeout_update(t, &tv1);
+    api->timeout_update(t0, &tv2);
+
+    struct itimerspec its;
+    timerfd_gettime(adapter.timerfd, &its);
+    CHECK_TRUE(its.it_value.tv_sec == 0 && its.it_value.tv_nsec <= 20000000);
+
+    CHECK_TRUE(ready(500));
+    aes67_mdns_avahi_poll_dispatch(&adapter, 0);
+    CHECK_EQUAL(3, calls.calls.size());
+    POINTERS_EQUAL(t0, calls.calls[2]);
+
+    // armed for the remaining one
+    CHECK_TRUE(armed());
+    CHECK_TRUE(ready(500));
+    aes67_mdns_avahi_poll_dispatch(&adapter, 0);
+    CHECK_EQUAL(4, calls.calls.size());
+    POINTERS_EQUAL(t, calls.calls[3]);
+}
+
+TEST(MDNS_AVAHI_POLL_TestGroup, timeout_rearm_in_callback)
+{
+    struct timeval tv = in_msec(10);
+    AvahiTimeout * t = api->timeout_new(api, &tv, timeout_callback, NULL);
+
+    calls.rearm = 3;
+    calls.rearm_msec = 20;
+
+    // (the dispatch re-arms the timerfd for the updated timeout)
+    for(size_t i = 0; i < 4; i++){
+        CHECK_TRUE(ready(500));
+        aes67_mdns_avahi_poll_dispatch(&adapter, 0);
+        CHECK_EQUAL(i + 1, calls.calls.size());
+        POINTERS_EQUAL(t, calls.calls[i]);
+        CHECK_EQUAL(i < 3, armed());
+    }
+
+    CHECK_FALSE(ready(50));
+}
+
+TEST(MDNS_AVAHI_POLL_TestGroup, timeout_free_in_callback)
+{
+    // (latest is dispatched first)
+    struct timeval tv = in_msec(10);
+    AvahiTimeout * t2 = api->timeout_new(api, &tv, timeout_callback, NULL);
+    AvahiTimeout * t1 = api->timeout_new(api, &tv, timeout_callback, NULL);
+
+    // due at the same time, the first frees the second
+    calls.free_timeout = t2;
+
+    CHECK_TRUE(ready(500));
+    aes67_mdns_avahi_poll_dispatch(&adapter, 0);
+    CHECK_EQUAL(1, calls.calls.size());
+    POINTERS_EQUAL(t1, calls.calls[0]);
+
+    CHECK_FALSE(armed());
+    CHECK_FALSE(ready(30));
+    aes67_mdns_avahi_poll_dispatch(&adapter, 0);
+    CHECK_EQUAL(1, calls.calls.size());
+
+    // frees itself
+    tv = in_msec(10);
+    api->timeout_update(t1, &tv);
+    calls.free_timeout = t1;
+
+    CHECK_TRUE(ready(500));
+    aes67_mdns_avahi_poll_dispatch(&adapter, 0);
+    CHECK_EQUAL(2, calls.calls.size());
+    CHECK_FALSE(armed());
+
+    // freed while pending
+    tv = in_msec(10);
+    AvahiTimeout * t = api->timeout_new(api, &tv, timeout_callback, NULL);
+    CHECK_TRUE(armed());
+    api->timeout_free(t);
+    CHECK_FALSE(armed());
+    CHECK_FALSE(ready(30));
+    aes67_mdns_avahi_poll_dispatch(&adapter, 0);
+    CHECK_EQUAL(2, calls.calls.size());
+}
@@ -0,0 +1,252 @@
+/**
+ * AES67 Framework
+ * Copyright (C) 2021  Philip Tschiemer, https://github.com/tschiemer/aes67
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CppUTest/TestHarness.h"
+
+#include "aes67/utils/mdns-cache.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+static const u8_t ip1[] = {10, 0, 0, 1};
+static const u8_t ip2[] = {10, 0, 0, 2};
+static const u8_t ip3[] = {10, 0, 0, 3};
+
+static std::vector<struct aes67_mdns_cache_entry *> refreshed;
+
+static void refresh_callback(struct aes67_mdns_cache_entry * entry, void * user_data)
+{
+    refreshed.push_back(entry);
+}
+
+static struct {
+    u32_t count;
+    std::string name;
+    std::string hosttarget;
+    u16_t port;
+    u32_t ttl;
+} reported;
+
+static void resolve_callback(aes67_mdns_resource_t res, enum aes67_mdns_result result, const char * type, const char * name, const char * hosttarget, u16_t port, u16_t txtlen, const u8_t * txt, enum aes67_net_ipver ipver, const u8_t * ip, u32_t ttl, void * context)
+{
+    reported.count++;
+    reported.name = name;
+    reported.hosttarget = hosttarget ? hosttarget : "";
+    reported.port = port;
+    reported.ttl = ttl;
+}
+
+TEST_GROUP(MDNS_CACHE_TestGroup)
+{
+    struct aes67_mdns_cache cache;
+
+    void setup()
+    {
+        refreshed.clear();
+        reported.count = 0;
+
+        aes67_mdns_cache_init(&cache);
+    }
+
+    void teardown()
+    {
+        aes67_mdns_cache_clear(&cache);
+        CHECK_EQUAL(0, cache.count);
+        CHECK_TRUE(cache.first == NULL);
+    }
+
+    void update(const char * type, const char * name, const char * domain, const u8_t * ip, u32_t ttl, const char * hosttarget = "host.local.")
+    {
+        aes67_mdns_cache_update(&cache, type, name, domain, hosttarget, 9191, 3, (const u8_t*)"\x02x=", aes67_net_ipver_4, ip, ttl);
+    }
+};
+
+TEST(MDNS_CACHE_TestGroup, normalize)
+{
+    update("_rtsp._tcp", "Session 1", "local", ip1, 10);
+    CHECK_EQUAL(1, cache.count);
+
+    struct aes67_mdns_cache_entry * entry = aes67_mdns_cache_lookup(&cache, "_rtsp._tcp", "Session 1", "local");
+    CHECK_TRUE(entry != NULL);
+    STRCMP_EQUAL("_rtsp._tcp", entry->type);
+    STRCMP_EQUAL("local", entry->domain);
+
+    // all forms of the backends refer to the same instance
+    POINTERS_EQUAL(entry, aes67_mdns_cache_lookup(&cache, "_ravenna._sub._rtsp._tcp", "Session 1", "local"));
+    POINTERS_EQUAL(entry, aes67_mdns_cache_lookup(&cache, "_rtsp._tcp,_ravenna", "Session 1", "local"));
+    POINTERS_EQUAL(entry, aes67_mdns_cache_lookup(&cache, "_rtsp._tcp.", "Session 1", "local."));
+    POINTERS_EQUAL(entry, aes67_mdns_cache_lookup(&cache, "_rtsp._tcp", "Session 1", NULL));
+    POINTERS_EQUAL(entry, aes67_mdns_cache_lookup(&cache, "_rtsp._tcp", "Session 1", ""));
+    POINTERS_EQUAL(entry, aes67_mdns_cache_lookup(&cache, "_RTSP._tcp", "session 1", "LOCAL"));
+
+    // but nothing else
+    POINTERS_EQUAL(NULL, aes67_mdns_cache_lookup(&cache, "_http._tcp", "Session 1", "local"));
+    POINTERS_EQUAL(NULL, aes67_mdns_cache_lookup(&cache, "_rtsp._tcp", "Session 2", "local"));
+    POINTERS_EQUAL(NULL, aes67_mdns_cache_lookup(&cache, "_rtsp._tcp", "Session 1", "example.com"));
+    POINTERS_EQUAL(NULL, aes67_mdns_cache_lookup(&cache, NULL, "Session 1", "local"));
+    POINTERS_EQUAL(NULL, aes67_mdns_cache_lookup(&cache, "_rtsp._tcp", NULL, "local"));
+
+    // updates (in any form) of the same instance
+    update("_ravenna._sub._rtsp._tcp.", "Session 1", NULL, ip2, 10);
+    update("_rtsp._tcp,_ravenna", "SESSION 1", "local.", ip1, 10);
+    CHECK_EQUAL(1, cache.count);
+    CHECK_EQUAL(2, entry->naddrs);
+
+    CHECK_EQUAL(2, aes67_mdns_cache_report(entry, NULL, aes67_mdns_result_discovered, "_rtsp._tcp", resolve_callback, NULL));
+    CHECK_EQUAL(2, reported.count);
+    STRCMP_EQUAL("Session 1", reported.name.c_str());
+    STRCMP_EQUAL("host.local.", reported.hosttarget.c_str());
+    CHECK_EQUAL(9191, reported.port);
+    CHECK_TRUE(reported.ttl >= 9 && reported.ttl <= 10);
+
+    // changed host target invalidates addresses
+    update("_rtsp._tcp", "Session 1", "local", ip3, 10, "other.local.");
+    CHECK_EQUAL(1, entry->naddrs);
+    CHECK_EQUAL(0, std::memcmp(ip3, entry->addrs[0].ip, 4));
+}
+
+TEST(MDNS_CACHE_TestGroup, expiry)
+{
+    update("_rtsp._tcp", "a", "local", ip1, 1);
+    update("_rtsp._tcp", "a", "local", ip2, 100);
+    update("_rtsp._tcp", "b", "local", ip1, 1);
+
+    struct aes67_mdns_cache_entry * a = aes67_mdns_cache_lookup(&cache, "_rtsp._tcp", "a", "local");
+    CHECK_TRUE(a != NULL);
+    CHECK_TRUE(aes67_mdns_cache_lookup(&cache, "_rtsp._tcp", "b", "local") != NULL);
+
+    usleep(1100000);
+
+    // lookup requires all addresses to be valid (ie refreshed in time)
+    POINTERS_EQUAL(NULL, aes67_mdns_cache_lookup(&cache, "_rtsp._tcp", "a", "local"));
+    POINTERS_EQUAL(NULL, aes67_mdns_cache_lookup(&cache, "_rtsp._tcp", "b", "local"));
+    CHECK_EQUAL(2, cache.count);
+
+    // expired address dropped, instances without address dropped
+    int64_t next = aes67_mdns_cache_process(&cache, NULL, NULL);
+    CHECK_EQUAL(1, cache.count);
+
+    POINTERS_EQUAL(a, aes67_mdns_cache_lookup(&cache, "_rtsp._tcp", "a", "local"));
+    CHECK_EQUAL(1, a->naddrs);
+    CHECK_EQUAL(0, std::memcmp(ip2, a->addrs[0].ip, 4));
+    CHECK_EQUAL(1, aes67_mdns_cache_report(a, NULL, aes67_mdns_result_discovered, "_rtsp._tcp", resolve_callback, NULL));
+
+    // refresh of expired address was due (once), thus next is expiry of remaining address
+    CHECK_EQUAL(AES67_MDNS_CACHE_NEVER, a->refresh);
+    CHECK_EQUAL(a->addrs[0].expires, next);
+    CHECK_EQUAL(a->addrs[0].received + 100000, next);
+}
+
+TEST(MDNS_CACHE_TestGroup, refresh)
+{
+    update("_rtsp._tcp", "a", "local", ip1, 100);
+    update("_rtsp._tcp", "a", "local", ip2, 10);
+    update("_rtsp._tcp", "b", "local", ip1, 1);
+
+    // at 80% of the shortest ttl
+    struct aes67_mdns_cache_entry * a = aes67_mdns_cache_lookup(&cache, "_rtsp._tcp", "a", "local");
+    CHECK_TRUE(a != NULL);
+    CHECK_EQUAL(a->addrs[1].received + 8000, a->refresh);
+
+    struct aes67_mdns_cache_entry * b = aes67_mdns_cache_lookup(&cache, "_rtsp._tcp", "b", "local");
+    CHECK_TRUE(b != NULL);
+    CHECK_EQUAL(b->addrs[0].received + 800, b->refresh);
+
+    int64_t next = aes67_mdns_cache_process(&cache, refresh_callback, NULL);
+    CHECK_EQUAL(0, refreshed.size());
+    CHECK_EQUAL(b->refresh, next);
+
+    usleep(850000);
+
+    // due once only
+    aes67_mdns_cache_process(&cache, refresh_callback, NULL);
+    aes67_mdns_cache_process(&cache, refresh_callback, NULL);
+    CHECK_EQUAL(1, refreshed.size());
+    POINTERS_EQUAL(b, refreshed[0]);
+    CHECK_EQUAL(AES67_MDNS_CACHE_NEVER, b->refresh);
+    POINTERS_EQUAL(b, aes67_mdns_cache_lookup(&cache, "_rtsp._tcp", "b", "local"));
+
+    // until resolved again
+    update("_rtsp._tcp", "b", "local", ip1, 1);
+    CHECK_TRUE(b->refresh != AES67_MDNS_CACHE_NEVER);
+
+    usleep(850000);
+
+    aes67_mdns_cache_process(&cache, refresh_callback, NULL);
+    CHECK_EQUAL(2, refreshed.size());
+    POINTERS_EQUAL(b, refreshed[1]);
+}
+
+TEST(MDNS_CACHE_TestGroup, evict)
+{
+    std::vector<std::string> names;
+
+    for(u32_t i = 0; i < AES67_MDNS_CACHE_SIZE; i++){
+        names.push_back("instance " + std::to_string(i));
+    }
+
+    // all but one long-lived
+    for(u32_t i = 0; i < AES67_MDNS_CACHE_SIZE; i++){
+        update("_rtsp._tcp", names[i].c_str(), "local", ip1, i == AES67_MDNS_CACHE_SIZE / 3 ? 100 : 1000 + i);
+    }
+    CHECK_EQUAL(AES67_MDNS_CACHE_SIZE, cache.count);
+
+    for(u32_t i = 0; i < AES67_MDNS_CACHE_SIZE; i++){
+        struct aes67_mdns_cache_entry * entry = aes67_mdns_cache_lookup(&cache, "_rtsp._tcp", names[i].c_str(), NULL);
+        CHECK_TRUE(entry != NULL);
+        STRCMP_EQUAL(names[i].c_str(), entry->name);
+    }
+
+    // refreshing a cached one does not evict
+    update("_rtsp._tcp", names[0].c_str(), "local", ip2, 1000);
+    CHECK_EQUAL(AES67_MDNS_CACHE_SIZE, cache.count);
+
+    // the one expiring first makes room
+    update("_rtsp._tcp", "new", "local", ip1, 50);
+    CHECK_EQUAL(AES67_MDNS_CACHE_SIZE, cache.count);
+    CHECK_TRUE(aes67_mdns_cache_lookup(&cache, "_rtsp._tcp", "new", NULL) != NULL);
+    POINTERS_EQUAL(NULL, aes67_mdns_cache_lookup(&cache, "_rtsp._tcp", names[AES67_MDNS_CACHE_SIZE / 3].c_str(), NULL));
+
+    // (which is now the new one)
+    update("_rtsp._tcp", "newer", "local", ip1, 1000);
+    POINTERS_EQUAL(NULL, aes67_mdns_cache_lookup(&cache, "_rtsp._tcp", "new", NULL));
+
+    // others still indexed (and listed), also after removing some
+    for(u32_t i = 0; i < AES67_MDNS_CACHE_SIZE; i += 7){
+        if (i == AES67_MDNS_CACHE_SIZE / 3){
+            continue;
+        }
+        struct aes67_mdns_cache_entry * entry = aes67_mdns_cache_lookup(&cache, "_rtsp._tcp", names[i].c_str(), NULL);
+        CHECK_TRUE(entry != NULL);
+        aes67_mdns_cache_remove(&cache, entry);
+    }
+
+    size_t listed = 0;
+    for(struct aes67_mdns_cache_entry * entry = cache.first; entry != NULL; entry = entry->next){
+        POINTERS_EQUAL(entry, aes67_mdns_cache_lookup(&cache, entry->type, entry->name, entry->domain));
+        listed++;
+    }
+    CHECK_EQUAL(cache.count, listed);
+
+    for(u32_t i = 0; i < AES67_MDNS_CACHE_SIZE; i++){
+        bool expected = i % 7 != 0 && i != AES67_MDNS_CACHE_SIZE / 3;
+        CHECK_EQUAL(expected, aes67_mdns_cache_lookup(&cache, "_rtsp._tcp", names[i].c_str(), NULL) != NULL);
+    }
+}
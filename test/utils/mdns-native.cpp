@@ -0,0 +1,507 @@
+/**
+ * AES67 Framework
+ * Copyright (C) 2021  Philip Tschiemer, https://github.com/tschiemer/aes67
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CppUTest/TestHarness.h"
+
+#include "aes67/utils/mdns.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MDNS_GROUP  "224.0.0.251"
+
+#define TYPE_A      1
+#define TYPE_PTR    12
+#define TYPE_TXT    16
+#define TYPE_SRV    33
+
+/**
+ * mDNS message as sent by the test (peer), names are written as given (ie possibly compressed).
+ */
+struct msg_st {
+    u8_t data[1500];
+    u16_t len;
+
+    msg_st(u16_t flags, u16_t ancount)
+    {
+        std::memset(data, 0, 12);
+        data[2] = flags >> 8;
+        data[3] = flags;
+        data[6] = ancount >> 8;
+        data[7] = ancount;
+        len = 12;
+    }
+
+    void u16(u16_t v)
+    {
+        data[len++] = v >> 8;
+        data[len++] = v;
+    }
+
+    void u32(u32_t v)
+    {
+        u16(v >> 16);
+        u16(v);
+    }
+
+    // dotted labels (without terminating zero length label), returns offset
+    u16_t labels(const char * dotted)
+    {
+        u16_t offset = len;
+        while(*dotted != '\0'){
+            const char * dot = std::strchr(dotted, '.');
+            size_t l = dot ? dot - dotted : std::strlen(dotted);
+            data[len++] = l;
+            std::memcpy(&data[len], dotted, l);
+            len += l;
+            dotted = dot ? dot + 1 : "";
+        }
+        return offset;
+    }
+
+    u16_t name(const char * dotted)
+    {
+        u16_t offset = labels(dotted);
+        data[len++] = 0;
+        return offset;
+    }
+
+    void pointer(u16_t offset)
+    {
+        u16(0xC000 | offset);
+    }
+
+    // record header up to rdlength, returns position of rdlength (see rdlength())
+    u16_t record(u16_t type, u32_t ttl)
+    {
+        u16(type);
+        u16(1);
+        u32(ttl);
+        u16(0);
+        return len - 2;
+    }
+
+    void rdlength(u16_t pos)
+    {
+        u16_t l = len - pos - 2;
+        data[pos] = l >> 8;
+        data[pos+1] = l;
+    }
+};
+
+static struct {
+    std::vector<std::string> discovered;
+    std::vector<std::string> terminated;
+
+    u32_t resolved;
+    std::string hosttarget;
+    u16_t port;
+    std::string txt;
+    u8_t ip[4];
+
+    u32_t registered;
+    u32_t collision;
+} events;
+
+static void browse_callback(aes67_mdns_resource_t res, enum aes67_mdns_result result, const char * type, const char * name, const char * domain, void * context)
+{
+    if (result == aes67_mdns_result_discovered){
+        events.discovered.push_back(name);
+    } else if (result == aes67_mdns_result_terminated){
+        events.terminated.push_back(name);
+    }
+}
+
+static void resolve_callback(aes67_mdns_resource_t res, enum aes67_mdns_result result, const char * type, const char * name, const char * hosttarget, u16_t port, u16_t txtlen, const u8_t * txt, enum aes67_net_ipver ipver, const u8_t * ip, u32_t ttl, void * context)
+{
+    if (result != aes67_mdns_result_discovered || ipver != aes67_net_ipver_4){
+        return;
+    }
+    events.resolved++;
+    events.hosttarget = hosttarget;
+    events.port = port;
+    events.txt = std::string((const char *)txt, txtlen);
+    std::memcpy(events.ip, ip, 4);
+}
+
+static void service_callback(aes67_mdns_resource_t res, enum aes67_mdns_result result, const char *type, const char *name, const char *domain, void * context)
+{
+    if (result == aes67_mdns_result_registered){
+        events.registered++;
+    } else if (result == aes67_mdns_result_collision){
+        events.collision++;
+    }
+}
+
+static int64_t now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+TEST_GROUP(MDNS_NATIVE_TestGroup)
+{
+    aes67_mdns_context_t context;
+    int peer;
+
+    // messages sent by context(s) as seen by peer, with time of reception
+    std::vector<std::vector<u8_t>> seen;
+    std::vector<int64_t> seen_at;
+
+    void setup()
+    {
+        events.discovered.clear();
+        events.terminated.clear();
+        events.resolved = 0;
+        events.registered = 0;
+        events.collision = 0;
+
+        context = aes67_mdns_new();
+        CHECK_TRUE(context != NULL);
+
+        // peer socket sending test messages and listening to messages of context
+        peer = socket(AF_INET, SOCK_DGRAM, 0);
+        CHECK_TRUE(peer != -1);
+
+        int yes = 1;
+        setsockopt(peer, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        setsockopt(peer, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes));
+
+        struct sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(AES67_MDNS_NATIVE_PORT);
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        CHECK_EQUAL(0, bind(peer, (struct sockaddr *)&addr, sizeof(addr)));
+
+        struct ip_mreq mreq;
+        inet_pton(AF_INET, MDNS_GROUP, &mreq.imr_multiaddr);
+        mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+        CHECK_EQUAL(0, setsockopt(peer, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)));
+    }
+
+    void teardown()
+    {
+        aes67_mdns_delete(context);
+        close(peer);
+    }
+
+    void send(struct msg_st & msg)
+    {
+        struct sockaddr_in group;
+        std::memset(&group, 0, sizeof(group));
+        group.sin_family = AF_INET;
+        group.sin_port = htons(AES67_MDNS_NATIVE_PORT);
+        inet_pton(AF_INET, MDNS_GROUP, &group.sin_addr);
+
+        CHECK_EQUAL(msg.len, sendto(peer, msg.data, msg.len, 0, (struct sockaddr *)&group, sizeof(group)));
+    }
+
+    // processes given contexts for some time (or until done), messages seen by the peer are collected
+    void process(int msec, aes67_mdns_context_t other = NULL, bool (*done)() = NULL)
+    {
+        int64_t until = now_ms() + msec;
+
+        while(now_ms() < until && (done == NULL || !done())){
+            aes67_mdns_process(context, 10);
+            if (other != NULL){
+                aes67_mdns_process(other, 0);
+            }
+
+            u8_t buf[1500];
+            ssize_t len;
+            while((len = recv(peer, buf, sizeof(buf), MSG_DONTWAIT)) > 0){
+                seen.push_back(std::vector<u8_t>(buf, buf + len));
+                seen_at.push_back(now_ms());
+            }
+        }
+    }
+};
+
+static u16_t msg_flags(const std::vector<u8_t> & msg)
+{
+    return (msg[2] << 8) | msg[3];
+}
+
+static u16_t msg_count(const std::vector<u8_t> & msg, int section)
+{
+    return (msg[4 + 2*section] << 8) | msg[5 + 2*section];
+}
+
+TEST(MDNS_NATIVE_TestGroup, browse_compressed)
+{
+    aes67_mdns_resource_t res = aes67_mdns_browse_start(context, "_rtsp._tcp", NULL, browse_callback, NULL);
+    CHECK_TRUE(res != NULL);
+
+    // pointer loops resp. pointers beyond message are ignored
+    {
+        struct msg_st msg(0x8400, 2);
+        u16_t type = msg.name("_rtsp._tcp.local");
+        u16_t rdlen = msg.record(TYPE_PTR, 4500);
+        u16_t loop = msg.labels("loop");
+        msg.pointer(loop);
+        msg.rdlength(rdlen);
+
+        msg.pointer(type);
+        rdlen = msg.record(TYPE_PTR, 4500);
+        msg.labels("beyond");
+        msg.pointer(1400);
+        msg.rdlength(rdlen);
+
+        send(msg);
+    }
+
+    process(200);
+    CHECK_EQUAL(0, events.discovered.size());
+
+    // owner name and instance names compressed
+    {
+        struct msg_st msg(0x8400, 2);
+        u16_t type = msg.name("_rtsp._tcp.local");
+        u16_t rdlen = msg.record(TYPE_PTR, 4500);
+        msg.labels("dev1");
+        msg.pointer(type);
+        msg.rdlength(rdlen);
+
+        msg.pointer(type);
+        rdlen = msg.record(TYPE_PTR, 4500);
+        msg.labels("Dev 2");
+        msg.pointer(type);
+        msg.rdlength(rdlen);
+
+        send(msg);
+    }
+
+    process(200);
+    CHECK_EQUAL(2, events.discovered.size());
+    CHECK_TRUE(events.discovered[0] == "dev1" || events.discovered[1] == "dev1");
+    CHECK_TRUE(events.discovered[0] == "Dev 2" || events.discovered[1] == "Dev 2");
+
+    // repeated announcements are no news
+    {
+        struct msg_st msg(0x8400, 1);
+        u16_t type = msg.name("_RTSP._tcp.local");
+        u16_t rdlen = msg.record(TYPE_PTR, 4500);
+        msg.labels("DEV1");
+        msg.pointer(type);
+        msg.rdlength(rdlen);
+
+        send(msg);
+    }
+
+    process(200);
+    CHECK_EQUAL(2, events.discovered.size());
+
+    // goodbye (removed after one second)
+    {
+        struct msg_st msg(0x8400, 1);
+        u16_t type = msg.name("_rtsp._tcp.local");
+        u16_t rdlen = msg.record(TYPE_PTR, 0);
+        msg.labels("dev1");
+        msg.pointer(type);
+        msg.rdlength(rdlen);
+
+        send(msg);
+    }
+
+    process(2000, NULL, []{ return events.terminated.size() > 0; });
+    CHECK_EQUAL(1, events.terminated.size());
+    CHECK_TRUE(events.terminated[0] == "dev1");
+
+    aes67_mdns_stop(res);
+}
+
+TEST(MDNS_NATIVE_TestGroup, resolve_records)
+{
+    aes67_mdns_resource_t res = aes67_mdns_resolve_start(context, "_rtsp._tcp", "dev1", NULL, resolve_callback, NULL);
+    CHECK_TRUE(res != NULL);
+
+    // rdata exceeding message, rest of message is dropped
+    {
+        struct msg_st msg(0x8400, 2);
+        u16_t instance = msg.name("dev1._rtsp._tcp.local");
+        msg.record(TYPE_TXT, 4500);
+        msg.data[msg.len - 1] = 200;
+        msg.data[msg.len++] = 0;
+        msg.pointer(instance);
+        msg.record(TYPE_SRV, 120);
+
+        send(msg);
+    }
+
+    process(200);
+    CHECK_EQUAL(0, events.resolved);
+
+    // SRV target compressed (pointing into owner name), address record owner pointing into SRV rdata
+    {
+        struct msg_st msg(0x8400, 3);
+        u16_t instance = msg.name("dev1._rtsp._tcp.local");
+        u16_t rdlen = msg.record(TYPE_SRV, 120);
+        msg.u16(0);
+        msg.u16(0);
+        msg.u16(9191);
+        u16_t target = msg.labels("host");
+        msg.pointer(instance + 1 + 4 + 1 + 5 + 1 + 4); // "local"
+        msg.rdlength(rdlen);
+
+        msg.pointer(instance);
+        rdlen = msg.record(TYPE_TXT, 4500);
+        msg.labels("a=1.b=2");
+        msg.rdlength(rdlen);
+
+        msg.pointer(target);
+        rdlen = msg.record(TYPE_A, 120);
+        msg.u32(0x0A000001);
+        msg.rdlength(rdlen);
+
+        send(msg);
+    }
+
+    process(500, NULL, []{ return events.resolved > 0; });
+
+    CHECK_EQUAL(1, events.resolved);
+    CHECK_TRUE(events.hosttarget == "host.local");
+    CHECK_EQUAL(9191, events.port);
+    CHECK_TRUE(events.txt == std::string("\x03" "a=1" "\x03" "b=2"));
+    u8_t ip[4] = {10, 0, 0, 1};
+    MEMCMP_EQUAL(ip, events.ip, 4);
+
+    aes67_mdns_stop(res);
+}
+
+TEST(MDNS_NATIVE_TestGroup, probe_announce)
+{
+    aes67_mdns_resource_t res = aes67_mdns_service_start(context, "_rtsp._tcp", "svc1", NULL, NULL, 9191, 0, NULL, service_callback, NULL);
+    CHECK_TRUE(res != NULL);
+
+    // nothing happens before commit
+    process(300);
+    CHECK_EQUAL(0, seen.size());
+
+    aes67_mdns_service_commit(context, res);
+
+    process(3000, NULL, []{ return events.registered > 0; });
+    CHECK_EQUAL(1, events.registered);
+
+    // (second announcement)
+    process(1500);
+
+    std::vector<int64_t> probes;
+    std::vector<int64_t> announcements;
+
+    for(size_t i = 0; i < seen.size(); i++){
+        if (msg_flags(seen[i]) == 0 && msg_count(seen[i], 0) > 0 && msg_count(seen[i], 2) > 0){
+            CHECK_EQUAL(0, announcements.size());
+            probes.push_back(seen_at[i]);
+        } else if (msg_flags(seen[i]) == 0x8400 && msg_count(seen[i], 1) > 0){
+            announcements.push_back(seen_at[i]);
+        }
+    }
+
+    CHECK_EQUAL(3, probes.size());
+    CHECK_EQUAL(2, announcements.size());
+
+    // (with some tolerance)
+    CHECK_TRUE(probes[1] - probes[0] >= 200);
+    CHECK_TRUE(probes[2] - probes[1] >= 200);
+    CHECK_TRUE(announcements[0] - probes[2] >= 200);
+    CHECK_TRUE(announcements[1] - announcements[0] >= 900);
+
+    aes67_mdns_stop(res);
+}
+
+TEST(MDNS_NATIVE_TestGroup, probe_conflict)
+{
+    aes67_mdns_resource_t res = aes67_mdns_service_start(context, "_rtsp._tcp", "svc1", NULL, NULL, 9191, 0, NULL, service_callback, NULL);
+    CHECK_TRUE(res != NULL);
+
+    aes67_mdns_service_commit(context, res);
+
+    // first probe
+    for(int i = 0; i < 100 && seen.empty(); i++){
+        process(10);
+    }
+    CHECK_EQUAL(1, seen.size());
+
+    // another device already uses the name
+    {
+        struct msg_st msg(0x8400, 1);
+        msg.name("svc1._rtsp._tcp.local");
+        u16_t rdlen = msg.record(TYPE_SRV, 120);
+        msg.u16(0);
+        msg.u16(0);
+        msg.u16(554);
+        msg.name("other.local");
+        msg.rdlength(rdlen);
+
+        send(msg);
+    }
+
+    process(2000);
+
+    CHECK_EQUAL(1, events.collision);
+    CHECK_EQUAL(0, events.registered);
+
+    // neither further probes nor announcements (peer sees the first probe and its own response only)
+    CHECK_EQUAL(2, seen.size());
+
+    aes67_mdns_stop(res);
+}
+
+TEST(MDNS_NATIVE_TestGroup, loopback_resolve)
+{
+    aes67_mdns_context_t other = aes67_mdns_new();
+    CHECK_TRUE(other != NULL);
+
+    const u8_t txt[] = "\x06" "path=/";
+
+    aes67_mdns_resource_t service = aes67_mdns_service_start(other, "_rtsp._tcp", "svc2", NULL, NULL, 1234, sizeof(txt) - 1, txt, service_callback, NULL);
+    CHECK_TRUE(service != NULL);
+    aes67_mdns_service_commit(other, service);
+
+    aes67_mdns_resource_t res = aes67_mdns_resolve_start(context, "_rtsp._tcp", "svc2", NULL, resolve_callback, NULL);
+    CHECK_TRUE(res != NULL);
+
+    process(5000, other, []{ return events.resolved > 0; });
+
+    CHECK_EQUAL(1, events.registered);
+    CHECK_TRUE(events.resolved > 0);
+    CHECK_EQUAL(1234, events.port);
+    CHECK_TRUE(events.txt == std::string((const char *)txt, sizeof(txt) - 1));
+
+    char hostname[64];
+    gethostname(hostname, sizeof(hostname));
+    hostname[sizeof(hostname)-1] = '\0';
+    if (std::strchr(hostname, '.') != NULL){
+        *std::strchr(hostname, '.') = '\0';
+    }
+    CHECK_TRUE(events.hosttarget == std::string(hostname) + ".local");
+
+    aes67_mdns_stop(res);
+    aes67_mdns_stop(service);
+
+    aes67_mdns_delete(other);
+}
@@ -0,0 +1,620 @@
+/**
+ * AES67 Framework
+ * Copyright (C) 2021  Philip Tschiemer, https://github.com/tschiemer/aes67
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CppUTest/TestHarness.h"
+
+#include "aes67/utils/rtsp-dsc.h"
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static const u8_t loopback[] = {127, 0, 0, 1};
+
+/**
+ * Trivial (non-blocking, single threaded) RTSP server answering DESCRIBE requests, one SDP per URI.
+ */
+struct server_st {
+    int listenfd;
+    u16_t port;
+
+    struct client_st {
+        int fd;
+        std::string in;
+    };
+    std::vector<client_st> clients;
+
+    u32_t accepted;
+    u32_t requests;
+    u32_t not_modified;
+    u16_t last_cseq;
+    std::string last_request;
+
+    bool hold;                  // do not respond (yet)
+    bool connection_close;      // respond with Connection: close (and close)
+    bool etag;                  // respond with validators (and honor conditional requests)
+    bool lastmod;
+
+    std::map<std::string, u32_t> versions;
+
+    void start()
+    {
+        listenfd = socket(AF_INET, SOCK_STREAM, 0);
+        CHECK_TRUE(listenfd != -1);
+
+        int yes = 1;
+        setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+        struct sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+
+        socklen_t addrlen = sizeof(addr);
+        CHECK_EQUAL(0, bind(listenfd, (struct sockaddr*)&addr, sizeof(addr)));
+        CHECK_EQUAL(0, listen(listenfd, 16));
+        CHECK_EQUAL(0, getsockname(listenfd, (struct sockaddr*)&addr, &addrlen));
+        port = ntohs(addr.sin_port);
+
+        fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL, 0) | O_NONBLOCK);
+
+        accepted = 0;
+        requests = 0;
+        not_modified = 0;
+        last_cseq = 0;
+        hold = false;
+        connection_close = false;
+        etag = false;
+        lastmod = false;
+    }
+
+    void stop()
+    {
+        close_clients();
+        close(listenfd);
+    }
+
+    void close_clients()
+    {
+        for(client_st & client : clients){
+            close(client.fd);
+        }
+        clients.clear();
+    }
+
+    void pollfds(std::vector<struct pollfd> & fds)
+    {
+        fds.push_back({listenfd, POLLIN, 0});
+        for(client_st & client : clients){
+            fds.push_back({client.fd, POLLIN, 0});
+        }
+    }
+
+    static std::string header(const std::string & request, const char * name)
+    {
+        std::string key = std::string("\r\n") + name + ": ";
+        size_t pos = request.find(key);
+        if (pos == std::string::npos){
+            return "";
+        }
+        pos += key.size();
+        return request.substr(pos, request.find("\r\n", pos) - pos);
+    }
+
+    std::string sdp(const std::string & uri)
+    {
+        u32_t version = versions.count(uri) ? versions[uri] : 1;
+        char buf[256];
+        std::snprintf(buf, sizeof(buf), "v=0\r\no=- %u %u IN IP4 127.0.0.1\r\ns=%s\r\nt=0 0\r\n", (u32_t)versions.size() + 1000, version, uri.c_str());
+        return buf;
+    }
+
+    // returns false if connection is to be closed
+    bool respond(client_st & client, const std::string & request)
+    {
+        requests++;
+        last_request = request;
+
+        // DESCRIBE rtsp://127.0.0.1:<port><uri> RTSP/1.0
+        size_t start = request.find('/', request.find("//") + 2);
+        std::string uri = request.substr(start, request.find(' ', start) - start);
+
+        std::string cseq = header(request, "CSeq");
+        last_cseq = std::atoi(cseq.c_str());
+
+        std::string body = sdp(uri);
+        char tag[32];
+        std::snprintf(tag, sizeof(tag), "\"v%u\"", versions.count(uri) ? versions[uri] : 1);
+        char date[40];
+        std::snprintf(date, sizeof(date), "Mon, 0%u Jan 2024 00:00:00 GMT", versions.count(uri) ? versions[uri] : 1);
+
+        std::string response;
+
+        if ((etag && header(request, "If-None-Match") == tag) || (lastmod && header(request, "If-Modified-Since") == date)){
+            not_modified++;
+            response = "RTSP/1.0 304 Not Modified\r\nCSeq: " + cseq + "\r\n";
+        } else {
+            response = "RTSP/1.0 200 OK\r\nCSeq: " + cseq + "\r\n"
+                       "Content-Type: application/sdp\r\n"
+                       "Content-Length: " + std::to_string(body.size()) + "\r\n";
+        }
+        if (etag){
+            response += std::string("ETag: ") + tag + "\r\n";
+        }
+        if (lastmod){
+            response += std::string("Last-Modified: ") + date + "\r\n";
+        }
+        if (connection_close){
+            response += "Connection: close\r\n";
+        }
+        response += "\r\n";
+        if (response[9] == '2'){
+            response += body;
+        }
+
+        CHECK_EQUAL((ssize_t)response.size(), send(client.fd, response.data(), response.size(), MSG_NOSIGNAL));
+
+        return !connection_close;
+    }
+
+    void process()
+    {
+        int fd;
+        while( (fd = accept(listenfd, NULL, NULL)) != -1){
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+            clients.push_back({fd, ""});
+            accepted++;
+        }
+
+        for(size_t i = 0; i < clients.size(); ){
+            client_st & client = clients[i];
+
+            char buf[1500];
+            ssize_t r;
+            bool closed = false;
+            while( (r = read(client.fd, buf, sizeof(buf))) > 0){
+                client.in.append(buf, r);
+            }
+            if (r == 0){
+                closed = true;
+            }
+
+            size_t end;
+            while(!closed && !hold && (end = client.in.find("\r\n\r\n")) != std::string::npos){
+                std::string request = client.in.substr(0, end + 4);
+                client.in.erase(0, end + 4);
+                if (!respond(client, request)){
+                    closed = true;
+                }
+            }
+
+            if (closed){
+                close(client.fd);
+                clients.erase(clients.begin() + i);
+            } else {
+                i++;
+            }
+        }
+    }
+};
+
+static struct {
+    struct result_st {
+        intptr_t id;
+        u16_t statuscode;
+        std::string content;
+        bool unchanged;
+    };
+    std::vector<result_st> results;
+} done;
+
+static void mux_callback(struct aes67_rtsp_dsc_mux * mux, void * req_data, u16_t statuscode, u8_t * content, u16_t contentlen, bool unchanged, void * user_data)
+{
+    done.results.push_back({(intptr_t)req_data, statuscode, content ? std::string((char*)content, contentlen) : "", unchanged});
+}
+
+TEST_GROUP(RTSP_DSC_TestGroup)
+{
+    server_st server;
+    struct aes67_rtsp_dsc_mux mux;
+
+    void setup()
+    {
+        done.results.clear();
+
+        server.start();
+
+        aes67_rtsp_dsc_mux_init(&mux, mux_callback, NULL);
+    }
+
+    void teardown()
+    {
+        aes67_rtsp_dsc_mux_deinit(&mux);
+
+        server.stop();
+    }
+
+    int start(const char * uri, intptr_t id)
+    {
+        return aes67_rtsp_dsc_mux_start(&mux, aes67_net_ipver_4, loopback, server.port, uri, (void*)id);
+    }
+
+    // process server and mux until given number of requests completed (or about a second passed)
+    void run(size_t count)
+    {
+        for(int i = 0; i < 100 && done.results.size() < count; i++){
+            std::vector<struct pollfd> fds(AES67_RTSP_DSC_MUX_SIZE);
+            fds.resize(aes67_rtsp_dsc_mux_getpollfds(&mux, fds.data(), fds.size()));
+            server.pollfds(fds);
+
+            poll(fds.data(), fds.size(), 10);
+
+            server.process();
+            aes67_rtsp_dsc_mux_process(&mux);
+        }
+    }
+};
+
+TEST(RTSP_DSC_TestGroup, mux_concurrent)
+{
+    server.hold = true;
+
+    // requests are started without waiting for the device
+    CHECK_EQUAL(EXIT_SUCCESS, start("/by-name/a", 1));
+    CHECK_EQUAL(EXIT_SUCCESS, start("/by-name/b", 2));
+    CHECK_EQUAL(EXIT_SUCCESS, start("/by-name/c", 3));
+
+    run(1);
+
+    // ... and are pending concurrently, each on its own connection
+    CHECK_EQUAL(0, done.results.size());
+    CHECK_EQUAL(3, aes67_rtsp_dsc_mux_count(&mux, aes67_net_ipver_4, loopback));
+    CHECK_EQUAL(AES67_RTSP_DSC_MUX_SIZE - 3, aes67_rtsp_dsc_mux_available(&mux));
+    CHECK_EQUAL(3, server.accepted);
+    CHECK_TRUE(aes67_rtsp_dsc_mux_deadline(&mux) != 0);
+
+    server.hold = false;
+
+    run(3);
+
+    CHECK_EQUAL(3, done.results.size());
+    CHECK_EQUAL(AES67_RTSP_DSC_MUX_SIZE, aes67_rtsp_dsc_mux_available(&mux));
+
+    for(auto & result : done.results){
+        const char * uri[] = {"", "/by-name/a", "/by-name/b", "/by-name/c"};
+        CHECK_EQUAL(AES67_RTSP_STATUS_OK, result.statuscode);
+        CHECK_TRUE(1 <= result.id && result.id <= 3);
+        CHECK_TRUE(result.content == server.sdp(uri[result.id]));
+        CHECK_FALSE(result.unchanged);
+    }
+
+    // an unreachable device only fails its own request
+    server_st gone;
+    gone.start();
+    u16_t port = gone.port;
+    gone.stop();
+
+    CHECK_EQUAL(EXIT_SUCCESS, start("/by-name/a", 4));
+    // (refused immediately resp. once connecting fails)
+    if (aes67_rtsp_dsc_mux_start(&mux, aes67_net_ipver_4, loopback, port, "/by-name/x", (void*)5) == EXIT_SUCCESS){
+        run(5);
+    } else {
+        run(4);
+    }
+
+    for(auto & result : done.results){
+        if (result.id == 4){
+            CHECK_EQUAL(AES67_RTSP_STATUS_OK, result.statuscode);
+        }
+        if (result.id == 5){
+            CHECK_EQUAL(0, result.statuscode);
+        }
+    }
+
+    // slots are limited
+    server.hold = true;
+    for(intptr_t i = 0; i < AES67_RTSP_DSC_MUX_SIZE; i++){
+        CHECK_EQUAL(EXIT_SUCCESS, start("/by-name/a", 10 + i));
+    }
+    CHECK_EQUAL(0, aes67_rtsp_dsc_mux_available(&mux));
+    CHECK_EQUAL(EXIT_FAILURE, start("/by-name/a", 100));
+
+    // cancelled requests are not called back
+    for(intptr_t i = 0; i < AES67_RTSP_DSC_MUX_SIZE; i++){
+        aes67_rtsp_dsc_mux_cancel(&mux, (void*)(10 + i));
+    }
+    CHECK_EQUAL(AES67_RTSP_DSC_MUX_SIZE, aes67_rtsp_dsc_mux_available(&mux));
+}
+
+TEST(RTSP_DSC_TestGroup, keepalive)
+{
+    CHECK_EQUAL(EXIT_SUCCESS, start("/by-name/a", 1));
+    run(1);
+
+    CHECK_EQUAL(1, done.results.size());
+    CHECK_EQUAL(1, server.last_cseq);
+
+    // subsequent requests to the same device reuse the connection
+    CHECK_EQUAL(EXIT_SUCCESS, start("/by-name/b", 2));
+    run(2);
+
+    CHECK_EQUAL(2, done.results.size());
+    CHECK_EQUAL(1, server.accepted);
+    CHECK_EQUAL(2, server.requests);
+    CHECK_EQUAL(2, server.last_cseq);
+    if (done.results.size() == 2){
+        CHECK_EQUAL(AES67_RTSP_STATUS_OK, done.results[1].statuscode);
+        CHECK_TRUE(done.results[1].content == server.sdp("/by-name/b"));
+    }
+
+    // unless the device says otherwise
+    server.connection_close = true;
+
+    CHECK_EQUAL(EXIT_SUCCESS, start("/by-name/a", 3));
+    run(3);
+
+    CHECK_EQUAL(1, server.accepted);
+
+    server.connection_close = false;
+
+    CHECK_EQUAL(EXIT_SUCCESS, start("/by-name/a", 4));
+    run(4);
+
+    CHECK_EQUAL(4, done.results.size());
+    CHECK_EQUAL(2, server.accepted);
+    // (new connection, new sequence)
+    CHECK_EQUAL(1, server.last_cseq);
+
+    for(auto & result : done.results){
+        CHECK_EQUAL(AES67_RTSP_STATUS_OK, result.statuscode);
+    }
+}
+
+TEST(RTSP_DSC_TestGroup, reconnect)
+{
+    CHECK_EQUAL(EXIT_SUCCESS, start("/by-name/a", 1));
+    run(1);
+
+    CHECK_EQUAL(1, server.accepted);
+
+    // device closes idle connection, which the client only notices once it sends the next request
+    server.close_clients();
+    usleep(10000);
+
+    CHECK_EQUAL(EXIT_SUCCESS, start("/by-name/b", 2));
+    run(2);
+
+    // (repeated on a new connection rather than failing)
+    CHECK_EQUAL(2, done.results.size());
+    CHECK_EQUAL(2, server.accepted);
+    CHECK_EQUAL(2, server.requests);
+    if (done.results.size() == 2){
+        CHECK_EQUAL(2, done.results[1].id);
+        CHECK_EQUAL(AES67_RTSP_STATUS_OK, done.results[1].statuscode);
+        CHECK_TRUE(done.results[1].content == server.sdp("/by-name/b"));
+    }
+
+    // if noticed while idle, the connection is just dropped
+    server.close_clients();
+    run(3);
+
+    CHECK_EQUAL(0, aes67_rtsp_dsc_mux_deadline(&mux));
+
+    CHECK_EQUAL(EXIT_SUCCESS, start("/by-name/c", 3));
+    run(3);
+
+    CHECK_EQUAL(3, done.results.size());
+    CHECK_EQUAL(3, server.accepted);
+    if (done.results.size() == 3){
+        CHECK_EQUAL(AES67_RTSP_STATUS_OK, done.results[2].statuscode);
+    }
+}
+
+TEST(RTSP_DSC_TestGroup, revalidate)
+{
+    struct aes67_rtsp_dsc_cache * cache = new aes67_rtsp_dsc_cache;
+
+    aes67_rtsp_dsc_cache_init(cache);
+    aes67_rtsp_dsc_mux_setcache(&mux, cache);
+
+    server.etag = true;
+
+    CHECK_EQUAL(EXIT_SUCCESS, start("/by-name/a", 1));
+    run(1);
+
+    struct aes67_rtsp_dsc_cache_entry * entry = aes67_rtsp_dsc_cache_lookup(cache, aes67_net_ipver_4, loopback, server.port, "/by-name/a");
+    CHECK_TRUE(entry != NULL);
+    if (entry == NULL){
+        return;
+    }
+    STRCMP_EQUAL("\"v1\"", entry->etag);
+    CHECK_TRUE(entry->has_origin);
+    CHECK_EQUAL('1', entry->origin.session_version.data[0]);
+
+    // revalidated by ETag, the cached content is passed on as unchanged
+    CHECK_EQUAL(EXIT_SUCCESS, start("/by-name/a", 2));
+    run(2);
+
+    CHECK_TRUE(server.last_request.find("If-None-Match: \"v1\"\r\n") != std::string::npos);
+    CHECK_EQUAL(1, server.not_modified);
+    CHECK_EQUAL(2, done.results.size());
+    if (done.results.size() == 2){
+        CHECK_EQUAL(AES67_RTSP_STATUS_OK, done.results[1].statuscode);
+        CHECK_TRUE(done.results[1].unchanged);
+        CHECK_TRUE(done.results[1].content == server.sdp("/by-name/a"));
+    }
+
+    // changed content comes in full
+    server.versions["/by-name/a"] = 2;
+
+    CHECK_EQUAL(EXIT_SUCCESS, start("/by-name/a", 3));
+    run(3);
+
+    CHECK_EQUAL(1, server.not_modified);
+    if (done.results.size() == 3){
+        CHECK_EQUAL(AES67_RTSP_STATUS_OK, done.results[2].statuscode);
+        CHECK_FALSE(done.results[2].unchanged);
+        CHECK_TRUE(done.results[2].content == server.sdp("/by-name/a"));
+    }
+    STRCMP_EQUAL("\"v2\"", entry->etag);
+    CHECK_EQUAL('2', entry->origin.session_version.data[0]);
+
+    // revalidated by Last-Modified
+    server.etag = false;
+    server.lastmod = true;
+
+    CHECK_EQUAL(EXIT_SUCCESS, start("/by-name/b", 4));
+    run(4);
+    CHECK_EQUAL(EXIT_SUCCESS, start("/by-name/b", 5));
+    run(5);
+
+    CHECK_TRUE(server.last_request.find("If-Modified-Since: Mon, 01 Jan 2024 00:00:00 GMT\r\n") != std::string::npos);
+    CHECK_TRUE(server.last_request.find("If-None-Match") == std::string::npos);
+    CHECK_EQUAL(2, server.not_modified);
+    if (done.results.size() == 5){
+        CHECK_FALSE(done.results[3].unchanged);
+        CHECK_TRUE(done.results[4].unchanged);
+        CHECK_TRUE(done.results[4].content == server.sdp("/by-name/b"));
+    }
+
+    // without validators, unchanged content is recognized as such
+    server.lastmod = false;
+
+    CHECK_EQUAL(EXIT_SUCCESS, start("/by-name/c", 6));
+    run(6);
+    CHECK_EQUAL(EXIT_SUCCESS, start("/by-name/c", 7));
+    run(7);
+
+    CHECK_TRUE(server.last_request.find("If-") == std::string::npos);
+    CHECK_EQUAL(2, server.not_modified);
+    if (done.results.size() == 7){
+        CHECK_FALSE(done.results[5].unchanged);
+        CHECK_TRUE(done.results[6].unchanged);
+    }
+
+    // a Not Modified without anything cached is useless
+    aes67_rtsp_dsc_cache_remove(cache, aes67_net_ipver_4, loopback, server.port, "/by-name/a");
+    CHECK_TRUE(NULL == aes67_rtsp_dsc_cache_lookup(cache, aes67_net_ipver_4, loopback, server.port, "/by-name/a"));
+
+    aes67_rtsp_dsc_mux_setcache(&mux, NULL);
+    aes67_rtsp_dsc_cache_deinit(cache);
+    delete cache;
+}
+
+/**
+ * Feeds a (completed) response of given device port and URI into cache.
+ */
+static struct aes67_rtsp_dsc_cache_entry * cache_put(struct aes67_rtsp_dsc_cache * cache, u16_t port, const char * uri, u32_t version, bool * unchanged)
+{
+    static struct aes67_rtsp_dsc_res_st res;
+
+    res.addr.ipver = aes67_net_ipver_4;
+    std::memcpy(res.addr.ip, loopback, 4);
+    res.addr.port = port;
+    res.statuscode = AES67_RTSP_STATUS_OK;
+    res.hdrlen = 0;
+    res.contentlen = std::snprintf((char*)res.buf, sizeof(res.buf), "v=0\r\no=- %u %u IN IP4 127.0.0.1\r\ns=%s\r\n", port, version, uri);
+    res.buflen = res.contentlen;
+    res.etag[0] = '\0';
+    res.lastmod[0] = '\0';
+
+    return aes67_rtsp_dsc_cache_update(cache, &res, uri, unchanged);
+}
+
+TEST(RTSP_DSC_TestGroup, cache_index)
+{
+    struct aes67_rtsp_dsc_cache * cache = new aes67_rtsp_dsc_cache;
+    bool unchanged;
+
+    aes67_rtsp_dsc_cache_init(cache);
+
+    // fill up completely (some devices with several sessions each)
+    for(u32_t i = 0; i < AES67_RTSP_DSC_CACHE_SIZE; i++){
+        char uri[32];
+        std::snprintf(uri, sizeof(uri), "/by-name/%u", i % 16);
+        CHECK_TRUE(cache_put(cache, 1000 + i / 16, uri, 1, &unchanged) != NULL);
+        CHECK_FALSE(unchanged);
+    }
+    CHECK_EQUAL(AES67_RTSP_DSC_CACHE_SIZE, cache->count);
+
+    for(u32_t i = 0; i < AES67_RTSP_DSC_CACHE_SIZE; i++){
+        char uri[32];
+        std::snprintf(uri, sizeof(uri), "/by-name/%u", i % 16);
+        struct aes67_rtsp_dsc_cache_entry * entry = aes67_rtsp_dsc_cache_lookup(cache, aes67_net_ipver_4, loopback, 1000 + i / 16, uri);
+        CHECK_TRUE(entry != NULL);
+        if (entry != NULL){
+            CHECK_EQUAL(1000 + i / 16, entry->addr.port);
+            STRCMP_EQUAL(uri, entry->uri);
+        }
+    }
+
+    // refreshing the first one makes the second the least recently used
+    CHECK_TRUE(cache_put(cache, 1000, "/by-name/0", 1, &unchanged) != NULL);
+    CHECK_TRUE(unchanged);
+
+    CHECK_TRUE(cache_put(cache, 2000, "/by-name/x", 1, &unchanged) != NULL);
+    CHECK_EQUAL(AES67_RTSP_DSC_CACHE_SIZE, cache->count);
+    CHECK_TRUE(NULL != aes67_rtsp_dsc_cache_lookup(cache, aes67_net_ipver_4, loopback, 1000, "/by-name/0"));
+    CHECK_TRUE(NULL == aes67_rtsp_dsc_cache_lookup(cache, aes67_net_ipver_4, loopback, 1000, "/by-name/1"));
+    CHECK_TRUE(NULL != aes67_rtsp_dsc_cache_lookup(cache, aes67_net_ipver_4, loopback, 2000, "/by-name/x"));
+
+    // remove every other entry (moving others around), the rest is still to be found
+    for(u32_t i = 2; i < AES67_RTSP_DSC_CACHE_SIZE; i += 2){
+        char uri[32];
+        std::snprintf(uri, sizeof(uri), "/by-name/%u", i % 16);
+        aes67_rtsp_dsc_cache_remove(cache, aes67_net_ipver_4, loopback, 1000 + i / 16, uri);
+    }
+    CHECK_EQUAL(AES67_RTSP_DSC_CACHE_SIZE / 2 + 1, cache->count);
+
+    for(u32_t i = 2; i < AES67_RTSP_DSC_CACHE_SIZE; i++){
+        char uri[32];
+        std::snprintf(uri, sizeof(uri), "/by-name/%u", i % 16);
+        struct aes67_rtsp_dsc_cache_entry * entry = aes67_rtsp_dsc_cache_lookup(cache, aes67_net_ipver_4, loopback, 1000 + i / 16, uri);
+        CHECK_TRUE((i % 2 == 0) == (entry == NULL));
+    }
+
+    // least recently used are still evicted in order (3, 5, ..)
+    for(u32_t i = 0; i < AES67_RTSP_DSC_CACHE_SIZE / 2 - 1; i++){
+        char uri[32];
+        std::snprintf(uri, sizeof(uri), "/new/%u", i);
+        CHECK_TRUE(cache_put(cache, 3000, uri, 1, &unchanged) != NULL);
+    }
+    CHECK_EQUAL(AES67_RTSP_DSC_CACHE_SIZE, cache->count);
+
+    CHECK_TRUE(cache_put(cache, 3000, "/new/last", 1, &unchanged) != NULL);
+    CHECK_TRUE(NULL == aes67_rtsp_dsc_cache_lookup(cache, aes67_net_ipver_4, loopback, 1000, "/by-name/3"));
+    CHECK_TRUE(NULL != aes67_rtsp_dsc_cache_lookup(cache, aes67_net_ipver_4, loopback, 1000, "/by-name/5"));
+    CHECK_TRUE(NULL != aes67_rtsp_dsc_cache_lookup(cache, aes67_net_ipver_4, loopback, 1000, "/by-name/0"));
+    CHECK_TRUE(NULL != aes67_rtsp_dsc_cache_lookup(cache, aes67_net_ipver_4, loopback, 3000, "/new/0"));
+
+    aes67_rtsp_dsc_cache_deinit(cache);
+    CHECK_EQUAL(0, cache->count);
+    CHECK_TRUE(NULL == aes67_rtsp_dsc_cache_lookup(cache, aes67_net_ipver_4, loopback, 3000, "/new/0"));
+
+    delete cache;
+}
@@ -0,0 +1,603 @@
+/**
+ * AES67 Framework
+ * Copyright (C) 2021  Philip Tschiemer, https://github.com/tschiemer/aes67
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CppUTest/TestHarness.h"
+
+#include "aes67/utils/rtsp-srv.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// (unlikely to collide with anything else)
+#define TEST_PORT   19554
+
+static const u8_t loopback[] = {127, 0, 0, 1};
+
+// SDP of resources (by sdpref)
+static std::map<void*, std::string> sdps;
+static u32_t getter_calls;
+
+u16_t aes67_rtsp_srv_sdp_getter(struct aes67_rtsp_srv * srv, void * sdpref, u8_t * buf, u16_t maxlen)
+{
+    getter_calls++;
+
+    if (sdps.count(sdpref) == 0){
+        return 0;
+    }
+
+    const std::string & sdp = sdps[sdpref];
+
+    int len = std::snprintf((char*)buf, maxlen, "Content-Length: %u\r\n\r\n", (u32_t)sdp.size());
+    if (len < 0 || len + sdp.size() > maxlen){
+        return 0;
+    }
+
+    std::memcpy(buf + len, sdp.data(), sdp.size());
+
+    return len + sdp.size();
+}
+
+void aes67_rtsp_srv_http_handler(struct aes67_rtsp_srv * srv, const enum aes67_rtsp_srv_method method, char * uri, u8_t urilen, u8_t * buf, u16_t * len, u16_t maxlen, bool * more, void ** response_state)
+{
+    // (http is not enabled)
+    FAIL("http handler called");
+}
+
+struct response_st {
+    u16_t status;
+    u16_t cseq;
+    bool close;
+    std::string body;
+};
+
+TEST_GROUP(RTSP_SRV_TestGroup)
+{
+    struct aes67_rtsp_srv srv;
+    std::vector<int> clients;
+
+    int a, b; // sdprefs
+
+    void setup()
+    {
+        sdps.clear();
+        getter_calls = 0;
+
+        aes67_rtsp_srv_init(&srv, false, NULL);
+        CHECK_EQUAL(EXIT_SUCCESS, aes67_rtsp_srv_start(&srv, aes67_net_ipver_4, loopback, TEST_PORT));
+        aes67_rtsp_srv_blocking(&srv, false);
+
+        sdps[&a] = sdp("a", 1);
+        sdps[&b] = sdp("b", 1);
+        aes67_rtsp_srv_sdp_add(&srv, "/by-name/a", sizeof("/by-name/a")-1, &a);
+        aes67_rtsp_srv_sdp_add(&srv, "/by-name/b", sizeof("/by-name/b")-1, &b);
+    }
+
+    void teardown()
+    {
+        for(int fd : clients){
+            close(fd);
+        }
+        clients.clear();
+
+        aes67_rtsp_srv_deinit(&srv);
+    }
+
+    static std::string sdp(const char * name, u32_t version)
+    {
+        char buf[256];
+        std::snprintf(buf, sizeof(buf), "v=0\r\no=- 1 %u IN IP4 127.0.0.1\r\ns=%s\r\nt=0 0\r\n", version, name);
+        return buf;
+    }
+
+    static std::string describe(const char * name, u16_t cseq, const char * extra = "")
+    {
+        char buf[256];
+        std::snprintf(buf, sizeof(buf), "DESCRIBE rtsp://127.0.0.1:%d/by-name/%s RTSP/1.0\r\nCSeq: %hu\r\n%s\r\n", TEST_PORT, name, cseq, extra);
+        return buf;
+    }
+
+    int connect_client()
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        CHECK_TRUE(fd != -1);
+
+        struct sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(TEST_PORT);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        // (completes by the backlog of the listening socket)
+        CHECK_EQUAL(0, connect(fd, (struct sockaddr*)&addr, sizeof(addr)));
+
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+        clients.push_back(fd);
+
+        process();
+
+        return fd;
+    }
+
+    void send(int fd, const std::string & data)
+    {
+        LONGS_EQUAL(data.size(), ::send(fd, data.data(), data.size(), MSG_NOSIGNAL));
+    }
+
+    void process(u32_t rounds = 5)
+    {
+        for(u32_t i = 0; i < rounds; i++){
+            aes67_rtsp_srv_process(&srv);
+            usleep(1000);
+        }
+    }
+
+    /**
+     * Reads (while processing the server) until count responses are complete or the connection is closed.
+     * Returns false if the connection was closed.
+     */
+    bool responses(int fd, std::vector<response_st> & res, size_t count, std::string * rest = NULL)
+    {
+        std::string in;
+        bool open = true;
+
+        for(int i = 0; i < 2000 && open && res.size() < count; i++){
+            aes67_rtsp_srv_process(&srv);
+
+            char buf[4096];
+            ssize_t rlen = recv(fd, buf, sizeof(buf), 0);
+            if (rlen > 0){
+                in.append(buf, rlen);
+            } else if (rlen == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)){
+                open = false;
+            } else {
+                usleep(1000);
+            }
+
+            for(size_t end; res.size() < count && (end = in.find("\r\n\r\n")) != std::string::npos; ){
+                std::string header = in.substr(0, end + 2);
+                size_t clen = 0;
+                size_t pos = header.find("Content-Length: ");
+                if (pos != std::string::npos){
+                    clen = std::atoi(header.c_str() + pos + sizeof("Content-Length: ")-1);
+                }
+                if (in.size() < end + 4 + clen){
+                    break;
+                }
+                response_st r;
+                r.status = std::atoi(header.c_str() + sizeof("RTSP/1.0 ")-1);
+                pos = header.find("CSeq: ");
+                r.cseq = pos == std::string::npos ? 0 : std::atoi(header.c_str() + pos + sizeof("CSeq: ")-1);
+                r.close = header.find("Connection: close\r\n") != std::string::npos;
+                r.body = in.substr(end + 4, clen);
+                res.push_back(r);
+                in.erase(0, end + 4 + clen);
+            }
+        }
+
+        if (rest){
+            *rest = in;
+        }
+
+        return open;
+    }
+
+    /**
+     * Whether the connection was closed by the server (after any pending data).
+     */
+    bool closed(int fd)
+    {
+        for(int i = 0; i < 2000; i++){
+            aes67_rtsp_srv_process(&srv);
+
+            char buf[256];
+            ssize_t rlen = recv(fd, buf, sizeof(buf), 0);
+            if (rlen == 0 || (rlen == -1 && errno != EAGAIN && errno != EWOULDBLOCK)){
+                return true;
+            }
+            if (rlen > 0){
+                continue;
+            }
+            if (i > 100){
+                return false;
+            }
+            usleep(1000);
+        }
+        return false;
+    }
+};
+
+TEST(RTSP_SRV_TestGroup, pipelined)
+{
+    int fd = connect_client();
+
+    // all requests in one segment, one not found in between
+    send(fd, describe("a", 1) + describe("nope", 2) + describe("b", 3));
+
+    std::vector<response_st> res;
+    CHECK_TRUE(responses(fd, res, 3));
+    CHECK_EQUAL(3, res.size());
+
+    CHECK_EQUAL(AES67_RTSP_STATUS_OK, res[0].status);
+    CHECK_EQUAL(1, res[0].cseq);
+    CHECK_TRUE(res[0].body == sdps[&a]);
+
+    CHECK_EQUAL(AES67_RTSP_STATUS_NOT_FOUND, res[1].status);
+    CHECK_EQUAL(2, res[1].cseq);
+    CHECK_TRUE(res[1].body.empty());
+
+    CHECK_EQUAL(AES67_RTSP_STATUS_OK, res[2].status);
+    CHECK_EQUAL(3, res[2].cseq);
+    CHECK_TRUE(res[2].body == sdps[&b]);
+    CHECK_FALSE(res[2].close);
+
+    // rendered once per resource
+    CHECK_EQUAL(2, getter_calls);
+
+    // split across segments (and the connection kept alive)
+    std::string req = describe("a", 4) + describe("b", 5);
+    send(fd, req.substr(0, 10));
+    process();
+    send(fd, req.substr(10, req.size() / 2));
+    process();
+    send(fd, req.substr(10 + req.size() / 2));
+
+    res.clear();
+    CHECK_TRUE(responses(fd, res, 2));
+    CHECK_EQUAL(2, res.size());
+    CHECK_EQUAL(4, res[0].cseq);
+    CHECK_TRUE(res[0].body == sdps[&a]);
+    CHECK_EQUAL(5, res[1].cseq);
+    CHECK_TRUE(res[1].body == sdps[&b]);
+
+    CHECK_EQUAL(1, srv.nconn);
+}
+
+TEST(RTSP_SRV_TestGroup, slow_client)
+{
+    int slow = connect_client();
+    int fast = connect_client();
+
+    // incomplete request (and nothing more for now)
+    std::string req = describe("a", 7);
+    send(slow, req.substr(0, req.size() - 5));
+    process();
+
+    send(fast, describe("b", 1));
+
+    std::vector<response_st> res;
+    CHECK_TRUE(responses(fast, res, 1));
+    CHECK_EQUAL(1, res.size());
+    CHECK_EQUAL(1, res[0].cseq);
+    CHECK_TRUE(res[0].body == sdps[&b]);
+
+    // slow client did not receive anything
+    char buf[16];
+    CHECK_EQUAL(-1, recv(slow, buf, sizeof(buf), 0));
+
+    // but is served once complete
+    send(slow, req.substr(req.size() - 5));
+
+    res.clear();
+    CHECK_TRUE(responses(slow, res, 1));
+    CHECK_EQUAL(1, res.size());
+    CHECK_EQUAL(7, res[0].cseq);
+    CHECK_TRUE(res[0].body == sdps[&a]);
+}
+
+TEST(RTSP_SRV_TestGroup, connection_close)
+{
+    int fd = connect_client();
+
+    // anything pipelined after a closing request is discarded
+    send(fd, describe("a", 1, "Connection: close\r\n") + describe("b", 2));
+
+    std::vector<response_st> res;
+    std::string rest;
+    responses(fd, res, 2, &rest);
+
+    CHECK_EQUAL(1, res.size());
+    CHECK_EQUAL(AES67_RTSP_STATUS_OK, res[0].status);
+    CHECK_EQUAL(1, res[0].cseq);
+    CHECK_TRUE(res[0].close);
+    CHECK_TRUE(res[0].body == sdps[&a]);
+    CHECK_TRUE(rest.empty());
+
+    CHECK_TRUE(closed(fd));
+    CHECK_EQUAL(0, srv.nconn);
+}
+
+TEST(RTSP_SRV_TestGroup, evict_idle)
+{
+    std::vector<int> fds;
+    std::vector<response_st> res;
+
+    for(int i = 0; i < AES67_RTSP_SRV_MAXCONN; i++){
+        int fd = connect_client();
+        send(fd, describe("a", i + 1));
+        CHECK_TRUE(responses(fd, res, i + 1));
+        fds.push_back(fd);
+    }
+    CHECK_EQUAL(AES67_RTSP_SRV_MAXCONN, srv.nconn);
+
+    // let (the server side of) one in the middle be the longest idle
+    int oldest = fds[AES67_RTSP_SRV_MAXCONN / 2];
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    CHECK_EQUAL(0, getsockname(oldest, (struct sockaddr*)&addr, &addrlen));
+
+    bool found = false;
+    for(int i = 0; i < AES67_RTSP_SRV_MAXCONN; i++){
+        if (srv.conn[i].addr.sin_port == addr.sin_port){
+            srv.conn[i].last_activity -= 5;
+            found = true;
+        }
+    }
+    CHECK_TRUE(found);
+
+    // new connection takes its place and is served
+    int fd = connect_client();
+    send(fd, describe("b", 100));
+
+    res.clear();
+    CHECK_TRUE(responses(fd, res, 1));
+    CHECK_EQUAL(1, res.size());
+    CHECK_EQUAL(100, res[0].cseq);
+    CHECK_EQUAL(AES67_RTSP_SRV_MAXCONN, srv.nconn);
+
+    CHECK_TRUE(closed(oldest));
+
+    // all others are still alive
+    for(int other : fds){
+        if (other == oldest){
+            continue;
+        }
+        send(other, describe("b", 200));
+        res.clear();
+        CHECK_TRUE(responses(other, res, 1));
+        CHECK_EQUAL(200, res[0].cseq);
+    }
+}
+
+TEST(RTSP_SRV_TestGroup, evict_none_busy)
+{
+    std::vector<int> fds;
+
+    // all connections with a pending (incomplete) request, ie none idle
+    for(int i = 0; i < AES67_RTSP_SRV_MAXCONN; i++){
+        int fd = connect_client();
+        send(fd, "DESCRIBE rtsp://");
+        fds.push_back(fd);
+    }
+    process();
+    CHECK_EQUAL(AES67_RTSP_SRV_MAXCONN, srv.nconn);
+
+    // is left in the backlog
+    int fd = connect_client();
+    send(fd, describe("b", 1));
+
+    process(20);
+    char buf[16];
+    CHECK_EQUAL(-1, recv(fd, buf, sizeof(buf), 0));
+
+    // until a slot is freed
+    close(fds[0]);
+    clients.erase(clients.begin());
+
+    std::vector<response_st> res;
+    CHECK_TRUE(responses(fd, res, 1));
+    CHECK_EQUAL(1, res.size());
+    CHECK_EQUAL(1, res[0].cseq);
+}
+
+TEST(RTSP_SRV_TestGroup, oversized)
+{
+    std::vector<response_st> res;
+
+    // request line of excessive length
+    int fd = connect_client();
+    send(fd, "DESCRIBE rtsp://127.0.0.1/" + std::string(300, 'x'));
+    CHECK_FALSE(responses(fd, res, 1));
+    CHECK_EQUAL(0, res.size());
+
+    // header exceeding rx buffer
+    fd = connect_client();
+    std::string req = "DESCRIBE rtsp://127.0.0.1/by-name/a RTSP/1.0\r\nCSeq: 1\r\n";
+    while(req.size() < AES67_RTSP_SRV_RXBUFSIZE + 100){
+        req += "X-Padding: 0123456789abcdef0123456789abcdef\r\n";
+    }
+    send(fd, req);
+    CHECK_FALSE(responses(fd, res, 1));
+    CHECK_EQUAL(0, res.size());
+
+    process();
+    CHECK_EQUAL(0, srv.nconn);
+
+    // server still serving
+    fd = connect_client();
+    send(fd, describe("a", 1));
+    CHECK_TRUE(responses(fd, res, 1));
+    CHECK_EQUAL(1, res.size());
+}
+
+TEST(RTSP_SRV_TestGroup, sdp_changed)
+{
+    int fd = connect_client();
+
+    std::vector<response_st> res;
+
+    send(fd, describe("a", 1));
+    CHECK_TRUE(responses(fd, res, 1));
+    CHECK_TRUE(res[0].body == sdp("a", 1));
+    CHECK_EQUAL(1, getter_calls);
+
+    // served from cache until told otherwise
+    sdps[&a] = sdp("a", 2);
+
+    send(fd, describe("a", 2));
+    CHECK_TRUE(responses(fd, res, 2));
+    CHECK_TRUE(res[1].body == sdp("a", 1));
+    CHECK_EQUAL(1, getter_calls);
+
+    aes67_rtsp_srv_sdp_changed(&srv, &a);
+
+    send(fd, describe("a", 3) + describe("b", 4));
+    CHECK_TRUE(responses(fd, res, 4));
+    CHECK_EQUAL(3, res[2].cseq);
+    CHECK_TRUE(res[2].body == sdp("a", 2));
+    CHECK_TRUE(res[3].body == sdp("b", 1));
+    CHECK_EQUAL(3, getter_calls);
+
+    // other resources are not affected
+    sdps[&b] = sdp("b", 2);
+    aes67_rtsp_srv_sdp_changed(&srv, &a);
+
+    send(fd, describe("b", 5));
+    CHECK_TRUE(responses(fd, res, 5));
+    CHECK_TRUE(res[4].body == sdp("b", 1));
+
+    // nor is anything unknown
+    int unknown;
+    aes67_rtsp_srv_sdp_changed(&srv, &unknown);
+    aes67_rtsp_srv_sdp_remove(&srv, &unknown);
+
+    // many resources (sharing buckets of both indices), every third changed of which every other removed
+    std::vector<int> refs(4 * AES67_RTSP_SRV_URI_HASHSIZE);
+    std::vector<std::string> names;
+    for(size_t i = 0; i < refs.size(); i++){
+        names.push_back("many-" + std::to_string(i));
+        std::string uri = "/by-name/" + names[i];
+        sdps[&refs[i]] = sdp(names[i].c_str(), 1);
+        aes67_rtsp_srv_sdp_add(&srv, uri.c_str(), uri.size(), &refs[i]);
+    }
+    for(size_t i = 0; i < refs.size(); i++){
+        res.clear();
+        send(fd, describe(names[i].c_str(), i));
+        CHECK_TRUE(responses(fd, res, 1));
+    }
+    for(size_t i = 0; i < refs.size(); i += 3){
+        sdps[&refs[i]] = sdp(names[i].c_str(), 2);
+        aes67_rtsp_srv_sdp_changed(&srv, &refs[i]);
+        if (i % 2){
+            aes67_rtsp_srv_sdp_remove(&srv, &refs[i]);
+        }
+    }
+    for(size_t i = 0; i < refs.size(); i++){
+        res.clear();
+        send(fd, describe(names[i].c_str(), i));
+        CHECK_TRUE(responses(fd, res, 1));
+        CHECK_EQUAL(i, res[0].cseq);
+        if (i % 3){
+            CHECK_EQUAL(AES67_RTSP_STATUS_OK, res[0].status);
+            CHECK_TRUE(res[0].body == sdp(names[i].c_str(), 1));
+        } else if (i % 2){
+            CHECK_EQUAL(AES67_RTSP_STATUS_NOT_FOUND, res[0].status);
+        } else {
+            CHECK_EQUAL(AES67_RTSP_STATUS_OK, res[0].status);
+            CHECK_TRUE(res[0].body == sdp(names[i].c_str(), 2));
+        }
+    }
+}
+
+TEST(RTSP_SRV_TestGroup, sdp_remove_while_sending)
+{
+    // large SDP, ie few responses fill the (reduced) socket buffers
+    std::string large = sdp("a", 1) + "i=" + std::string(1200, 'x') + "\r\n";
+    sdps[&a] = large;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK_TRUE(fd != -1);
+    clients.push_back(fd);
+
+    int size = 2048;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(TEST_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK_EQUAL(0, connect(fd, (struct sockaddr*)&addr, sizeof(addr)));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    process();
+
+    CHECK_EQUAL(1, srv.nconn);
+    struct aes67_rtsp_srv_conn * conn = NULL;
+    for(int i = 0; i < AES67_RTSP_SRV_MAXCONN; i++){
+        if (srv.conn[i].state != aes67_rtsp_srv_state_init){
+            conn = &srv.conn[i];
+        }
+    }
+    CHECK_TRUE(conn != NULL);
+    setsockopt(conn->sockfd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+    // as many pipelined requests as fit into the rx buffer (without reading any response)
+    std::string req;
+    u16_t count = 0;
+    while(req.size() + describe("a", count + 1).size() <= AES67_RTSP_SRV_RXBUFSIZE){
+        req += describe("a", ++count);
+    }
+    send(fd, req);
+
+    // until stuck sending a response
+    for(int i = 0; i < 100 && !(conn->state == aes67_rtsp_srv_state_sending && conn->res.sent > 0); i++){
+        process(1);
+    }
+    CHECK_EQUAL(aes67_rtsp_srv_state_sending, conn->state);
+    CHECK_TRUE(conn->res.body != NULL);
+    CHECK_TRUE(conn->res.sent < conn->res.len + conn->res.body->len);
+    CHECK_EQUAL(2, conn->res.body->refs);
+
+    u16_t stuck = conn->req.cseq;
+    CHECK_TRUE(stuck < count);
+
+    // the connection keeps the only reference
+    aes67_rtsp_srv_sdp_remove(&srv, &a);
+    sdps.erase(&a);
+
+    CHECK_EQUAL(1, conn->res.body->refs);
+
+    // response in progress is completed, later requests are not found
+    std::vector<response_st> res;
+    CHECK_TRUE(responses(fd, res, count));
+    CHECK_EQUAL(count, res.size());
+
+    for(u16_t i = 0; i < count; i++){
+        CHECK_EQUAL(i + 1, res[i].cseq);
+        if (res[i].cseq <= stuck){
+            CHECK_EQUAL(AES67_RTSP_STATUS_OK, res[i].status);
+            CHECK_TRUE(res[i].body == large);
+        } else {
+            CHECK_EQUAL(AES67_RTSP_STATUS_NOT_FOUND, res[i].status);
+            CHECK_TRUE(res[i].body.empty());
+        }
+    }
+    CHECK_TRUE(conn->res.body == NULL);
+}
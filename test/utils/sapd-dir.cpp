@@ -0,0 +1,262 @@
+/**
+ * AES67 Framework
+ * Copyright (C) 2021  Philip Tschiemer, https://github.com/tschiemer/aes67
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CppUTest/TestHarness.h"
+
+#include "aes67/utils/sapd-dir.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <pthread.h>
+
+static struct aes67_sdp_originator origin(u32_t id, u32_t version)
+{
+    struct aes67_sdp_originator o;
+    char str[128];
+
+    int len = std::snprintf(str, sizeof(str), "o=- %u %u IN IP4 10.0.0.1\r\n", id, version);
+
+    LONGS_EQUAL(AES67_SDP_OK, aes67_sdp_origin_fromstr(&o, (u8_t*)str, len));
+
+    return o;
+}
+
+static int payload(char * buf, size_t maxlen, u32_t id, u32_t version)
+{
+    return std::snprintf(buf, maxlen, "v=0\r\no=- %u %u IN IP4 10.0.0.1\r\ns=session %u\r\n", id, version, id);
+}
+
+static int add(struct aes67_sapd_dir * dir, u32_t id, u32_t version)
+{
+    struct aes67_sdp_originator o = origin(id, version);
+    char buf[256];
+    int len = payload(buf, sizeof(buf), id, version);
+
+    return aes67_sapd_dir_add(dir, &o, 0, 1, 0, (u8_t*)buf, len);
+}
+
+TEST_GROUP(SAPD_DIR_TestGroup)
+{
+    struct aes67_sapd_dir * writer;
+    struct aes67_sapd_dir * reader;
+
+    void setup()
+    {
+        writer = aes67_sapd_dir_create(8, 4096);
+        CHECK_TRUE(writer != NULL);
+
+        reader = aes67_sapd_dir_open();
+        CHECK_TRUE(reader != NULL);
+    }
+
+    void teardown()
+    {
+        aes67_sapd_dir_close(reader);
+        aes67_sapd_dir_destroy(writer);
+    }
+};
+
+TEST(SAPD_DIR_TestGroup, lookup)
+{
+    struct aes67_sapd_dir_record record;
+    u8_t buf[256];
+    char expected[256];
+
+    aes67_sapd_dir_begin(writer);
+    for(u32_t id = 1; id <= 8; id++){
+        LONGS_EQUAL(EXIT_SUCCESS, add(writer, id, 100 + id));
+    }
+    aes67_sapd_dir_commit(writer);
+
+    LONGS_EQUAL(0, reader->header->flags);
+    LONGS_EQUAL(8, reader->header->count);
+
+    for(u32_t id = 1; id <= 8; id++){
+        struct aes67_sdp_originator o = origin(id, 1);
+
+        ssize_t len = aes67_sapd_dir_lookup(reader, &o, &record, buf, sizeof(buf));
+
+        LONGS_EQUAL(payload(expected, sizeof(expected), id, 100 + id), len);
+        MEMCMP_EQUAL(expected, buf, len);
+
+        std::snprintf(expected, sizeof(expected), "%u", 100 + id);
+        STRCMP_EQUAL(expected, record.version);
+
+        std::snprintf(expected, sizeof(expected), "- %u IN IP4 10.0.0.1", id);
+        STRCMP_EQUAL(expected, record.key);
+    }
+
+    // unknown session
+    struct aes67_sdp_originator o = origin(9, 1);
+    LONGS_EQUAL(-1, aes67_sapd_dir_lookup(reader, &o, &record, buf, sizeof(buf)));
+
+    // by index
+    CHECK_TRUE(aes67_sapd_dir_get(reader, 7, &record, buf, sizeof(buf)) > 0);
+    LONGS_EQUAL(-1, aes67_sapd_dir_get(reader, 8, &record, buf, sizeof(buf)));
+
+    // payload buffer too small
+    o = origin(1, 1);
+    LONGS_EQUAL(-1, aes67_sapd_dir_lookup(reader, &o, &record, buf, 8));
+}
+
+TEST(SAPD_DIR_TestGroup, update)
+{
+    struct aes67_sapd_dir_record record;
+    u8_t buf[256];
+    struct aes67_sdp_originator o = origin(1, 1);
+
+    aes67_sapd_dir_begin(writer);
+    add(writer, 1, 1);
+    add(writer, 2, 1);
+    aes67_sapd_dir_commit(writer);
+
+    u32_t seq = aes67_sapd_dir_seq(reader);
+    LONGS_EQUAL(0, seq & 1);
+
+    // sessions that are gone are not found anymore (also not through stale index entries)
+    aes67_sapd_dir_begin(writer);
+    add(writer, 2, 2);
+    aes67_sapd_dir_commit(writer);
+
+    CHECK_TRUE(seq != aes67_sapd_dir_seq(reader));
+
+    LONGS_EQUAL(-1, aes67_sapd_dir_lookup(reader, &o, &record, buf, sizeof(buf)));
+
+    o = origin(2, 1);
+    CHECK_TRUE(aes67_sapd_dir_lookup(reader, &o, &record, buf, sizeof(buf)) > 0);
+    STRCMP_EQUAL("2", record.version);
+}
+
+TEST(SAPD_DIR_TestGroup, truncated)
+{
+    aes67_sapd_dir_begin(writer);
+
+    // origin too long for a record
+    struct aes67_sdp_originator o = origin(1, 1);
+    std::memset(o.address.data, 'a', sizeof(o.address.data));
+    o.address.length = sizeof(o.address.data);
+
+    if (o.address.length + 32 >= AES67_SAPD_DIR_KEYLEN){
+        LONGS_EQUAL(EXIT_FAILURE, aes67_sapd_dir_add(writer, &o, 0, 1, 0, (u8_t*)"v=0\r\n", 5));
+        LONGS_EQUAL(AES67_SAPD_DIR_FLAG_TRUNCATED, writer->header->flags);
+    }
+
+    // other sessions are still added
+    for(u32_t id = 1; id <= 8; id++){
+        LONGS_EQUAL(EXIT_SUCCESS, add(writer, id, 1));
+    }
+
+    // full
+    LONGS_EQUAL(EXIT_FAILURE, add(writer, 9, 1));
+    LONGS_EQUAL(AES67_SAPD_DIR_FLAG_TRUNCATED, writer->header->flags);
+
+    aes67_sapd_dir_commit(writer);
+
+    LONGS_EQUAL(8, reader->header->count);
+
+    // flags are reset with every update
+    aes67_sapd_dir_begin(writer);
+    add(writer, 1, 1);
+    aes67_sapd_dir_commit(writer);
+
+    LONGS_EQUAL(0, reader->header->flags);
+}
+
+TEST(SAPD_DIR_TestGroup, writer_stuck)
+{
+    struct aes67_sapd_dir_record record;
+    u8_t buf[256];
+    struct aes67_sdp_originator o = origin(1, 1);
+
+    aes67_sapd_dir_begin(writer);
+    add(writer, 1, 1);
+    aes67_sapd_dir_commit(writer);
+
+    // an update that is not completed (ie writer died) must not block readers
+    aes67_sapd_dir_begin(writer);
+
+    LONGS_EQUAL(1, aes67_sapd_dir_seq(reader) & 1);
+    LONGS_EQUAL(-1, aes67_sapd_dir_lookup(reader, &o, &record, buf, sizeof(buf)));
+    LONGS_EQUAL(-1, aes67_sapd_dir_get(reader, 0, &record, buf, sizeof(buf)));
+
+    add(writer, 1, 1);
+    aes67_sapd_dir_commit(writer);
+
+    CHECK_TRUE(aes67_sapd_dir_lookup(reader, &o, &record, buf, sizeof(buf)) > 0);
+}
+
+static struct aes67_sapd_dir * concurrent_writer;
+static volatile bool concurrent_done;
+
+static void * concurrent_write(void * arg)
+{
+    for(u32_t version = 1; version <= 5000; version++){
+        aes67_sapd_dir_begin(concurrent_writer);
+        // (varying set of sessions, ie index and heap layout change)
+        for(u32_t id = version % 3; id < 8; id++){
+            add(concurrent_writer, id, version);
+        }
+        aes67_sapd_dir_commit(concurrent_writer);
+    }
+
+    __atomic_store_n(&concurrent_done, true, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+TEST(SAPD_DIR_TestGroup, concurrent)
+{
+    struct aes67_sapd_dir_record record;
+    u8_t buf[256];
+    char expected[256];
+    pthread_t thread;
+
+    concurrent_writer = writer;
+    concurrent_done = false;
+
+    CHECK_EQUAL(0, pthread_create(&thread, NULL, concurrent_write, NULL));
+
+    u32_t found = 0;
+
+    // every record read must be consistent with its payload
+    bool done;
+    do {
+        done = __atomic_load_n(&concurrent_done, __ATOMIC_ACQUIRE);
+
+        for(u32_t id = 0; id < 8; id++){
+            struct aes67_sdp_originator o = origin(id, 0);
+
+            ssize_t len = aes67_sapd_dir_lookup(reader, &o, &record, buf, sizeof(buf));
+            if (len == -1){
+                continue;
+            }
+
+            int elen = payload(expected, sizeof(expected), id, std::atoi(record.version));
+
+            LONGS_EQUAL(elen, len);
+            MEMCMP_EQUAL(expected, buf, elen);
+
+            found++;
+        }
+    } while(!done);
+
+    pthread_join(thread, NULL);
+
+    CHECK_TRUE(found > 0);
+}
@@ -0,0 +1,190 @@
+/**
+ * AES67 Framework
+ * Copyright (C) 2021  Philip Tschiemer, https://github.com/tschiemer/aes67
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CppUTest/TestHarness.h"
+
+#include "aes67/utils/sapsrv.h"
+#include "aes67/sap.h"
+
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#if AES67_SAPSRV_THREADED != 1
+#error to be built with AES67_SAPSRV_THREADED = 1
+#endif
+
+// (not the same as non-threaded tests, in case both run in parallel)
+#define TEST_PORT   19876
+
+static struct {
+    u32_t discovered;
+    u32_t deleted;
+    u32_t other;
+    u32_t foreign_thread;
+    enum aes67_sapsrv_event last;
+} events;
+
+static pthread_t loop_thread;
+
+static void event_handler(aes67_sapsrv_t server, aes67_sapsrv_session_t session, enum aes67_sapsrv_event event, const struct aes67_sdp_originator * origin, u8_t * payload, u16_t payloadlen, void * user_data)
+{
+    // events are to be delivered in the thread calling aes67_sapsrv_process*() only
+    if (!pthread_equal(pthread_self(), loop_thread)){
+        events.foreign_thread++;
+    }
+
+    if (event == aes67_sapsrv_event_discovered){
+        events.discovered++;
+    } else if (event == aes67_sapsrv_event_deleted){
+        events.deleted++;
+    } else {
+        events.other++;
+    }
+    events.last = event;
+}
+
+TEST_GROUP(SAPSRV_Threaded_TestGroup)
+{
+    aes67_sapsrv_t server;
+    int sockfd;
+    int notifyfd;
+
+    void setup()
+    {
+        std::memset(&events, 0, sizeof(events));
+
+        loop_thread = pthread_self();
+
+        aes67_time_init_system();
+        aes67_timer_init_system();
+
+        server = aes67_sapsrv_start(AES67_SAPSRV_SCOPE_IPv4_ADMINISTERED, TEST_PORT, AES67_SAPSRV_SCOPE_IPv4_ADMINISTERED, 0, event_handler, NULL);
+        CHECK_TRUE(server != NULL);
+
+        aes67_sapsrv_setblocking(server, false);
+
+        int * fds;
+        size_t count;
+        aes67_sapsrv_getsockfds(server, &fds, &count);
+
+        // the host only waits for the notification fd
+        CHECK_EQUAL(1, count);
+        notifyfd = fds[0];
+
+        sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+        CHECK_TRUE(sockfd != -1);
+    }
+
+    void teardown()
+    {
+        close(sockfd);
+
+        aes67_sapsrv_stop(server);
+
+        aes67_timer_deinit_system();
+        aes67_time_deinit_system();
+    }
+
+    void send(const u8_t * data, size_t len)
+    {
+        struct sockaddr_in addr;
+
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(TEST_PORT);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        LONGS_EQUAL(len, sendto(sockfd, data, len, 0, (struct sockaddr*)&addr, sizeof(addr)));
+    }
+
+    // wait for io thread to signal events
+    bool notified()
+    {
+        struct pollfd pfd = {
+            .fd = notifyfd,
+            .events = POLLIN
+        };
+
+        return poll(&pfd, 1, 1000) == 1;
+    }
+};
+
+static u16_t announcement(u8_t * msg, u16_t hash, u8_t msgtype = AES67_SAP_STATUS_MSGTYPE_ANNOUNCE)
+{
+    msg[AES67_SAP_STATUS] = AES67_SAP_STATUS_VERSION_2 | AES67_SAP_STATUS_ADDRTYPE_IPv4 | msgtype;
+    msg[AES67_SAP_AUTH_LEN] = 0;
+    msg[AES67_SAP_MSG_ID_HASH] = hash >> 8;
+    msg[AES67_SAP_MSG_ID_HASH + 1] = hash & 0xff;
+    std::memcpy(&msg[AES67_SAP_ORIGIN_SRC], "\x0a\x00\x00\x01", 4);
+
+    u16_t len = AES67_SAP_ORIGIN_SRC + 4;
+
+    std::memcpy(&msg[len], AES67_SDP_MIMETYPE, sizeof(AES67_SDP_MIMETYPE));
+    len += sizeof(AES67_SDP_MIMETYPE);
+
+    len += std::sprintf((char*)&msg[len], "v=0\r\n"
+                                          "o=- %hu 1 IN IP4 10.0.0.1\r\n"
+                                          "s=test\r\n"
+                                          "t=0 0\r\n", hash);
+
+    return len;
+}
+
+TEST(SAPSRV_Threaded_TestGroup, events_in_loop_thread)
+{
+    u8_t msg[256] = {0};
+
+    send(msg, announcement(msg, 1234));
+
+    CHECK_TRUE(notified());
+
+    // received by the io thread, but not delivered until the host processes
+    CHECK_EQUAL(0, events.discovered);
+
+    aes67_sapsrv_lock(server);
+    aes67_sapsrv_session_t session = aes67_sapsrv_session_first(server);
+    CHECK_TRUE(session != NULL);
+    aes67_sapsrv_unlock(server);
+
+    aes67_sapsrv_process_sockfd(server, notifyfd);
+
+    CHECK_EQUAL(1, events.discovered);
+    CHECK_EQUAL(0, events.foreign_thread);
+
+    // several events are delivered in order (and notified once)
+    send(msg, announcement(msg, 1235));
+    send(msg, announcement(msg, 1235, AES67_SAP_STATUS_MSGTYPE_DELETE));
+
+    // (both messages have been handled once the session is gone again)
+    for(int i = 0; i < 100 && events.deleted == 0; i++){
+        CHECK_TRUE(notified());
+        aes67_sapsrv_process(server);
+    }
+
+    CHECK_EQUAL(2, events.discovered);
+    CHECK_EQUAL(1, events.deleted);
+    CHECK_EQUAL(aes67_sapsrv_event_deleted, events.last);
+    CHECK_EQUAL(0, events.other);
+    CHECK_EQUAL(0, events.foreign_thread);
+}
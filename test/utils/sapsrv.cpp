@@ -0,0 +1,466 @@
+/**
+ * AES67 Framework
+ * Copyright (C) 2021  Philip Tschiemer, https://github.com/tschiemer/aes67
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CppUTest/TestHarness.h"
+
+#include "aes67/utils/sapsrv.h"
+#include "aes67/sap.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// (unlikely to collide with anything else)
+#define TEST_PORT   19875
+
+static struct {
+    u32_t discovered;
+    u32_t updated;
+    u32_t deleted;
+    u32_t other;
+} events;
+
+static void event_handler(aes67_sapsrv_t server, aes67_sapsrv_session_t session, enum aes67_sapsrv_event event, const struct aes67_sdp_originator * origin, u8_t * payload, u16_t payloadlen, void * user_data)
+{
+    if (event == aes67_sapsrv_event_discovered){
+        events.discovered++;
+    } else if (event == aes67_sapsrv_event_updated){
+        events.updated++;
+    } else if (event == aes67_sapsrv_event_deleted){
+        events.deleted++;
+    } else {
+        events.other++;
+    }
+}
+
+TEST_GROUP(SAPSRV_TestGroup)
+{
+    aes67_sapsrv_t server;
+    int sockfd;
+
+    void setup()
+    {
+        std::memset(&events, 0, sizeof(events));
+
+        aes67_time_init_system();
+        aes67_timer_init_system();
+
+        server = aes67_sapsrv_start(AES67_SAPSRV_SCOPE_IPv4_ADMINISTERED, TEST_PORT, AES67_SAPSRV_SCOPE_IPv4_ADMINISTERED, 0, event_handler, NULL);
+        CHECK_TRUE(server != NULL);
+
+        aes67_sapsrv_setblocking(server, false);
+
+        sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+        CHECK_TRUE(sockfd != -1);
+    }
+
+    void teardown()
+    {
+        close(sockfd);
+
+        aes67_sapsrv_stop(server);
+
+        aes67_timer_deinit_system();
+        aes67_time_deinit_system();
+    }
+
+    void send(const u8_t * data, size_t len)
+    {
+        struct sockaddr_in addr;
+
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(TEST_PORT);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        LONGS_EQUAL(len, sendto(sockfd, data, len, 0, (struct sockaddr*)&addr, sizeof(addr)));
+    }
+
+    void process()
+    {
+        // (loopback delivery is immediate, but let's not be too strict)
+        usleep(10000);
+
+        aes67_sapsrv_process(server);
+    }
+};
+
+/**
+ * Announcement (or deletion) of a session (with given msg hash as session id unless given)
+ */
+static u16_t announcement(u8_t * msg, u16_t hash, u32_t version = 1, u16_t id = 0, u8_t msgtype = AES67_SAP_STATUS_MSGTYPE_ANNOUNCE)
+{
+    msg[AES67_SAP_STATUS] = AES67_SAP_STATUS_VERSION_2 | AES67_SAP_STATUS_ADDRTYPE_IPv4 | msgtype;
+    msg[AES67_SAP_AUTH_LEN] = 0;
+    msg[AES67_SAP_MSG_ID_HASH] = hash >> 8;
+    msg[AES67_SAP_MSG_ID_HASH + 1] = hash & 0xff;
+    std::memcpy(&msg[AES67_SAP_ORIGIN_SRC], "\x0a\x00\x00\x01", 4);
+
+    u16_t len = AES67_SAP_ORIGIN_SRC + 4;
+
+    std::memcpy(&msg[len], AES67_SDP_MIMETYPE, sizeof(AES67_SDP_MIMETYPE));
+    len += sizeof(AES67_SDP_MIMETYPE);
+
+    len += std::sprintf((char*)&msg[len], "v=0\r\n"
+                                          "o=- %hu %u IN IP4 10.0.0.1\r\n"
+                                          "s=test\r\n"
+                                          "t=0 0\r\n", id ? id : hash, version);
+
+    return len;
+}
+
+TEST(SAPSRV_TestGroup, empty_datagram)
+{
+    u8_t msg[256] = {0};
+
+    // an empty datagram must neither abort nor stop draining the socket
+    send(msg, 0);
+    send(msg, announcement(msg, 1234));
+
+    process();
+
+    CHECK_EQUAL(1, events.discovered);
+    CHECK_EQUAL(0, events.other);
+
+    // and once more on its own
+    send(msg, 0);
+
+    process();
+
+    send(msg, announcement(msg, 1235));
+
+    process();
+
+    CHECK_EQUAL(2, events.discovered);
+    CHECK_EQUAL(0, events.other);
+}
+
+TEST(SAPSRV_TestGroup, by_origin)
+{
+    u8_t msg[256] = {0};
+
+    struct aes67_sdp_originator origin;
+    u8_t ostr[] = "o=- 1234 1 IN IP4 10.0.0.1";
+    CHECK_EQUAL(AES67_SDP_OK, aes67_sdp_origin_fromstr(&origin, ostr, sizeof(ostr) - 1));
+
+    send(msg, announcement(msg, 1234));
+    process();
+
+    CHECK_EQUAL(1, events.discovered);
+
+    aes67_sapsrv_session_t session = aes67_sapsrv_session_by_origin(server, &origin);
+    CHECK_TRUE(session != NULL);
+
+    // a newer version updates the very same session (which is found by any version of its origin)
+    send(msg, announcement(msg, 1234, 2));
+    process();
+
+    CHECK_EQUAL(1, events.updated);
+    CHECK_TRUE(session == aes67_sapsrv_session_by_origin(server, &origin));
+
+    struct aes67_sdp_originator * sorigin = aes67_sapsrv_session_get_origin(session);
+    CHECK_EQUAL(1, sorigin->session_version.length);
+    CHECK_EQUAL('2', sorigin->session_version.data[0]);
+
+    u16_t sdplen = 0;
+    u8_t * sdp = aes67_sapsrv_session_get_sdp(session, &sdplen);
+    CHECK_TRUE(std::strstr((char*)sdp, "o=- 1234 2 IN IP4") != NULL);
+
+    // ... also when announced with another msg hash
+    send(msg, announcement(msg, 4321, 3, 1234));
+    process();
+
+    CHECK_EQUAL(2, events.updated);
+    CHECK_TRUE(session == aes67_sapsrv_session_by_origin(server, &origin));
+    CHECK_TRUE(session == aes67_sapsrv_session_first(server));
+    CHECK_TRUE(NULL == aes67_sapsrv_session_next(session));
+
+    // an outdated version is just a refresh
+    send(msg, announcement(msg, 4321, 2, 1234));
+    process();
+
+    CHECK_EQUAL(2, events.updated);
+    CHECK_EQUAL('3', aes67_sapsrv_session_get_origin(session)->session_version.data[0]);
+
+    // gone once deleted (without resurrecting by any further lookup)
+    send(msg, announcement(msg, 4321, 3, 1234, AES67_SAP_STATUS_MSGTYPE_DELETE));
+    process();
+
+    CHECK_EQUAL(1, events.deleted);
+    CHECK_TRUE(NULL == aes67_sapsrv_session_by_origin(server, &origin));
+    CHECK_TRUE(NULL == aes67_sapsrv_session_first(server));
+
+    // and rediscovered as new session
+    send(msg, announcement(msg, 1234, 4));
+    process();
+
+    CHECK_EQUAL(2, events.discovered);
+    CHECK_TRUE(NULL != aes67_sapsrv_session_by_origin(server, &origin));
+
+    CHECK_EQUAL(0, events.other);
+}
+
+static std::vector<u8_t> file_read(const char * path)
+{
+    std::vector<u8_t> data;
+
+    FILE * fd = std::fopen(path, "rb");
+    if (fd != NULL){
+        u8_t buf[256];
+        size_t len;
+        while( (len = std::fread(buf, 1, sizeof(buf), fd)) > 0){
+            data.insert(data.end(), buf, buf + len);
+        }
+        std::fclose(fd);
+    }
+
+    return data;
+}
+
+static void file_write(const char * path, const u8_t * data, size_t len)
+{
+    FILE * fd = std::fopen(path, "wb");
+    CHECK_TRUE(fd != NULL);
+    CHECK_EQUAL(len, std::fwrite(data, 1, len, fd));
+    std::fclose(fd);
+}
+
+TEST(SAPSRV_TestGroup, snapshot)
+{
+    u8_t msg[256] = {0};
+
+    char path[64];
+    std::snprintf(path, sizeof(path), "/tmp/aes67-sapsrv-test-%d.snapshot", getpid());
+
+    for(u16_t hash = 1000; hash < 1003; hash++){
+        send(msg, announcement(msg, hash));
+    }
+    process();
+
+    CHECK_EQUAL(3, events.discovered);
+
+    CHECK_EQUAL(EXIT_SUCCESS, aes67_sapsrv_snapshot_save(server, path));
+
+    // restart with empty state
+    aes67_sapsrv_stop(server);
+    server = aes67_sapsrv_start(AES67_SAPSRV_SCOPE_IPv4_ADMINISTERED, TEST_PORT, AES67_SAPSRV_SCOPE_IPv4_ADMINISTERED, 0, event_handler, NULL);
+    CHECK_TRUE(server != NULL);
+    aes67_sapsrv_setblocking(server, false);
+
+    std::memset(&events, 0, sizeof(events));
+
+    CHECK_EQUAL(EXIT_SUCCESS, aes67_sapsrv_snapshot_load(server, path));
+
+    CHECK_EQUAL(3, events.discovered);
+
+    for(u16_t hash = 1000; hash < 1003; hash++){
+        struct aes67_sdp_originator origin;
+        u8_t ostr[64];
+        u16_t olen = std::sprintf((char*)ostr, "o=- %hu 1 IN IP4 10.0.0.1", hash);
+        CHECK_EQUAL(AES67_SDP_OK, aes67_sdp_origin_fromstr(&origin, ostr, olen));
+
+        aes67_sapsrv_session_t session = aes67_sapsrv_session_by_origin(server, &origin);
+        CHECK_TRUE(session != NULL);
+        if (session == NULL){
+            continue;
+        }
+
+        CHECK_TRUE(aes67_sapsrv_session_is_provisional(session));
+        CHECK_EQUAL(AES67_SAPSRV_MANAGEDBY_REMOTE, aes67_sapsrv_session_get_managedby(session));
+
+        u16_t sdplen = 0;
+        u8_t * sdp = aes67_sapsrv_session_get_sdp(session, &sdplen);
+        u16_t len = announcement(msg, hash);
+        CHECK_EQUAL(len - (AES67_SAP_ORIGIN_SRC + 4 + sizeof(AES67_SDP_MIMETYPE)), sdplen);
+        MEMCMP_EQUAL(&msg[AES67_SAP_ORIGIN_SRC + 4 + sizeof(AES67_SDP_MIMETYPE)], sdp, sdplen);
+    }
+
+    // announced again, a session is confirmed (and not discovered twice)
+    send(msg, announcement(msg, 1000));
+    process();
+
+    CHECK_EQUAL(3, events.discovered);
+
+    // known sessions are not restored twice
+    CHECK_EQUAL(EXIT_SUCCESS, aes67_sapsrv_snapshot_load(server, path));
+    CHECK_EQUAL(3, events.discovered);
+
+    std::vector<u8_t> data = file_read(path);
+
+    // header (magic, version, count, size) and at least one record
+    CHECK_COMPARE(16, <, data.size());
+    if (data.size() <= 16){
+        return;
+    }
+
+    // broken files are rejected as a whole (on an empty server)
+    aes67_sapsrv_stop(server);
+    server = aes67_sapsrv_start(AES67_SAPSRV_SCOPE_IPv4_ADMINISTERED, TEST_PORT, AES67_SAPSRV_SCOPE_IPv4_ADMINISTERED, 0, event_handler, NULL);
+    CHECK_TRUE(server != NULL);
+    aes67_sapsrv_setblocking(server, false);
+
+    std::memset(&events, 0, sizeof(events));
+
+    std::vector<u8_t> broken;
+
+    // missing
+    unlink(path);
+    CHECK_EQUAL(EXIT_FAILURE, aes67_sapsrv_snapshot_load(server, path));
+
+    // truncated (within header, within a record)
+    for(size_t len : {(size_t)0, (size_t)8, data.size() / 2, data.size() - 1}){
+        file_write(path, data.data(), len);
+        CHECK_EQUAL(EXIT_FAILURE, aes67_sapsrv_snapshot_load(server, path));
+    }
+
+    // wrong magic
+    broken = data;
+    broken[0] ^= 0xff;
+    file_write(path, broken.data(), broken.size());
+    CHECK_EQUAL(EXIT_FAILURE, aes67_sapsrv_snapshot_load(server, path));
+
+    // wrong version
+    broken = data;
+    broken[4] ^= 0xff;
+    file_write(path, broken.data(), broken.size());
+    CHECK_EQUAL(EXIT_FAILURE, aes67_sapsrv_snapshot_load(server, path));
+
+    // record count not matching records
+    broken = data;
+    broken[8] += 1;
+    file_write(path, broken.data(), broken.size());
+    CHECK_EQUAL(EXIT_FAILURE, aes67_sapsrv_snapshot_load(server, path));
+
+    // payload length of first record beyond file (record: last activity, ifaces, hash, payloadlen)
+    broken = data;
+    broken[16 + 8 + 4 + 2] = 0xff;
+    broken[16 + 8 + 4 + 2 + 1] = 0xff;
+    file_write(path, broken.data(), broken.size());
+    CHECK_EQUAL(EXIT_FAILURE, aes67_sapsrv_snapshot_load(server, path));
+
+    // trailing garbage
+    broken = data;
+    broken.insert(broken.end(), 8, 0);
+    file_write(path, broken.data(), broken.size());
+    CHECK_EQUAL(EXIT_FAILURE, aes67_sapsrv_snapshot_load(server, path));
+
+    CHECK_EQUAL(0, events.discovered);
+    CHECK_TRUE(NULL == aes67_sapsrv_session_first(server));
+
+    // and the original once more
+    file_write(path, data.data(), data.size());
+    CHECK_EQUAL(EXIT_SUCCESS, aes67_sapsrv_snapshot_load(server, path));
+    CHECK_EQUAL(3, events.discovered);
+
+    unlink(path);
+}
+
+/**
+ * (Locally managed) session payload with given session id
+ */
+static u16_t local_sdp(u8_t * sdp, u32_t id, u32_t version = 1)
+{
+    return std::sprintf((char*)sdp, "v=0\r\n"
+                                    "o=- %u %u IN IP4 10.0.0.2\r\n"
+                                    "s=local\r\n"
+                                    "t=0 0\r\n", id, version);
+}
+
+TEST(SAPSRV_TestGroup, changed_since)
+{
+    u8_t sdp[256];
+    const u8_t ip[] = {10, 0, 0, 2};
+
+    uint64_t seq0 = aes67_sapsrv_changes_seq(server);
+
+    // nothing forgotten yet
+    CHECK_EQUAL(seq0, aes67_sapsrv_changes_horizon(server));
+    CHECK_TRUE(NULL == aes67_sapsrv_session_changed_since(server, seq0));
+
+    aes67_sapsrv_session_t a = aes67_sapsrv_session_add(server, 1, aes67_net_ipver_4, ip, sdp, local_sdp(sdp, 1));
+    aes67_sapsrv_session_t b = aes67_sapsrv_session_add(server, 2, aes67_net_ipver_4, ip, sdp, local_sdp(sdp, 2));
+    CHECK_TRUE(a != NULL && b != NULL);
+
+    uint64_t seq1 = aes67_sapsrv_changes_seq(server);
+    CHECK_EQUAL(seq0 + 2, seq1);
+
+    // oldest change first
+    CHECK_TRUE(a == aes67_sapsrv_session_changed_since(server, seq0));
+    CHECK_TRUE(b == aes67_sapsrv_session_next_changed(a));
+    CHECK_TRUE(NULL == aes67_sapsrv_session_next_changed(b));
+    CHECK_TRUE(NULL == aes67_sapsrv_session_changed_since(server, seq1));
+
+    // an update moves the session to the end
+    aes67_sapsrv_session_update(server, a, sdp, local_sdp(sdp, 1, 2));
+
+    CHECK_TRUE(a == aes67_sapsrv_session_changed_since(server, seq1));
+    CHECK_TRUE(NULL == aes67_sapsrv_session_next_changed(a));
+    CHECK_TRUE(b == aes67_sapsrv_session_changed_since(server, seq0));
+    CHECK_TRUE(a == aes67_sapsrv_session_next_changed(b));
+
+    // a deletion leaves a tombstone
+    aes67_sapsrv_session_delete(server, b, false);
+
+    uint64_t seq2 = aes67_sapsrv_changes_seq(server);
+    uint64_t tseq = 0;
+
+    CHECK_EQUAL(1, aes67_sapsrv_tombstone_count(server));
+    const struct aes67_sdp_originator * tomb = aes67_sapsrv_tombstone_get(server, 0, &tseq);
+    CHECK_TRUE(tomb != NULL);
+    CHECK_EQUAL(seq2, tseq);
+    CHECK_EQUAL('2', tomb->session_id.data[0]);
+
+    CHECK_TRUE(a == aes67_sapsrv_session_changed_since(server, seq0));
+    CHECK_TRUE(NULL == aes67_sapsrv_session_next_changed(a));
+
+    // still within horizon, ie changes since seq0 can be told completely
+    CHECK_COMPARE(aes67_sapsrv_changes_horizon(server), <=, seq0);
+
+    // forget the first tombstone (and one more), each session added and deleted again
+    for(u32_t i = 0; i <= AES67_SAPSRV_TOMBSTONES; i++){
+        aes67_sapsrv_session_t s = aes67_sapsrv_session_add(server, 3 + i, aes67_net_ipver_4, ip, sdp, local_sdp(sdp, 3 + i));
+        CHECK_TRUE(s != NULL);
+        aes67_sapsrv_session_delete(server, s, false);
+    }
+
+    uint64_t horizon = aes67_sapsrv_changes_horizon(server);
+
+    CHECK_EQUAL(AES67_SAPSRV_TOMBSTONES, aes67_sapsrv_tombstone_count(server));
+
+    // seq0 and seq1 are below the horizon (the deletion of b is forgotten), seq2 is not
+    CHECK_COMPARE(seq1, <, horizon);
+    CHECK_COMPARE(seq2, <, horizon);
+    CHECK_COMPARE(seq2 + 2, ==, horizon);
+
+    // inside the horizon, any tombstone after is still known
+    CHECK_TRUE(aes67_sapsrv_tombstone_get(server, 0, &tseq) != NULL);
+    CHECK_COMPARE(horizon, <, tseq);
+    CHECK_TRUE(aes67_sapsrv_tombstone_get(server, AES67_SAPSRV_TOMBSTONES - 1, &tseq) != NULL);
+    CHECK_EQUAL(aes67_sapsrv_changes_seq(server), tseq);
+    CHECK_TRUE(NULL == aes67_sapsrv_tombstone_get(server, AES67_SAPSRV_TOMBSTONES, &tseq));
+
+    // live sessions are told either way (a full resync starts off all sessions)
+    CHECK_TRUE(a == aes67_sapsrv_session_changed_since(server, seq0));
+    CHECK_TRUE(NULL == aes67_sapsrv_session_changed_since(server, horizon));
+
+    aes67_sapsrv_session_delete(server, a, false);
+}
@@ -0,0 +1,346 @@
+/**
+ * AES67 Framework
+ * Copyright (C) 2021  Philip Tschiemer, https://github.com/tschiemer/aes67
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "CppUTest/TestHarness.h"
+
+#include "aes67/host/time.h"
+#include "aes67/host/timer.h"
+
+// timer wheel of the linux port (ie other ports have no timerfd)
+#ifdef AES67_TIMER_FD
+
+#include <cstdint>
+#include <vector>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+// (see ports/linux/timer.c)
+#define WHEEL_LEVEL1_SPAN   64
+#define WHEEL_LEVEL2_SPAN   4096
+#define WHEEL_LEVEL3_SPAN   (1 << 18)
+#define WHEEL_RANGE         (1 << 24)
+
+static std::vector<struct aes67_timer *> fired;
+
+static struct {
+    u32_t rearm;                    // number of times an expired timer sets itself again
+    u32_t rearm_msec;
+    struct aes67_timer * unset;     // to unset by next callback
+} cb;
+
+static void timer_callback(struct aes67_timer * timer, void * user_data)
+{
+    fired.push_back(timer);
+
+    // as passed to aes67_timer_setcallback()
+    POINTERS_EQUAL(timer, user_data);
+
+    CHECK_EQUAL(aes67_timer_state_expired, aes67_timer_getstate(timer));
+
+    if (cb.unset != NULL){
+        aes67_timer_unset(cb.unset);
+        cb.unset = NULL;
+    }
+    if (cb.rearm > 0){
+        cb.rearm--;
+        aes67_timer_set(timer, cb.rearm_msec);
+    }
+}
+
+static uint64_t monotonic_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+TEST_GROUP(TIMER_TestGroup)
+{
+    struct aes67_timer timers[4];
+
+    void setup()
+    {
+        fired.clear();
+        cb.rearm = 0;
+        cb.rearm_msec = 0;
+        cb.unset = NULL;
+
+        aes67_time_init_system();
+        aes67_timer_init_system();
+
+        for(size_t i = 0; i < sizeof(timers) / sizeof(timers[0]); i++){
+            aes67_timer_init(&timers[i]);
+            aes67_timer_setcallback(&timers[i], timer_callback, &timers[i]);
+        }
+    }
+
+    void teardown()
+    {
+        // (timers must not remain in the wheel)
+        for(size_t i = 0; i < sizeof(timers) / sizeof(timers[0]); i++){
+            aes67_timer_deinit(&timers[i]);
+        }
+
+        aes67_timer_deinit_system();
+        aes67_time_deinit_system();
+    }
+
+    // msec until timerfd expires (-1 if disarmed)
+    s32_t armed()
+    {
+        struct itimerspec its;
+        CHECK_EQUAL(0, timerfd_gettime(aes67_timer_getfd(), &its));
+        if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0){
+            return -1;
+        }
+        return its.it_value.tv_sec * 1000 + its.it_value.tv_nsec / 1000000;
+    }
+
+    // as the host would, ie wait for the timerfd to become readable
+    bool ready(int timeout_msec)
+    {
+        struct pollfd pfd = {aes67_timer_getfd(), POLLIN, 0};
+        return poll(&pfd, 1, timeout_msec) == 1;
+    }
+};
+
+TEST(TIMER_TestGroup, short)
+{
+    CHECK_EQUAL(-1, armed());
+
+    aes67_timer_set(&timers[0], 30);
+    aes67_timer_set(&timers[1], 10);
+    aes67_timer_set(&timers[2], 20);
+
+    CHECK_EQUAL(aes67_timer_state_set, aes67_timer_getstate(&timers[0]));
+
+    // armed for the first one
+    CHECK_TRUE(0 <= armed() && armed() <= 10);
+    CHECK_FALSE(ready(0));
+
+    // in order of expiry, one at a time
+    for(size_t i = 0; i < 3; i++){
+        CHECK_TRUE(ready(200));
+
+        aes67_timer_process();
+
+        CHECK_EQUAL(i + 1, fired.size());
+    }
+    POINTERS_EQUAL(&timers[1], fired[0]);
+    POINTERS_EQUAL(&timers[2], fired[1]);
+    POINTERS_EQUAL(&timers[0], fired[2]);
+
+    CHECK_EQUAL(aes67_timer_state_expired, aes67_timer_getstate(&timers[0]));
+
+    // nothing left
+    CHECK_EQUAL(-1, armed());
+    CHECK_FALSE(ready(50));
+
+    // expiry is also seen when polling, the callback comes with processing nonetheless
+    aes67_timer_set(&timers[3], 10);
+    usleep(30000);
+    CHECK_EQUAL(aes67_timer_state_expired, aes67_timer_getstate(&timers[3]));
+    CHECK_EQUAL(3, fired.size());
+
+    aes67_timer_process();
+    CHECK_EQUAL(4, fired.size());
+    POINTERS_EQUAL(&timers[3], fired[3]);
+
+    // already due
+    aes67_timer_set(&timers[0], AES67_TIMER_NOW);
+    CHECK_TRUE(ready(50));
+    aes67_timer_process();
+    CHECK_EQUAL(5, fired.size());
+}
+
+TEST(TIMER_TestGroup, cascade)
+{
+    // beyond the second level, ie cascaded down before expiring
+    u32_t msec = WHEEL_LEVEL2_SPAN + 100;
+
+    uint64_t start = monotonic_ms();
+
+    aes67_timer_set(&timers[0], msec);
+
+    // armed for the cascade rather than the expiry
+    CHECK_TRUE(0 <= armed() && armed() <= WHEEL_LEVEL2_SPAN);
+
+    u32_t wakeups = 0;
+
+    while(fired.empty()){
+        CHECK_TRUE(ready(msec + 500));
+
+        aes67_timer_process();
+        wakeups++;
+
+        if (fired.empty()){
+            // (still pending and armed again)
+            CHECK_EQUAL(aes67_timer_state_set, aes67_timer_getstate(&timers[0]));
+            CHECK_TRUE(0 <= armed() && (u32_t)armed() <= msec);
+        }
+
+        if (wakeups > 4){
+            FAIL("too many wakeups");
+            break;
+        }
+    }
+
+    uint64_t elapsed = monotonic_ms() - start;
+
+    CHECK_TRUE(wakeups > 1);
+    CHECK_EQUAL(1, fired.size());
+    CHECK_TRUE(msec - 1 <= elapsed && elapsed < msec + 50);
+    CHECK_EQUAL(-1, armed());
+}
+
+TEST(TIMER_TestGroup, beyond_range)
+{
+    // parked in the last level until in range
+    aes67_timer_set(&timers[0], WHEEL_RANGE + 1000000);
+
+    CHECK_EQUAL(aes67_timer_state_set, aes67_timer_getstate(&timers[0]));
+
+    // armed for the last cascade within range (rather than wrapped around to an earlier slot)
+    s32_t parked = armed();
+    CHECK_TRUE(WHEEL_RANGE - 2 * WHEEL_LEVEL3_SPAN < parked && parked <= WHEEL_RANGE);
+
+    // another one in the first level
+    aes67_timer_set(&timers[1], 20);
+    CHECK_TRUE(0 <= armed() && armed() <= 20);
+
+    CHECK_TRUE(ready(200));
+    aes67_timer_process();
+
+    CHECK_EQUAL(1, fired.size());
+    POINTERS_EQUAL(&timers[1], fired[0]);
+
+    // stays armed for the parked one
+    CHECK_EQUAL(aes67_timer_state_set, aes67_timer_getstate(&timers[0]));
+    CHECK_TRUE(WHEEL_LEVEL2_SPAN < armed() && armed() <= parked);
+
+    // another one in the second level
+    aes67_timer_set(&timers[2], WHEEL_LEVEL1_SPAN + 20);
+    CHECK_TRUE(armed() <= WHEEL_LEVEL1_SPAN + 20);
+
+    while(fired.size() < 2 && ready(500)){
+        aes67_timer_process();
+    }
+    CHECK_EQUAL(2, fired.size());
+    POINTERS_EQUAL(&timers[2], fired[1]);
+
+    CHECK_TRUE(WHEEL_LEVEL2_SPAN < armed() && armed() <= parked);
+
+    aes67_timer_unset(&timers[0]);
+    CHECK_EQUAL(aes67_timer_state_unset, aes67_timer_getstate(&timers[0]));
+}
+
+TEST(TIMER_TestGroup, unset)
+{
+    // while pending
+    aes67_timer_set(&timers[0], 20);
+    aes67_timer_unset(&timers[0]);
+    CHECK_EQUAL(aes67_timer_state_unset, aes67_timer_getstate(&timers[0]));
+
+    // (might wake up spuriously)
+    ready(50);
+    aes67_timer_process();
+    CHECK_EQUAL(0, fired.size());
+    CHECK_EQUAL(aes67_timer_state_unset, aes67_timer_getstate(&timers[0]));
+
+    // expired, but not yet processed
+    aes67_timer_set(&timers[0], 10);
+    usleep(30000);
+    CHECK_EQUAL(aes67_timer_state_expired, aes67_timer_getstate(&timers[0]));
+    aes67_timer_unset(&timers[0]);
+
+    aes67_timer_process();
+    CHECK_EQUAL(0, fired.size());
+    CHECK_EQUAL(aes67_timer_state_unset, aes67_timer_getstate(&timers[0]));
+
+    // expired at the same time, the first one called unsets the other
+    aes67_timer_set(&timers[0], 10);
+    aes67_timer_set(&timers[1], 10);
+    usleep(30000);
+
+    cb.unset = &timers[1];
+    aes67_timer_process();
+    if (fired.size() == 1){
+        POINTERS_EQUAL(&timers[0], fired[0]);
+        CHECK_EQUAL(aes67_timer_state_unset, aes67_timer_getstate(&timers[1]));
+    } else {
+        // (timer unset itself)
+        CHECK_EQUAL(2, fired.size());
+        POINTERS_EQUAL(&timers[1], fired[0]);
+        POINTERS_EQUAL(&timers[0], fired[1]);
+    }
+
+    // unset one of several
+    fired.clear();
+    aes67_timer_set(&timers[0], 10);
+    aes67_timer_set(&timers[1], 20);
+    aes67_timer_unset(&timers[0]);
+
+    while(fired.empty() && ready(200)){
+        aes67_timer_process();
+    }
+    CHECK_EQUAL(1, fired.size());
+    POINTERS_EQUAL(&timers[1], fired[0]);
+}
+
+TEST(TIMER_TestGroup, rearm_in_callback)
+{
+    cb.rearm = 3;
+    cb.rearm_msec = 20;
+
+    aes67_timer_set(&timers[0], 10);
+
+    for(size_t i = 0; i < 4; i++){
+        CHECK_TRUE(ready(200));
+
+        aes67_timer_process();
+
+        CHECK_EQUAL(i + 1, fired.size());
+
+        // set again from within aes67_timer_process(), thus armed for it
+        if (i < 3){
+            CHECK_EQUAL(aes67_timer_state_set, aes67_timer_getstate(&timers[0]));
+            CHECK_TRUE(0 <= armed() && armed() <= 20);
+        } else {
+            CHECK_EQUAL(aes67_timer_state_expired, aes67_timer_getstate(&timers[0]));
+            CHECK_EQUAL(-1, armed());
+        }
+    }
+
+    // immediately due again, ie not called again within the same processing
+    cb.rearm = 1;
+    cb.rearm_msec = AES67_TIMER_NOW;
+
+    aes67_timer_set(&timers[0], 10);
+    CHECK_TRUE(ready(200));
+
+    aes67_timer_process();
+    CHECK_EQUAL(5, fired.size());
+
+    CHECK_TRUE(ready(50));
+    aes67_timer_process();
+    CHECK_EQUAL(6, fired.size());
+}
+
+#endif //AES67_TIMER_FD